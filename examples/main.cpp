@@ -2,7 +2,12 @@
 #include <WiFiMulti.h>
 
 #include <hawkbit.h>
+#include <hawkbit_preferences.h>
+#include <hawkbit_sink_ota.h>
+#include <hawkbit_sink_file.h>
+#include <hawkbit_executor.h>
 #include <Update.h>
+#include <SPIFFS.h>
 #include <ArduinoJson.h>
 
 #define VERSION "1.0.0"
@@ -10,10 +15,21 @@
 WiFiMulti wifi;
 EspClass esp;
 WiFiClientSecure client;
-StaticJsonDocument<16*1024> doc;
+// a deployment takes about 1 KiB per artifact (file name, hashes and links), so this is good for
+// about 30 artifacts. It is allocated once, on the heap, as it is too large for the stack.
+DynamicJsonDocument doc(32*1024);
 
 #define STRINGIFY(x) #x
 HawkbitClient update(doc, client, STRINGIFY(HAWKBIT_URL), STRINGIFY(HAWKBIT_TENANT), STRINGIFY(HAWKBIT_DEVICE_ID), STRINGIFY(HAWKBIT_DEVICE_TOKEN));
+PollScheduler scheduler;
+DownloadPipeline pipeline;
+PreferencesStorage storage;
+
+// write the firmware into the next OTA partition, which only gets activated once committed
+OtaSink ota;
+// the application data, replacing the current file once committed
+FileSink application(SPIFFS, "/application.bin");
+DeploymentExecutor executor(update, HawkbitClient::AUTO_LINK);
 
 const char * root_ca = "-----BEGIN CERTIFICATE-----\n\
 MIIDSjCCAjKgAwIBAgIQRK+wgNajJ7qJMDmGLvhAazANBgkqhkiG9w0BAQUFADA/\n\
@@ -82,125 +98,175 @@ void setup()
 
     setClock();
     client.setCACert(root_ca);
+    update.keepAlive(true);
+    // keep final feedback, which could not be sent, across reboots. Progress during a download gets
+    // queued as well, only the latest report is sent once the download is done. A second TLS
+    // connection (see progressClient()) would report it right away, but costs about 40 KiB of heap.
+    update.queueFeedback(8, &storage);
+    // resume a pending deployment after a reboot, without fetching it again
+    update.persistDeployments(&storage);
+
+    if (!SPIFFS.begin(true)) {
+        log_e("Failed to mount SPIFFS");
+    }
+    // all artifacts are verified first, the firmware gets committed (and activated) last
+    executor.routePart("bApp", application, 0);
+    executor.routePart("os", ota, 255);
+    executor.pipeline(pipeline);
+
+    // spread out the first poll of devices powered up at the same time
+    scheduler.begin(10000);
 }
 
-void processUpdate(const Deployment& deployment) {
-  if (deployment.chunks().size() != 1) {
-    throw String("Expect update to have one chunk");
-  }
+/**
+ * The attributes of the device, which don't change while running.
+ */
+const std::map<String, String>& attributes() {
+  static const std::map<String, String> result = {
+    {"mac", WiFi.macAddress()},
+    {"app.version", VERSION},
+    {"esp", "esp32"},
+    {"esp32.chipRevision", String(esp.getChipRevision())},
+    {"esp32.sdkVersion", esp.getSdkVersion()}
+  };
+  return result;
+}
 
-  const Chunk& chunk = deployment.chunks().front();
-  if (chunk.artifacts().size() != 1 ) {
-    throw String("Expect update to have one artifact");
+String updateError() {
+  return Update.hasError() ? String(Update.errorString()) : String("Failed to update");
+}
+
+/**
+ * Apply a delta to the running firmware. Returns false if the update should be re-tried, as the
+ * download failed. Any other failure is reported to the server.
+ */
+bool processDelta(const Deployment& deployment, const Artifact& artifact) {
+  PartitionSource running;
+  if (!ota.begin(artifact)) {
+    update.reportComplete(deployment, false, {updateError()});
+    return true;
   }
 
-  const Artifact& artifact = chunk.artifacts().front();
+  HawkbitError error = update.downloadDelta(artifact, HawkbitClient::AUTO_LINK, running, [](const uint8_t* data, size_t len) -> bool {
+    return ota.write(data, len);
+  });
 
-  try {
+  if (error.failed()) {
+    ota.abort();
+    log_w("Failed to download delta: %s %d", error.categoryName(), error.code());
+    if (error.transient()) {
+      // download failed, we can re-try
+      return false;
+    }
+    if (error.category() == HawkbitError::APPLICATION) {
+      update.reportComplete(deployment, false, {updateError()});
+    } else {
+      update.reportComplete(deployment, false, {String("Failed to download: ") + error.categoryName()});
+    }
+    return true;
+  }
 
-    update.download(artifact, "download-http", [artifact, deployment](Download& d){
+  if (!ota.commit()) {
+    update.reportComplete(deployment, false, {updateError()});
+    return true;
+  }
 
-      // begin update
+  update.reportComplete(deployment, true);
 
-      if (!Update.begin(artifact.size())) {
-        if(Update.hasError()) {
-          throw String(Update.errorString());
-        } else {
-          throw String("Failed to start update");
-        }
-      }
+  esp.restart();
 
-      // fetch checksum
-      auto md5 = artifact.hashes().find("md5");
+  return true;
+}
 
-      // we have a checksum
-      if(md5 != artifact.hashes().end()) {
-        Update.setMD5(md5->second.c_str());
+/**
+ * Apply the deployment. Returns false if the update should be re-tried, as the download failed.
+ * Any other failure is reported to the server.
+ */
+bool processUpdate(const Deployment& deployment) {
+  // report the download progress, at most every 5 seconds and each 5 percent
+  ProgressReporter progress(update, deployment, 5000, 5);
+
+  for (const Chunk& chunk : deployment.chunks()) {
+    for (const Artifact& artifact : chunk.artifacts()) {
+      if (!DeltaPatcher::isDelta(artifact.filename())) {
+        continue;
       }
-
-      // write update
-      Update.writeStream(d.stream());
-
-      if(!Update.end()) {
-        if(Update.hasError()) {
-          throw String(Update.errorString());
-        } else {
-          throw String("Failed to end update");
-        }
+      // a delta applies to the running firmware, so it must be all there is
+      if (deployment.chunks().size() != 1 || chunk.artifacts().size() != 1) {
+        update.reportComplete(deployment, false, {"Expect a delta to be the only artifact"});
+        return true;
       }
-    });
-
-  }
-  catch ( DownloadError err ) {
-    // download failed, we can re-try
-    log_w("Failed to download new firmware: %d", err.code());
-    return;
+      return processDelta(deployment, artifact);
+    }
   }
 
-  // all done
+  // downloads all artifacts into their sinks, verifies them, then commits them, and reports the result
+  HawkbitError error = executor.execute(deployment);
 
-  update.reportComplete(deployment, true);
+  if (error.transient()) {
+    // download failed, we can re-try
+    log_w("Failed to download: %s %d", error.categoryName(), error.code());
+    return false;
+  }
 
-  esp.restart();
+  if (error.ok()) {
+    pipeline.dump(Serial);
+    esp.restart();
+  }
 
+  return true;
 }
 
 void loop()
 {
+    if (!scheduler.due()) {
+      delay(min(scheduler.remaining(), 1000U));
+      return;
+    }
+
     log_d("Start loop");
 
-    try {
+    State current;
+    HawkbitError error = update.readState(current);
 
-      log_d("readState");
+    if (error.failed()) {
+      log_e("Failed to fetch update information: %s %d", error.categoryName(), error.code());
+      scheduler.failure();
+      return;
+    }
 
-      State current = update.readState();
-      current.dump(Serial);
+    scheduler.success(current);
+    current.dump(Serial);
 
-      switch(current.type())
+    switch(current.type())
+    {
+      case State::NONE:
       {
-        case State::NONE:
-        {
-          log_d("No update pending");
-          break;
-        }
-        case State::REGISTER:
-        {
-          log_i("Need to register");
-          update.updateRegistration(current.registration(), {
-            {"mac", WiFi.macAddress()},
-            {"app.version", VERSION},
-            {"esp", "esp32"},
-            {"esp32.chipRevision", String(esp.getChipRevision())},
-            {"esp32.sdkVersion", esp.getSdkVersion()}
-          });
-          break;
-        }
-        case State::UPDATE:
-        {
-          const Deployment& deployment = current.deployment();
-          update.reportProgress(deployment, 1, 2);
-          try {
-            processUpdate(deployment);
-          }
-          catch (const String& error) {
-            update.reportComplete(deployment, false, {error});
-          }
-
-          break;
-        }
-        case State::CANCEL:
-        {
-          update.reportCancelAccepted(current.stop());
-          break;
+        log_d("No update pending");
+        break;
+      }
+      case State::REGISTER:
+      {
+        log_i("Need to register");
+        // only sends the attributes which changed since the last registration
+        update.syncRegistration(current.registration(), attributes());
+        break;
+      }
+      case State::UPDATE:
+      {
+        if (!processUpdate(current.deployment())) {
+          scheduler.failure();
         }
+        break;
+      }
+      case State::CANCEL:
+      {
+        update.reportCancelAccepted(current.stop());
+        break;
       }
-    }
-    catch (int err) {
-      log_e("Failed to fetch update information: %d", err);
     }
 
-    log_i("End loop");
-
-    delay(30000);
+    update.stats().dump(Serial, "  ");
+    update.linkSelector().dump(Serial, "  ");
+    update.handshakeStats().dump(Serial, "  ");
 }
-
@@ -13,8 +13,13 @@
 
 #include "hawkbit.h"
 
+#include <algorithm>
+#include <new>
 #include <Arduino.h>
 
+const char* const HawkbitClient::AUTO_LINK = "auto";
+const char* const HawkbitClient::DEPLOYMENT_KEY = "deployment";
+
 HawkbitClient::HawkbitClient(
     JsonDocument& doc,
     WiFiClient& wifi,
@@ -24,11 +29,425 @@ HawkbitClient::HawkbitClient(
     const String &securityToken) :
     _doc(doc),
     _wifi(wifi),
-    _baseUrl(baseUrl),
-    _tenantName(tenantName),
-    _controllerId(controllerId),
-    _authToken("TargetToken " + securityToken)
+    _controllerUrl(baseUrl + "/" + tenantName + "/controller/v1/" + controllerId),
+    _authToken("TargetToken " + securityToken),
+    _streaming(true),
+    _keepAlive(false),
+    _reused(false),
+    _tlsSessions(nullptr),
+    _timeout(HTTPCLIENT_DEFAULT_TCP_TIMEOUT),
+    _connectTimeout(-1),
+    _heatshrinkWindow(HeatshrinkDecompressor::DEFAULT_WINDOW),
+    _heatshrinkLookahead(HeatshrinkDecompressor::DEFAULT_LOOKAHEAD),
+    _progressWifi(nullptr),
+    _progress(nullptr),
+    _downloading(false),
+    _resume(),
+    _progressStop(false),
+    _progressRunning(false),
+#if defined(ESP32)
+    _progressDone(nullptr),
+#endif
+    _deploymentStorage(nullptr),
+    _rejectedFeedback(0)
+{
+    // validators for conditional requests
+    static const char* headers[] = { "ETag", "Last-Modified", "Content-Range", "Content-Encoding" };
+    _http.collectHeaders(headers, 4);
+
+    // HTTP/1.0 keeps the server from using chunked transfer encoding,
+    // which we cannot parse directly from the raw stream (see streaming()).
+    _http.useHTTP10(this->_streaming && !this->_keepAlive);
+}
+
+/**
+ * A stream, echoing everything it reads to a second output.
+ */
+class LoggingStream : public Stream {
+    public:
+        LoggingStream(Stream& source, Print& log) :
+            _source(source),
+            _log(log)
+        {
+        }
+
+        int available() override { return _source.available(); }
+        int peek() override { return _source.peek(); }
+        void flush() override { _source.flush(); }
+        size_t write(uint8_t c) override { return _source.write(c); }
+
+        int read() override
+        {
+            int c = _source.read();
+            if (c >= 0) {
+                _log.write((uint8_t)c);
+            }
+            return c;
+        }
+
+    private:
+        Stream& _source;
+        Print& _log;
+};
+
+/**
+ * A stream, providing the serialized JSON of a document, without holding all of it in a String.
+ *
+ * Each read serializes the document again, only keeping the requested part. HTTPClient copies
+ * the body through a buffer of its own (up to a TCP segment, 1460 bytes), reading blocks of that
+ * size, so a small document gets serialized only once. Only that buffer holds the serialized
+ * document, regardless of its size.
+ */
+class JsonBodyStream : public Stream {
+    public:
+        JsonBodyStream(const JsonDocument& doc) :
+            _doc(doc),
+            _size(measureJson(doc)),
+            _position(0)
+        {
+        }
+
+        size_t size() const { return this->_size; }
+
+        int available() override { return this->_size - this->_position; }
+        void flush() override {}
+        size_t write(uint8_t) override { return 0; }
+
+        int peek() override
+        {
+            uint8_t c;
+            Window window(&c, this->_position, 1);
+            serializeJson(this->_doc, window);
+            return window.captured() == 1 ? c : -1;
+        }
+
+        int read() override
+        {
+            uint8_t c;
+            return readBytes(&c, 1) == 1 ? c : -1;
+        }
+
+        using Stream::readBytes;
+
+        size_t readBytes(char* buffer, size_t length) override
+        {
+            Window window((uint8_t*)buffer, this->_position, length);
+            serializeJson(this->_doc, window);
+            this->_position += window.captured();
+            return window.captured();
+        }
+
+    private:
+        /**
+         * Captures a part of the output, discarding everything else.
+         */
+        class Window : public Print {
+            public:
+                Window(uint8_t* buffer, size_t skip, size_t length) :
+                    _buffer(buffer),
+                    _skip(skip),
+                    _length(length),
+                    _captured(0)
+                {
+                }
+
+                size_t captured() const { return this->_captured; }
+
+                size_t write(uint8_t c) override { return write(&c, 1); }
+
+                size_t write(const uint8_t* data, size_t len) override
+                {
+                    size_t result = len;
+                    if (this->_skip >= len) {
+                        this->_skip -= len;
+                        return result;
+                    }
+                    data += this->_skip;
+                    len -= this->_skip;
+                    this->_skip = 0;
+                    size_t n = std::min(len, this->_length - this->_captured);
+                    memcpy(this->_buffer + this->_captured, data, n);
+                    this->_captured += n;
+                    return result;
+                }
+
+            private:
+                uint8_t* _buffer;
+                size_t _skip;
+                size_t _length;
+                size_t _captured;
+        };
+
+        const JsonDocument& _doc;
+        size_t _size;
+        size_t _position;
+};
+
+/**
+ * Fields of the controller base resource, which are evaluated by readState().
+ */
+static void controllerBaseFilter(JsonDocument& filter)
+{
+    JsonObject links = filter.createNestedObject("_links");
+    links["deploymentBase"]["href"] = true;
+    links["configData"]["href"] = true;
+    links["cancelAction"]["href"] = true;
+    filter["config"]["polling"]["sleep"] = true;
+}
+
+// the slots of the filter, their size depends on the platform (e.g. 16 bytes on the ESP32)
+static const size_t CONTROLLER_BASE_FILTER_SIZE = JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(3) + 5 * JSON_OBJECT_SIZE(1);
+
+/**
+ * Parse a hawkBit interval ("HH:MM:SS") into milliseconds, returns zero if the value is invalid.
+ */
+static uint32_t parseInterval(const char* value)
+{
+    unsigned int hours, minutes, seconds;
+    if (sscanf(value, "%u:%u:%u", &hours, &minutes, &seconds) != 3) {
+        return 0;
+    }
+    return ((hours * 60 + minutes) * 60 + seconds) * 1000;
+}
+
+/**
+ * Fields of the deploymentBase resource, which are evaluated by readDeployment().
+ */
+static void deploymentBaseFilter(JsonDocument& filter)
+{
+    filter["id"] = true;
+
+    JsonObject deployment = filter.createNestedObject("deployment");
+    deployment["download"] = true;
+    deployment["update"] = true;
+
+    JsonObject chunk = deployment.createNestedArray("chunks").createNestedObject();
+    chunk["part"] = true;
+    chunk["version"] = true;
+    chunk["name"] = true;
+
+    JsonObject artifact = chunk.createNestedArray("artifacts").createNestedObject();
+    artifact["filename"] = true;
+    artifact["size"] = true;
+    artifact["hashes"] = true;
+    // any link may be a download link (e.g. of a mirror), see LinkSelector
+    artifact["_links"] = true;
+}
+
+static const size_t DEPLOYMENT_BASE_FILTER_SIZE = JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(1)
+    + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(4);
+
+/**
+ * Fields of the cancelAction resource, which are evaluated by readCancel().
+ */
+static void cancelActionFilter(JsonDocument& filter)
+{
+    filter["cancelAction"]["stopId"] = true;
+}
+
+static const size_t CANCEL_ACTION_FILTER_SIZE = 2 * JSON_OBJECT_SIZE(1);
+
+/**
+ * Get the scheme and authority part of a URL, identifying the connection it requires.
+ */
+static String connectionOf(const String& url)
+{
+    int start = url.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+    int end = url.indexOf('/', start);
+    return end < 0 ? url : url.substring(0, end);
+}
+
+void HawkbitClient::keepAlive(bool keepAlive)
+{
+    this->_keepAlive = keepAlive;
+    // a persistent connection requires HTTP/1.1
+    this->_http.useHTTP10(this->_streaming && !keepAlive);
+    this->_http.setReuse(keepAlive);
+    if (!keepAlive) {
+        this->disconnect();
+    }
+}
+
+bool HawkbitClient::begin(const String& url)
+{
+    String connection = connectionOf(url);
+
+    this->_reused = this->_keepAlive && this->_wifi.connected() && connection == this->_connection;
+
+    if (this->_reused) {
+        this->_handshakeStats.reuse();
+        log_d("Re-using connection to: %s", connection.c_str());
+    } else {
+        if (this->_wifi.connected()) {
+            this->_wifi.stop();
+        }
+        this->_connection = connection;
+    }
+
+    _http.begin(this->_wifi, url);
+
+    if (this->_reused) {
+        return true;
+    }
+    // without a connection to keep, or a session to resume, the HTTPClient connects itself
+    if (!this->_keepAlive && this->_tlsSessions == nullptr) {
+        return true;
+    }
+    return this->connect(connection);
+}
+
+bool HawkbitClient::connect(const String& connection)
+{
+    // connect ahead of the HTTPClient, which then uses the open connection, so the handshake gets measured on its own
+    int start = connection.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+    String host;
+    int colon;
+    if (connection.charAt(start) == '[') {
+        // an IPv6 address, e.g. "https://[::1]:8443"
+        int close = connection.indexOf(']', start);
+        if (close < 0) {
+            log_w("Invalid host: %s", connection.c_str());
+            this->_connection = "";
+            return false;
+        }
+        host = connection.substring(start + 1, close);
+        colon = connection.indexOf(':', close);
+    } else {
+        colon = connection.indexOf(':', start);
+        host = colon < 0 ? connection.substring(start) : connection.substring(start, colon);
+    }
+    uint16_t port = colon < 0 ? (connection.startsWith("https:") ? 443 : 80) : connection.substring(colon + 1).toInt();
+
+    if (this->_tlsSessions != nullptr) {
+        this->_tlsSessions->beforeConnect(this->_wifi, connection);
+    }
+
+    unsigned long begin = millis();
+    // the same call as the HTTPClient makes, when connecting itself
+    bool connected = this->_connectTimeout < 0
+        ? this->_wifi.connect(host.c_str(), port)
+        : this->_wifi.connect(host.c_str(), port, this->_connectTimeout);
+    if (!connected) {
+        log_w("Failed to connect to: %s", connection.c_str());
+        if (this->_tlsSessions != nullptr) {
+            this->_tlsSessions->invalidate(connection);
+        }
+        this->_connection = "";
+        return false;
+    }
+    uint32_t latency = millis() - begin;
+
+    bool resumed = this->_tlsSessions != nullptr && this->_tlsSessions->afterConnect(this->_wifi, connection);
+    this->_handshakeStats.record(resumed, latency);
+    log_d("Connected to: %s - %u ms, resumed: %d", connection.c_str(), latency, resumed);
+
+    // the HTTPClient applies its timeout when connecting itself
+    this->_http.setTimeout(this->_timeout);
+    return true;
+}
+
+void HawkbitClient::addConditionalHeaders(const Validator& validator)
+{
+    if (!validator.etag.isEmpty()) {
+        _http.addHeader("If-None-Match", validator.etag);
+    }
+    if (!validator.lastModified.isEmpty()) {
+        _http.addHeader("If-Modified-Since", validator.lastModified);
+    }
+}
+
+HawkbitClient::Validator HawkbitClient::readValidator()
+{
+    Validator validator;
+    validator.etag = _http.header("ETag");
+    validator.lastModified = _http.header("Last-Modified");
+    return validator;
+}
+
+void HawkbitClient::disconnect()
+{
+    if (this->_wifi.connected()) {
+        this->_wifi.stop();
+    }
+    this->_connection = "";
+}
+
+int HawkbitClient::requestDownload(const String& url, uint32_t& offset, uint32_t size)
+{
+    String range = offset > 0 ? "bytes=" + String(offset) + "-" : String();
+
+    int code = this->execute(RequestStats::DOWNLOAD, url, [this, &range]() -> int {
+        _http.addHeader("Authorization", this->_authToken);
+        if (!range.isEmpty()) {
+            _http.addHeader("Range", range);
+        }
+        return _http.GET();
+    });
+
+    if (code == HTTP_CODE_PARTIAL_CONTENT) {
+        String contentRange = _http.header("Content-Range");
+        unsigned int start, end, total;
+        bool valid = sscanf(contentRange.c_str(), "bytes %u-%u/%u", &start, &end, &total) == 3
+            && start == offset
+            && (size == 0 || (total == size && end + 1 == size));
+        if (!valid) {
+            log_w("Unexpected range: %s (requested: %s), restarting download", contentRange.c_str(), range.c_str());
+            _http.end();
+            this->disconnect();
+            offset = 0;
+            return this->requestDownload(url, offset, size);
+        }
+    } else if (code == HTTP_CODE_OK && offset > 0) {
+        log_w("Range request not supported by server, restarting download");
+        offset = 0;
+    }
+
+    return code;
+}
+
+void HawkbitClient::logPayload()
 {
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
+    // only read the payload for logging, end() discards whatever is left
+    String resultPayload = _http.getString();
+    log_d("Result - payload: %s", resultPayload.c_str());
+#endif
+}
+
+DeserializationError HawkbitClient::readJson(const JsonDocument& filter)
+{
+    DeserializationError error;
+
+    // a chunked response (HTTP/1.1 without a content length) can only be decoded by the buffered path
+    bool http10 = this->_streaming && !this->_keepAlive;
+    bool chunked = !http10 && _http.getSize() < 0;
+
+    if (this->_streaming && !chunked) {
+        Stream& stream = _http.getStream();
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
+        log_d("Result - payload:");
+        LoggingStream logging(stream, Serial);
+        error = deserializeJson(_doc, logging, DeserializationOption::Filter(filter));
+        Serial.println();
+#else
+        error = deserializeJson(_doc, stream, DeserializationOption::Filter(filter));
+#endif
+    } else {
+        String resultPayload = _http.getString();
+        log_d("Result - payload: %s", resultPayload.c_str());
+        error = deserializeJson(_doc, resultPayload, DeserializationOption::Filter(filter));
+    }
+
+#if defined(ESP32)
+    log_d("JSON - result: %s, used: %u, heap: %u, min heap: %u",
+        error.c_str(), _doc.memoryUsage(), ESP.getFreeHeap(), ESP.getMinFreeHeap());
+#else
+    log_d("JSON - result: %s, used: %u", error.c_str(), _doc.memoryUsage());
+#endif
+
+    return error;
 }
 
 UpdateResult HawkbitClient::updateRegistration(const Registration& registration, const std::map<String,String>& data, MergeMode mergeMode, std::initializer_list<String> details)
@@ -48,266 +467,1076 @@ UpdateResult HawkbitClient::updateRegistration(const Registration& registration,
     }
 
     _doc.createNestedObject("data");
-    for (const std::pair<String,String>& entry : data) {
-        _doc["data"][String(entry.first)] = entry.second;
+    for (const std::pair<const String,String>& entry : data) {
+        _doc["data"][entry.first] = entry.second;
     }
 
     JsonArray d = _doc["status"].createNestedArray("details");
-    for (auto detail : details) {
+    for (const String& detail : details) {
         d.add(detail);
     }
 
     _doc["status"]["execution"] = "closed";
     _doc["status"]["result"]["finished"] = "success";
 
-    _http.begin(this->_wifi, registration.url());
-
-    _http.addHeader("Accept", "application/hal+json");
-    _http.addHeader("Content-Type", "application/json");
-    _http.addHeader("Authorization", this->_authToken);
-
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
     serializeJsonPretty(_doc, Serial);
 #endif
 
-    String buffer;
-    size_t len = serializeJson(_doc, buffer);
-    (void)len; // ignore unused
-
-    log_d("JSON - len: %d", len);
+    log_d("JSON - len: %u", measureJson(_doc));
 
-    int code = _http.PUT(buffer);
+    int code = this->execute(RequestStats::REGISTRATION, registration.url(), [this]() -> int {
+        _http.addHeader("Accept", "application/hal+json");
+        _http.addHeader("Content-Type", "application/json");
+        _http.addHeader("Authorization", this->_authToken);
+        JsonBodyStream body(_doc);
+        return _http.sendRequest("PUT", &body, body.size());
+    });
     log_d("Result - code: %d", code);
 
-    String resultPayload = _http.getString();
-    log_d("Result - payload: %s", resultPayload.c_str());
+    this->logPayload();
 
     _http.end();
 
     return UpdateResult(code);
 }
 
-State HawkbitClient::readState()
+UpdateResult HawkbitClient::syncRegistration(const Registration& registration, const std::map<String,String>& data, std::initializer_list<String> details)
 {
-    _http.begin(this->_wifi, this->_baseUrl + "/" + this->_tenantName + "/controller/v1/" + this->_controllerId);
+    const std::map<String,String>& last = this->_registered;
 
-    _http.addHeader("Authorization", this->_authToken);
-    _http.addHeader("Accept", "application/hal+json");
+    // dropped attributes can only be removed by replacing all of them
+    bool replace = last.empty();
+    for (const std::pair<const String,String>& entry : last) {
+        if (replace) {
+            break;
+        }
+        replace = data.find(entry.first) == data.end();
+    }
 
-    _doc.clear();
+    UpdateResult result(HTTP_CODE_NO_CONTENT);
+
+    if (replace) {
+        result = this->updateRegistration(registration, data, REPLACE, details);
+    } else {
+        std::map<String,String> changed;
+        for (const std::pair<const String,String>& entry : data) {
+            auto i = last.find(entry.first);
+            if (i == last.end() || i->second != entry.second) {
+                changed.insert(entry);
+            }
+        }
+        if (changed.empty() && !data.empty()) {
+            // only a request clears the configData link, so the server stops asking
+            changed.insert(*data.begin());
+        }
+        log_d("Registration - changed: %u of %u", changed.size(), data.size());
+        result = this->updateRegistration(registration, changed, MERGE, details);
+    }
+
+    if (result.ok()) {
+        this->_registered = data;
+    }
+
+    return result;
+}
+
+/**
+ * Get the error for a failed deserialization, running out of memory is a capacity problem.
+ */
+static HawkbitError jsonError(const DeserializationError& error)
+{
+    if (error == DeserializationError::NoMemory || error == DeserializationError::TooDeep) {
+        return HawkbitError(HawkbitError::CAPACITY, error.code());
+    }
+    return HawkbitError(HawkbitError::JSON, error.code());
+}
+
+HawkbitError HawkbitClient::startDownload(const Artifact& artifact, const String& linkType, Download*& download, uint32_t offset)
+{
+    download = nullptr;
+
+    if (this->_download) {
+        log_w("Download already in progress");
+        return HawkbitError(HawkbitError::APPLICATION);
+    }
+
+    FlatMap::const_iterator href = linkType == AUTO_LINK
+        ? this->_linkSelector.select(artifact.links())
+        : artifact.links().find(linkType);
+
+    if ( href == artifact.links().end()) {
+        log_w("Missing link for download: %s", linkType.c_str());
+        return HawkbitError(HawkbitError::PROTOCOL);
+    }
+
+    String url = href->second;
+    int code = this->requestDownload(url, offset, artifact.size());
+    log_i("Result - code: %d, offset: %u", code, offset);
+
+    if (code != HTTP_CODE_OK && code != HTTP_CODE_PARTIAL_CONTENT) {
+        _http.end();
+        this->_linkSelector.failure(url);
+        return HawkbitError::http(code);
+    }
+
+    std::unique_ptr<HashVerifier> verifier;
+    if (this->canResume(artifact, offset)) {
+        // continue with the hashes of the interrupted download
+        verifier = std::move(this->_resume.verifier);
+    } else {
+        verifier.reset(new HashVerifier());
+        for (const KeyValue& hash : artifact.hashes()) {
+            verifier->add(hash.first, hash.second);
+        }
+        if (offset > 0) {
+            log_w("Unable to verify download resumed at %u", offset);
+            verifier->disable();
+        }
+    }
+    this->_resume.verifier.reset();
+
+    int length = _http.getSize();
+    bool gzipEncoded = _http.header("Content-Encoding") == "gzip";
+    this->_download.reset(new Download(_http.getStream(), offset, length > 0 ? length : 0, gzipEncoded, artifact, url,
+        this->_heatshrinkWindow, this->_heatshrinkLookahead, std::move(verifier)));
+    if (this->_progress != nullptr) {
+        this->_progress->begin(artifact.size());
+        this->_download->_counting.reporter(this->_progress, offset);
+    }
+    this->_downloading = true;
+    this->startProgress();
+
+    download = this->_download.get();
+    return HawkbitError();
+}
+
+HawkbitError HawkbitClient::transferError(Download& d, bool rejected)
+{
+    if (rejected) {
+        return HawkbitError(HawkbitError::APPLICATION);
+    }
+    if (d.failed()) {
+        return HawkbitError(HawkbitError::INTEGRITY);
+    }
+    if (!d.received()) {
+        // the connection broke
+        return HawkbitError(HawkbitError::TRANSPORT);
+    }
+    return HawkbitError(HawkbitError::INTEGRITY);
+}
+
+HawkbitError HawkbitClient::downloadTo(const Artifact& artifact, const String& linkType, DownloadSink& sink)
+{
+    return this->failover(artifact, linkType, sink, nullptr);
+}
+
+HawkbitError HawkbitClient::downloadTo(const Artifact& artifact, const String& linkType, DownloadSink& sink, DownloadPipeline& pipeline)
+{
+    return this->failover(artifact, linkType, sink, &pipeline);
+}
+
+HawkbitError HawkbitClient::failover(const Artifact& artifact, const String& linkType, DownloadSink& sink, DownloadPipeline* pipeline)
+{
+    // the failed link is avoided by the next selection, so each attempt uses another one
+    bool automatic = linkType == AUTO_LINK;
+    size_t attempts = automatic ? LinkSelector::count(artifact.links()) : 1;
+
+    HawkbitError error;
+    size_t attempt = 0;
+    do {
+        error = this->transferTo(artifact, linkType, sink, pipeline);
+        // another host may still serve the artifact, even if this one does not have it
+        if (!error.transient() && !(automatic && error.category() == HawkbitError::HTTP)) {
+            break;
+        }
+        log_w("Download failed: %s %d", error.categoryName(), error.code());
+    } while (++attempt < attempts);
+    return error;
+}
+
+/**
+ * Passes the blocks of a pipeline on to a sink, in multiples of its block size.
+ *
+ * Aligned blocks are passed on directly. Only data of short blocks (e.g. a short read of the
+ * network, or of the decompressor) is copied, into a buffer which is allocated on first use.
+ */
+class BlockWriter {
+    public:
+        BlockWriter(DownloadSink& sink) :
+            _sink(sink),
+            _size(sink.blockSize()),
+            _filled(0)
+        {
+        }
+
+        bool write(const uint8_t* data, size_t len)
+        {
+            if (this->_size == 0) {
+                return this->_sink.write(data, len);
+            }
+            while (len > 0) {
+                if (this->_filled == 0 && len >= this->_size) {
+                    size_t aligned = len - len % this->_size;
+                    if (!this->_sink.write(data, aligned)) {
+                        return false;
+                    }
+                    data += aligned;
+                    len -= aligned;
+                    continue;
+                }
+                if (!this->_buffer) {
+                    this->_buffer.reset(new (std::nothrow) uint8_t[this->_size]);
+                    if (!this->_buffer) {
+                        log_e("Failed to allocate %u bytes for re-blocking", this->_size);
+                        return false;
+                    }
+                }
+                size_t part = std::min(len, this->_size - this->_filled);
+                memcpy(this->_buffer.get() + this->_filled, data, part);
+                this->_filled += part;
+                data += part;
+                len -= part;
+                if (this->_filled == this->_size) {
+                    this->_filled = 0;
+                    if (!this->_sink.write(this->_buffer.get(), this->_size)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Write the rest, a block which may be shorter than the block size.
+         */
+        bool finish()
+        {
+            size_t filled = this->_filled;
+            this->_filled = 0;
+            return filled == 0 || this->_sink.write(this->_buffer.get(), filled);
+        }
+
+    private:
+        DownloadSink& _sink;
+        size_t _size;
+        std::unique_ptr<uint8_t[]> _buffer;
+        size_t _filled;
+};
+
+/**
+ * Begin the sink anew, if a download was to be resumed, but the server sent the complete artifact.
+ */
+static bool restartSink(const Artifact& artifact, DownloadSink& sink, uint32_t resumed, const Download& d)
+{
+    if (resumed == 0 || d.offset() > 0) {
+        return true;
+    }
+    log_d("Server ignored the range, starting over");
+    sink.abort();
+    return sink.begin(artifact);
+}
+
+HawkbitError HawkbitClient::transferTo(const Artifact& artifact, const String& linkType, DownloadSink& sink, DownloadPipeline* pipeline)
+{
+    uint32_t offset = sink.resume(artifact);
+    if (offset > 0 && !this->canResume(artifact, offset)) {
+        log_d("Unable to resume at %u, starting over", offset);
+        sink.abort();
+        offset = 0;
+    }
+    if (offset == 0 && !sink.begin(artifact)) {
+        return HawkbitError(HawkbitError::APPLICATION);
+    }
+
+    HawkbitError error;
+    uint32_t resumed = offset;
+    // a failed request leaves the data, which was kept, as it is
+    bool resumable = resumed > 0;
+
+    if (pipeline != nullptr) {
+        error = download(artifact, linkType, offset, [&artifact, &sink, pipeline, resumed, &resumable](Download& d) -> HawkbitError {
+            if (!restartSink(artifact, sink, resumed, d)) {
+                return HawkbitError(HawkbitError::APPLICATION);
+            }
+            BlockWriter blocks(sink);
+            auto write = [&blocks](const uint8_t* data, size_t len) -> bool {
+                return blocks.write(data, len);
+            };
+            HawkbitError error = pipelined(artifact, d, *pipeline, write);
+            if (!blocks.finish()) {
+                resumable = false;
+                return error.ok() ? HawkbitError(HawkbitError::APPLICATION) : error;
+            }
+            // all blocks read from the network were passed on, even if the transfer broke
+            resumable = d.resumable();
+            return error;
+        });
+        return completeSink(sink, error, resumable);
+    }
+
+    size_t size = sink.blockSize() > 0 ? sink.blockSize() : 1024;
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[size]);
+    if (!buffer) {
+        sink.abort();
+        return HawkbitError(HawkbitError::CAPACITY);
+    }
+
+    error = download(artifact, linkType, offset, [&artifact, &sink, &buffer, size, resumed, &resumable](Download& d) -> HawkbitError {
+        if (!restartSink(artifact, sink, resumed, d)) {
+            return HawkbitError(HawkbitError::APPLICATION);
+        }
+        Stream& stream = d.decompressed();
+        size_t filled = 0;
+        // read up to the end of the response, without waiting for the stream to time out
+        while (!d.received() || d.decoding()) {
+            size_t len = stream.readBytes(buffer.get() + filled, size - filled);
+            if (len == 0) {
+                break;
+            }
+            filled += len;
+            // only pass on full blocks, short reads are topped up first
+            if (filled == size) {
+                if (!sink.write(buffer.get(), filled)) {
+                    return HawkbitError(HawkbitError::APPLICATION);
+                }
+                filled = 0;
+            }
+        }
+        if (filled > 0 && !sink.write(buffer.get(), filled)) {
+            return HawkbitError(HawkbitError::APPLICATION);
+        }
+        if (d.failed() || !d.received()) {
+            // everything read was written, so the sink holds the data up to the position
+            resumable = d.resumable();
+            return transferError(d, false);
+        }
+        if (!d.verify()) {
+            return HawkbitError(HawkbitError::INTEGRITY);
+        }
+        return HawkbitError();
+    });
+
+    return completeSink(sink, error, resumable);
+}
+
+HawkbitError HawkbitClient::completeSink(DownloadSink& sink, HawkbitError error, bool resumable)
+{
+    if (error.ok() && !sink.flush()) {
+        error = HawkbitError(HawkbitError::APPLICATION);
+    }
+    if (error.failed()) {
+        if (!(error.transient() && resumable && sink.flush() && sink.suspend())) {
+            sink.abort();
+        }
+        return error;
+    }
+    if (!sink.commit()) {
+        return HawkbitError(HawkbitError::APPLICATION);
+    }
+    return HawkbitError();
+}
+
+void HawkbitClient::finishDownload(bool completed, bool resumable)
+{
+    if (this->_download) {
+        Download& d = *this->_download;
+        if (completed) {
+            this->_linkSelector.success(d.url(), d.position() - d.offset(), millis() - d._started);
+        } else if (!d.received() || d.failed()) {
+            // the transfer broke, an artifact rejected by the application is not the fault of the host
+            this->_linkSelector.failure(d.url());
+        }
+        if (!completed && resumable && d.resumable()) {
+            log_d("Download can be resumed at %u", d.position());
+            this->_resume.artifact = d._artifact;
+            this->_resume.offset = d.position();
+            this->_resume.verifier = std::move(d._verifier);
+        }
+    }
+
+    this->stopProgress();
+    this->_downloading = false;
+    this->_download.reset();
+
+    _http.end();
+    if (!completed) {
+        // the remainder of the body is still pending, the connection cannot be re-used
+        this->disconnect();
+    }
+}
 
-    int code = _http.GET();
+HawkbitError HawkbitClient::readState(State& result)
+{
+    int code = this->execute(RequestStats::POLL, this->_controllerUrl, [this]() -> int {
+        _http.addHeader("Authorization", this->_authToken);
+        _http.addHeader("Accept", "application/hal+json");
+        this->addConditionalHeaders(this->_stateValidator);
+        return _http.GET();
+    });
     log_d("Result - code: %d", code);
-    String resultPayload = _http.getString();
-    log_d("Result - payload: %s", resultPayload.c_str());
+
+    if ( code == HTTP_CODE_NOT_MODIFIED ) {
+        _http.end();
+        log_d("State not modified");
+        this->flushPendingFeedback();
+        result = this->_state.copy();
+        return HawkbitError();
+    }
+
+    Validator validator;
+
     if ( code == HTTP_CODE_OK ) {
-        DeserializationError error = deserializeJson(_doc, resultPayload);
+        validator = this->readValidator();
+        _doc.clear();
+        StaticJsonDocument<CONTROLLER_BASE_FILTER_SIZE> filter;
+        controllerBaseFilter(filter);
+        DeserializationError error = this->readJson(filter);
         if (error) {
             _http.end();
-            // FIXME: need a way to handle errors
-            throw 1;
+            this->disconnect();
+            return jsonError(error);
         }
     }
     _http.end();
 
+    if ( code != HTTP_CODE_OK ) {
+        return HawkbitError::http(code);
+    }
+
+    // read before the document gets re-used by the following requests
+    uint32_t pollingInterval = parseInterval(_doc["config"]["polling"]["sleep"] | "");
+    log_d("Polling interval: %u ms", pollingInterval);
+
+    State state;
+
     String href = _doc["_links"]["deploymentBase"]["href"] | "";
+    String configHref = _doc["_links"]["configData"]["href"] | "";
+    String cancelHref = _doc["_links"]["cancelAction"]["href"] | "";
+
     if (!href.isEmpty()) {
         log_d("Fetching deployment: %s", href.c_str());
-        return State(this->readDeployment(href));
+        Deployment deployment;
+        HawkbitError error = this->readDeployment(href, deployment);
+        if (error.failed()) {
+            return error;
+        }
+        state = State(std::move(deployment));
+    } else if (!configHref.isEmpty()) {
+        log_d("Need to register: %s", configHref.c_str());
+        state = State(Registration(configHref));
+    } else if (!cancelHref.isEmpty()) {
+        log_d("Fetching cancel action: %s", cancelHref.c_str());
+        Stop stop;
+        HawkbitError error = this->readCancel(cancelHref, stop);
+        if (error.failed()) {
+            return error;
+        }
+        state = State(std::move(stop));
+    } else {
+        log_d("No update");
     }
 
-    href = _doc["_links"]["configData"]["href"] | "";
-    if (!href.isEmpty()) {
-        log_d("Need to register", href.c_str());
-        return State(Registration(href));
-    }
+    state._pollingInterval = pollingInterval;
 
-    href = _doc["_links"]["cancelAction"]["href"] | "";
-    if (!href.isEmpty()) {
-        log_d("Fetching cancel action: %s", href.c_str());
-        return State(this->readCancel(href));
-    }
+    // only remember the state once it was completely evaluated
+    this->_state = state.copy();
+    this->_stateValidator = validator;
+
+    // the server is reachable again
+    this->flushPendingFeedback();
 
-    log_d("No update");
-    return State();
+    result = std::move(state);
+    return HawkbitError();
 }
 
-std::map<String,String> toMap(const JsonObject& obj) {
-    std::map<String,String> result;
-    for (const JsonPair& p: obj) {
-        if (p.value().is<char*>()) {
-            result[String(p.key().c_str())] = String(p.value().as<char*>());
-        }
+/**
+ * Get the value of a hash, or the "href" of a link. Returns null for a hash which is not a string.
+ */
+const char* entryValue(const JsonPairConst& p, bool link)
+{
+    if (link) {
+        return p.value()["href"].as<const char*>();
     }
-    return result;
+    return p.value().is<const char*>() ? p.value().as<const char*>() : nullptr;
 }
 
-std::map<String,String> toLinks(const JsonObject& obj) {
-    std::map<String,String> result;
-    for (const JsonPair& p: obj) {
-        const char* key = p.key().c_str();
-        const char* value = p.value()["href"];
-        result[String(key)] = String(value);
+static void measureEntries(JsonObjectConst obj, bool link, size_t& entries, size_t& strings)
+{
+    for (JsonPairConst p: obj) {
+        const char* value = entryValue(p, link);
+        if (value == nullptr && !link) {
+            continue;
+        }
+        entries++;
+        strings += Arena::sizeOf(p.key().c_str()) + Arena::sizeOf(value);
     }
-    return result;
 }
 
-std::list<Artifact> artifacts(const JsonArray& artifacts)
+static FlatMap copyEntries(Arena& arena, JsonObjectConst obj, bool link, KeyValue*& next)
 {
-    std::list<Artifact> result;
-
-    for (JsonObject o : artifacts) {
-        Artifact artifact (
-            o["filename"],
-            o["size"] | 0,
-            toMap(o["hashes"]),
-            toLinks(o["_links"])
-        );
-        result.push_back(artifact);
+    KeyValue* begin = next;
+    for (JsonPairConst p: obj) {
+        const char* value = entryValue(p, link);
+        if (value == nullptr && !link) {
+            continue;
+        }
+        new (next++) KeyValue(arena.copy(p.key().c_str()), arena.copy(value));
     }
-
-    return result;
+    FlatMap::sort(begin, next);
+    return FlatMap(begin, next - begin);
 }
 
-std::list<Chunk> chunks(const JsonArray& chunks)
+/**
+ * Create a deployment from the deploymentBase resource in the document.
+ *
+ * The document is walked twice: first to measure the records and strings, then to copy them
+ * into an arena of exactly that size. So the deployment requires a single allocation only.
+ */
+static HawkbitError buildDeployment(const JsonDocument& doc, Deployment& result)
 {
-    std::list<Chunk> result;
+    const char* id = doc["id"].as<const char*>();
+    const char* download = doc["deployment"]["download"].as<const char*>();
+    const char* update = doc["deployment"]["update"].as<const char*>();
+    JsonArrayConst chunks = doc["deployment"]["chunks"].as<JsonArrayConst>();
+
+    size_t numChunks = 0;
+    size_t numArtifacts = 0;
+    size_t numEntries = 0;
+    size_t strings = Arena::sizeOf(id) + Arena::sizeOf(download) + Arena::sizeOf(update);
+
+    for (JsonObjectConst c : chunks) {
+        numChunks++;
+        strings += Arena::sizeOf(c["part"].as<const char*>()) + Arena::sizeOf(c["version"].as<const char*>()) + Arena::sizeOf(c["name"].as<const char*>());
+        for (JsonObjectConst a : c["artifacts"].as<JsonArrayConst>()) {
+            numArtifacts++;
+            strings += Arena::sizeOf(a["filename"].as<const char*>());
+            measureEntries(a["hashes"].as<JsonObjectConst>(), false, numEntries, strings);
+            measureEntries(a["_links"].as<JsonObjectConst>(), true, numEntries, strings);
+        }
+    }
 
-    for(JsonObject o : chunks)
-    {
-        Chunk chunk(
-            o["part"],
-            o["version"],
-            o["name"],
-            artifacts(o["artifacts"])
+    // all records go first, strings don't need to be aligned
+    Arena arena(numChunks * sizeof(Chunk) + numArtifacts * sizeof(Artifact) + numEntries * sizeof(KeyValue) + strings);
+    if (!arena.valid()) {
+        log_w("Failed to allocate deployment");
+        return HawkbitError(HawkbitError::CAPACITY);
+    }
+
+    Chunk* chunk = arena.allocate<Chunk>(numChunks);
+    Artifact* artifact = arena.allocate<Artifact>(numArtifacts);
+    KeyValue* entry = arena.allocate<KeyValue>(numEntries);
+
+    Chunk* firstChunk = chunk;
+    for (JsonObjectConst c : chunks) {
+        Artifact* firstArtifact = artifact;
+        for (JsonObjectConst a : c["artifacts"].as<JsonArrayConst>()) {
+            FlatMap hashes = copyEntries(arena, a["hashes"].as<JsonObjectConst>(), false, entry);
+            FlatMap links = copyEntries(arena, a["_links"].as<JsonObjectConst>(), true, entry);
+            new (artifact++) Artifact(arena.copy(a["filename"].as<const char*>()), a["size"] | 0, hashes, links);
+        }
+        new (chunk++) Chunk(
+            arena.copy(c["part"].as<const char*>()),
+            arena.copy(c["version"].as<const char*>()),
+            arena.copy(c["name"].as<const char*>()),
+            ArrayView<Artifact>(firstArtifact, artifact - firstArtifact)
             );
-        result.push_back(chunk);
     }
 
-    return result;
+    StringRef deploymentId = arena.copy(id);
+    StringRef deploymentDownload = arena.copy(download);
+    StringRef deploymentUpdate = arena.copy(update);
+
+    log_d("Deployment - chunks: %u, artifacts: %u, entries: %u, bytes: %u", numChunks, numArtifacts, numEntries, arena.used());
+
+    result = Deployment(arena, deploymentId, deploymentDownload, deploymentUpdate, ArrayView<Chunk>(firstChunk, numChunks));
+    return HawkbitError();
 }
 
-Deployment HawkbitClient::readDeployment(const String& href)
+HawkbitError HawkbitClient::readDeployment(const String& href, Deployment& result)
 {
-    _http.begin(this->_wifi, href);
+    // the server puts a hash of the deployment content into the href (?c=), so it changes with the content
+    bool versioned = href.indexOf("?c=") >= 0 || href.indexOf("&c=") >= 0;
+    bool cached = href == this->_deploymentHref;
+
+    if (versioned && cached) {
+        log_d("Deployment unchanged, using cached one");
+        result = this->_deployment;
+        return HawkbitError();
+    }
+
+    if (versioned && this->restoreDeployment(href, result)) {
+        return HawkbitError();
+    }
+
+    int code = this->execute(RequestStats::DEPLOYMENT, href, [this, cached]() -> int {
+        _http.addHeader("Authorization", this->_authToken);
+        _http.addHeader("Accept", "application/hal+json");
+        if (cached) {
+            this->addConditionalHeaders(this->_deploymentValidator);
+        }
+        return _http.GET();
+    });
+    log_d("Result - code: %d", code);
+
+    if ( code == HTTP_CODE_NOT_MODIFIED && cached ) {
+        _http.end();
+        log_d("Deployment not modified");
+        result = this->_deployment;
+        return HawkbitError();
+    }
 
-    _http.addHeader("Authorization", this->_authToken);
-    _http.addHeader("Accept", "application/hal+json");
+    Validator validator;
 
     _doc.clear();
 
-    int code = _http.GET();
-    log_d("Result - code: %d", code);
-    String resultPayload = _http.getString();
-    log_d("Result - payload: %s", resultPayload.c_str());
     if ( code == HTTP_CODE_OK ) {
-        DeserializationError error = deserializeJson(_doc, resultPayload);
+        validator = this->readValidator();
+        StaticJsonDocument<DEPLOYMENT_BASE_FILTER_SIZE> filter;
+        deploymentBaseFilter(filter);
+        DeserializationError error = this->readJson(filter);
         if (error) {
             _http.end();
-            // FIXME: need a way to handle errors
-            throw 1;
+            this->disconnect();
+            return jsonError(error);
         }
     }
     _http.end();
 
-    String id = _doc["id"];
-    String download = _doc["deployment"]["download"];
-    String update = _doc["deployment"]["update"];
+    if ( code != HTTP_CODE_OK ) {
+        return HawkbitError::http(code);
+    }
+
+    Deployment deployment;
+    HawkbitError error = buildDeployment(_doc, deployment);
+    if (error.failed()) {
+        return error;
+    }
+
+    this->_deployment = deployment;
+    this->_deploymentHref = href;
+    this->_deploymentValidator = validator;
+
+    if (versioned) {
+        this->persistDeployment(href);
+    }
+
+    result = std::move(deployment);
+    return HawkbitError();
+}
+
+void HawkbitClient::persistDeployment(const String& href)
+{
+    if (this->_deploymentStorage == nullptr) {
+        return;
+    }
+
+    // store the filtered document, which is re-parsed when restoring
+    size_t size = href.length() + 1 + measureJson(_doc);
+    if (size > MAX_PERSISTED_DEPLOYMENT) {
+        log_w("Deployment too large to persist (%u bytes)", size);
+        this->_deploymentStorage->remove(DEPLOYMENT_KEY);
+        return;
+    }
+
+    String value = href;
+    value += '\n';
+    serializeJson(_doc, value);
 
-    return Deployment(id, download, update, chunks(_doc["deployment"]["chunks"]));
+    if (!this->_deploymentStorage->store(DEPLOYMENT_KEY, value)) {
+        log_w("Failed to persist deployment (%u bytes)", value.length());
+        // don't leave a partial or outdated one behind
+        this->_deploymentStorage->remove(DEPLOYMENT_KEY);
+    }
 }
 
-Stop HawkbitClient::readCancel(const String& href)
+bool HawkbitClient::restoreDeployment(const String& href, Deployment& result)
 {
-    _http.begin(this->_wifi, href);
+    String value;
+    if (this->_deploymentStorage == nullptr || !this->_deploymentStorage->load(DEPLOYMENT_KEY, value)) {
+        return false;
+    }
+
+    int separator = value.indexOf('\n');
+    if (separator < 0 || value.substring(0, separator) != href) {
+        return false;
+    }
+
+    // the strings get copied into the document, as the input is read-only
+    _doc.clear();
+    DeserializationError error = deserializeJson(_doc, value.c_str() + separator + 1);
+    if (error) {
+        log_w("Failed to restore deployment: %s", error.c_str());
+        return false;
+    }
 
-    _http.addHeader("Authorization", this->_authToken);
-    _http.addHeader("Accept", "application/hal+json");
+    Deployment deployment;
+    if (buildDeployment(_doc, deployment).failed()) {
+        return false;
+    }
+
+    log_d("Deployment restored from storage");
+
+    this->_deployment = deployment;
+    this->_deploymentHref = href;
+    this->_deploymentValidator = Validator();
 
+    result = std::move(deployment);
+    return true;
+}
+
+HawkbitError HawkbitClient::readCancel(const String& href, Stop& result)
+{
     _doc.clear();
 
-    int code = _http.GET();
+    int code = this->execute(RequestStats::CANCEL, href, [this]() -> int {
+        _http.addHeader("Authorization", this->_authToken);
+        _http.addHeader("Accept", "application/hal+json");
+        return _http.GET();
+    });
     log_d("Result - code: %d", code);
-    String resultPayload = _http.getString();
-    log_d("Result - payload: %s", resultPayload.c_str());
     if ( code == HTTP_CODE_OK ) {
-        DeserializationError error = deserializeJson(_doc, resultPayload);
+        StaticJsonDocument<CANCEL_ACTION_FILTER_SIZE> filter;
+        cancelActionFilter(filter);
+        DeserializationError error = this->readJson(filter);
         if (error) {
             _http.end();
-            // FIXME: need a way to handle errors
-            throw 1;
+            this->disconnect();
+            return jsonError(error);
         }
     }
     _http.end();
 
+    if ( code != HTTP_CODE_OK ) {
+        return HawkbitError::http(code);
+    }
+
     String stopId = _doc["cancelAction"]["stopId"] | "";
-    
-    return Stop(stopId);
+
+    result = Stop(stopId);
+    return HawkbitError();
+}
+
+String HawkbitClient::resourceUrl(const char* resource, const char* id, const char* suffix) const
+{
+    String url;
+    url.reserve(this->_controllerUrl.length() + strlen(resource) + strlen(id) + strlen(suffix));
+    url += this->_controllerUrl;
+    url += resource;
+    url += id;
+    url += suffix;
+    return url;
 }
 
 String HawkbitClient::feedbackUrl(const Deployment& deployment) const
 {
-    return this->_baseUrl + "/" + this->_tenantName + "/controller/v1/" + this->_controllerId + "/deploymentBase/" + deployment.id() + "/feedback";
+    return this->resourceUrl("/deploymentBase/", deployment.id().c_str(), "/feedback");
 }
 
 String HawkbitClient::feedbackUrl(const Stop& stop) const
 {
-    return this->_baseUrl + "/" + this->_tenantName + "/controller/v1/" + this->_controllerId + "/cancelAction/" + stop.id() + "/feedback";
+    return this->resourceUrl("/cancelAction/", stop.id().c_str(), "/feedback");
 }
 
 template<typename IdProvider>
-UpdateResult HawkbitClient::sendFeedback(IdProvider id, const String& execution, const String& finished, std::vector<String> details)
+UpdateResult HawkbitClient::sendFeedback(IdProvider id, const String& execution, const String& finished, const std::vector<String>& details, uint32_t done, uint32_t total)
 {
-    _doc.clear();
+    return this->submit(Feedback(this->feedbackUrl(id), id.id(), execution, finished, details, done, total));
+}
 
-    _doc["id"] = id.id();
-    
-    JsonArray d = _doc["status"].createNestedArray("details");
-    for (auto detail : details) {
+void HawkbitClient::queueFeedback(size_t capacity, HawkbitStorage* storage)
+{
+    this->_feedback.reset(new FeedbackQueue(capacity, storage));
+    this->_feedback->restore(_doc);
+}
+
+UpdateResult HawkbitClient::submit(const Feedback& feedback)
+{
+    if (feedback.isFinal() && this->_deploymentStorage != nullptr) {
+        // the action is done, its deployment will not be offered again
+        this->_deploymentStorage->remove(DEPLOYMENT_KEY);
+    }
+
+    if (!this->_feedback) {
+        return this->post(feedback);
+    }
+
+    if (!this->_feedback->push(feedback)) {
+        // the queue is full, still send what is pending
+        this->flushFeedback(NO_FEEDBACK);
+        return UpdateResult(0);
+    }
+    // the pending entries go first, but only the result of this one counts
+    return this->flushFeedback(this->_feedback->size() - 1);
+}
+
+UpdateResult HawkbitClient::flushFeedback()
+{
+    return this->flushFeedback(NO_FEEDBACK);
+}
+
+UpdateResult HawkbitClient::flushFeedback(size_t own)
+{
+    if (!this->_feedback) {
+        return UpdateResult(0);
+    }
+
+    int code = 0;
+    int failure = 0;
+    int result = 0;
+    bool sent = false;
+
+    for (size_t position = 0; !this->_feedback->empty(); position++) {
+        code = this->post(this->_feedback->front()).code();
+        if (position == own) {
+            result = code;
+            sent = true;
+        }
+        if (failure == 0 && (code < 200 || code >= 300)) {
+            failure = code;
+        }
+        if (code <= 0 || code >= 500 || code == 429) {
+            // keep for later, the server might accept it then
+            log_d("Failed to send feedback (%d), %u pending", code, this->_feedback->size());
+            break;
+        }
+        if (code >= 400) {
+            // re-sending would not change anything, e.g. the action is gone
+            log_w("Feedback rejected by server: %d", code);
+            this->_rejectedFeedback++;
+        }
+        this->_feedback->pop();
+    }
+
+    this->_feedback->persist(_doc);
+
+    if (own == NO_FEEDBACK) {
+        return UpdateResult(failure != 0 ? failure : code);
+    }
+    // not sent, as an earlier entry failed: that attempt tells why
+    return UpdateResult(sent ? result : code);
+}
+
+void HawkbitClient::flushPendingFeedback()
+{
+    if (this->_feedback && !this->_feedback->empty()) {
+        log_d("Flushing %u pending feedback entries", this->_feedback->size());
+        this->flushFeedback();
+    }
+}
+
+/**
+ * Fill the document with the JSON of the feedback.
+ */
+static void feedbackJson(JsonDocument& doc, const Feedback& feedback)
+{
+    doc.clear();
+
+    doc["id"] = feedback.id();
+
+    JsonArray d = doc["status"].createNestedArray("details");
+    for (const String& detail : feedback.details()) {
         d.add(detail);
     }
 
-    _doc["status"]["execution"] = execution;
-    _doc["status"]["result"]["finished"] = finished;
+    doc["status"]["execution"] = feedback.execution();
+    doc["status"]["result"]["finished"] = feedback.finished();
 
-    _http.begin(this->_wifi, this->feedbackUrl(id));
+    if (feedback.total() > 0) {
+        doc["status"]["result"]["progress"]["cnt"] = feedback.done();
+        doc["status"]["result"]["progress"]["of"] = feedback.total();
+    }
+}
 
-    _http.addHeader("Accept", "application/hal+json");
-    _http.addHeader("Content-Type", "application/json");
-    _http.addHeader("Authorization", this->_authToken);
+UpdateResult HawkbitClient::post(const Feedback& feedback)
+{
+    if (this->_downloading) {
+        if (!this->_progressRunning || feedback.total() == 0) {
+            // the connection is busy with the download
+            log_d("No connection available for feedback during download");
+            return UpdateResult(0);
+        }
+        {
+            // replaces a report, which was not sent yet
+            std::lock_guard<std::mutex> lock(this->_progressLock);
+            this->_progressPending.reset(new Feedback(feedback));
+        }
+        this->_progressWake.notify_one();
+        return UpdateResult(HTTP_CODE_ACCEPTED);
+    }
 
-    String buffer;
-    size_t len = serializeJson(_doc, buffer);
-    (void)len; // ignore unused
+    feedbackJson(_doc, feedback);
 
-    log_d("JSON - len: %d", len);
+    log_d("JSON - len: %u", measureJson(_doc));
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
     serializeJsonPretty(_doc, Serial);
 #endif
 
-    // FIXME: handle result
-    int code = _http.POST(buffer);
+    int code = this->execute(RequestStats::FEEDBACK, feedback.url(), [this]() -> int {
+        _http.addHeader("Accept", "application/hal+json");
+        _http.addHeader("Content-Type", "application/json");
+        _http.addHeader("Authorization", this->_authToken);
+        JsonBodyStream body(_doc);
+        return _http.sendRequest("POST", &body, body.size());
+    });
     log_d("Result - code: %d", code);
 
-    String resultPayload = _http.getString();
-    log_d("Result - payload: %s", resultPayload.c_str());
+    this->logPayload();
 
     _http.end();
 
     return UpdateResult(code);
 }
 
-UpdateResult HawkbitClient::reportProgress(const Deployment& deployment, uint32_t done, uint32_t total, std::vector<String> details)
+void HawkbitClient::startProgress()
+{
+    if (this->_progressWifi == nullptr) {
+        return;
+    }
+
+    this->_progressPending.reset();
+    this->_progressStop = false;
+    this->_progressRunning = true;
+
+#if defined(ESP32)
+    this->_progressDone = xSemaphoreCreateBinary();
+    // the TLS stack needs some room when writing to a secure client
+    if (this->_progressDone == nullptr
+        || xTaskCreate(&HawkbitClient::progressTask, "hawkbit-progress", 8192, this, uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        log_e("Failed to start progress task");
+        if (this->_progressDone != nullptr) {
+            vSemaphoreDelete(this->_progressDone);
+        }
+        this->_progressRunning = false;
+    }
+#else
+    this->_progressThread = std::thread(&HawkbitClient::progressTask, this);
+#endif
+}
+
+void HawkbitClient::stopProgress()
+{
+    if (!this->_progressRunning) {
+        return;
+    }
+
+    // waits for a report which is being sent, a pending one is dropped
+    {
+        std::lock_guard<std::mutex> lock(this->_progressLock);
+        this->_progressStop = true;
+    }
+    this->_progressWake.notify_one();
+#if defined(ESP32)
+    xSemaphoreTake(this->_progressDone, portMAX_DELAY);
+    vSemaphoreDelete(this->_progressDone);
+#else
+    this->_progressThread.join();
+#endif
+    this->_progressRunning = false;
+    this->_progressPending.reset();
+}
+
+void HawkbitClient::progressTask(void* client)
+{
+    HawkbitClient* self = static_cast<HawkbitClient*>(client);
+    self->sendProgress();
+#if defined(ESP32)
+    xSemaphoreGive(self->_progressDone);
+    vTaskDelete(NULL);
+#endif
+}
+
+void HawkbitClient::sendProgress()
+{
+    // the main document may be in use by the download, this one fits a report without details, plus
+    // 128 bytes for the copied strings (the ID and the status)
+    StaticJsonDocument<JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(3) + 2 * JSON_OBJECT_SIZE(2) + 128> doc;
+
+    while (true) {
+        std::unique_ptr<Feedback> feedback;
+        {
+            std::unique_lock<std::mutex> lock(this->_progressLock);
+            this->_progressWake.wait(lock, [this]() { return this->_progressStop || this->_progressPending; });
+            if (this->_progressStop) {
+                break;
+            }
+            feedback = std::move(this->_progressPending);
+        }
+
+        feedbackJson(doc, *feedback);
+
+        _progressHttp.begin(*this->_progressWifi, feedback->url());
+        _progressHttp.addHeader("Accept", "application/hal+json");
+        _progressHttp.addHeader("Content-Type", "application/json");
+        _progressHttp.addHeader("Authorization", this->_authToken);
+        JsonBodyStream body(doc);
+        int code = _progressHttp.sendRequest("POST", &body, body.size());
+        log_d("Progress - code: %d", code);
+        _progressHttp.end();
+    }
+}
+
+UpdateResult HawkbitClient::reportProgress(const Deployment& deployment, uint32_t done, uint32_t total, const std::vector<String>& details)
 {
     return sendFeedback(
         deployment,
         "proceeding",
         "none",
-        details
+        details,
+        done,
+        total
     );
 }
 
-UpdateResult HawkbitClient::reportScheduled(const Deployment& deployment, std::vector<String> details)
+void HawkbitClient::progressClient(WiFiClient& client)
+{
+    this->_progressWifi = &client;
+    // progress is reported repeatedly, keep the connection open
+    this->_progressHttp.setReuse(true);
+}
+
+ProgressReporter::ProgressReporter(HawkbitClient& client, const Deployment& deployment, uint32_t interval, uint8_t step) :
+    _client(client),
+    _deployment(deployment),
+    _interval(interval),
+    _step(step),
+    _total(0),
+    _lastTime(0),
+    _lastPercent(0),
+    _started(false),
+    _reports(0)
+{
+    this->_client._progress = this;
+}
+
+ProgressReporter::~ProgressReporter()
+{
+    if (this->_client._progress == this) {
+        this->_client._progress = nullptr;
+    }
+}
+
+void ProgressReporter::begin(uint32_t total)
+{
+    this->_total = total;
+    this->_lastTime = millis();
+    this->_lastPercent = 0;
+    this->_started = true;
+}
+
+void ProgressReporter::report(uint32_t done, uint8_t percent)
+{
+    // record the attempt first, a failing report must not be re-tried faster than the configured rate
+    this->_lastTime = millis();
+    this->_lastPercent = percent;
+
+    UpdateResult result = this->_client.reportProgress(this->_deployment, done, this->_total);
+    if (result.ok()) {
+        this->_reports++;
+    }
+}
+
+UpdateResult HawkbitClient::reportScheduled(const Deployment& deployment, const std::vector<String>& details)
 {
     return sendFeedback(
         deployment,
@@ -317,7 +1546,7 @@ UpdateResult HawkbitClient::reportScheduled(const Deployment& deployment, std::v
     );
 }
 
-UpdateResult HawkbitClient::reportResumed(const Deployment& deployment, std::vector<String> details)
+UpdateResult HawkbitClient::reportResumed(const Deployment& deployment, const std::vector<String>& details)
 {
     return sendFeedback(
         deployment,
@@ -327,7 +1556,7 @@ UpdateResult HawkbitClient::reportResumed(const Deployment& deployment, std::vec
     );
 }
 
-UpdateResult HawkbitClient::reportComplete(const Deployment& deployment, bool success, std::vector<String> details)
+UpdateResult HawkbitClient::reportComplete(const Deployment& deployment, bool success, const std::vector<String>& details)
 {
     return sendFeedback(
         deployment,
@@ -337,7 +1566,7 @@ UpdateResult HawkbitClient::reportComplete(const Deployment& deployment, bool su
     );
 }
 
-UpdateResult HawkbitClient::reportCanceled(const Deployment& deployment, std::vector<String> details)
+UpdateResult HawkbitClient::reportCanceled(const Deployment& deployment, const std::vector<String>& details)
 {
     return sendFeedback(
         deployment,
@@ -347,7 +1576,7 @@ UpdateResult HawkbitClient::reportCanceled(const Deployment& deployment, std::ve
     );
 }
 
-UpdateResult HawkbitClient::reportCancelAccepted(const Stop& stop, std::vector<String> details)
+UpdateResult HawkbitClient::reportCancelAccepted(const Stop& stop, const std::vector<String>& details)
 {
     return sendFeedback(
         stop,
@@ -357,7 +1586,7 @@ UpdateResult HawkbitClient::reportCancelAccepted(const Stop& stop, std::vector<S
     );
 }
 
-UpdateResult HawkbitClient::reportCancelRejected(const Stop& stop, std::vector<String> details)
+UpdateResult HawkbitClient::reportCancelRejected(const Stop& stop, const std::vector<String>& details)
 {
     return sendFeedback(
         stop,
@@ -19,8 +19,34 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <map>
-#include <list>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <ArduinoJson.h>
+#include <Arduino.h>
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <thread>
+#endif
+
+#include "hawkbit_log.h"
+#include "hawkbit_error.h"
+#include "hawkbit_arena.h"
+#include "hawkbit_pipeline.h"
+#include "hawkbit_verify.h"
+#include "hawkbit_delta.h"
+#include "hawkbit_compress.h"
+#include "hawkbit_feedback.h"
+#include "hawkbit_storage.h"
+#include "hawkbit_sink.h"
+#include "hawkbit_stats.h"
+#include "hawkbit_links.h"
+#include "hawkbit_tls.h"
 
 class Artifact;
 class Chunk;
@@ -29,6 +55,7 @@ class State;
 class UpdateResult;
 class DownloadResult;
 class HawkbitClient;
+class ProgressReporter;
 
 class UpdateResult {
     public:
@@ -39,6 +66,20 @@ class UpdateResult {
 
         uint32_t code() const { return this->_code; }
 
+        bool ok() const { return this->error().ok(); }
+
+        /**
+         * Get the error, a successful request returns a 2xx status.
+         */
+        HawkbitError error() const
+        {
+            int code = (int)this->_code;
+            if (code >= 200 && code < 300) {
+                return HawkbitError();
+            }
+            return HawkbitError(code <= 0 ? HawkbitError::TRANSPORT : HawkbitError::HTTP, code);
+        }
+
     private:
         uint32_t _code;
 };
@@ -56,13 +97,16 @@ class DownloadResult {
         uint32_t _code;
 };
 
+/**
+ * An artifact of a deployment, stored in the arena of the deployment.
+ */
 class Artifact {
     public:
         Artifact(
-            const String& filename,
+            StringRef filename,
             uint32_t size,
-            const std::map<String,String>& hashes,
-            const std::map<String,String>& links
+            const FlatMap& hashes,
+            const FlatMap& links
             ) :
             _filename(filename),
             _size(size),
@@ -71,33 +115,52 @@ class Artifact {
         {
         }
 
-        const String& filename() const { return _filename; }
+        StringRef filename() const { return _filename; }
         const uint32_t size() const { return _size; }
-        const std::map<String,String>& hashes() const { return _hashes; }
-        const std::map<String,String>& links() const { return _links; }
+        const FlatMap& hashes() const { return _hashes; }
+        const FlatMap& links() const { return _links; }
 
         void dump(Print& out, const String& prefix = "") const {
             out.printf("%s%s %u\n", prefix.c_str(), this->_filename.c_str(), this->_size);
             out.printf("%sHashes\n", prefix.c_str());
-            for (std::pair<String,String> element : this->_hashes) {
+            for (const KeyValue& element : this->_hashes) {
                 out.printf("%s    %s = %s\n", prefix.c_str(), element.first.c_str(), element.second.c_str());
             }
             out.printf("%sLinks\n", prefix.c_str());
-            for (std::pair<String,String> element : this->_links) {
+            for (const KeyValue& element : this->_links) {
                 out.printf("%s    %s = %s\n", prefix.c_str(), element.first.c_str(), element.second.c_str());
             }
         }
 
+        /**
+         * Identify the artifact by its name and content, independent of the parsed deployment.
+         */
+        String key() const
+        {
+            String result = this->_filename;
+            result += ':';
+            result += this->_size;
+            if (!this->_hashes.empty()) {
+                // sorted by name, so this is always the same hash
+                result += ':';
+                result += this->_hashes.front().second.c_str();
+            }
+            return result;
+        }
+
     private:
-        String _filename;
+        StringRef _filename;
         uint32_t _size;
-        std::map<String,String> _hashes;
-        std::map<String,String> _links;
+        FlatMap _hashes;
+        FlatMap _links;
 };
 
+/**
+ * A chunk of a deployment, stored in the arena of the deployment.
+ */
 class Chunk {
     public:
-        Chunk(const String& part, const String& version, const String& name, const std::list<Artifact>& artifacts) :
+        Chunk(StringRef part, StringRef version, StringRef name, const ArrayView<Artifact>& artifacts) :
             _part(part),
             _version(version),
             _name(name),
@@ -105,31 +168,38 @@ class Chunk {
         {
         }
 
-        const String& part() const { return _part; }
-        const String& version() const { return _version; }
-        const String& name() const { return _name; }
-        const std::list<Artifact>& artifacts() const { return _artifacts; }
+        StringRef part() const { return _part; }
+        StringRef version() const { return _version; }
+        StringRef name() const { return _name; }
+        const ArrayView<Artifact>& artifacts() const { return _artifacts; }
 
         void dump(Print& out, const String& prefix = "") const {
             out.printf("%s%s - %s (%s)\n", prefix.c_str(), this->_name.c_str(), this->_version.c_str(), this->_part.c_str());
-            for (Artifact a: this->_artifacts) {
+            for (const Artifact& a: this->_artifacts) {
                 a.dump(out, prefix + "    ");
             }
         }
 
     private:
-        String _part;
-        String _version;
-        String _name;
-        std::list<Artifact> _artifacts;
+        StringRef _part;
+        StringRef _version;
+        StringRef _name;
+        ArrayView<Artifact> _artifacts;
 };
 
+/**
+ * A deployment, with all of its chunks, artifacts and strings stored in a single arena.
+ *
+ * Copies share the arena, which is released with the last copy. Chunks and artifacts
+ * are only valid as long as a copy of their deployment exists.
+ */
 class Deployment {
     public:
         Deployment() {
         }
 
-        Deployment(const String& id, const String& download, const String& update, const std::list<Chunk>& chunks) :
+        Deployment(const Arena& arena, StringRef id, StringRef download, StringRef update, const ArrayView<Chunk>& chunks) :
+            _arena(arena),
             _id(id),
             _download(download),
             _update(update),
@@ -137,24 +207,30 @@ class Deployment {
         {
         }
 
-        const String& id() const { return _id; }
-        const std::list<Chunk>& chunks() const { return _chunks; }
+        StringRef id() const { return _id; }
+        const ArrayView<Chunk>& chunks() const { return _chunks; }
+
+        /**
+         * Get the number of bytes, allocated for the deployment.
+         */
+        size_t memory() const { return _arena.capacity(); }
 
         void dump(Print& out, const String& prefix = "") const {
             out.printf("%sDeployment: %s\n", prefix.c_str(), this->_id.c_str());
             out.printf("%s    Download: %s, Update: %s\n", prefix.c_str(), this->_download.c_str(), this->_update.c_str());
             out.printf("%s    Chunks:\n", prefix.c_str());
             String chunkPrefix = prefix + "        ";
-            for (Chunk c : this->_chunks) {
+            for (const Chunk& c : this->_chunks) {
                 c.dump(out, chunkPrefix);
             }
             out.println();
         };
     private:
-        String _id;
-        String _download;
-        String _update;
-        std::list<Chunk> _chunks;
+        Arena _arena;
+        StringRef _id;
+        StringRef _download;
+        StringRef _update;
+        ArrayView<Chunk> _chunks;
 };
 
 class Stop {
@@ -205,26 +281,55 @@ class State {
         typedef enum { NONE, REGISTER, UPDATE, CANCEL } Type;
 
         State() :
-            _type(State::NONE)
+            _type(State::NONE),
+            _pollingInterval(0)
         {
         }
 
-        State(const Stop& stop) :
+        State(Stop stop) :
             _type(State::CANCEL),
-            _stop(stop)
+            _pollingInterval(0)
         {
+            new (&this->_stop) Stop(std::move(stop));
         }
 
-        State(const Registration& registration) :
+        State(Registration registration) :
             _type(State::REGISTER),
-            _registration(registration)
+            _pollingInterval(0)
         {
+            new (&this->_registration) Registration(std::move(registration));
         }
 
-        State(const Deployment& deployment) :
+        State(Deployment deployment) :
             _type(State::UPDATE),
-            _deployment(deployment)
+            _pollingInterval(0)
         {
+            new (&this->_deployment) Deployment(std::move(deployment));
+        }
+
+        State(State&& other) :
+            _type(State::NONE),
+            _pollingInterval(other._pollingInterval)
+        {
+            this->assign(std::move(other));
+        }
+
+        State& operator=(State&& other)
+        {
+            if (this != &other) {
+                this->reset();
+                this->_pollingInterval = other._pollingInterval;
+                this->assign(std::move(other));
+            }
+            return *this;
+        }
+
+        State(const State&) = delete;
+        State& operator=(const State&) = delete;
+
+        ~State()
+        {
+            this->reset();
         }
 
         boolean is(Type type) const
@@ -233,10 +338,24 @@ class State {
         }
 
         const Type type() const { return this->_type; }
+        /**
+         * Get the deployment, only valid for an UPDATE state.
+         */
         const Deployment& deployment() const { return this->_deployment; }
+        /**
+         * Get the stop request, only valid for a CANCEL state.
+         */
         const Stop& stop() const { return this->_stop; }
+        /**
+         * Get the registration request, only valid for a REGISTER state.
+         */
         const Registration& registration() const { return this->_registration; }
 
+        /**
+         * Get the polling interval (in milliseconds) requested by the server, or zero if none was provided.
+         */
+        uint32_t pollingInterval() const { return this->_pollingInterval; }
+
         void dump(Print& out, const String& prefix = "") const
         {
             switch (this->_type) {
@@ -263,35 +382,460 @@ class State {
 
     private:
         Type _type;
+        // only the alternative of the type is alive
+        union {
+            Deployment _deployment;
+            Stop _stop;
+            Registration _registration;
+        };
+        uint32_t _pollingInterval;
+
+        void reset()
+        {
+            switch (this->_type) {
+                case State::UPDATE:
+                    this->_deployment.~Deployment();
+                    break;
+                case State::CANCEL:
+                    this->_stop.~Stop();
+                    break;
+                case State::REGISTER:
+                    this->_registration.~Registration();
+                    break;
+                default:
+                    break;
+            }
+            this->_type = State::NONE;
+        }
+
+        /**
+         * Move the alternative of another state into this one, which must be of type NONE.
+         */
+        void assign(State&& other)
+        {
+            switch (other._type) {
+                case State::UPDATE:
+                    new (&this->_deployment) Deployment(std::move(other._deployment));
+                    break;
+                case State::CANCEL:
+                    new (&this->_stop) Stop(std::move(other._stop));
+                    break;
+                case State::REGISTER:
+                    new (&this->_registration) Registration(std::move(other._registration));
+                    break;
+                default:
+                    break;
+            }
+            this->_type = other._type;
+        }
+
+        /**
+         * Copy the state, used for caching it. Copying a deployment only shares its arena.
+         */
+        State copy() const
+        {
+            switch (this->_type) {
+                case State::UPDATE: {
+                    State result(this->_deployment);
+                    result._pollingInterval = this->_pollingInterval;
+                    return result;
+                }
+                case State::CANCEL: {
+                    State result(this->_stop);
+                    result._pollingInterval = this->_pollingInterval;
+                    return result;
+                }
+                case State::REGISTER: {
+                    State result(this->_registration);
+                    result._pollingInterval = this->_pollingInterval;
+                    return result;
+                }
+                default: {
+                    State result;
+                    result._pollingInterval = this->_pollingInterval;
+                    return result;
+                }
+            }
+        }
+
+    friend HawkbitClient;
+};
+
+/**
+ * Schedules polling the server.
+ *
+ * Polls at the interval requested by the server, falling back to a default interval. Failed polls
+ * back off exponentially, up to a maximum interval. Each delay is randomized by a jitter, so that
+ * devices which started at the same time spread out their requests.
+ */
+class PollScheduler {
+    public:
+        /**
+         * @param defaultInterval the interval (in milliseconds) when the server did not request one
+         * @param maxInterval the maximum interval (in milliseconds) when backing off
+         * @param jitter the maximum jitter, in percent of the interval
+         */
+        PollScheduler(uint32_t defaultInterval = 30000, uint32_t maxInterval = 3600000, uint8_t jitter = 20) :
+            _defaultInterval(defaultInterval),
+            _maxInterval(maxInterval),
+            _jitter(jitter),
+            _interval(defaultInterval),
+            _failures(0),
+            _last(millis()),
+            _delay(0)
+        {
+        }
+
+        /**
+         * Delay the first poll by a random time, up to the provided spread (in milliseconds).
+         */
+        void begin(uint32_t spread)
+        {
+            schedule(spread > 0 ? random(spread) : 0);
+        }
+
+        /**
+         * Check if the next poll is due.
+         */
+        bool due() const
+        {
+            return millis() - this->_last >= this->_delay;
+        }
+
+        /**
+         * Get the time (in milliseconds) until the next poll is due.
+         */
+        uint32_t remaining() const
+        {
+            uint32_t elapsed = millis() - this->_last;
+            return elapsed >= this->_delay ? 0 : this->_delay - elapsed;
+        }
+
+        /**
+         * Record a successful poll, scheduling the next one.
+         */
+        void success(const State& state)
+        {
+            this->_failures = 0;
+            this->_interval = state.pollingInterval() > 0 ? state.pollingInterval() : this->_defaultInterval;
+            schedule(jittered(this->_interval));
+        }
+
+        /**
+         * Record a failed poll, scheduling the next one with an increased back-off.
+         */
+        void failure()
+        {
+            if (this->_failures < 16) {
+                this->_failures++;
+            }
+            uint64_t backoff = (uint64_t)this->_interval << this->_failures;
+            schedule(jittered(backoff > this->_maxInterval ? this->_maxInterval : (uint32_t)backoff));
+        }
+
+        uint32_t failures() const { return this->_failures; }
+
+    private:
+        uint32_t _defaultInterval;
+        uint32_t _maxInterval;
+        uint8_t _jitter;
+
+        uint32_t _interval;
+        uint32_t _failures;
+        uint32_t _last;
+        uint32_t _delay;
+
+        uint32_t jittered(uint32_t interval) const
+        {
+            uint32_t range = (uint64_t)interval * this->_jitter / 100;
+            if (range == 0) {
+                return interval;
+            }
+            return interval - range + random(2 * range + 1);
+        }
+
+        void schedule(uint32_t delay)
+        {
+            this->_last = millis();
+            this->_delay = delay;
+            log_d("Next poll in %u ms", delay);
+        }
+};
+
+/**
+ * Reports the progress of a download to the server, limited to a maximum rate.
+ *
+ * While it exists, the reporter is attached to the client, and counts the bytes of each download.
+ * A report is only sent once both the minimum interval passed and the progress advanced by the
+ * minimum step. Feedback can only be sent during a download when the client has a secondary
+ * connection (see HawkbitClient::progressClient()). Otherwise the reports get queued (see
+ * HawkbitClient::queueFeedback(), only the latest one is kept) or skipped.
+ */
+class ProgressReporter {
+    public:
+        /**
+         * @param interval the minimum time (in milliseconds) between two reports, zero for no limit
+         * @param step the minimum progress (in percent) between two reports, zero for no limit
+         */
+        ProgressReporter(HawkbitClient& client, const Deployment& deployment, uint32_t interval = 10000, uint8_t step = 10);
+        ~ProgressReporter();
+
+        ProgressReporter(const ProgressReporter&) = delete;
+        ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+        /**
+         * Start a new download.
+         * @param total the total number of bytes to transfer
+         */
+        void begin(uint32_t total);
+
+        /**
+         * Record the number of bytes transferred so far, sending a report if due.
+         */
+        void transferred(uint32_t done)
+        {
+            if (!this->_started || this->_total == 0) {
+                return;
+            }
+            uint8_t percent = (uint64_t)done * 100 / this->_total;
+            if (percent - this->_lastPercent < this->_step || millis() - this->_lastTime < this->_interval) {
+                return;
+            }
+            report(done, percent);
+        }
+
+        /**
+         * Get the number of reports which have been sent successfully, or handed over to the
+         * background task of the progress connection.
+         */
+        uint32_t reports() const { return this->_reports; }
+
+    private:
+        HawkbitClient& _client;
         Deployment _deployment;
-        Stop _stop;
-        Registration _registration;
+        uint32_t _interval;
+        uint8_t _step;
+
+        uint32_t _total;
+        uint32_t _lastTime;
+        uint8_t _lastPercent;
+        bool _started;
+        uint32_t _reports;
+
+        void report(uint32_t done, uint8_t percent);
 };
 
-class DownloadError {
+/**
+ * A stream, counting the bytes read from it.
+ */
+class CountingStream : public Stream {
     public:
-        DownloadError(uint32_t code) :
-            _code(code)
+        CountingStream(Stream& source) :
+            _source(source),
+            _count(0),
+            _reporter(nullptr),
+            _base(0)
         {
         }
 
-        uint32_t code() const { return this->_code; }
+        uint32_t count() const { return this->_count; }
+
+        /**
+         * Report the bytes read to a progress reporter, on top of a base (e.g. the offset of a resumed download).
+         */
+        void reporter(ProgressReporter* reporter, uint32_t base)
+        {
+            this->_reporter = reporter;
+            this->_base = base;
+        }
+
+        int available() override { return _source.available(); }
+        int peek() override { return _source.peek(); }
+        void flush() override { _source.flush(); }
+        size_t write(uint8_t c) override { return _source.write(c); }
+
+        int read() override
+        {
+            int c = _source.read();
+            if (c >= 0) {
+                this->_count++;
+                this->report();
+            }
+            return c;
+        }
+
+        using Stream::readBytes;
+
+        size_t readBytes(char* buffer, size_t length) override
+        {
+            size_t len = _source.readBytes(buffer, length);
+            this->_count += len;
+            this->report();
+            return len;
+        }
 
     private:
-        uint32_t _code;
+        Stream& _source;
+        uint32_t _count;
+        ProgressReporter* _reporter;
+        uint32_t _base;
+
+        void report()
+        {
+            if (this->_reporter != nullptr) {
+                this->_reporter->transferred(this->_base + this->_count);
+            }
+        }
 };
 
 class Download {
     public:
-        Stream& stream() { return this->_stream; }
+        /**
+         * Get the stream of the artifact data.
+         *
+         * All hashes of the artifact are computed while reading from the stream.
+         */
+        Stream& stream() { return this->_verifying; }
+
+        /**
+         * Get the offset in the artifact, at which the stream starts.
+         */
+        uint32_t offset() const { return this->_offset; }
+
+        /**
+         * Get the URL the artifact is downloaded from.
+         */
+        const String& url() const { return this->_url; }
+
+        /**
+         * Get the position in the artifact, after the bytes read from the stream so far.
+         */
+        uint32_t position() const { return this->_offset + this->_counting.count(); }
+
+        /**
+         * Verify the hashes of the data read from the stream.
+         *
+         * Call this after reading the complete stream, before committing the data. A resumed
+         * download (non-zero offset) can only be verified if the client kept the state of the hashes
+         * from the interrupted download (see HawkbitClient::finishDownload()), as only the remainder
+         * was received.
+         * @return true if all hashes, which the server provided for the artifact, match
+         */
+        bool verify() { return this->_verifier->verify(); }
+
+        /**
+         * Check if the download can be resumed later on, at its position: the data read from the
+         * stream is the artifact as is, and all of it got verified so far.
+         */
+        bool resumable() const { return !this->decoding() && this->_verifier->active(); }
+
+        /**
+         * Get the number of bytes, which can be read from the network without blocking.
+         */
+        int available() { return this->_counting.available(); }
+
+        /**
+         * Check if the complete response has been read from the network.
+         */
+        bool received()
+        {
+            if (this->_contentLength > 0) {
+                return this->_counting.count() >= this->_contentLength;
+            }
+            if (this->_decoding) {
+                // the length of the encoded response is unknown, it ends with the gzip data or the connection
+                return this->_decoding->finished() || (!this->_connection.connected() && this->_connection.available() <= 0);
+            }
+            return this->position() >= this->_size;
+        }
+
+        /**
+         * Check if the data gets decoded or decompressed, so that output may still be pending once
+         * the response has been received.
+         */
+        bool decoding() const { return this->_decoding || this->compressed(); }
+
+        /**
+         * Check if the artifact is compressed, detected by its file name.
+         */
+        bool compressed() const { return this->_compression != Compression::NONE; }
+
+        /**
+         * Get the stream of the decompressed artifact data.
+         *
+         * For a compressed artifact, this decompresses the data of stream(), using a fixed size
+         * window. The hashes, as well as the size of the artifact, apply to the compressed data.
+         * For an uncompressed artifact, this is the same as stream(). A resumed download cannot be
+         * decompressed, the stream fails right away.
+         */
+        Stream& decompressed()
+        {
+            if (this->_compression == Compression::NONE) {
+                return stream();
+            }
+            if (!this->_decompressing) {
+                Decompressor* decompressor = nullptr;
+                if (this->_offset > 0) {
+                    log_w("Unable to decompress a resumed download");
+                } else {
+                    decompressor = createDecompressor(this->_compression, this->_window, this->_lookahead);
+                }
+                this->_decompressing.reset(new DecompressingStream(this->_verifying, this->_length, decompressor));
+            }
+            return *this->_decompressing;
+        }
+
+        /**
+         * Check if decoding or decompressing the data failed.
+         */
+        bool failed() const
+        {
+            return (this->_decoding && this->_decoding->failed()) || (this->_decompressing && this->_decompressing->failed());
+        }
 
     private:
-        Stream& _stream;
+        WiFiClient& _connection;
+        CountingStream _counting;
+        // decodes a transfer using "Content-Encoding: gzip"
+        std::unique_ptr<DecompressingStream> _decoding;
+        std::unique_ptr<HashVerifier> _verifier;
+        VerifyingStream _verifying;
+        std::unique_ptr<DecompressingStream> _decompressing;
+        Compression _compression;
+        uint32_t _offset;
+        uint32_t _length;
+        uint32_t _contentLength;
+        uint32_t _size;
+        String _url;
+        // see Artifact::key()
+        String _artifact;
+        unsigned long _started;
+        // the heatshrink parameters
+        uint8_t _window;
+        uint8_t _lookahead;
 
-        Download(Stream& stream) :
-            _stream(stream)
-         {
-         }
+        /**
+         * @param verifier the verifier, which saw all data up to the offset
+         */
+        Download(WiFiClient& connection, uint32_t offset, uint32_t length, bool gzipEncoded, const Artifact& artifact, const String& url,
+            uint8_t window, uint8_t lookahead, std::unique_ptr<HashVerifier> verifier) :
+            _connection(connection),
+            _counting(connection),
+            _decoding(gzipEncoded ? new DecompressingStream(_counting, length, createDecompressor(Compression::GZIP)) : nullptr),
+            _verifier(std::move(verifier)),
+            _verifying(_decoding ? static_cast<Stream&>(*_decoding) : static_cast<Stream&>(_counting), *_verifier),
+            _compression(compressionOf(artifact.filename())),
+            _offset(offset),
+            _length(gzipEncoded ? 0 : length),
+            _contentLength(length),
+            _size(artifact.size()),
+            _url(url),
+            _artifact(artifact.key()),
+            _started(millis()),
+            _window(window),
+            _lookahead(lookahead)
+        {
+        }
 
     friend HawkbitClient;
 };
@@ -309,64 +853,306 @@ class HawkbitClient {
             const String& controllerId,
             const String& securityToken);
 
-        State readState();
+        /**
+         * Read the state from the server.
+         */
+        HawkbitError readState(State& state);
 
+        /**
+         * Download an artifact.
+         *
+         * The handler is called with the download (<code>HawkbitError handler(Download& d)</code>),
+         * and returns its result, which is returned by this call.
+         */
         template<typename DownloadHandler>
-        void download(const Artifact& artifact, DownloadHandler function)
+        HawkbitError download(const Artifact& artifact, DownloadHandler function)
         {
-            download(artifact, "download", function);
+            return download(artifact, "download", function);
         }
 
         template<typename DownloadHandler>
-        void download(const Artifact& artifact, const String& linkType, DownloadHandler function)
+        HawkbitError download(const Artifact& artifact, const String& linkType, DownloadHandler function)
         {
-            auto href = artifact.links().find(linkType);
+            uint32_t offset = 0;
+            return download(artifact, linkType, offset, function);
+        }
 
-            if ( href == artifact.links().end()) {
-                throw String("Missing link for download");
+        /**
+         * Download an artifact, resuming at an offset.
+         *
+         * If the offset is non-zero, only the remainder of the artifact is requested. If the server
+         * ignores the range, or responds with an unexpected one, the full artifact is downloaded
+         * instead, and Download::offset() is zero. On return, the offset is updated to the position
+         * in the artifact which was reached, also if the download failed, so that the caller can
+         * resume later on. After a transient error, the client keeps the state of the hashes at that
+         * position, so that the resumed download can be verified (see canResume()).
+         * @param offset uint32_t the number of bytes already committed
+         */
+        template<typename DownloadHandler>
+        HawkbitError download(const Artifact& artifact, const String& linkType, uint32_t& offset, DownloadHandler function)
+        {
+            Download* d;
+            HawkbitError error = this->startDownload(artifact, linkType, d, offset);
+            if (error.failed()) {
+                return error;
             }
+            error = function(*d);
+            offset = d->position();
+            this->finishDownload(error.ok(), error.transient());
+            return error;
+        };
 
-            _http.begin(this->_wifi, href->second);
+        /**
+         * Start downloading an artifact, for reading it step by step.
+         *
+         * Sends the request, and provides the download once the response headers have been
+         * received. The download stays valid until finishDownload() is called, which must be done
+         * before any other request is made on the primary connection.
+         * @param offset uint32_t the number of bytes already committed, see download()
+         */
+        HawkbitError startDownload(const Artifact& artifact, const String& linkType, Download*& download, uint32_t offset = 0);
 
-            _http.addHeader("Authorization", this->_authToken);
+        /**
+         * Finish the download, started by startDownload().
+         * @param completed true if the artifact was read completely, otherwise the connection is closed
+         * @param resumable true if the data read so far was kept, to resume the download at its
+         *     position. Unless the download cannot be resumed (see Download::resumable()), the client
+         *     keeps the state of the hashes, until the next download starts.
+         */
+        void finishDownload(bool completed, bool resumable = false);
 
-            int code = _http.GET();
-            log_i("Result - code: %d", code);
+        /**
+         * Check if a download of the artifact, which was interrupted at the offset, can be resumed
+         * and still gets verified.
+         */
+        bool canResume(const Artifact& artifact, uint32_t offset) const
+        {
+            return offset > 0 && this->_resume.verifier && this->_resume.offset == offset && this->_resume.artifact == artifact.key();
+        }
 
-            if (code == HTTP_CODE_OK ) {
-                Download d(_http.getStream());
-                function(d);
-            }
+        /**
+         * Download an artifact, overlapping the network transfer with writing to the sink.
+         *
+         * The sink is called with each received block (<code>bool sink(const uint8_t* data, size_t len)</code>)
+         * and returns false to abort the download. The pipeline provides the buffers, and records the
+         * statistics of the transfer. The hashes of the artifact are verified once the transfer is complete,
+         * so the caller may only commit the data written to the sink once this call returned successfully.
+         */
+        template<typename Sink>
+        HawkbitError downloadPipelined(const Artifact& artifact, const String& linkType, DownloadPipeline& pipeline, Sink sink)
+        {
+            return download(artifact, linkType, [&artifact, &pipeline, &sink](Download& d) -> HawkbitError {
+                return pipelined(artifact, d, pipeline, sink);
+            });
+        }
 
-            _http.end();
+        /**
+         * Download a delta artifact, and apply it to the source image while it is being received.
+         *
+         * The sink is called with each block of the resulting image (<code>bool sink(const uint8_t* data, size_t len)</code>),
+         * and returns false to abort. Both the delta artifact and the resulting image are verified,
+         * before this call returns.
+         */
+        template<typename Sink>
+        HawkbitError downloadDelta(const Artifact& artifact, const String& linkType, DeltaSource& source, Sink sink)
+        {
+            return download(artifact, linkType, [&source, &sink](Download& d) -> HawkbitError {
+                bool rejected = false;
+                auto guarded = [&sink, &rejected](const uint8_t* data, size_t len) -> bool {
+                    rejected = !sink(data, len);
+                    return !rejected;
+                };
+                DeltaPatcher patcher;
+                if (!patcher.apply(d.decompressed(), source, guarded)) {
+                    return transferError(d, rejected);
+                }
+                if (d.failed() || !d.received()) {
+                    return transferError(d, false);
+                }
+                if (!d.verify()) {
+                    return HawkbitError(HawkbitError::INTEGRITY);
+                }
+                log_i("Delta applied - size: %u, copied: %u, inserted: %u", patcher.targetSize(), patcher.copied(), patcher.inserted());
+                return HawkbitError();
+            });
+        }
 
-            if (code != HTTP_CODE_OK ) {
-                throw DownloadError(code);
-            }
-        };
+        /**
+         * Download an artifact into a sink.
+         *
+         * The data is written in blocks of the size preferred by the sink. The sink is only committed
+         * once the artifact was received completely and verified, otherwise it gets aborted.
+         */
+        HawkbitError downloadTo(const Artifact& artifact, const String& linkType, DownloadSink& sink);
 
-        UpdateResult reportProgress(const Deployment& deployment, uint32_t done, uint32_t total, std::vector<String> details = {});
+        /**
+         * Download an artifact into a sink, using a pipeline.
+         *
+         * The blocks of the pipeline are passed to the sink directly, without copying them.
+         */
+        HawkbitError downloadTo(const Artifact& artifact, const String& linkType, DownloadSink& sink, DownloadPipeline& pipeline);
+
+        /**
+         * The link type, which selects the download link automatically (see linkSelector()).
+         *
+         * It can be used with all download calls. The sink based ones also fail over to the next
+         * link, when the transfer fails with a transient error.
+         */
+        static const char* const AUTO_LINK;
 
-        UpdateResult reportComplete(const Deployment& deployment, bool success = true, std::vector<String> details = {});
+        /**
+         * Get the statistics of the hosts, which artifacts were downloaded from.
+         */
+        const LinkSelector& linkSelector() const { return this->_linkSelector; }
+
+        UpdateResult reportProgress(const Deployment& deployment, uint32_t done, uint32_t total, const std::vector<String>& details = {});
+
+        UpdateResult reportComplete(const Deployment& deployment, bool success = true, const std::vector<String>& details = {});
         
-        UpdateResult reportScheduled(const Deployment& deployment, std::vector<String> details = {});
+        UpdateResult reportScheduled(const Deployment& deployment, const std::vector<String>& details = {});
         
-        UpdateResult reportResumed(const Deployment& deployment, std::vector<String> details = {});
+        UpdateResult reportResumed(const Deployment& deployment, const std::vector<String>& details = {});
         
-        UpdateResult reportCancelAccepted(const Stop& stop, std::vector<String> details = {});
+        UpdateResult reportCancelAccepted(const Stop& stop, const std::vector<String>& details = {});
         
-        UpdateResult reportCancelRejected(const Stop& stop, std::vector<String> details = {});
+        UpdateResult reportCancelRejected(const Stop& stop, const std::vector<String>& details = {});
 
-        UpdateResult reportCanceled(const Deployment& deployment, std::vector<String> details = {});
+        UpdateResult reportCanceled(const Deployment& deployment, const std::vector<String>& details = {});
 
         UpdateResult updateRegistration(const Registration& registration, const std::map<String,String>& data, MergeMode mergeMode = REPLACE, std::initializer_list<String> details = {});
 
+        /**
+         * Update the registration, sending only the attributes which changed since the last successful update.
+         *
+         * The client keeps a copy of the attributes it sent last. The first update (after a reboot,
+         * or resetRegistration()) replaces all attributes, later ones only merge the changed
+         * attributes. If an attribute was dropped, all attributes get replaced. A request is made in
+         * any case, as the server keeps asking for the registration until it gets one. If nothing
+         * changed, a single attribute is merged.
+         */
+        UpdateResult syncRegistration(const Registration& registration, const std::map<String,String>& data, std::initializer_list<String> details = {});
+
+        /**
+         * Forget the attributes sent last, so that the next syncRegistration() sends all of them.
+         */
+        void resetRegistration() { this->_registered.clear(); }
+
+        /**
+         * Enable or disable parsing responses directly from the HTTP stream.
+         *
+         * When enabled (the default), the response is deserialized while it is being received,
+         * instead of copying the full payload into a String first. This uses HTTP/1.0
+         * for requests, so that the server cannot use chunked transfer encoding. With keep-alive enabled,
+         * HTTP/1.1 is used instead, and chunked responses fall back to the buffered path.
+         *
+         * HTTP/1.0 applies to all requests of the client, not only to the polls: downloads and
+         * feedback close the connection as well. That costs nothing extra without keep-alive, as
+         * each request opens a connection of its own then. It also lets downloads read the body
+         * right from the stream: an artifact without a length (e.g. gzip encoded on the fly) ends
+         * with its data, or with the connection. Enable keep-alive to save the handshakes instead,
+         * the server then has to send the length of the artifacts.
+         * @param streaming bool
+         */
+        void streaming(bool streaming)
+        {
+            this->_streaming = streaming;
+            this->_http.useHTTP10(streaming && !this->_keepAlive);
+        }
+
+        /**
+         * Queue feedback, which could not be sent, and send it once the server is reachable again.
+         *
+         * Feedback supersedes the pending, non-final feedback of the same action (e.g. only the
+         * latest progress is kept), and the queue is bounded to the capacity. If a storage is
+         * provided, the pending feedback is persisted, and restored when calling this method.
+         * Pending feedback is sent with each report, and after each successful poll.
+         * @param capacity the maximum number of pending feedback entries
+         * @param storage the storage to persist to, may be null
+         */
+        void queueFeedback(size_t capacity = 8, HawkbitStorage* storage = nullptr);
+
+        /**
+         * Persist the last fetched deployment, so that it needs not be fetched again after a reboot.
+         *
+         * The deployment is only kept in memory otherwise. In both cases, it is only re-used while
+         * the server references it with the same content hash. A deployment which is too large for
+         * the storage is not persisted, and the persisted one is removed once the final feedback of
+         * an action is submitted.
+         * @param storage the storage to persist to, may be null
+         */
+        void persistDeployments(HawkbitStorage* storage) { this->_deploymentStorage = storage; }
+
+        /**
+         * Get the number of pending feedback entries.
+         */
+        size_t pendingFeedback() const { return this->_feedback ? this->_feedback->size() : 0; }
+
+        /**
+         * Try to send all pending feedback, returns the result of the first failed attempt, or of
+         * the last one if all succeeded.
+         *
+         * The report methods (e.g. reportComplete()) flush the pending feedback as well, but return
+         * the result of their own feedback only.
+         */
+        UpdateResult flushFeedback();
+
+        /**
+         * Get the number of pending feedback entries, which the server rejected (with a 4xx status)
+         * when they were finally sent, and which were dropped.
+         */
+        uint32_t rejectedFeedback() const { return this->_rejectedFeedback; }
+
+        /**
+         * Set a secondary connection, used for reporting progress while a download is in progress.
+         *
+         * This must be a different client instance than the one used for the main connection. The
+         * reports are sent by a background task, so that a slow request (e.g. a TLS handshake) does
+         * not hold up the download. If a report is still being sent, the next ones replace each
+         * other, so that only the latest one is sent. Other feedback is not sent during a download.
+         * Note that a secondary TLS connection requires about 40 KiB of heap.
+         * @param client WiFiClient&
+         */
+        void progressClient(WiFiClient& client);
+
+        /**
+         * Enable or disable keeping the connection to the server open between requests.
+         *
+         * When enabled, consecutive requests to the same host (e.g. poll, fetch deployment, feedback)
+         * share a single connection, saving a TLS handshake for each of them. If the server closed
+         * the connection in the meantime, the request is transparently re-tried on a new one.
+         * @param keepAlive bool
+         */
+        void keepAlive(bool keepAlive);
+
+        /**
+         * Get the number of connections (and so TLS handshakes) which had been opened. These are only
+         * counted with keep-alive, or a cache of TLS sessions (see tlsSessions()), otherwise the
+         * HTTPClient opens the connections itself.
+         */
+        uint32_t handshakes() const { return this->_handshakeStats.full() + this->_handshakeStats.resumed(); }
+
+        /**
+         * Get the number of requests which re-used an existing connection, saving a handshake.
+         */
+        uint32_t handshakesSaved() const { return this->_handshakeStats.reused(); }
+
+        /**
+         * Get the statistics of the requests made by this client.
+         */
+        const RequestStats& stats() const { return this->_stats; }
+
+        /**
+         * Clear the request statistics, e.g. to start a new measurement period.
+         */
+        void resetStats() { this->_stats.reset(); }
+
         /**
          * Set the timeout (in milliseconds) for establishing a connection to the server.
          * @param connectTimeout int32_t
          */
         void connectTimeout(int32_t connectTimeout)
         {
+            this->_connectTimeout = connectTimeout;
             this->_http.setConnectTimeout(connectTimeout);
         }
 
@@ -376,26 +1162,221 @@ class HawkbitClient {
          */
         void timeout(uint16_t timeout)
         {
+            this->_timeout = timeout;
             this->_http.setTimeout(timeout);
         }
 
+        /**
+         * Set the parameters of heatshrink compressed artifacts (".hs"), which must match the ones
+         * used for compressing them (<code>heatshrink -w &lt;window&gt; -l &lt;lookahead&gt;</code>).
+         * @param window the window size, in bits (default 8)
+         * @param lookahead the lookahead size, in bits (default 4)
+         */
+        void heatshrink(uint8_t window, uint8_t lookahead)
+        {
+            this->_heatshrinkWindow = window;
+            this->_heatshrinkLookahead = lookahead;
+        }
+
+        /**
+         * Resume TLS sessions from the cache, when connecting to the server or an artifact host.
+         * @param cache the session cache, may be null
+         */
+        void tlsSessions(TlsSessionCache* cache) { this->_tlsSessions = cache; }
+
+        /**
+         * Get the number and latency of the TLS handshakes, full and resumed, and the number of
+         * requests which saved a handshake.
+         */
+        const HandshakeStats& handshakeStats() const { return this->_handshakeStats; }
+
     private:
         JsonDocument& _doc;
         WiFiClient& _wifi;
     
         HTTPClient _http;
 
-        String _baseUrl;
-        String _tenantName;
-        String _controllerId;
+        // the URL of the controller base resource, all other resources are below it
+        String _controllerUrl;
         String _authToken;
 
-        Deployment readDeployment(const String& href);
-        Stop readCancel(const String& href);
+        bool _streaming;
+        bool _keepAlive;
+
+        String _connection;
+        bool _reused;
+        RequestStats _stats;
+        HandshakeStats _handshakeStats;
+        TlsSessionCache* _tlsSessions;
+        uint16_t _timeout;
+        // a negative value uses the default of the client
+        int32_t _connectTimeout;
+        LinkSelector _linkSelector;
+        uint8_t _heatshrinkWindow;
+        uint8_t _heatshrinkLookahead;
+
+        WiFiClient* _progressWifi;
+        HTTPClient _progressHttp;
+        ProgressReporter* _progress;
+        bool _downloading;
+        std::unique_ptr<Download> _download;
+
+        // the state of the last interrupted download, see finishDownload()
+        struct {
+            String artifact;
+            uint32_t offset;
+            std::unique_ptr<HashVerifier> verifier;
+        } _resume;
+
+        // the latest progress report, waiting for the background task
+        std::mutex _progressLock;
+        std::unique_ptr<Feedback> _progressPending;
+        std::condition_variable _progressWake;
+        bool _progressStop;
+        std::atomic<bool> _progressRunning;
+#if defined(ESP32)
+        // given by the task when it is done, the task cannot be joined
+        SemaphoreHandle_t _progressDone;
+#else
+        std::thread _progressThread;
+#endif
+
+        void startProgress();
+        void stopProgress();
+        void sendProgress();
+        static void progressTask(void* client);
+
+        /**
+         * Prepare a request, connecting to the host of the URL, unless the connection is re-used.
+         * @return false if connecting failed, the request must not be sent then
+         */
+        bool begin(const String& url);
+        bool connect(const String& connection);
+        void disconnect();
+
+        /**
+         * The validators of a previously received response, for making conditional requests.
+         */
+        struct Validator {
+            String etag;
+            String lastModified;
+        };
+
+        Validator _stateValidator;
+        State _state;
+
+        Validator _deploymentValidator;
+        String _deploymentHref;
+        Deployment _deployment;
+        HawkbitStorage* _deploymentStorage;
+
+        // the attributes sent last, see syncRegistration()
+        std::map<String,String> _registered;
+
+        static const char* const DEPLOYMENT_KEY;
+        // NVS stores strings of up to 4000 bytes
+        static const size_t MAX_PERSISTED_DEPLOYMENT = 4000;
 
+        void persistDeployment(const String& href);
+        bool restoreDeployment(const String& href, Deployment& result);
+
+        void addConditionalHeaders(const Validator& validator);
+        Validator readValidator();
+
+        template<typename Request>
+        int execute(RequestStats::Kind kind, const String& url, Request request)
+        {
+            unsigned long start = millis();
+            int code = begin(url) ? request() : HTTPC_ERROR_CONNECTION_REFUSED;
+            if (code < 0 && this->_reused) {
+                // the server closed the persistent connection, try once more with a new one
+                log_d("Connection lost (%d), reconnecting", code);
+                _http.end();
+                this->disconnect();
+                code = begin(url) ? request() : HTTPC_ERROR_CONNECTION_REFUSED;
+            }
+            this->_stats.record(kind, code, millis() - start);
+            return code;
+        }
+
+        int requestDownload(const String& url, uint32_t& offset, uint32_t size);
+
+        DeserializationError readJson(const JsonDocument& filter);
+        void logPayload();
+
+        HawkbitError readDeployment(const String& href, Deployment& deployment);
+        HawkbitError readCancel(const String& href, Stop& stop);
+
+        /**
+         * Classify a failed transfer: rejected by the sink, broken data, or an incomplete download.
+         */
+        static HawkbitError transferError(Download& d, bool rejected);
+
+        /**
+         * Flush and commit the sink, or abort it if the download failed. After a transient error, a
+         * resumable download suspends the sink instead, if the sink supports that.
+         */
+        static HawkbitError completeSink(DownloadSink& sink, HawkbitError error, bool resumable);
+
+        /**
+         * Download into the sink, re-trying with the next link on transient errors if automatic.
+         */
+        HawkbitError failover(const Artifact& artifact, const String& linkType, DownloadSink& sink, DownloadPipeline* pipeline);
+
+        /**
+         * Download into the sink once, through the pipeline if there is one.
+         */
+        HawkbitError transferTo(const Artifact& artifact, const String& linkType, DownloadSink& sink, DownloadPipeline* pipeline);
+
+        /**
+         * Read the download through the pipeline, see downloadPipelined().
+         */
+        template<typename Sink>
+        static HawkbitError pipelined(const Artifact& artifact, Download& d, DownloadPipeline& pipeline, Sink& sink)
+        {
+            bool rejected = false;
+            auto guarded = [&sink, &rejected](const uint8_t* data, size_t len) -> bool {
+                rejected = !sink(data, len);
+                return !rejected;
+            };
+            // the length of decompressed data is unknown
+            uint32_t length = artifact.size() > d.offset() && !d.compressed() ? artifact.size() - d.offset() : 0;
+            if (!pipeline.run(d.decompressed(), length, guarded)) {
+                return transferError(d, rejected);
+            }
+            // without a length, a broken connection looks like the end of the stream
+            if (d.failed() || !d.received()) {
+                return transferError(d, false);
+            }
+            if (!d.verify()) {
+                return HawkbitError(HawkbitError::INTEGRITY);
+            }
+            return HawkbitError();
+        }
+
+        String resourceUrl(const char* resource, const char* id, const char* suffix) const;
         String feedbackUrl(const Deployment& deployment) const;
         String feedbackUrl(const Stop& stop) const;
 
+        std::unique_ptr<FeedbackQueue> _feedback;
+        uint32_t _rejectedFeedback;
+
+        // the position of no feedback, see flushFeedback(size_t)
+        static const size_t NO_FEEDBACK = (size_t)-1;
+
+        UpdateResult submit(const Feedback& feedback);
+        UpdateResult post(const Feedback& feedback);
+
+        /**
+         * Send the pending feedback in order, until an attempt fails transiently.
+         * @param own the position of the entry, whose result is returned, or NO_FEEDBACK for the
+         * result of the first failed attempt, or of the last one if all succeeded
+         */
+        UpdateResult flushFeedback(size_t own);
+        void flushPendingFeedback();
+
         template<typename IdProvider>
-        UpdateResult sendFeedback(IdProvider id, const String& execution, const String& finished, std::vector<String> details );
+        UpdateResult sendFeedback(IdProvider id, const String& execution, const String& finished, const std::vector<String>& details, uint32_t done = 0, uint32_t total = 0);
+
+    friend ProgressReporter;
 };
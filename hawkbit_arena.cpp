@@ -0,0 +1,111 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+bool keyLess(const KeyValue& entry, const char* key)
+{
+    return strcmp(entry.first.c_str(), key) < 0;
+}
+
+bool entryLess(const KeyValue& a, const KeyValue& b)
+{
+    return strcmp(a.first.c_str(), b.first.c_str()) < 0;
+}
+
+}
+
+FlatMap::const_iterator FlatMap::find(const char* key) const
+{
+    const_iterator i = std::lower_bound(begin(), end(), key, keyLess);
+    if (i != end() && i->first == key) {
+        return i;
+    }
+    return end();
+}
+
+void FlatMap::sort(KeyValue* begin, KeyValue* end)
+{
+    std::sort(begin, end, entryLess);
+}
+
+Arena::Arena(size_t capacity) :
+    _block(static_cast<Block*>(malloc(sizeof(Block) + capacity)))
+{
+    if (this->_block != nullptr) {
+        this->_block->refs = 1;
+        this->_block->capacity = capacity;
+        this->_block->used = 0;
+    }
+}
+
+Arena::Arena(const Arena& other) :
+    _block(other._block)
+{
+    if (this->_block != nullptr) {
+        this->_block->refs++;
+    }
+}
+
+Arena& Arena::operator=(const Arena& other)
+{
+    if (other._block != nullptr) {
+        other._block->refs++;
+    }
+    this->release();
+    this->_block = other._block;
+    return *this;
+}
+
+Arena::~Arena()
+{
+    this->release();
+}
+
+void Arena::release()
+{
+    if (this->_block != nullptr && --this->_block->refs == 0) {
+        free(this->_block);
+    }
+    this->_block = nullptr;
+}
+
+void* Arena::allocate(size_t size)
+{
+    if (this->_block == nullptr || this->_block->capacity - this->_block->used < size) {
+        return nullptr;
+    }
+    // the header is a multiple of the pointer size, as is the size of every record
+    char* result = reinterpret_cast<char*>(this->_block + 1) + this->_block->used;
+    this->_block->used += size;
+    return result;
+}
+
+StringRef Arena::copy(const char* str)
+{
+    if (str == nullptr) {
+        return StringRef();
+    }
+    size_t size = sizeOf(str);
+    char* result = static_cast<char*>(this->allocate(size));
+    if (result == nullptr) {
+        return StringRef();
+    }
+    memcpy(result, str, size);
+    return StringRef(result);
+}
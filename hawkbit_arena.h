@@ -0,0 +1,190 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <cstring>
+#include <utility>
+#include <WString.h>
+
+/**
+ * A reference to a null terminated string, owned by someone else (e.g. an arena).
+ */
+class StringRef {
+    public:
+        StringRef() :
+            _str("")
+        {
+        }
+
+        explicit StringRef(const char* str) :
+            _str(str != nullptr ? str : "")
+        {
+        }
+
+        const char* c_str() const { return this->_str; }
+        size_t length() const { return strlen(this->_str); }
+        bool isEmpty() const { return this->_str[0] == 0; }
+
+        operator String() const { return String(this->_str); }
+
+        bool operator==(const char* other) const { return strcmp(this->_str, other) == 0; }
+        bool operator==(const String& other) const { return strcmp(this->_str, other.c_str()) == 0; }
+        bool operator!=(const char* other) const { return !(*this == other); }
+        bool operator!=(const String& other) const { return !(*this == other); }
+
+    private:
+        const char* _str;
+};
+
+/**
+ * A read-only view of an array, owned by someone else (e.g. an arena).
+ */
+template<typename T>
+class ArrayView {
+    public:
+        typedef const T* const_iterator;
+
+        ArrayView() :
+            _data(nullptr),
+            _size(0)
+        {
+        }
+
+        ArrayView(const T* data, size_t size) :
+            _data(data),
+            _size(size)
+        {
+        }
+
+        const_iterator begin() const { return this->_data; }
+        const_iterator end() const { return this->_data + this->_size; }
+        size_t size() const { return this->_size; }
+        bool empty() const { return this->_size == 0; }
+        const T& front() const { return this->_data[0]; }
+        const T& back() const { return this->_data[this->_size - 1]; }
+        const T& operator[](size_t index) const { return this->_data[index]; }
+
+    private:
+        const T* _data;
+        size_t _size;
+};
+
+struct KeyValue {
+    KeyValue(StringRef key, StringRef value) :
+        first(key),
+        second(value)
+    {
+    }
+
+    StringRef first;
+    StringRef second;
+};
+
+/**
+ * A read-only map, stored as an array of entries, sorted by key.
+ */
+class FlatMap : public ArrayView<KeyValue> {
+    public:
+        FlatMap()
+        {
+        }
+
+        FlatMap(const KeyValue* data, size_t size) :
+            ArrayView<KeyValue>(data, size)
+        {
+        }
+
+        /**
+         * Find the entry of a key, returns end() if there is none.
+         */
+        const_iterator find(const char* key) const;
+        const_iterator find(const String& key) const { return find(key.c_str()); }
+
+        /**
+         * Sort the entries of a range by key, so that it can be used as a map.
+         */
+        static void sort(KeyValue* begin, KeyValue* end);
+};
+
+/**
+ * A reference counted block of memory, which holds records and strings of a fixed overall size.
+ *
+ * Everything is allocated from one heap block, which is released when the last copy of the arena
+ * is destroyed. No destructors are run, so only trivially destructible types can be stored.
+ */
+class Arena {
+    public:
+        Arena() :
+            _block(nullptr)
+        {
+        }
+
+        /**
+         * Allocate an arena. If the allocation fails, the arena is not valid.
+         */
+        explicit Arena(size_t capacity);
+
+        Arena(const Arena& other);
+        Arena& operator=(const Arena& other);
+
+        Arena(Arena&& other) :
+            _block(other._block)
+        {
+            other._block = nullptr;
+        }
+
+        Arena& operator=(Arena&& other)
+        {
+            std::swap(this->_block, other._block);
+            return *this;
+        }
+
+        ~Arena();
+
+        bool valid() const { return this->_block != nullptr; }
+        size_t capacity() const { return this->_block != nullptr ? this->_block->capacity : 0; }
+        size_t used() const { return this->_block != nullptr ? this->_block->used : 0; }
+
+        /**
+         * Allocate memory for count records. Records must be allocated before any strings, in
+         * order to stay aligned. Returns null if the arena is exhausted.
+         */
+        template<typename T>
+        T* allocate(size_t count)
+        {
+            return static_cast<T*>(this->allocate(count * sizeof(T)));
+        }
+
+        /**
+         * Copy a string into the arena, a null string occupies no space.
+         */
+        StringRef copy(const char* str);
+
+        /**
+         * Get the number of bytes, copy() requires for a string.
+         */
+        static size_t sizeOf(const char* str) { return str != nullptr ? strlen(str) + 1 : 0; }
+
+    private:
+        struct Block {
+            size_t refs;
+            size_t capacity;
+            size_t used;
+        };
+
+        Block* _block;
+
+        void* allocate(size_t size);
+        void release();
+};
@@ -0,0 +1,344 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_compress.h"
+
+Compression compressionOf(const String& filename)
+{
+    if (filename.endsWith(".gz")) {
+        return Compression::GZIP;
+    } else if (filename.endsWith(".hs")) {
+        return Compression::HEATSHRINK;
+    }
+    return Compression::NONE;
+}
+
+Decompressor* createDecompressor(Compression compression, uint8_t window, uint8_t lookahead)
+{
+    switch (compression) {
+        case Compression::HEATSHRINK:
+            return new HeatshrinkDecompressor(window, lookahead);
+#if defined(HAWKBIT_GZIP)
+        case Compression::GZIP:
+            return new GzipDecompressor();
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    // processes a nibble at a time, so the table stays small
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ data[i]) & 0x0f];
+        crc = (crc >> 4) ^ table[(crc ^ (data[i] >> 4)) & 0x0f];
+    }
+    return ~crc;
+}
+
+size_t CompressedInput::peek(const uint8_t*& data)
+{
+    if (this->_pos >= this->_len) {
+        size_t len = sizeof(this->_buffer);
+        if (this->_limited && this->_remaining < len) {
+            len = this->_remaining;
+        }
+        // don't wait for more than what arrived, if the source knows
+        int available = this->_source.available();
+        if (available > 0 && (size_t)available < len) {
+            len = available;
+        }
+        this->_pos = 0;
+        this->_len = len > 0 ? this->_source.readBytes(this->_buffer, len) : 0;
+        this->_remaining -= this->_limited ? this->_len : 0;
+    }
+    data = this->_buffer + this->_pos;
+    return this->_len - this->_pos;
+}
+
+HeatshrinkDecompressor::HeatshrinkDecompressor(uint8_t window, uint8_t lookahead) :
+    _windowBits(window),
+    _lookaheadBits(lookahead),
+    _window(nullptr),
+    _mask((1 << window) - 1),
+    _head(0),
+    _offset(0),
+    _count(0),
+    _current(0),
+    _bit(0)
+{
+    if (window < 4 || window > 15 || lookahead < 3 || lookahead >= window) {
+        log_w("Invalid heatshrink parameters - window: %u, lookahead: %u", window, lookahead);
+        return;
+    }
+    this->_window = (uint8_t*)calloc(1, 1 << window);
+    if (this->_window == nullptr) {
+        log_e("Failed to allocate window of %u bytes", 1 << window);
+    }
+}
+
+HeatshrinkDecompressor::~HeatshrinkDecompressor()
+{
+    free(this->_window);
+}
+
+int HeatshrinkDecompressor::readBits(CompressedInput& in, uint8_t count)
+{
+    int result = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (this->_bit == 0) {
+            int c = in.next();
+            if (c < 0) {
+                return -1;
+            }
+            this->_current = c;
+            this->_bit = 0x80;
+        }
+        result = (result << 1) | ((this->_current & this->_bit) ? 1 : 0);
+        this->_bit >>= 1;
+    }
+    return result;
+}
+
+size_t HeatshrinkDecompressor::read(CompressedInput& in, uint8_t* buffer, size_t len)
+{
+    if (this->_window == nullptr) {
+        return 0;
+    }
+
+    size_t produced = 0;
+
+    while (produced < len) {
+        uint8_t c;
+
+        if (this->_count > 0) {
+            // copy from a back-reference
+            c = this->_window[(this->_head - this->_offset) & this->_mask];
+            this->_count--;
+        } else {
+            int tag = readBits(in, 1);
+            if (tag < 0) {
+                break;
+            }
+            if (tag == 0) {
+                int index = readBits(in, this->_windowBits);
+                int count = index < 0 ? -1 : readBits(in, this->_lookaheadBits);
+                if (count < 0) {
+                    // the remaining bits are padding
+                    break;
+                }
+                this->_offset = index + 1;
+                this->_count = count + 1;
+                continue;
+            }
+            int literal = readBits(in, 8);
+            if (literal < 0) {
+                break;
+            }
+            c = literal;
+        }
+
+        this->_window[this->_head & this->_mask] = c;
+        this->_head++;
+        buffer[produced++] = c;
+    }
+
+    return produced;
+}
+
+#if defined(HAWKBIT_GZIP)
+
+GzipDecompressor::GzipDecompressor() :
+    _inflator(new tinfl_decompressor),
+    _dict((uint8_t*)malloc(TINFL_LZ_DICT_SIZE)),
+    _dictOffset(0),
+    _pendingOffset(0),
+    _pending(0),
+    _crc(0),
+    _size(0),
+    _header(false),
+    _done(false),
+    _failed(false)
+{
+    if (this->_dict == nullptr) {
+        log_e("Failed to allocate window of %u bytes", TINFL_LZ_DICT_SIZE);
+        this->_failed = true;
+        this->_done = true;
+    }
+    tinfl_init(this->_inflator);
+}
+
+GzipDecompressor::~GzipDecompressor()
+{
+    delete this->_inflator;
+    free(this->_dict);
+}
+
+static bool skipString(CompressedInput& in)
+{
+    int c;
+    while ((c = in.next()) > 0) {
+    }
+    return c == 0;
+}
+
+bool GzipDecompressor::readHeader(CompressedInput& in)
+{
+    uint8_t header[10];
+    for (size_t i = 0; i < sizeof(header); i++) {
+        int c = in.next();
+        if (c < 0) {
+            return false;
+        }
+        header[i] = c;
+    }
+
+    if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) {
+        log_w("Invalid gzip header");
+        return false;
+    }
+
+    uint8_t flags = header[3];
+
+    if (flags & 0x04) {
+        // FEXTRA
+        int lsb = in.next();
+        int msb = in.next();
+        if (lsb < 0 || msb < 0) {
+            return false;
+        }
+        for (int i = (msb << 8) | lsb; i > 0; i--) {
+            if (in.next() < 0) {
+                return false;
+            }
+        }
+    }
+    if ((flags & 0x08) && !skipString(in)) {
+        // FNAME
+        return false;
+    }
+    if ((flags & 0x10) && !skipString(in)) {
+        // FCOMMENT
+        return false;
+    }
+    if ((flags & 0x02) && (in.next() < 0 || in.next() < 0)) {
+        // FHCRC
+        return false;
+    }
+
+    return true;
+}
+
+static bool readUint32(CompressedInput& in, uint32_t& value)
+{
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = in.next();
+        if (c < 0) {
+            return false;
+        }
+        value |= (uint32_t)c << (i * 8);
+    }
+    return true;
+}
+
+bool GzipDecompressor::readTrailer(CompressedInput& in)
+{
+    uint32_t crc, size;
+    if (!readUint32(in, crc) || !readUint32(in, size)) {
+        log_w("Missing gzip trailer");
+        return false;
+    }
+    if (crc != this->_crc || size != this->_size) {
+        log_w("Invalid gzip trailer - crc: %08x, size: %u, actual crc: %08x, size: %u", crc, size, this->_crc, this->_size);
+        return false;
+    }
+
+    // read up to the end, so that all input passes through the stream (e.g. for computing its hashes).
+    // Without a length, the end is where the data ends, so only what arrived is read, instead of
+    // waiting for the source to time out.
+    const uint8_t* data;
+    size_t len;
+    while ((in.limited() || in.arrived()) && (len = in.peek(data)) > 0) {
+        in.consume(len);
+    }
+
+    return true;
+}
+
+size_t GzipDecompressor::read(CompressedInput& in, uint8_t* buffer, size_t len)
+{
+    if (!this->_header) {
+        this->_header = true;
+        if (!readHeader(in)) {
+            this->_failed = true;
+            this->_done = true;
+        }
+    }
+
+    size_t produced = 0;
+
+    while (produced < len) {
+        if (this->_pending > 0) {
+            size_t n = this->_pending < len - produced ? this->_pending : len - produced;
+            memcpy(buffer + produced, this->_dict + this->_pendingOffset, n);
+            this->_pendingOffset += n;
+            this->_pending -= n;
+            produced += n;
+            continue;
+        }
+
+        if (this->_done) {
+            break;
+        }
+
+        const uint8_t* data;
+        size_t available = in.peek(data);
+        size_t inBytes = available;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - this->_dictOffset;
+
+        tinfl_status status = tinfl_decompress(
+            this->_inflator,
+            data, &inBytes,
+            this->_dict, this->_dict + this->_dictOffset, &outBytes,
+            available > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+
+        in.consume(inBytes);
+
+        this->_pendingOffset = this->_dictOffset;
+        this->_pending = outBytes;
+        this->_dictOffset = (this->_dictOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+        this->_crc = crc32Update(this->_crc, this->_dict + this->_pendingOffset, outBytes);
+        this->_size += outBytes;
+
+        if (status == TINFL_STATUS_DONE) {
+            this->_done = true;
+            this->_failed = !readTrailer(in);
+        } else if (status < 0 || (status == TINFL_STATUS_NEEDS_MORE_INPUT && available == 0)) {
+            log_w("Failed to inflate: %d", status);
+            this->_failed = true;
+            this->_done = true;
+        }
+    }
+
+    return produced;
+}
+
+#endif
@@ -0,0 +1,264 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "hawkbit_log.h"
+
+// gzip is decoded by the inflater in the ESP32 ROM (the host build provides one on top of zlib)
+#if defined(__has_include)
+#if __has_include(<esp32/rom/miniz.h>)
+#include <esp32/rom/miniz.h>
+#define HAWKBIT_GZIP 1
+#elif __has_include(<rom/miniz.h>)
+#include <rom/miniz.h>
+#define HAWKBIT_GZIP 1
+#endif
+#endif
+
+enum class Compression { NONE, GZIP, HEATSHRINK };
+
+/**
+ * Detect the compression of an artifact by its file name (".gz" or ".hs").
+ */
+Compression compressionOf(const String& filename);
+
+/**
+ * Buffered, length limited input of compressed data.
+ */
+class CompressedInput {
+    public:
+        /**
+         * @param length the number of bytes to read from the source, or zero to read until the stream ends
+         */
+        CompressedInput(Stream& source, uint32_t length) :
+            _source(source),
+            _remaining(length),
+            _limited(length > 0),
+            _pos(0),
+            _len(0)
+        {
+        }
+
+        /**
+         * Get the buffered input, refilling the buffer if necessary. Returns zero at the end of the input.
+         */
+        size_t peek(const uint8_t*& data);
+
+        void consume(size_t n) { this->_pos += n; }
+
+        /**
+         * Check if the input is limited to a length, otherwise it ends with the source.
+         */
+        bool limited() const { return this->_limited; }
+
+        /**
+         * Check if input can be read without waiting, as it is buffered or arrived at the source.
+         */
+        bool arrived() { return this->_pos < this->_len || this->_source.available() > 0; }
+
+        int next()
+        {
+            const uint8_t* data;
+            if (peek(data) == 0) {
+                return -1;
+            }
+            consume(1);
+            return *data;
+        }
+
+    private:
+        Stream& _source;
+        uint32_t _remaining;
+        bool _limited;
+
+        uint8_t _buffer[64];
+        size_t _pos;
+        size_t _len;
+};
+
+class Decompressor {
+    public:
+        virtual ~Decompressor() {}
+
+        /**
+         * Decompress up to len bytes. Returns the number of bytes produced, zero at the end of the data.
+         */
+        virtual size_t read(CompressedInput& in, uint8_t* buffer, size_t len) = 0;
+
+        virtual bool failed() const = 0;
+
+        /**
+         * Check if the end of the compressed data was reached, for a format which marks its end.
+         */
+        virtual bool finished() const { return false; }
+};
+
+/**
+ * Decoder for heatshrink (LZSS) compressed data.
+ *
+ * Only needs a window of 2^window bytes. The parameters must match the ones used for compression
+ * (<code>heatshrink -w &lt;window&gt; -l &lt;lookahead&gt;</code>). The window must be 4 to 15
+ * bits, the lookahead 3 bits up to one less than the window, otherwise the decoder fails.
+ */
+class HeatshrinkDecompressor : public Decompressor {
+    public:
+        static const uint8_t DEFAULT_WINDOW = 8;
+        static const uint8_t DEFAULT_LOOKAHEAD = 4;
+
+        HeatshrinkDecompressor(uint8_t window = DEFAULT_WINDOW, uint8_t lookahead = DEFAULT_LOOKAHEAD);
+        ~HeatshrinkDecompressor();
+
+        size_t read(CompressedInput& in, uint8_t* buffer, size_t len) override;
+        bool failed() const override { return this->_window == nullptr; }
+
+    private:
+        uint8_t _windowBits;
+        uint8_t _lookaheadBits;
+        uint8_t* _window;
+        uint16_t _mask;
+        uint16_t _head;
+
+        uint16_t _offset;
+        uint16_t _count;
+
+        uint8_t _current;
+        uint8_t _bit;
+
+        int readBits(CompressedInput& in, uint8_t count);
+};
+
+#if defined(HAWKBIT_GZIP)
+
+/**
+ * Decoder for gzip compressed data.
+ *
+ * Deflate may reference the previous 32 KiB of output, so this always requires a 32 KiB window.
+ * The CRC-32 and size of the trailer are checked, and the input is read up to its end, so that
+ * all of it passes through the stream the input is read from.
+ */
+class GzipDecompressor : public Decompressor {
+    public:
+        GzipDecompressor();
+        ~GzipDecompressor();
+
+        size_t read(CompressedInput& in, uint8_t* buffer, size_t len) override;
+        bool failed() const override { return this->_failed; }
+        bool finished() const override { return this->_done; }
+
+    private:
+        tinfl_decompressor* _inflator;
+        uint8_t* _dict;
+        size_t _dictOffset;
+        size_t _pendingOffset;
+        size_t _pending;
+        uint32_t _crc;
+        uint32_t _size;
+        bool _header;
+        bool _done;
+        bool _failed;
+
+        bool readHeader(CompressedInput& in);
+        bool readTrailer(CompressedInput& in);
+};
+
+#endif
+
+/**
+ * A stream, decompressing the data read from another stream.
+ */
+class DecompressingStream : public Stream {
+    public:
+        /**
+         * @param length the number of compressed bytes, or zero to read until the stream ends
+         * @param decompressor the decompressor, the stream takes ownership. If null, the stream fails.
+         */
+        DecompressingStream(Stream& source, uint32_t length, Decompressor* decompressor) :
+            _input(source, length),
+            _decompressor(decompressor),
+            _peeked(-1)
+        {
+        }
+
+        ~DecompressingStream()
+        {
+            delete this->_decompressor;
+        }
+
+        DecompressingStream(const DecompressingStream&) = delete;
+        DecompressingStream& operator=(const DecompressingStream&) = delete;
+
+        bool failed() const { return this->_decompressor == nullptr || this->_decompressor->failed(); }
+
+        /**
+         * Check if all compressed data was read, see Decompressor::finished().
+         */
+        bool finished() const { return this->_decompressor != nullptr && this->_decompressor->finished(); }
+
+        int available() override { return this->_peeked >= 0 ? 1 : 0; }
+        void flush() override {}
+        size_t write(uint8_t) override { return 0; }
+
+        int peek() override
+        {
+            if (this->_peeked < 0) {
+                this->_peeked = read();
+            }
+            return this->_peeked;
+        }
+
+        int read() override
+        {
+            uint8_t c;
+            return readBytes(&c, 1) == 1 ? c : -1;
+        }
+
+        using Stream::readBytes;
+
+        size_t readBytes(char* buffer, size_t length) override
+        {
+            if (length == 0) {
+                return 0;
+            }
+            size_t len = 0;
+            if (this->_peeked >= 0) {
+                buffer[len++] = this->_peeked;
+                this->_peeked = -1;
+            }
+            if (this->_decompressor != nullptr) {
+                len += this->_decompressor->read(this->_input, (uint8_t*)buffer + len, length - len);
+            }
+            return len;
+        }
+
+    private:
+        CompressedInput _input;
+        Decompressor* _decompressor;
+        int _peeked;
+};
+
+/**
+ * Create a decompressor for the compression, or null if the compression is not supported.
+ * @param window the window size (in bits) of heatshrink compressed data
+ * @param lookahead the lookahead size (in bits) of heatshrink compressed data
+ */
+Decompressor* createDecompressor(Compression compression,
+    uint8_t window = HeatshrinkDecompressor::DEFAULT_WINDOW,
+    uint8_t lookahead = HeatshrinkDecompressor::DEFAULT_LOOKAHEAD);
+
+/**
+ * Update a CRC-32 (as used by gzip) with the data, starting with zero.
+ */
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len);
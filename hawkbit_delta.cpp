@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_delta.h"
+
+static bool readUint32(Stream& stream, uint32_t& value)
+{
+    uint8_t b[4];
+    if (stream.readBytes(b, 4) != 4) {
+        return false;
+    }
+    value = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    return true;
+}
+
+static void toHex(const uint8_t* hash, size_t len, char* hex)
+{
+    for (size_t i = 0; i < len; i++) {
+        sprintf(hex + i * 2, "%02x", hash[i]);
+    }
+}
+
+DeltaPatcher::DeltaPatcher() :
+    _sourceSize(0),
+    _sourceHash(),
+    _sourceVerified(false),
+    _targetSize(0),
+    _written(0),
+    _copied(0),
+    _inserted(0)
+{
+}
+
+bool DeltaPatcher::readHeader(Stream& patch, DeltaSource& source, HashVerifier& verifier)
+{
+    uint8_t magic[4];
+    if (patch.readBytes(magic, 4) != 4 || memcmp(magic, "HBD2", 4) != 0) {
+        log_w("Invalid delta header");
+        return false;
+    }
+
+    if (!readUint32(patch, this->_sourceSize) || !readUint32(patch, this->_targetSize)) {
+        log_w("Invalid delta header");
+        return false;
+    }
+
+    if (this->_sourceSize > source.size()) {
+        log_w("Delta requires a source of %u bytes, but only %u are available", this->_sourceSize, source.size());
+        return false;
+    }
+
+    uint8_t hash[32];
+    if (patch.readBytes(this->_sourceHash, sizeof(this->_sourceHash)) != sizeof(this->_sourceHash)
+        || patch.readBytes(hash, sizeof(hash)) != sizeof(hash)) {
+        log_w("Invalid delta header");
+        return false;
+    }
+
+    char hex[sizeof(hash) * 2 + 1];
+    toHex(hash, sizeof(hash), hex);
+    verifier.add("sha256", hex);
+
+    log_d("Delta - source: %u, target: %u, sha256: %s", this->_sourceSize, this->_targetSize, hex);
+
+    return true;
+}
+
+bool DeltaPatcher::readRecord(Stream& patch, uint8_t& op, uint32_t& offset, uint32_t& length)
+{
+    if (patch.readBytes(&op, 1) != 1) {
+        log_w("Delta ended early");
+        return false;
+    }
+
+    switch (op) {
+        case END:
+            return true;
+        case COPY:
+            if (!readUint32(patch, offset) || !readUint32(patch, length)) {
+                log_w("Delta ended early");
+                return false;
+            }
+            if (offset > this->_sourceSize || length > this->_sourceSize - offset) {
+                log_w("Delta copies outside of source: %u+%u", offset, length);
+                return false;
+            }
+            return true;
+        case INSERT:
+            if (!readUint32(patch, length)) {
+                log_w("Delta ended early");
+                return false;
+            }
+            return true;
+        default:
+            log_w("Invalid delta operation: %u", op);
+            return false;
+    }
+}
+
+bool DeltaPatcher::verifySource(DeltaSource& source)
+{
+    char hex[sizeof(this->_sourceHash) * 2 + 1];
+    toHex(this->_sourceHash, sizeof(this->_sourceHash), hex);
+    HashVerifier verifier;
+    verifier.add("sha256", hex);
+
+    for (uint32_t offset = 0; offset < this->_sourceSize;) {
+        size_t len = this->_sourceSize - offset < BUFFER_SIZE ? this->_sourceSize - offset : BUFFER_SIZE;
+        if (!source.read(offset, this->_buffer, len)) {
+            log_w("Failed to read source at %u", offset);
+            return false;
+        }
+        verifier.update(this->_buffer, len);
+        offset += len;
+    }
+
+    if (!verifier.verify()) {
+        log_w("Delta was created for another source image");
+        return false;
+    }
+
+    this->_sourceVerified = true;
+    return true;
+}
@@ -0,0 +1,197 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "hawkbit_log.h"
+
+#include "hawkbit_verify.h"
+
+#if defined(ESP32)
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#endif
+
+/**
+ * The image a delta gets applied to, e.g. the currently running firmware.
+ */
+class DeltaSource {
+    public:
+        virtual ~DeltaSource() {}
+
+        virtual uint32_t size() const = 0;
+        virtual bool read(uint32_t offset, uint8_t* buffer, size_t len) = 0;
+};
+
+#if defined(ESP32)
+
+/**
+ * A delta source, reading from a flash partition. Defaults to the running application.
+ */
+class PartitionSource : public DeltaSource {
+    public:
+        PartitionSource(const esp_partition_t* partition = esp_ota_get_running_partition()) :
+            _partition(partition)
+        {
+        }
+
+        uint32_t size() const override { return this->_partition != nullptr ? this->_partition->size : 0; }
+
+        bool read(uint32_t offset, uint8_t* buffer, size_t len) override
+        {
+            return this->_partition != nullptr && esp_partition_read(this->_partition, offset, buffer, len) == ESP_OK;
+        }
+
+    private:
+        const esp_partition_t* _partition;
+};
+
+#endif
+
+/**
+ * Applies a delta (binary patch) while it is being received, with a fixed amount of memory.
+ *
+ * The patch starts with a header, followed by a sequence of records. All numbers are unsigned,
+ * 32 bit, little endian:
+ *
+ * <pre>
+ * header:  "HBD2" | source size | target size | source SHA-256 (32 bytes) | target SHA-256 (32 bytes)
+ * COPY:    0x01 | source offset | length        copy a range of the source image
+ * INSERT:  0x02 | length | data                 insert literal data from the patch
+ * END:     0x00
+ * </pre>
+ *
+ * The target is produced strictly sequentially, and verified against the target SHA-256 of the
+ * header. Before the first COPY, the source image up to the source size is verified against the
+ * source SHA-256, so that a patch created for another image fails before any data of the source
+ * gets used. Patches are created with <code>tools/hawkbit_delta.py</code>.
+ */
+class DeltaPatcher {
+    public:
+        static const size_t BUFFER_SIZE = 512;
+
+        /**
+         * Check if an artifact is a delta, by its file name ending with ".delta".
+         */
+        static bool isDelta(const String& filename) { return filename.endsWith(".delta"); }
+
+        DeltaPatcher();
+
+        /**
+         * Apply the patch, passing the target image on to the sink.
+         *
+         * The sink gets called with each produced block (<code>bool sink(const uint8_t* data, size_t len)</code>),
+         * and returns false to abort.
+         * @return true if the patch was applied completely, and the target image matches its hash
+         */
+        template<typename Sink>
+        bool apply(Stream& patch, DeltaSource& source, Sink sink)
+        {
+            HashVerifier verifier;
+            if (!readHeader(patch, source, verifier)) {
+                return false;
+            }
+
+            for (;;) {
+                uint8_t op;
+                uint32_t offset = 0, length = 0;
+
+                if (!readRecord(patch, op, offset, length)) {
+                    return false;
+                }
+
+                if (op == END) {
+                    break;
+                }
+
+                if (op == COPY && !this->_sourceVerified && !verifySource(source)) {
+                    return false;
+                }
+
+                if (length > this->_targetSize - this->_written) {
+                    log_w("Delta exceeds target size");
+                    return false;
+                }
+
+                while (length > 0) {
+                    size_t len = length < BUFFER_SIZE ? length : BUFFER_SIZE;
+
+                    if (op == COPY) {
+                        if (!source.read(offset, this->_buffer, len)) {
+                            log_w("Failed to read source at %u", offset);
+                            return false;
+                        }
+                        offset += len;
+                        this->_copied += len;
+                    } else {
+                        if (patch.readBytes(this->_buffer, len) != len) {
+                            log_w("Delta ended early");
+                            return false;
+                        }
+                        this->_inserted += len;
+                    }
+
+                    verifier.update(this->_buffer, len);
+                    if (!sink(this->_buffer, len)) {
+                        log_w("Sink rejected block");
+                        return false;
+                    }
+
+                    this->_written += len;
+                    length -= len;
+                }
+            }
+
+            if (this->_written != this->_targetSize) {
+                log_w("Delta produced %u bytes, expected %u", this->_written, this->_targetSize);
+                return false;
+            }
+
+            return verifier.verify();
+        }
+
+        uint32_t targetSize() const { return this->_targetSize; }
+
+        /**
+         * Get the number of bytes taken from the source image.
+         */
+        uint32_t copied() const { return this->_copied; }
+
+        /**
+         * Get the number of bytes taken from the patch.
+         */
+        uint32_t inserted() const { return this->_inserted; }
+
+    private:
+        enum { END = 0x00, COPY = 0x01, INSERT = 0x02 };
+
+        uint8_t _buffer[BUFFER_SIZE];
+
+        uint32_t _sourceSize;
+        uint8_t _sourceHash[32];
+        bool _sourceVerified;
+        uint32_t _targetSize;
+        uint32_t _written;
+        uint32_t _copied;
+        uint32_t _inserted;
+
+        bool readHeader(Stream& patch, DeltaSource& source, HashVerifier& verifier);
+        bool readRecord(Stream& patch, uint8_t& op, uint32_t& offset, uint32_t& length);
+
+        /**
+         * Verify the source image, up to the source size, against the source hash of the header.
+         */
+        bool verifySource(DeltaSource& source);
+};
@@ -0,0 +1,106 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * The error of an operation: a category, and a code specific to the category.
+ *
+ * The library does not throw, all operations which may fail return an error.
+ */
+class HawkbitError {
+    public:
+        typedef enum {
+            // no error
+            NONE,
+            // the connection failed or broke, the code is the (negative) HTTPClient error
+            TRANSPORT,
+            // an unexpected HTTP status, the code is the status
+            HTTP,
+            // the response could not be parsed, the code is the DeserializationError code
+            JSON,
+            // out of memory, or a buffer (like the JSON document) is too small
+            CAPACITY,
+            // the server response lacks something, e.g. a download link
+            PROTOCOL,
+            // data does not match its hash, or cannot be decompressed or patched
+            INTEGRITY,
+            // a handler or sink of the application failed
+            APPLICATION
+        } Category;
+
+        HawkbitError() :
+            _category(NONE),
+            _code(0)
+        {
+        }
+
+        HawkbitError(Category category, int code = 0) :
+            _category(category),
+            _code(code)
+        {
+        }
+
+        /**
+         * Create the error for the result of an HTTP request, which expected the status.
+         */
+        static HawkbitError http(int code, int expected = 200)
+        {
+            if (code == expected) {
+                return HawkbitError();
+            }
+            return HawkbitError(code <= 0 ? TRANSPORT : HTTP, code);
+        }
+
+        bool ok() const { return this->_category == NONE; }
+        bool failed() const { return this->_category != NONE; }
+
+        Category category() const { return this->_category; }
+        int code() const { return this->_code; }
+
+        /**
+         * Check if the operation might succeed when re-tried later on.
+         */
+        bool transient() const
+        {
+            switch (this->_category) {
+                case TRANSPORT:
+                    return true;
+                case HTTP:
+                    return this->_code >= 500 || this->_code == 408 || this->_code == 429;
+                default:
+                    return false;
+            }
+        }
+
+        const char* categoryName() const
+        {
+            switch (this->_category) {
+                case NONE: return "none";
+                case TRANSPORT: return "transport";
+                case HTTP: return "http";
+                case JSON: return "json";
+                case CAPACITY: return "capacity";
+                case PROTOCOL: return "protocol";
+                case INTEGRITY: return "integrity";
+                case APPLICATION: return "application";
+            }
+            return "unknown";
+        }
+
+    private:
+        Category _category;
+        int _code;
+};
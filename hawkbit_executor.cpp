@@ -0,0 +1,186 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_executor.h"
+
+#include <algorithm>
+
+HawkbitError DeploymentExecutor::execute(const Deployment& deployment)
+{
+    if (this->_deployment != deployment.id()) {
+        // a different deployment, nothing of it has been done yet
+        this->abortStaged();
+        this->_deployment = deployment.id();
+    }
+
+    std::vector<Task> tasks;
+
+    for (const Chunk& chunk : deployment.chunks()) {
+        for (const Artifact& artifact : chunk.artifacts()) {
+            const Route* route = this->route(chunk, artifact);
+            if (route == nullptr) {
+                return this->reject(deployment, String("No sink for artifact: ") + artifact.filename().c_str());
+            }
+            for (const Task& task : tasks) {
+                // a sink holds a single artifact, until all of them are committed
+                if (task.route->sink == route->sink) {
+                    return this->reject(deployment, String("Artifacts share a sink: ") + task.artifact->filename().c_str()
+                        + ", " + artifact.filename().c_str());
+                }
+            }
+            tasks.push_back({ &artifact, route });
+        }
+    }
+
+    std::stable_sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) -> bool {
+        if (a.route->priority != b.route->priority) {
+            return a.route->priority < b.route->priority;
+        }
+        return a.artifact->size() < b.artifact->size();
+    });
+
+    std::vector<String> details;
+    HawkbitError result;
+
+    for (const Task& task : tasks) {
+        const Artifact& artifact = *task.artifact;
+        if (this->findStaged(artifact) != nullptr) {
+            log_d("Artifact verified already: %s", artifact.filename().c_str());
+            continue;
+        }
+
+        log_i("Processing artifact: %s (%u bytes)", artifact.filename().c_str(), artifact.size());
+
+        HawkbitError error = this->transfer(artifact, *task.route->sink);
+
+        if (error.failed()) {
+            log_w("Failed to process artifact %s: %s %d", artifact.filename().c_str(), error.categoryName(), error.code());
+            if (error.transient()) {
+                // keep what has been verified, and re-try later on
+                return error;
+            }
+            details.push_back(String(artifact.filename().c_str()) + ": failed (" + error.categoryName() + ")");
+            result = error;
+            break;
+        }
+
+        this->_staged.push_back({ artifact.key(), task.route->sink });
+    }
+
+    if (result.ok()) {
+        result = this->commit(tasks, details);
+    }
+
+    // the deployment is finished, one way or the other
+    this->abortStaged();
+
+    this->_client.reportComplete(deployment, result.ok(), details);
+
+    return result;
+}
+
+HawkbitError DeploymentExecutor::commit(std::vector<Task> tasks, std::vector<String>& details)
+{
+    // sinks which cannot undo their commit go last, so that all others can still be rolled back
+    std::stable_partition(tasks.begin(), tasks.end(), [](const Task& task) -> bool {
+        return task.route->sink->revertible();
+    });
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+        const Task& task = tasks[i];
+        if (task.route->sink->commit()) {
+            // committed, so it must not be aborted anymore
+            for (auto staged = this->_staged.begin(); staged != this->_staged.end(); ++staged) {
+                if (staged->sink == task.route->sink) {
+                    this->_staged.erase(staged);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        log_w("Failed to commit artifact: %s", task.artifact->filename().c_str());
+
+        // undo the commits so far, latest first, so that the deployment is applied completely or not at all
+        std::vector<String> undone;
+        for (size_t j = i; j > 0; j--) {
+            const Task& committed = tasks[j - 1];
+            bool rolledBack = committed.route->sink->rollback();
+            if (!rolledBack) {
+                log_w("Failed to roll back artifact: %s", committed.artifact->filename().c_str());
+            }
+            undone.push_back(String(committed.artifact->filename().c_str()) + (rolledBack ? ": rolled back" : ": failed to roll back"));
+        }
+        details.insert(details.end(), undone.rbegin(), undone.rend());
+        details.push_back(String(task.artifact->filename().c_str()) + ": failed to commit");
+        for (size_t j = i + 1; j < tasks.size(); j++) {
+            details.push_back(String(tasks[j].artifact->filename().c_str()) + ": skipped");
+        }
+        return HawkbitError(HawkbitError::APPLICATION);
+    }
+
+    for (const Task& task : tasks) {
+        details.push_back(String(task.artifact->filename().c_str()) + ": done");
+    }
+    return HawkbitError();
+}
+
+HawkbitError DeploymentExecutor::reject(const Deployment& deployment, const String& reason)
+{
+    log_w("%s", reason.c_str());
+    this->abortStaged();
+    this->_client.reportComplete(deployment, false, { reason });
+    return HawkbitError(HawkbitError::PROTOCOL);
+}
+
+const DeploymentExecutor::Route* DeploymentExecutor::route(const Chunk& chunk, const Artifact& artifact) const
+{
+    for (const Route& route : this->_routes) {
+        if (route.type == Route::PART && chunk.part() == route.match) {
+            return &route;
+        }
+        if (route.type == Route::FILENAME && String(artifact.filename()).endsWith(route.match)) {
+            return &route;
+        }
+    }
+    return nullptr;
+}
+
+const DeploymentExecutor::Staged* DeploymentExecutor::findStaged(const Artifact& artifact) const
+{
+    String key = artifact.key();
+    for (const Staged& staged : this->_staged) {
+        if (staged.artifact == key) {
+            return &staged;
+        }
+    }
+    return nullptr;
+}
+
+void DeploymentExecutor::abortStaged()
+{
+    for (const Staged& staged : this->_staged) {
+        staged.sink->abort();
+    }
+    this->_staged.clear();
+}
+
+HawkbitError DeploymentExecutor::transfer(const Artifact& artifact, DownloadSink& sink)
+{
+    // the client commits right after verifying, the executor once all artifacts are verified
+    StagingSink staging(sink);
+    if (this->_pipeline != nullptr) {
+        return this->_client.downloadTo(artifact, this->_linkType, staging, *this->_pipeline);
+    }
+    return this->_client.downloadTo(artifact, this->_linkType, staging);
+}
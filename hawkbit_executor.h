@@ -0,0 +1,167 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "hawkbit.h"
+#include "hawkbit_sink.h"
+
+/**
+ * Executes a deployment, by downloading each of its artifacts into a sink.
+ *
+ * Artifacts are routed to sinks by the part of their chunk (e.g. "os" or "bApp"), or by the
+ * suffix of their file name. Before downloading anything, every artifact must have a sink of its
+ * own. Artifacts are downloaded ordered by the priority of their route (lowest first), and then by
+ * size (smallest first), so that a failing deployment fails as early as possible.
+ *
+ * No sink is committed before all artifacts have been received and verified. Then all sinks get
+ * committed, in the same order, except that sinks which cannot roll back a commit (see
+ * DownloadSink::revertible()) go last. If a commit fails, the sinks committed before get rolled
+ * back, latest first. A sink which cannot roll back is only safe as the last one, so there should
+ * be no more than one. As committing the firmware image activates it, its route should have the
+ * highest priority value, so that it is committed last.
+ *
+ * The deployment is reported once, when all artifacts are committed or one of them failed.
+ * Artifacts which were verified already are kept uncommitted, and skipped when the deployment is
+ * re-tried, e.g. after a transient network error.
+ */
+class DeploymentExecutor {
+    public:
+        DeploymentExecutor(HawkbitClient& client, const String& linkType = "download") :
+            _client(client),
+            _linkType(linkType),
+            _pipeline(nullptr)
+        {
+        }
+
+        ~DeploymentExecutor()
+        {
+            this->abortStaged();
+        }
+
+        /**
+         * Route the artifacts of all chunks with the part to the sink.
+         * @param priority the lower, the earlier the artifacts are processed
+         */
+        void routePart(const String& part, DownloadSink& sink, uint8_t priority = 128)
+        {
+            this->_routes.push_back(Route(Route::PART, part, sink, priority));
+        }
+
+        /**
+         * Route the artifacts with a file name ending with the suffix to the sink.
+         * @param priority the lower, the earlier the artifacts are processed
+         */
+        void routeFilename(const String& suffix, DownloadSink& sink, uint8_t priority = 128)
+        {
+            this->_routes.push_back(Route(Route::FILENAME, suffix, sink, priority));
+        }
+
+        /**
+         * Download through the pipeline, overlapping the transfer with writing to the sinks.
+         */
+        void pipeline(DownloadPipeline& pipeline) { this->_pipeline = &pipeline; }
+
+        /**
+         * Execute the deployment, and report its result.
+         *
+         * A transient error (see HawkbitError::transient()) is not reported, but returned, so that the
+         * deployment can be re-tried later on. All other errors fail the deployment.
+         */
+        HawkbitError execute(const Deployment& deployment);
+
+        /**
+         * Get the number of artifacts of the current deployment, which have been verified, but not
+         * yet committed.
+         */
+        size_t staged() const { return this->_staged.size(); }
+
+    private:
+        struct Route {
+            typedef enum { PART, FILENAME } Type;
+
+            Route(Type type, const String& match, DownloadSink& sink, uint8_t priority) :
+                type(type),
+                match(match),
+                sink(&sink),
+                priority(priority)
+            {
+            }
+
+            Type type;
+            String match;
+            DownloadSink* sink;
+            uint8_t priority;
+        };
+
+        struct Task {
+            const Artifact* artifact;
+            const Route* route;
+        };
+
+        struct Staged {
+            // see Artifact::key()
+            String artifact;
+            DownloadSink* sink;
+        };
+
+        /**
+         * Passes everything on to a sink, except for committing, which is up to the executor.
+         */
+        class StagingSink : public DownloadSink {
+            public:
+                StagingSink(DownloadSink& sink) :
+                    _sink(sink)
+                {
+                }
+
+                bool begin(const Artifact& artifact) override { return this->_sink.begin(artifact); }
+                bool write(const uint8_t* data, size_t len) override { return this->_sink.write(data, len); }
+                bool flush() override { return this->_sink.flush(); }
+                size_t blockSize() const override { return this->_sink.blockSize(); }
+                bool commit() override { return true; }
+                void abort() override { this->_sink.abort(); }
+                bool suspend() override { return this->_sink.suspend(); }
+                uint32_t resume(const Artifact& artifact) override { return this->_sink.resume(artifact); }
+
+            private:
+                DownloadSink& _sink;
+        };
+
+        HawkbitClient& _client;
+        String _linkType;
+        DownloadPipeline* _pipeline;
+        std::vector<Route> _routes;
+
+        // the verified, but not yet committed artifacts of the deployment
+        String _deployment;
+        std::vector<Staged> _staged;
+
+        const Route* route(const Chunk& chunk, const Artifact& artifact) const;
+        const Staged* findStaged(const Artifact& artifact) const;
+        void abortStaged();
+
+        /**
+         * Fail the deployment before downloading anything.
+         */
+        HawkbitError reject(const Deployment& deployment, const String& reason);
+
+        /**
+         * Commit all sinks, rolling back the committed ones if one of them fails.
+         */
+        HawkbitError commit(std::vector<Task> tasks, std::vector<String>& details);
+
+        HawkbitError transfer(const Artifact& artifact, DownloadSink& sink);
+};
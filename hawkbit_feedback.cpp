@@ -0,0 +1,149 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_feedback.h"
+
+#include <Arduino.h>
+
+#include "hawkbit_log.h"
+
+const char* FeedbackQueue::STORAGE_KEY = "feedback";
+
+bool FeedbackQueue::push(const Feedback& feedback)
+{
+    // drop everything superseded by the new feedback
+    for (auto i = this->_entries.begin(); i != this->_entries.end(); ) {
+        if (i->url() == feedback.url() && !i->isFinal()) {
+            log_d("Coalescing feedback - %s: %s", i->id().c_str(), i->execution().c_str());
+            i = this->_entries.erase(i);
+        } else {
+            ++i;
+        }
+    }
+
+    if (this->_entries.size() >= this->_capacity) {
+        auto drop = this->_entries.end();
+        for (auto i = this->_entries.begin(); i != this->_entries.end(); ++i) {
+            if (!i->isFinal()) {
+                drop = i;
+                break;
+            }
+        }
+        if (drop == this->_entries.end() && !feedback.isFinal()) {
+            log_w("Feedback queue full, dropping: %s", feedback.execution().c_str());
+            return false;
+        }
+        if (drop == this->_entries.end()) {
+            // only final feedback queued, the oldest one is the least relevant
+            drop = this->_entries.begin();
+        }
+        log_w("Feedback queue full, dropping: %s", drop->execution().c_str());
+        this->_dirty |= drop->isFinal();
+        this->_entries.erase(drop);
+    }
+
+    this->_entries.push_back(feedback);
+    this->_dirty |= feedback.isFinal();
+
+    return true;
+}
+
+void FeedbackQueue::persist(JsonDocument& doc)
+{
+    if (this->_storage == nullptr) {
+        return;
+    }
+
+    size_t count = 0;
+    for (const Feedback& feedback : this->_entries) {
+        count += feedback.isFinal() ? 1 : 0;
+    }
+
+    if (count == 0) {
+        // only touch the storage if there had been something stored before
+        if (this->_stored) {
+            this->_storage->remove(STORAGE_KEY);
+            this->_stored = false;
+        }
+        this->_dirty = false;
+        return;
+    }
+
+    if (!this->_dirty) {
+        return;
+    }
+
+    doc.clear();
+    JsonArray entries = doc.to<JsonArray>();
+    for (const Feedback& feedback : this->_entries) {
+        if (!feedback.isFinal()) {
+            continue;
+        }
+        JsonObject o = entries.createNestedObject();
+        o["url"] = feedback.url();
+        o["id"] = feedback.id();
+        o["execution"] = feedback.execution();
+        o["finished"] = feedback.finished();
+        if (feedback.total() > 0) {
+            o["done"] = feedback.done();
+            o["total"] = feedback.total();
+        }
+        JsonArray details = o.createNestedArray("details");
+        for (const String& detail : feedback.details()) {
+            details.add(detail);
+        }
+    }
+
+    String buffer;
+    serializeJson(doc, buffer);
+    this->_stored = this->_storage->store(STORAGE_KEY, buffer);
+    this->_dirty = !this->_stored;
+
+    log_d("Persisted %u feedback entries: %s", count, this->_stored ? "ok" : "failed");
+}
+
+void FeedbackQueue::restore(JsonDocument& doc)
+{
+    String buffer;
+    if (this->_storage == nullptr || !this->_storage->load(STORAGE_KEY, buffer)) {
+        return;
+    }
+
+    doc.clear();
+    if (deserializeJson(doc, buffer)) {
+        log_w("Failed to restore feedback queue");
+        return;
+    }
+
+    for (JsonObject o : doc.as<JsonArray>()) {
+        std::vector<String> details;
+        for (JsonVariant detail : o["details"].as<JsonArray>()) {
+            details.push_back(detail.as<const char*>());
+        }
+        this->push(Feedback(
+            o["url"] | "",
+            o["id"] | "",
+            o["execution"] | "",
+            o["finished"] | "",
+            details,
+            o["done"] | 0,
+            o["total"] | 0
+        ));
+    }
+
+    // what we just loaded is stored already
+    this->_stored = true;
+    this->_dirty = false;
+
+    log_d("Restored %u feedback entries", this->_entries.size());
+}
@@ -0,0 +1,128 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <WString.h>
+#include <ArduinoJson.h>
+
+#include "hawkbit_storage.h"
+
+/**
+ * A feedback message for an action.
+ */
+class Feedback {
+    public:
+        Feedback(
+            const String& url,
+            const String& id,
+            const String& execution,
+            const String& finished,
+            const std::vector<String>& details,
+            uint32_t done = 0,
+            uint32_t total = 0
+            ) :
+            _url(url),
+            _id(id),
+            _execution(execution),
+            _finished(finished),
+            _details(details),
+            _done(done),
+            _total(total)
+        {
+        }
+
+        const String& url() const { return this->_url; }
+        const String& id() const { return this->_id; }
+        const String& execution() const { return this->_execution; }
+        const String& finished() const { return this->_finished; }
+        const std::vector<String>& details() const { return this->_details; }
+        uint32_t done() const { return this->_done; }
+        uint32_t total() const { return this->_total; }
+
+        /**
+         * Check if this is the final feedback of an action, which must not get lost.
+         */
+        bool isFinal() const
+        {
+            return this->_execution == "closed" || this->_execution == "canceled" || this->_execution == "rejected";
+        }
+
+    private:
+        String _url;
+        String _id;
+        String _execution;
+        String _finished;
+        std::vector<String> _details;
+        uint32_t _done;
+        uint32_t _total;
+};
+
+/**
+ * A bounded queue of feedback, waiting to be sent to the server.
+ *
+ * Feedback for an action supersedes all queued, non-final feedback of the same action, so that
+ * e.g. only the latest progress is kept. When the queue is full, the oldest non-final feedback
+ * is dropped first. Only final feedback is persisted, the rest is superseded soon anyway, and
+ * would wear the flash with each progress report.
+ */
+class FeedbackQueue {
+    public:
+        static const char* STORAGE_KEY;
+
+        FeedbackQueue(size_t capacity, HawkbitStorage* storage = nullptr) :
+            _capacity(capacity),
+            _storage(storage),
+            _stored(false),
+            _dirty(false)
+        {
+        }
+
+        /**
+         * Add feedback to the queue, returns false if it was dropped.
+         */
+        bool push(const Feedback& feedback);
+
+        bool empty() const { return this->_entries.empty(); }
+        size_t size() const { return this->_entries.size(); }
+        const Feedback& front() const { return this->_entries.front(); }
+
+        void pop()
+        {
+            this->_dirty |= this->_entries.front().isFinal();
+            this->_entries.erase(this->_entries.begin());
+        }
+
+        /**
+         * Persist the final feedback of the queue to the storage, if it changed since it was last
+         * stored. Without final feedback, a previously stored queue is removed. Uses the provided
+         * document for serializing.
+         */
+        void persist(JsonDocument& doc);
+
+        /**
+         * Load the queue from the storage. Uses the provided document for parsing.
+         */
+        void restore(JsonDocument& doc);
+
+    private:
+        size_t _capacity;
+        HawkbitStorage* _storage;
+        // the storage holds a (non-empty) queue
+        bool _stored;
+        // the final feedback of the queue changed since it was last stored
+        bool _dirty;
+
+        std::vector<Feedback> _entries;
+};
@@ -0,0 +1,160 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_links.h"
+
+#include <limits.h>
+#include <string.h>
+
+// link types of the checksum files, hawkBit provides along with the artifact
+static const char* const CHECKSUM_LINKS[] = { "md5sum", "sha1sum", "sha256sum" };
+
+static bool isDownloadLink(const KeyValue& link)
+{
+    if (link.second.isEmpty()) {
+        return false;
+    }
+    for (const char* checksum : CHECKSUM_LINKS) {
+        if (strncmp(link.first.c_str(), checksum, strlen(checksum)) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+String LinkSelector::hostOf(const char* url)
+{
+    const char* start = strstr(url, "://");
+    start = start == nullptr ? url : start + 3;
+    const char* end = strchr(start, '/');
+    return end == nullptr ? String(url) : String(url).substring(0, end - url);
+}
+
+size_t LinkSelector::count(const FlatMap& links)
+{
+    size_t result = 0;
+    for (const KeyValue& link : links) {
+        if (isDownloadLink(link)) {
+            result++;
+        }
+    }
+    return result;
+}
+
+FlatMap::const_iterator LinkSelector::select(const FlatMap& links) const
+{
+    FlatMap::const_iterator best = links.end();
+    const Host* bestHost = nullptr;
+    bool bestBlocked = true;
+
+    for (FlatMap::const_iterator i = links.begin(); i != links.end(); ++i) {
+        if (!isDownloadLink(*i)) {
+            continue;
+        }
+
+        const Host* host = this->find(hostOf(i->second.c_str()));
+        bool isBlocked = host != nullptr && this->blocked(*host);
+
+        bool better;
+        if (best == links.end()) {
+            better = true;
+        } else if (isBlocked != bestBlocked) {
+            better = !isBlocked;
+        } else if (isBlocked) {
+            // all failed recently, re-try the one which failed first
+            better = host->lastFailure - bestHost->lastFailure > (unsigned long)LONG_MAX;
+        } else if (host == nullptr || bestHost == nullptr) {
+            // measure unknown hosts first
+            better = host == nullptr && bestHost != nullptr;
+        } else {
+            uint64_t score = (uint64_t)host->throughput * host->successes / (host->successes + host->failures);
+            uint64_t bestScore = (uint64_t)bestHost->throughput * bestHost->successes / (bestHost->successes + bestHost->failures);
+            better = score > bestScore;
+        }
+
+        if (better) {
+            best = i;
+            bestHost = host;
+            bestBlocked = isBlocked;
+        }
+    }
+
+    return best;
+}
+
+void LinkSelector::success(const String& url, uint32_t bytes, uint32_t elapsed)
+{
+    Host& host = this->entry(url);
+    uint32_t throughput = (uint64_t)bytes * 1000 / (elapsed > 0 ? elapsed : 1);
+
+    host.successes++;
+    host.recentFailures = 0;
+    host.throughput = host.throughput == 0 ? throughput : (host.throughput * 3 + throughput) / 4;
+}
+
+void LinkSelector::failure(const String& url)
+{
+    Host& host = this->entry(url);
+
+    host.failures++;
+    host.recentFailures++;
+    host.lastFailure = millis();
+}
+
+void LinkSelector::dump(Print& out, const String& prefix) const
+{
+    for (const Host& host : this->_hosts) {
+        out.printf("%s%s: %u bytes/s - succeeded: %u, failed: %u%s\n", prefix.c_str(), host.host.c_str(),
+            host.throughput, host.successes, host.failures, this->blocked(host) ? " (avoided)" : "");
+    }
+}
+
+const LinkSelector::Host* LinkSelector::find(const String& host) const
+{
+    for (const Host& entry : this->_hosts) {
+        if (entry.host == host) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+LinkSelector::Host& LinkSelector::entry(const String& url)
+{
+    String host = hostOf(url.c_str());
+    Host* result = const_cast<Host*>(this->find(host));
+
+    if (result == nullptr) {
+        if (this->_hosts.size() < MAX_HOSTS) {
+            this->_hosts.push_back(Host());
+            result = &this->_hosts.back();
+        } else {
+            result = &this->_hosts.front();
+            for (Host& entry : this->_hosts) {
+                if (entry.lastUsed - result->lastUsed > (unsigned long)LONG_MAX) {
+                    result = &entry;
+                }
+            }
+        }
+        *result = Host();
+        result->host = host;
+    }
+
+    result->lastUsed = millis();
+    return *result;
+}
+
+bool LinkSelector::blocked(const Host& host) const
+{
+    return host.recentFailures > 0 && millis() - host.lastFailure < this->_backoff;
+}
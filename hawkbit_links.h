@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <Arduino.h>
+
+#include "hawkbit_arena.h"
+
+/**
+ * Selects the download link of an artifact, by the throughput and failures seen for its host.
+ *
+ * Hosts which were not used so far are tried first, so that each of them gets measured. After
+ * that, the host with the best throughput (weighted by its success rate) is used. A host which
+ * just failed is avoided for a while, unless all hosts failed.
+ */
+class LinkSelector {
+    public:
+        // the number of hosts to keep statistics for, the least recently used one is dropped
+        static const size_t MAX_HOSTS = 8;
+
+        struct Host {
+            String host;
+            uint32_t successes;
+            uint32_t failures;
+            // the number of failures since the last success
+            uint32_t recentFailures;
+            // the moving average of the throughput, in bytes/s
+            uint32_t throughput;
+            unsigned long lastFailure;
+            unsigned long lastUsed;
+        };
+
+        /**
+         * @param backoff the time (in milliseconds) a failed host is avoided
+         */
+        LinkSelector(uint32_t backoff = 60000) :
+            _backoff(backoff)
+        {
+        }
+
+        /**
+         * Select one of the download links, returns end() if there is none.
+         *
+         * All links of an artifact are download links (e.g. "download", "download-http", or the
+         * links of mirrors), except for the ones of the checksum files (e.g. "md5sum").
+         */
+        FlatMap::const_iterator select(const FlatMap& links) const;
+
+        /**
+         * Get the number of download links.
+         */
+        static size_t count(const FlatMap& links);
+
+        /**
+         * Record a completed transfer from the URL.
+         */
+        void success(const String& url, uint32_t bytes, uint32_t elapsed);
+
+        /**
+         * Record a failed request or transfer from the URL.
+         */
+        void failure(const String& url);
+
+        const std::vector<Host>& hosts() const { return this->_hosts; }
+
+        void dump(Print& out, const String& prefix = "") const;
+
+        /**
+         * Get the host part of an URL (e.g. "https://host:port").
+         */
+        static String hostOf(const char* url);
+
+    private:
+        uint32_t _backoff;
+        std::vector<Host> _hosts;
+
+        const Host* find(const String& host) const;
+        Host& entry(const String& url);
+        bool blocked(const Host& host) const;
+};
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+/*
+ * Logging is done through the macros of the ESP32 Arduino core. Other platforms (e.g. a host
+ * build against an Arduino emulation) get a fallback, which writes to stderr. Define
+ * HAWKBIT_DEBUG to also get the info and debug output.
+ */
+
+#if defined(ESP32)
+#include <esp32-hal-log.h>
+#endif
+
+#if !defined(log_d)
+
+#include <cstdio>
+
+#define ARDUHAL_LOG_LEVEL_NONE 0
+#define ARDUHAL_LOG_LEVEL_ERROR 1
+#define ARDUHAL_LOG_LEVEL_WARN 2
+#define ARDUHAL_LOG_LEVEL_INFO 3
+#define ARDUHAL_LOG_LEVEL_DEBUG 4
+
+#if !defined(ARDUHAL_LOG_LEVEL)
+#if defined(HAWKBIT_DEBUG)
+#define ARDUHAL_LOG_LEVEL ARDUHAL_LOG_LEVEL_DEBUG
+#else
+#define ARDUHAL_LOG_LEVEL ARDUHAL_LOG_LEVEL_WARN
+#endif
+#endif
+
+#define HAWKBIT_LOG(level, letter, format, ...) \
+    do { \
+        if (ARDUHAL_LOG_LEVEL >= level) { \
+            fprintf(stderr, "[" letter "][%s:%u] %s(): " format "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define log_e(format, ...) HAWKBIT_LOG(ARDUHAL_LOG_LEVEL_ERROR, "E", format, ##__VA_ARGS__)
+#define log_w(format, ...) HAWKBIT_LOG(ARDUHAL_LOG_LEVEL_WARN, "W", format, ##__VA_ARGS__)
+#define log_i(format, ...) HAWKBIT_LOG(ARDUHAL_LOG_LEVEL_INFO, "I", format, ##__VA_ARGS__)
+#define log_d(format, ...) HAWKBIT_LOG(ARDUHAL_LOG_LEVEL_DEBUG, "D", format, ##__VA_ARGS__)
+
+#endif
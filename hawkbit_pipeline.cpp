@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_pipeline.h"
+
+#if !defined(ESP32)
+#include <thread>
+#endif
+
+DownloadPipeline::DownloadPipeline(size_t blockSize, int core) :
+    _blockSize(blockSize),
+    _core(core),
+    _buffer(nullptr),
+    _abort(false),
+    _running(false),
+    _stream(nullptr),
+    _length(0),
+    _failed(false),
+    _started(0),
+    _elapsed(0),
+    _bytes(0),
+    _producerStalls(0),
+    _consumerStalls(0)
+{
+}
+
+DownloadPipeline::~DownloadPipeline()
+{
+    free(this->_buffer);
+}
+
+bool DownloadPipeline::start(Stream& stream, uint32_t length)
+{
+    if (this->_buffer == nullptr) {
+        this->_buffer = (uint8_t*)malloc(this->_blockSize * BLOCKS);
+        if (this->_buffer == nullptr) {
+            log_e("Failed to allocate %u bytes of buffers", this->_blockSize * BLOCKS);
+            return false;
+        }
+    }
+
+    this->_free.clear();
+    this->_filled.clear();
+    for (size_t i = 0; i < BLOCKS; i++) {
+        Block block = { this->_buffer + i * this->_blockSize, 0 };
+        this->_free.push(block);
+    }
+
+    this->_stream = &stream;
+    this->_length = length;
+    this->_failed = false;
+    this->_abort = false;
+    this->_bytes = 0;
+    this->_producerStalls = 0;
+    this->_consumerStalls = 0;
+    this->_started = millis();
+    this->_running = true;
+
+#if defined(ESP32)
+    // the TLS stack needs some room when reading from a secure client
+    if (xTaskCreatePinnedToCore(&DownloadPipeline::producer, "hawkbit-dl", 8192, this, uxTaskPriorityGet(NULL), NULL, this->_core) != pdPASS) {
+        log_e("Failed to start producer task");
+        this->_running = false;
+        return false;
+    }
+#else
+    std::thread(&DownloadPipeline::producer, this).detach();
+#endif
+
+    return true;
+}
+
+void DownloadPipeline::finish(bool abort)
+{
+    if (abort) {
+        this->_abort = true;
+    }
+    while (this->_running) {
+        delay(1);
+    }
+    this->_elapsed = millis() - this->_started;
+    this->_stream = nullptr;
+}
+
+void DownloadPipeline::producer(void* pipeline)
+{
+    static_cast<DownloadPipeline*>(pipeline)->produce();
+#if defined(ESP32)
+    vTaskDelete(NULL);
+#endif
+}
+
+void DownloadPipeline::produce()
+{
+    uint32_t remaining = this->_length;
+
+    while (!this->_abort) {
+        if (this->_length > 0 && remaining == 0) {
+            break;
+        }
+
+        Block block;
+        if (!this->_free.pop(block)) {
+            this->_producerStalls++;
+            delay(1);
+            continue;
+        }
+
+        size_t len = this->_blockSize;
+        if (this->_length > 0 && remaining < len) {
+            len = remaining;
+        }
+
+        block.length = this->_stream->readBytes(block.data, len);
+        if (block.length == 0) {
+            // a stream of unknown length ends with a timeout, otherwise we ran short
+            this->_failed = this->_length > 0;
+            if (this->_failed) {
+                log_w("Stream ended early, missing %u bytes", remaining);
+            }
+            break;
+        }
+
+        remaining -= block.length;
+        this->_filled.push(block);
+    }
+
+    Block end = { nullptr, 0 };
+    this->_filled.push(end);
+
+    this->_running = false;
+}
@@ -0,0 +1,198 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <Arduino.h>
+
+#include "hawkbit_log.h"
+
+/**
+ * A bounded, lock-free ring buffer for a single producer and a single consumer.
+ *
+ * The capacity must be a power of two.
+ */
+template<typename T, size_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        SpscRing() :
+            _items(),
+            _head(0),
+            _tail(0)
+        {
+        }
+
+        /**
+         * Add an item, called by the producer only. Returns false if the ring is full.
+         */
+        bool push(const T& item)
+        {
+            size_t head = this->_head.load(std::memory_order_relaxed);
+            if (head - this->_tail.load(std::memory_order_acquire) == N) {
+                return false;
+            }
+            this->_items[head & (N - 1)] = item;
+            this->_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Remove an item, called by the consumer only. Returns false if the ring is empty.
+         */
+        bool pop(T& item)
+        {
+            size_t tail = this->_tail.load(std::memory_order_relaxed);
+            if (tail == this->_head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = this->_items[tail & (N - 1)];
+            this->_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        void clear()
+        {
+            this->_head.store(0, std::memory_order_relaxed);
+            this->_tail.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        T _items[N];
+        std::atomic<size_t> _head;
+        std::atomic<size_t> _tail;
+};
+
+/**
+ * Overlaps reading a download from the network with writing it to a sink.
+ *
+ * A producer task fills fixed-size blocks from the stream, while the calling task drains them
+ * into the sink. On the ESP32, the producer runs pinned to its own core. Both sides are joined by
+ * two lock-free rings, one for filled blocks and one for blocks ready to be re-used.
+ */
+class DownloadPipeline {
+    public:
+        static const size_t BLOCKS = 4;
+
+        /**
+         * @param blockSize the size of each block, ideally a multiple of the flash sector size
+         * @param core the core to run the producer on (ESP32 only)
+         */
+        DownloadPipeline(size_t blockSize = 4096, int core = 0);
+        ~DownloadPipeline();
+
+        /**
+         * Copy the stream into the sink.
+         *
+         * The sink gets called with each filled block (<code>bool sink(const uint8_t* data, size_t len)</code>),
+         * and returns false to abort the download.
+         * @param length the number of bytes to expect, or zero to read until the stream ends
+         * @return true if all data was read and accepted by the sink
+         */
+        template<typename Sink>
+        bool run(Stream& stream, uint32_t length, Sink sink)
+        {
+            if (!start(stream, length)) {
+                return false;
+            }
+
+            bool success = true;
+            Block block;
+
+            for (;;) {
+                if (!this->_filled.pop(block)) {
+                    this->_consumerStalls++;
+                    delay(1);
+                    continue;
+                }
+                if (block.length == 0) {
+                    // end of stream
+                    break;
+                }
+                if (!sink(block.data, block.length)) {
+                    log_w("Sink rejected block");
+                    success = false;
+                    break;
+                }
+                this->_bytes += block.length;
+                this->_free.push(block);
+            }
+
+            finish(!success);
+
+            return success && !this->_failed;
+        }
+
+        uint32_t bytes() const { return this->_bytes; }
+
+        /**
+         * Get the duration of the last run, in milliseconds.
+         */
+        uint32_t elapsed() const { return this->_elapsed; }
+
+        /**
+         * Get the throughput of the last run, in bytes per second.
+         */
+        uint32_t throughput() const { return this->_elapsed > 0 ? (uint64_t)this->_bytes * 1000 / this->_elapsed : 0; }
+
+        /**
+         * Get the number of times the producer had to wait for the sink, as all blocks were filled.
+         */
+        uint32_t producerStalls() const { return this->_producerStalls; }
+
+        /**
+         * Get the number of times the sink had to wait for the network, as no block was filled.
+         */
+        uint32_t consumerStalls() const { return this->_consumerStalls; }
+
+        void dump(Print& out, const String& prefix = "") const
+        {
+            out.printf("%sPipeline: %u bytes in %u ms (%u bytes/s)\n", prefix.c_str(), this->_bytes, this->_elapsed, this->throughput());
+            out.printf("%s    Stalls - network: %u, sink: %u\n", prefix.c_str(), this->_consumerStalls, this->_producerStalls);
+        }
+
+    private:
+        struct Block {
+            uint8_t* data;
+            size_t length;
+        };
+
+        size_t _blockSize;
+        int _core;
+        uint8_t* _buffer;
+
+        // twice the number of blocks, so that the end marker always fits
+        SpscRing<Block, BLOCKS * 2> _free;
+        SpscRing<Block, BLOCKS * 2> _filled;
+
+        std::atomic<bool> _abort;
+        std::atomic<bool> _running;
+
+        Stream* _stream;
+        uint32_t _length;
+        bool _failed;
+
+        uint32_t _started;
+        uint32_t _elapsed;
+        uint32_t _bytes;
+        uint32_t _producerStalls;
+        uint32_t _consumerStalls;
+
+        bool start(Stream& stream, uint32_t length);
+        void finish(bool abort);
+        void produce();
+
+        static void producer(void* pipeline);
+};
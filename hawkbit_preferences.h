@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <Preferences.h>
+#include <esp_flash_encrypt.h>
+
+#include "hawkbit_storage.h"
+
+/**
+ * Storage backed by the ESP32 NVS, using the Preferences library.
+ *
+ * The values are encrypted, if the firmware is built with NVS encryption (CONFIG_NVS_ENCRYPTION)
+ * and flash encryption is enabled on the device.
+ */
+class PreferencesStorage : public HawkbitStorage {
+    public:
+        PreferencesStorage(const char* name = "hawkbit") :
+            _name(name)
+        {
+        }
+
+        bool store(const char* key, const String& value) override
+        {
+            Preferences prefs;
+            if (!prefs.begin(this->_name, false)) {
+                return false;
+            }
+            bool result = prefs.putString(key, value) == value.length();
+            prefs.end();
+            return result;
+        }
+
+        bool load(const char* key, String& value) override
+        {
+            Preferences prefs;
+            if (!prefs.begin(this->_name, true)) {
+                return false;
+            }
+            // an empty value is treated as missing
+            value = prefs.getString(key, String());
+            prefs.end();
+            return !value.isEmpty();
+        }
+
+        void remove(const char* key) override
+        {
+            Preferences prefs;
+            if (prefs.begin(this->_name, false)) {
+                prefs.remove(key);
+                prefs.end();
+            }
+        }
+
+        bool encrypted() const override
+        {
+#if defined(CONFIG_NVS_ENCRYPTION)
+            return esp_flash_encryption_enabled();
+#else
+            return false;
+#endif
+        }
+
+    private:
+        const char* _name;
+};
@@ -0,0 +1,351 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_runner.h"
+
+UpdateRunner::UpdateRunner(HawkbitClient& client, PollScheduler& scheduler, size_t slice, uint32_t stall) :
+    _client(client),
+    _scheduler(scheduler),
+    _slice(slice),
+    _stall(stall),
+    _linkType("download"),
+    _phase(IDLE),
+    _chunk(0),
+    _artifact(0),
+    _download(nullptr),
+    _offset(0),
+    _lastData(0),
+    _buffer(new uint8_t[slice]),
+    _success(true),
+    _suspended()
+{
+}
+
+bool UpdateRunner::tick()
+{
+    switch (this->_phase) {
+        case IDLE:
+            if (!this->_scheduler.due()) {
+                return false;
+            }
+            this->_phase = POLL;
+            return true;
+        case POLL:
+            return this->poll();
+        case DEPLOYMENT:
+            return this->deployment();
+        case ARTIFACT:
+            return this->nextArtifact();
+        case TRANSFER:
+            return this->transfer();
+        case VERIFY:
+            return this->verify();
+        case FEEDBACK:
+            return this->feedback();
+    }
+    return false;
+}
+
+const Artifact& UpdateRunner::artifact() const
+{
+    return this->_state.deployment().chunks()[this->_chunk].artifacts()[this->_artifact];
+}
+
+const Artifact* UpdateRunner::artifactAt(const Deployment& deployment, size_t chunk, size_t artifact)
+{
+    if (chunk >= deployment.chunks().size() || artifact >= deployment.chunks()[chunk].artifacts().size()) {
+        return nullptr;
+    }
+    return &deployment.chunks()[chunk].artifacts()[artifact];
+}
+
+bool UpdateRunner::poll()
+{
+    HawkbitError error = this->_client.readState(this->_state);
+    if (error.failed()) {
+        log_w("Failed to fetch update information: %s %d", error.categoryName(), error.code());
+        this->_scheduler.failure();
+        this->_phase = IDLE;
+        return false;
+    }
+
+    this->_scheduler.success(this->_state);
+
+    switch (this->_state.type()) {
+        case State::UPDATE:
+            this->_phase = DEPLOYMENT;
+            return true;
+        case State::REGISTER:
+            if (this->_onRegistration) {
+                this->_onRegistration(this->_state.registration());
+            }
+            break;
+        case State::CANCEL:
+            // nothing is running in between polls, so a cancel can always be accepted
+            this->discardSuspended();
+            this->_client.reportCancelAccepted(this->_state.stop());
+            break;
+        default:
+            break;
+    }
+
+    this->_state = State();
+    this->_phase = IDLE;
+    return false;
+}
+
+bool UpdateRunner::deployment()
+{
+    this->_chunk = 0;
+    this->_artifact = 0;
+    this->_offset = 0;
+    this->_success = true;
+    this->_details.clear();
+
+    const Deployment& deployment = this->_state.deployment();
+    if (this->_suspended.active) {
+        const Artifact* current = artifactAt(deployment, this->_suspended.chunk, this->_suspended.artifact);
+        const Artifact* suspended = artifactAt(this->_suspended.deployment, this->_suspended.chunk, this->_suspended.artifact);
+        if (this->_suspended.deployment.id() == deployment.id().c_str() && current != nullptr && current->key() == suspended->key()) {
+            // the deployment was accepted before, and the artifacts up to here are committed
+            log_i("Continuing deployment %s at artifact %s", deployment.id().c_str(), current->filename().c_str());
+            this->_chunk = this->_suspended.chunk;
+            this->_artifact = this->_suspended.artifact;
+            this->_offset = this->_suspended.offset;
+            this->_suspended.active = false;
+            this->_suspended.deployment = Deployment();
+            this->_phase = ARTIFACT;
+            return true;
+        }
+        this->discardSuspended();
+    }
+
+    if (this->_onDeployment && !this->_onDeployment(this->_state.deployment())) {
+        this->_success = false;
+        this->_details.push_back("Deployment rejected");
+        this->_phase = FEEDBACK;
+        return true;
+    }
+
+    this->_phase = ARTIFACT;
+    return true;
+}
+
+bool UpdateRunner::nextArtifact()
+{
+    const ArrayView<Chunk>& chunks = this->_state.deployment().chunks();
+    while (this->_chunk < chunks.size() && this->_artifact >= chunks[this->_chunk].artifacts().size()) {
+        this->_chunk++;
+        this->_artifact = 0;
+    }
+
+    if (this->_chunk >= chunks.size()) {
+        // all done
+        this->_phase = FEEDBACK;
+        return true;
+    }
+
+    const Artifact& artifact = this->artifact();
+    uint32_t offset = this->_offset;
+    this->_offset = 0;
+
+    if (offset > 0 && !(this->_client.canResume(artifact, offset) && this->_onResume && this->_onResume(artifact, offset))) {
+        log_i("Unable to resume artifact at %u, starting over", offset);
+        if (this->_onArtifactDone) {
+            this->_onArtifactDone(artifact, false);
+        }
+        offset = 0;
+    }
+
+    if (offset == 0 && this->_onArtifact && !this->_onArtifact(artifact)) {
+        return this->fail(String("Failed to prepare for artifact: ") + artifact.filename().c_str());
+    }
+
+    HawkbitError error = this->_client.startDownload(artifact, this->_linkType, this->_download, offset);
+    if (error.failed()) {
+        log_w("Failed to download artifact: %s %d", error.categoryName(), error.code());
+        if (error.transient()) {
+            // the client keeps the state of the hashes, as no other download started
+            return this->suspend(offset);
+        }
+        if (this->_onArtifactDone) {
+            this->_onArtifactDone(artifact, false);
+        }
+        return this->fail(String("Failed to download artifact: ") + artifact.filename().c_str());
+    }
+
+    if (offset > 0 && this->_download->offset() == 0) {
+        // the server sends the complete artifact
+        if (this->_onArtifactDone) {
+            this->_onArtifactDone(artifact, false);
+        }
+        if (this->_onArtifact && !this->_onArtifact(artifact)) {
+            this->_download = nullptr;
+            this->_client.finishDownload(false);
+            return this->fail(String("Failed to prepare for artifact: ") + artifact.filename().c_str());
+        }
+    }
+
+    this->_lastData = millis();
+    this->_phase = TRANSFER;
+    return true;
+}
+
+bool UpdateRunner::transfer()
+{
+    const Artifact& artifact = this->artifact();
+    Download& d = *this->_download;
+
+    bool received = d.received();
+    if (received && !d.decoding()) {
+        this->_phase = VERIFY;
+        return true;
+    }
+
+    // don't block waiting for data, once received only pending output gets decoded
+    if (!received && d.available() <= 0) {
+        if (millis() - this->_lastData > this->_stall) {
+            uint32_t position = d.position();
+            log_w("Download stalled at %u", position);
+            this->_download = nullptr;
+            // all data read so far was handed over, so the artifact may continue at the position
+            this->_client.finishDownload(false, true);
+            return this->suspend(this->_client.canResume(artifact, position) ? position : 0);
+        }
+        return false;
+    }
+
+    // only ask for what already arrived, so that reading does not wait for the network
+    size_t len = this->_slice;
+    if (!received && (size_t)d.available() < len) {
+        len = d.available();
+    }
+    len = d.decompressed().readBytes(this->_buffer.get(), len);
+
+    if (d.failed()) {
+        return this->fail(String("Failed to decompress artifact: ") + artifact.filename().c_str());
+    }
+
+    if (len == 0) {
+        if (received) {
+            this->_phase = VERIFY;
+            return true;
+        }
+        return false;
+    }
+
+    this->_lastData = millis();
+
+    if (this->_onData && !this->_onData(artifact, this->_buffer.get(), len)) {
+        return this->fail(String("Failed to write artifact: ") + artifact.filename().c_str());
+    }
+
+    return true;
+}
+
+bool UpdateRunner::verify()
+{
+    const Artifact& artifact = this->artifact();
+
+    bool verified = this->_download->verify();
+    this->_download = nullptr;
+    this->_client.finishDownload(true);
+
+    if (!verified) {
+        if (this->_onArtifactDone) {
+            this->_onArtifactDone(artifact, false);
+        }
+        return this->fail(String("Hash mismatch: ") + artifact.filename().c_str());
+    }
+
+    if (this->_onArtifactDone && !this->_onArtifactDone(artifact, true)) {
+        return this->fail(String("Failed to commit artifact: ") + artifact.filename().c_str());
+    }
+
+    this->_artifact++;
+    this->_phase = ARTIFACT;
+    return true;
+}
+
+bool UpdateRunner::feedback()
+{
+    const Deployment& deployment = this->_state.deployment();
+
+    this->_client.reportComplete(deployment, this->_success, this->_details);
+
+    if (this->_onComplete) {
+        this->_onComplete(deployment, this->_success);
+    }
+
+    this->_state = State();
+    this->_details.clear();
+    this->_phase = IDLE;
+    return false;
+}
+
+bool UpdateRunner::retry()
+{
+    // the server offers the deployment again with the next poll
+    this->_scheduler.failure();
+    this->_state = State();
+    this->_phase = IDLE;
+    return false;
+}
+
+bool UpdateRunner::suspend(uint32_t offset)
+{
+    if (offset == 0 && this->_onArtifactDone) {
+        this->_onArtifactDone(this->artifact(), false);
+    }
+
+    this->_suspended.active = true;
+    this->_suspended.deployment = this->_state.deployment();
+    this->_suspended.chunk = this->_chunk;
+    this->_suspended.artifact = this->_artifact;
+    this->_suspended.offset = offset;
+
+    return this->retry();
+}
+
+void UpdateRunner::discardSuspended()
+{
+    if (!this->_suspended.active) {
+        return;
+    }
+
+    if (this->_suspended.offset > 0 && this->_onArtifactDone) {
+        const Artifact* artifact = artifactAt(this->_suspended.deployment, this->_suspended.chunk, this->_suspended.artifact);
+        this->_onArtifactDone(*artifact, false);
+    }
+
+    this->_suspended.active = false;
+    this->_suspended.deployment = Deployment();
+}
+
+bool UpdateRunner::fail(const String& reason)
+{
+    log_w("Deployment failed: %s", reason.c_str());
+
+    if (this->_download != nullptr) {
+        this->_download = nullptr;
+        this->_client.finishDownload(false);
+        if (this->_onArtifactDone) {
+            this->_onArtifactDone(this->artifact(), false);
+        }
+    }
+
+    this->_success = false;
+    this->_details.push_back(reason);
+    this->_phase = FEEDBACK;
+    return true;
+}
@@ -0,0 +1,165 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "hawkbit.h"
+
+/**
+ * Runs the update cycle of a client as a state machine, in small steps.
+ *
+ * Each call to tick() does a bounded amount of work: at most one request (poll, download request,
+ * feedback), or reading and handing over one slice of an artifact. So the application loop can
+ * keep running in between. All artifacts of a deployment are downloaded in order, and the
+ * application is notified through callbacks. Transient errors are re-tried with the next poll,
+ * all others fail the deployment.
+ *
+ * When the same deployment is offered again after a transient error, the artifacts which were
+ * committed already are skipped. An artifact, which broke off while downloading, continues at the
+ * position it reached, if the application accepts that (see onResume()) and the data received so
+ * far can still be verified. Otherwise it starts over.
+ *
+ * A step only reads the data which already arrived. Decompressing an artifact may still wait for
+ * a few more bytes, if the data which arrived ends within a compressed token.
+ */
+class UpdateRunner {
+    public:
+        typedef enum { IDLE, POLL, DEPLOYMENT, ARTIFACT, TRANSFER, VERIFY, FEEDBACK } Phase;
+
+        /**
+         * Decide on a deployment, returning false rejects it.
+         */
+        typedef std::function<bool(const Deployment&)> DeploymentHandler;
+        /**
+         * Prepare for receiving an artifact, returning false fails the deployment.
+         */
+        typedef std::function<bool(const Artifact&)> ArtifactHandler;
+        /**
+         * Write a slice of an artifact, returning false fails the deployment.
+         */
+        typedef std::function<bool(const Artifact&, const uint8_t*, size_t)> DataHandler;
+        /**
+         * Commit (success is true) or discard an artifact, returning false fails the deployment.
+         */
+        typedef std::function<bool(const Artifact&, bool)> ArtifactDoneHandler;
+        /**
+         * Called once the result of a deployment has been reported.
+         */
+        typedef std::function<void(const Deployment&, bool)> CompleteHandler;
+        typedef std::function<void(const Registration&)> RegistrationHandler;
+        /**
+         * Continue writing an artifact at an offset, after its download broke off. The data written
+         * so far was not discarded. Returning false discards it, and the artifact starts over.
+         */
+        typedef std::function<bool(const Artifact&, uint32_t)> ResumeHandler;
+
+        /**
+         * @param slice the maximum number of bytes, read and written by one step
+         * @param stall the time (in milliseconds) without data, after which a download is aborted
+         */
+        UpdateRunner(HawkbitClient& client, PollScheduler& scheduler, size_t slice = 1024, uint32_t stall = 30000);
+
+        void onDeployment(DeploymentHandler handler) { this->_onDeployment = handler; }
+        void onArtifact(ArtifactHandler handler) { this->_onArtifact = handler; }
+        void onData(DataHandler handler) { this->_onData = handler; }
+        void onArtifactDone(ArtifactDoneHandler handler) { this->_onArtifactDone = handler; }
+        void onComplete(CompleteHandler handler) { this->_onComplete = handler; }
+        void onRegistration(RegistrationHandler handler) { this->_onRegistration = handler; }
+        void onResume(ResumeHandler handler) { this->_onResume = handler; }
+
+        /**
+         * Set the link type used for downloading artifacts.
+         */
+        void linkType(const String& linkType) { this->_linkType = linkType; }
+
+        /**
+         * Advance the state machine by one step.
+         * @return true if more work is pending right away, false if waiting for the next poll or data
+         */
+        bool tick();
+
+        Phase phase() const { return this->_phase; }
+
+    private:
+        HawkbitClient& _client;
+        PollScheduler& _scheduler;
+        size_t _slice;
+        uint32_t _stall;
+        String _linkType;
+
+        DeploymentHandler _onDeployment;
+        ArtifactHandler _onArtifact;
+        DataHandler _onData;
+        ArtifactDoneHandler _onArtifactDone;
+        CompleteHandler _onComplete;
+        RegistrationHandler _onRegistration;
+        ResumeHandler _onResume;
+
+        Phase _phase;
+        State _state;
+        size_t _chunk;
+        size_t _artifact;
+        Download* _download;
+        // the offset the next artifact continues at
+        uint32_t _offset;
+        unsigned long _lastData;
+        std::unique_ptr<uint8_t[]> _buffer;
+
+        bool _success;
+        std::vector<String> _details;
+
+        // the position of a deployment, which was interrupted by a transient error
+        struct {
+            bool active;
+            Deployment deployment;
+            size_t chunk;
+            size_t artifact;
+            // the data of the artifact up to the offset was kept
+            uint32_t offset;
+        } _suspended;
+
+        const Artifact& artifact() const;
+        static const Artifact* artifactAt(const Deployment& deployment, size_t chunk, size_t artifact);
+
+        bool poll();
+        bool deployment();
+        bool nextArtifact();
+        bool transfer();
+        bool verify();
+        bool feedback();
+
+        /**
+         * Abort the current deployment, to re-try it later on.
+         */
+        bool retry();
+
+        /**
+         * Abort the current deployment, to continue it at the current artifact later on.
+         * @param offset the position the artifact continues at, zero discards its data
+         */
+        bool suspend(uint32_t offset);
+
+        /**
+         * Forget the suspended deployment, discarding the data of its artifact.
+         */
+        void discardSuspended();
+
+        /**
+         * Abort the current deployment, reporting the failure.
+         */
+        bool fail(const String& reason);
+};
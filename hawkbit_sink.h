@@ -0,0 +1,210 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class Artifact;
+
+/**
+ * The destination of a downloaded artifact.
+ *
+ * Data must only be made permanent with commit(), which is called once the artifact has been
+ * received completely, and its hashes have been verified. The download passes its own buffers
+ * to write(), all blocks but the last are a multiple of blockSize(), also when the download runs
+ * through a DownloadPipeline (its blocks are re-blocked if needed).
+ *
+ * A sink may support resuming an artifact, after the transfer broke: then suspend() is called
+ * instead of abort(), and the data written so far is kept. The next download of the artifact
+ * calls resume() instead of begin(), and continues after the data which was kept. The block
+ * written last before suspending may be shorter than blockSize().
+ */
+class DownloadSink {
+    public:
+        virtual ~DownloadSink() {}
+
+        /**
+         * Prepare for receiving an artifact, returns false if it cannot be stored.
+         */
+        virtual bool begin(const Artifact& artifact) = 0;
+
+        /**
+         * Write the next block of data, returns false to abort the download.
+         */
+        virtual bool write(const uint8_t* data, size_t len) = 0;
+
+        /**
+         * Write out any buffered data, called once all data has been written.
+         */
+        virtual bool flush() { return true; }
+
+        /**
+         * Get the preferred block size of writes (e.g. the flash sector size), or zero for any size.
+         */
+        virtual size_t blockSize() const { return 0; }
+
+        /**
+         * Make the received data permanent, returns false if that failed.
+         */
+        virtual bool commit() = 0;
+
+        /**
+         * Discard the received data.
+         */
+        virtual void abort() = 0;
+
+        /**
+         * Check if the sink can undo a commit, see rollback().
+         */
+        virtual bool revertible() const { return false; }
+
+        /**
+         * Undo the last commit, restoring what was there before. Called when another artifact of the
+         * same deployment failed to commit. Returns false if that failed, or is not supported.
+         */
+        virtual bool rollback() { return false; }
+
+        /**
+         * Keep the data written so far, for resuming the artifact later on. Returns false if the
+         * sink cannot resume, then it gets aborted.
+         */
+        virtual bool suspend() { return false; }
+
+        /**
+         * Resume receiving the suspended artifact.
+         *
+         * The download only continues if the client kept the state of the hashes, for the same
+         * artifact and position (see HawkbitClient::canResume()), otherwise the sink gets aborted
+         * and begun anew.
+         * @return the number of bytes written so far, zero if nothing was kept
+         */
+        virtual uint32_t resume(const Artifact&) { return 0; }
+};
+
+/**
+ * A sink discarding all data, for measuring the raw transfer speed.
+ */
+class NullSink : public DownloadSink {
+    public:
+        NullSink() :
+            _bytes(0)
+        {
+        }
+
+        bool begin(const Artifact&) override
+        {
+            this->_bytes = 0;
+            return true;
+        }
+
+        bool write(const uint8_t*, size_t len) override
+        {
+            this->_bytes += len;
+            return true;
+        }
+
+        bool commit() override { return true; }
+        void abort() override {}
+
+        size_t bytes() const { return this->_bytes; }
+
+    private:
+        size_t _bytes;
+};
+
+/**
+ * A sink storing the artifact in a buffer, provided by the caller.
+ */
+class RamSink : public DownloadSink {
+    public:
+        RamSink(uint8_t* buffer, size_t capacity) :
+            _buffer(buffer),
+            _capacity(capacity),
+            _size(0),
+            _committed(false),
+            _suspended(false)
+        {
+        }
+
+        bool begin(const Artifact&) override
+        {
+            this->_size = 0;
+            this->_committed = false;
+            this->_suspended = false;
+            return true;
+        }
+
+        bool write(const uint8_t* data, size_t len) override
+        {
+            if (len > this->_capacity - this->_size) {
+                return false;
+            }
+            memcpy(this->_buffer + this->_size, data, len);
+            this->_size += len;
+            return true;
+        }
+
+        bool commit() override
+        {
+            this->_committed = true;
+            return true;
+        }
+
+        void abort() override
+        {
+            this->_size = 0;
+            this->_suspended = false;
+        }
+
+        bool revertible() const override { return true; }
+
+        bool rollback() override
+        {
+            // the data was only valid once committed
+            this->_committed = false;
+            return true;
+        }
+
+        bool suspend() override
+        {
+            this->_suspended = true;
+            return true;
+        }
+
+        uint32_t resume(const Artifact&) override
+        {
+            // holds a single artifact, which gets resumed
+            if (!this->_suspended) {
+                return 0;
+            }
+            this->_suspended = false;
+            return this->_size;
+        }
+
+        /**
+         * Get the data, only complete once committed.
+         */
+        const uint8_t* data() const { return this->_buffer; }
+        size_t size() const { return this->_size; }
+        bool committed() const { return this->_committed; }
+
+    private:
+        uint8_t* _buffer;
+        size_t _capacity;
+        size_t _size;
+        bool _committed;
+        bool _suspended;
+};
@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <FS.h>
+
+#include "hawkbit_sink.h"
+
+/**
+ * A sink storing the artifact in a file.
+ *
+ * The data is written to a temporary file next to the target, which replaces the target
+ * once committed. So an existing file is kept, until the new one is complete. The replaced file
+ * is kept as a backup (the path with ".bak" appended), for rolling back the commit, until the next
+ * artifact begins. A suspended file is kept open, to be resumed.
+ */
+class FileSink : public DownloadSink {
+    public:
+        FileSink(fs::FS& fs, const String& path, size_t blockSize = 512) :
+            _fs(fs),
+            _path(path),
+            _temp(path + ".tmp"),
+            _backup(path + ".bak"),
+            _blockSize(blockSize),
+            _written(0),
+            _replaced(false)
+        {
+        }
+
+        bool begin(const Artifact&) override
+        {
+            this->_file.close();
+            this->_written = 0;
+            // the previous commit is final now
+            this->_fs.remove(this->_backup);
+            this->_replaced = false;
+            this->_file = this->_fs.open(this->_temp, "w");
+            return (bool)this->_file;
+        }
+
+        bool write(const uint8_t* data, size_t len) override
+        {
+            size_t written = this->_file.write(data, len);
+            this->_written += written;
+            return written == len;
+        }
+
+        bool flush() override
+        {
+            this->_file.flush();
+            return true;
+        }
+
+        size_t blockSize() const override { return this->_blockSize; }
+
+        bool commit() override
+        {
+            this->_file.close();
+            this->_fs.remove(this->_backup);
+            this->_replaced = this->_fs.exists(this->_path);
+            if (this->_replaced && !this->_fs.rename(this->_path, this->_backup)) {
+                this->_replaced = false;
+                return false;
+            }
+            if (!this->_fs.rename(this->_temp, this->_path)) {
+                this->rollback();
+                return false;
+            }
+            return true;
+        }
+
+        void abort() override
+        {
+            this->_file.close();
+            this->_fs.remove(this->_temp);
+            this->_written = 0;
+        }
+
+        bool revertible() const override { return true; }
+
+        bool rollback() override
+        {
+            this->_fs.remove(this->_path);
+            if (!this->_replaced) {
+                // there was no file before
+                return true;
+            }
+            this->_replaced = false;
+            return this->_fs.rename(this->_backup, this->_path);
+        }
+
+        bool suspend() override
+        {
+            return (bool)this->_file;
+        }
+
+        uint32_t resume(const Artifact&) override
+        {
+            return this->_file ? this->_written : 0;
+        }
+
+    private:
+        fs::FS& _fs;
+        String _path;
+        String _temp;
+        String _backup;
+        size_t _blockSize;
+        fs::File _file;
+        uint32_t _written;
+        // if the commit moved an existing file to the backup
+        bool _replaced;
+};
@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <Update.h>
+#include <esp_ota_ops.h>
+
+#include "hawkbit.h"
+#include "hawkbit_sink.h"
+
+/**
+ * A sink writing a firmware image into the next OTA partition, using the Update library.
+ *
+ * Committing activates the new image for the next boot, rolling back switches the next boot back
+ * to the running image. A suspended update keeps running, so that it can be resumed as long as the
+ * device is not restarted.
+ */
+class OtaSink : public DownloadSink {
+    public:
+        bool begin(const Artifact& artifact) override
+        {
+            if (Update.isRunning()) {
+                // drop a suspended update
+                Update.abort();
+            }
+            // the size of an image produced from a delta or a compressed artifact is unknown up front
+            this->_unknownSize = DeltaPatcher::isDelta(artifact.filename()) || compressionOf(artifact.filename()) != Compression::NONE;
+            if (!Update.begin(this->_unknownSize ? UPDATE_SIZE_UNKNOWN : artifact.size())) {
+                log_w("Failed to begin update: %s", Update.errorString());
+                return false;
+            }
+            return true;
+        }
+
+        bool write(const uint8_t* data, size_t len) override
+        {
+            return Update.write(const_cast<uint8_t*>(data), len) == len;
+        }
+
+        // the flash sector size
+        size_t blockSize() const override { return 4096; }
+
+        bool commit() override
+        {
+            if (!Update.end(this->_unknownSize)) {
+                log_w("Failed to end update: %s", Update.errorString());
+                return false;
+            }
+            return true;
+        }
+
+        void abort() override
+        {
+            Update.abort();
+        }
+
+        bool revertible() const override { return true; }
+
+        bool rollback() override
+        {
+            esp_err_t err = esp_ota_set_boot_partition(esp_ota_get_running_partition());
+            if (err != ESP_OK) {
+                log_w("Failed to roll back update: %d", err);
+                return false;
+            }
+            return true;
+        }
+
+        bool suspend() override
+        {
+            return Update.isRunning();
+        }
+
+        uint32_t resume(const Artifact&) override
+        {
+            return Update.isRunning() ? Update.progress() : 0;
+        }
+
+    private:
+        bool _unknownSize = false;
+};
@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_stats.h"
+
+#include <string.h>
+
+static size_t bucketOf(uint32_t latency)
+{
+    // bucket 0 holds 0 ms, bucket n holds [2^(n-1), 2^n)
+    size_t bucket = 0;
+    while (latency > 0 && bucket < RequestStats::BUCKETS - 1) {
+        latency >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void RequestStats::record(Kind kind, int code, uint32_t latency)
+{
+    Entry& entry = this->_entries[kind];
+
+    entry.requests++;
+    if (code < 200 || (code >= 300 && code != 304)) {
+        entry.failures++;
+    }
+    entry.latency += latency;
+    if (latency > entry.maxLatency) {
+        entry.maxLatency = latency;
+    }
+    entry.buckets[bucketOf(latency)]++;
+}
+
+void RequestStats::merge(const RequestStats& other)
+{
+    for (size_t i = 0; i < KINDS; i++) {
+        Entry& entry = this->_entries[i];
+        const Entry& from = other._entries[i];
+
+        entry.requests += from.requests;
+        entry.failures += from.failures;
+        entry.latency += from.latency;
+        if (from.maxLatency > entry.maxLatency) {
+            entry.maxLatency = from.maxLatency;
+        }
+        for (size_t b = 0; b < BUCKETS; b++) {
+            entry.buckets[b] += from.buckets[b];
+        }
+    }
+}
+
+void RequestStats::reset()
+{
+    memset(this->_entries, 0, sizeof(this->_entries));
+}
+
+uint32_t RequestStats::percentile(Kind kind, uint8_t percent) const
+{
+    const Entry& entry = this->_entries[kind];
+    if (entry.requests == 0) {
+        return 0;
+    }
+
+    // the number of requests, which must be covered (rounded up)
+    uint64_t required = ((uint64_t)entry.requests * percent + 99) / 100;
+    uint64_t covered = 0;
+
+    for (size_t b = 0; b < BUCKETS; b++) {
+        covered += entry.buckets[b];
+        if (covered >= required && covered > 0) {
+            // the upper bound of the bucket, but nothing took longer than the maximum
+            uint32_t bound = b == 0 ? 0 : (1UL << b) - 1;
+            return bound < entry.maxLatency ? bound : entry.maxLatency;
+        }
+    }
+
+    return entry.maxLatency;
+}
+
+void RequestStats::dump(Print& out, const String& prefix) const
+{
+    for (size_t i = 0; i < KINDS; i++) {
+        Kind kind = (Kind)i;
+        if (this->requests(kind) == 0) {
+            continue;
+        }
+        out.printf("%s%s: %u requests, %u failed - latency avg: %u ms, p50: %u ms, p90: %u ms, p99: %u ms, max: %u ms\n",
+            prefix.c_str(), kindName(kind), this->requests(kind), this->failures(kind), this->averageLatency(kind),
+            this->percentile(kind, 50), this->percentile(kind, 90), this->percentile(kind, 99), this->maxLatency(kind));
+    }
+}
+
+const char* RequestStats::kindName(Kind kind)
+{
+    switch (kind) {
+        case POLL: return "Poll";
+        case DEPLOYMENT: return "Deployment";
+        case CANCEL: return "Cancel";
+        case FEEDBACK: return "Feedback";
+        case REGISTRATION: return "Registration";
+        case DOWNLOAD: return "Download";
+        case KINDS: break;
+    }
+    return "Unknown";
+}
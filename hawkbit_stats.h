@@ -0,0 +1,91 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <Arduino.h>
+
+/**
+ * Statistics of the requests made by a client, by the kind of request.
+ *
+ * Latencies are recorded in a histogram of power of two buckets (in milliseconds), so the
+ * percentiles are approximations, which never underestimate the latency. The statistics of
+ * several clients can be merged, for evaluating a fleet of devices.
+ */
+class RequestStats {
+    public:
+        typedef enum { POLL, DEPLOYMENT, CANCEL, FEEDBACK, REGISTRATION, DOWNLOAD, KINDS } Kind;
+
+        // the last bucket collects everything from 2^(BUCKETS - 2) ms on
+        static const size_t BUCKETS = 18;
+
+        RequestStats() { reset(); }
+
+        /**
+         * Record the result of a request.
+         * @param code the HTTP status, or the (negative) HTTPClient error
+         * @param latency the time (in milliseconds) until the response headers were received
+         */
+        void record(Kind kind, int code, uint32_t latency);
+
+        /**
+         * Add the statistics of another client.
+         */
+        void merge(const RequestStats& other);
+
+        void reset();
+
+        uint32_t requests(Kind kind) const { return this->_entries[kind].requests; }
+
+        /**
+         * Get the number of requests which failed, with an error or a status other than 2xx or 304.
+         */
+        uint32_t failures(Kind kind) const { return this->_entries[kind].failures; }
+
+        uint32_t averageLatency(Kind kind) const
+        {
+            const Entry& entry = this->_entries[kind];
+            return entry.requests > 0 ? entry.latency / entry.requests : 0;
+        }
+
+        uint32_t maxLatency(Kind kind) const { return this->_entries[kind].maxLatency; }
+
+        /**
+         * Get the latency (in milliseconds), which the percentage of requests did not exceed.
+         */
+        uint32_t percentile(Kind kind, uint8_t percent) const;
+
+        /**
+         * Get the number of requests per minute, over the period (in milliseconds).
+         */
+        uint32_t rate(Kind kind, uint32_t period) const
+        {
+            return period > 0 ? (uint64_t)this->_entries[kind].requests * 60000 / period : 0;
+        }
+
+        void dump(Print& out, const String& prefix = "") const;
+
+        static const char* kindName(Kind kind);
+
+    private:
+        struct Entry {
+            uint32_t requests;
+            uint32_t failures;
+            uint64_t latency;
+            uint32_t maxLatency;
+            uint32_t buckets[BUCKETS];
+        };
+
+        Entry _entries[KINDS];
+};
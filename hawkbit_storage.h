@@ -0,0 +1,40 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <WString.h>
+
+/**
+ * Persistent storage for the client state, which should survive a reboot.
+ *
+ * Keys are short (up to 15 characters), so that they can be used with NVS directly.
+ */
+class HawkbitStorage {
+    public:
+        virtual ~HawkbitStorage() {}
+
+        virtual bool store(const char* key, const String& value) = 0;
+
+        /**
+         * Load a value, returns false if there is no value for the key.
+         */
+        virtual bool load(const char* key, String& value) = 0;
+
+        virtual void remove(const char* key) = 0;
+
+        /**
+         * Check if the values are encrypted at rest, so that secrets may be stored.
+         */
+        virtual bool encrypted() const { return false; }
+};
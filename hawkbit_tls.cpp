@@ -0,0 +1,235 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_tls.h"
+#include "hawkbit_log.h"
+
+#include <algorithm>
+#include <limits.h>
+
+const char* TlsSessionCache::STORAGE_KEY = "tls";
+
+TlsSessionCache::TlsSessionCache(TlsSessionAdapter& adapter, HawkbitStorage* storage, size_t capacity, size_t maxSession) :
+    _adapter(adapter),
+    _storage(storage),
+    _capacity(capacity),
+    _maxSession(maxSession),
+    _allowUnencrypted(false),
+    _persistInterval(3600000),
+    _restored(false),
+    _dirty(false),
+    _persisted(false),
+    _lastPersisted(0)
+{
+}
+
+void TlsSessionCache::beforeConnect(WiFiClient& client, const String& host)
+{
+    this->restore();
+
+    Session* session = this->find(host);
+    if (session == nullptr) {
+        this->_adapter.clearSession(client);
+        return;
+    }
+
+    log_d("Resuming TLS session for: %s", host.c_str());
+    session->lastUsed = millis();
+    this->_adapter.importSession(client, session->data);
+}
+
+bool TlsSessionCache::afterConnect(WiFiClient& client, const String& host)
+{
+    this->restore();
+
+    if (this->_adapter.resumed(client)) {
+        return true;
+    }
+
+    std::vector<uint8_t> data;
+    if (!this->_adapter.exportSession(client, data) || data.empty() || data.size() > this->_maxSession) {
+        this->invalidate(host);
+        return false;
+    }
+
+    Session* session = this->find(host);
+    if (session == nullptr) {
+        if (this->_sessions.size() < this->_capacity) {
+            this->_sessions.push_back(Session());
+            session = &this->_sessions.back();
+        } else {
+            session = &this->_sessions.front();
+            for (Session& entry : this->_sessions) {
+                if (entry.lastUsed - session->lastUsed > (unsigned long)LONG_MAX) {
+                    session = &entry;
+                }
+            }
+        }
+        session->host = host;
+    }
+
+    session->data = std::move(data);
+    session->lastUsed = millis();
+
+    this->changed();
+
+    return false;
+}
+
+void TlsSessionCache::invalidate(const String& host)
+{
+    this->restore();
+
+    for (auto i = this->_sessions.begin(); i != this->_sessions.end(); ++i) {
+        if (i->host == host) {
+            this->_sessions.erase(i);
+            this->changed();
+            return;
+        }
+    }
+}
+
+void TlsSessionCache::flush()
+{
+    if (this->_dirty) {
+        this->persist();
+    }
+}
+
+TlsSessionCache::Session* TlsSessionCache::find(const String& host)
+{
+    for (Session& session : this->_sessions) {
+        if (session.host == host) {
+            return &session;
+        }
+    }
+    return nullptr;
+}
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+bool TlsSessionCache::persistent() const
+{
+    return this->_storage != nullptr && (this->_allowUnencrypted || this->_storage->encrypted());
+}
+
+void TlsSessionCache::changed()
+{
+    this->_dirty = true;
+    if (!this->_persisted || millis() - this->_lastPersisted >= this->_persistInterval) {
+        this->persist();
+    }
+}
+
+void TlsSessionCache::persist()
+{
+    if (!this->persistent()) {
+        return;
+    }
+
+    this->_dirty = false;
+    this->_persisted = true;
+    this->_lastPersisted = millis();
+
+    // one line per session: the host, a space, and the session in hex. The most recently used
+    // sessions first, as many as fit.
+    std::vector<const Session*> sessions;
+    for (const Session& session : this->_sessions) {
+        sessions.push_back(&session);
+    }
+    std::sort(sessions.begin(), sessions.end(), [](const Session* a, const Session* b) {
+        unsigned long newer = a->lastUsed - b->lastUsed;
+        return newer != 0 && newer <= (unsigned long)LONG_MAX;
+    });
+
+    String buffer;
+    for (const Session* session : sessions) {
+        size_t length = session->host.length() + 1 + session->data.size() * 2 + 1;
+        if (buffer.length() + length > MAX_PERSISTED) {
+            continue;
+        }
+        buffer += session->host;
+        buffer += ' ';
+        for (uint8_t b : session->data) {
+            buffer += HEX_DIGITS[b >> 4];
+            buffer += HEX_DIGITS[b & 0x0F];
+        }
+        buffer += '\n';
+    }
+
+    if (buffer.isEmpty()) {
+        this->_storage->remove(STORAGE_KEY);
+        return;
+    }
+
+    if (!this->_storage->store(STORAGE_KEY, buffer)) {
+        log_w("Failed to persist TLS sessions");
+    }
+}
+
+void TlsSessionCache::restore()
+{
+    if (this->_restored || this->_storage == nullptr) {
+        return;
+    }
+    this->_restored = true;
+
+    if (!this->persistent()) {
+        // don't leave the secrets of sessions, which were persisted before, in the storage
+        this->_storage->remove(STORAGE_KEY);
+        return;
+    }
+
+    String buffer;
+    if (!this->_storage->load(STORAGE_KEY, buffer)) {
+        return;
+    }
+
+    int start = 0;
+    while (start < (int)buffer.length() && this->_sessions.size() < this->_capacity) {
+        int end = buffer.indexOf('\n', start);
+        int separator = buffer.indexOf(' ', start);
+        if (end < 0 || separator < 0 || separator > end || (end - separator - 1) % 2 != 0) {
+            break;
+        }
+
+        Session session;
+        session.host = buffer.substring(start, separator);
+        session.lastUsed = 0;
+        for (int i = separator + 1; i < end; i += 2) {
+            int high = hexValue(buffer[i]);
+            int low = hexValue(buffer[i + 1]);
+            if (high < 0 || low < 0) {
+                log_w("Invalid TLS session for: %s", session.host.c_str());
+                return;
+            }
+            session.data.push_back((uint8_t)(high << 4 | low));
+        }
+        this->_sessions.push_back(std::move(session));
+
+        start = end + 1;
+    }
+
+    log_d("Restored %u TLS sessions", this->_sessions.size());
+}
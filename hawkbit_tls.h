@@ -0,0 +1,220 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <WiFi.h>
+
+#include "hawkbit_storage.h"
+
+/**
+ * Statistics of the connections used by a client: the ones opened, split into full and resumed
+ * TLS handshakes, and the requests which re-used an open connection.
+ */
+class HandshakeStats {
+    public:
+        HandshakeStats() :
+            _full(0),
+            _resumed(0),
+            _reused(0),
+            _fullLatency(0),
+            _resumedLatency(0)
+        {
+        }
+
+        /**
+         * Record a connection.
+         * @param latency the time (in milliseconds) it took to connect
+         */
+        void record(bool resumed, uint32_t latency)
+        {
+            if (resumed) {
+                this->_resumed++;
+                this->_resumedLatency += latency;
+            } else {
+                this->_full++;
+                this->_fullLatency += latency;
+            }
+        }
+
+        /**
+         * Record a request, which re-used an open connection.
+         */
+        void reuse() { this->_reused++; }
+
+        uint32_t full() const { return this->_full; }
+        uint32_t resumed() const { return this->_resumed; }
+        uint32_t reused() const { return this->_reused; }
+
+        uint32_t fullLatency() const { return this->_full > 0 ? this->_fullLatency / this->_full : 0; }
+        uint32_t resumedLatency() const { return this->_resumed > 0 ? this->_resumedLatency / this->_resumed : 0; }
+
+        void dump(Print& out, const String& prefix = "") const
+        {
+            out.printf("%sHandshakes - full: %u (avg %u ms), resumed: %u (avg %u ms), saved: %u\n", prefix.c_str(),
+                this->_full, this->fullLatency(), this->_resumed, this->resumedLatency(), this->_reused);
+        }
+
+    private:
+        uint32_t _full;
+        uint32_t _resumed;
+        uint32_t _reused;
+        uint64_t _fullLatency;
+        uint64_t _resumedLatency;
+};
+
+/**
+ * Access to the TLS session of a client, which depends on the TLS implementation.
+ *
+ * The Arduino core for the ESP32 (1.0.x) runs the handshake as part of connect(), without a way
+ * to provide a session beforehand. So an adapter needs a TLS client which supports this, see
+ * ResumableClientSecure (hawkbit_tls_secure.h).
+ */
+class TlsSessionAdapter {
+    public:
+        virtual ~TlsSessionAdapter() {}
+
+        /**
+         * Get the session of the connected client, returns false if there is none.
+         */
+        virtual bool exportSession(WiFiClient& client, std::vector<uint8_t>& session) = 0;
+
+        /**
+         * Provide a session to resume with the next connect of the client.
+         */
+        virtual void importSession(WiFiClient& client, const std::vector<uint8_t>& session) = 0;
+
+        /**
+         * Clear any session provided before, so that the next connect performs a full handshake.
+         */
+        virtual void clearSession(WiFiClient& client) = 0;
+
+        /**
+         * Check if the last handshake of the client resumed a session.
+         */
+        virtual bool resumed(WiFiClient& client) = 0;
+};
+
+/**
+ * A bounded cache of TLS sessions, by host.
+ *
+ * The cache keeps at most a number of sessions, dropping the least recently used one. If a
+ * storage is provided, the sessions are persisted, and restored with the first connection. So
+ * the first connection after a reboot may be resumed as well.
+ *
+ * A session contains the master secret of the connection, which lets anybody reading it decrypt
+ * recorded traffic of the session, or resume it. So sessions are only persisted to a storage
+ * which is encrypted (see HawkbitStorage::encrypted()), unless allowUnencrypted() is set.
+ *
+ * Each full handshake creates a new session. To limit the wear of the flash, the sessions are
+ * persisted at most once per interval (see persistInterval()), the changes in between are written
+ * with the next change after the interval, or with flush().
+ */
+class TlsSessionCache {
+    public:
+        static const char* STORAGE_KEY;
+
+        /**
+         * The default maximum size of a session: the fields of a session besides the ticket (at most
+         * 92 bytes, see ClientSecureSessionAdapter) and a ticket of up to 1 KiB.
+         */
+        static const size_t DEFAULT_MAX_SESSION = 92 + 1024;
+
+        /**
+         * The maximum size of the persisted sessions, the size of a string value in NVS. The most
+         * recently used sessions, which fit, are persisted.
+         */
+        static const size_t MAX_PERSISTED = 4000;
+
+        /**
+         * @param capacity the maximum number of sessions
+         * @param maxSession the maximum size (in bytes) of a session, larger ones are not cached
+         */
+        TlsSessionCache(TlsSessionAdapter& adapter, HawkbitStorage* storage = nullptr, size_t capacity = 4,
+            size_t maxSession = DEFAULT_MAX_SESSION);
+
+        /**
+         * Allow persisting the sessions to a storage, which is not encrypted.
+         *
+         * Warning: anybody with access to the flash can then read the master secrets of the
+         * sessions, and decrypt traffic recorded while they were used. Only use this if the flash
+         * is protected otherwise.
+         */
+        void allowUnencrypted(bool allow) { this->_allowUnencrypted = allow; }
+
+        /**
+         * Set the minimum time (in milliseconds) between two writes to the storage, by default one hour.
+         */
+        void persistInterval(uint32_t interval) { this->_persistInterval = interval; }
+
+        /**
+         * Persist the sessions, if they changed since they were persisted (e.g. before a restart).
+         */
+        void flush();
+
+        /**
+         * Prepare the client for connecting to the host, resuming the cached session.
+         * @param host the host part of the URL (e.g. "https://host:port")
+         */
+        void beforeConnect(WiFiClient& client, const String& host);
+
+        /**
+         * Cache the session of the client, which connected to the host.
+         * @return true if the handshake resumed a session
+         */
+        bool afterConnect(WiFiClient& client, const String& host);
+
+        /**
+         * Drop the session of the host, e.g. when connecting failed.
+         */
+        void invalidate(const String& host);
+
+        size_t size() const { return this->_sessions.size(); }
+
+    private:
+        struct Session {
+            String host;
+            std::vector<uint8_t> data;
+            unsigned long lastUsed;
+        };
+
+        TlsSessionAdapter& _adapter;
+        HawkbitStorage* _storage;
+        size_t _capacity;
+        size_t _maxSession;
+        std::vector<Session> _sessions;
+
+        bool _allowUnencrypted;
+        uint32_t _persistInterval;
+        bool _restored;
+        // the sessions changed since they were persisted
+        bool _dirty;
+        bool _persisted;
+        unsigned long _lastPersisted;
+
+        Session* find(const String& host);
+
+        /**
+         * Check if the sessions may be persisted to the storage.
+         */
+        bool persistent() const;
+
+        /**
+         * Record a change of the sessions, persisting them unless that happened recently.
+         */
+        void changed();
+
+        void persist();
+        void restore();
+};
@@ -0,0 +1,256 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_tls_secure.h"
+
+#if defined(ESP32) && defined(HAWKBIT_TLS_RESUME)
+
+#include <mutex>
+#include <string.h>
+
+#include <mbedtls/platform.h>
+
+#include "hawkbit_log.h"
+
+extern "C" int __real_mbedtls_ssl_handshake(mbedtls_ssl_context* ssl);
+
+extern "C" int __wrap_mbedtls_ssl_handshake(mbedtls_ssl_context* ssl)
+{
+    // the handshake gets called again, as long as it waits for data
+    if (ssl->state == MBEDTLS_SSL_HELLO_REQUEST) {
+        ResumableClientSecure::beforeHandshake(ssl);
+    }
+    return __real_mbedtls_ssl_handshake(ssl);
+}
+
+// all clients, for finding the one owning a TLS context
+static std::mutex clientsLock;
+static ResumableClientSecure* clients = nullptr;
+
+ResumableClientSecure::ResumableClientSecure() :
+    _pending(false),
+    _next(nullptr)
+{
+    mbedtls_ssl_session_init(&this->_session);
+
+    std::lock_guard<std::mutex> lock(clientsLock);
+    this->_next = clients;
+    clients = this;
+}
+
+ResumableClientSecure::~ResumableClientSecure()
+{
+    {
+        std::lock_guard<std::mutex> lock(clientsLock);
+        for (ResumableClientSecure** i = &clients; *i != nullptr; i = &(*i)->_next) {
+            if (*i == this) {
+                *i = this->_next;
+                break;
+            }
+        }
+    }
+
+    mbedtls_ssl_session_free(&this->_session);
+}
+
+void ResumableClientSecure::beforeHandshake(mbedtls_ssl_context* ssl)
+{
+    std::lock_guard<std::mutex> lock(clientsLock);
+    for (ResumableClientSecure* client = clients; client != nullptr; client = client->_next) {
+        if (client->context() != ssl) {
+            continue;
+        }
+        if (client->_pending) {
+            int ret = mbedtls_ssl_set_session(ssl, &client->_session);
+            if (ret != 0) {
+                log_w("Failed to provide TLS session: -0x%04x", -ret);
+            }
+        }
+        return;
+    }
+}
+
+static void put(std::vector<uint8_t>& out, uint32_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void put(std::vector<uint8_t>& out, const unsigned char* data, size_t len)
+{
+    out.insert(out.end(), data, data + len);
+}
+
+/**
+ * Reads the fields of a session, as written by encode().
+ */
+class SessionReader {
+    public:
+        SessionReader(const std::vector<uint8_t>& data) :
+            _data(data),
+            _position(0)
+        {
+        }
+
+        bool has(size_t len) const { return this->_position + len <= this->_data.size(); }
+        bool done() const { return this->_position == this->_data.size(); }
+
+        uint32_t get(size_t bytes)
+        {
+            uint32_t value = 0;
+            for (size_t i = 0; i < bytes; i++) {
+                value |= (uint32_t)this->_data[this->_position++] << (8 * i);
+            }
+            return value;
+        }
+
+        void get(unsigned char* data, size_t len)
+        {
+            memcpy(data, this->_data.data() + this->_position, len);
+            this->_position += len;
+        }
+
+    private:
+        const std::vector<uint8_t>& _data;
+        size_t _position;
+};
+
+static bool encode(const mbedtls_ssl_session& session, std::vector<uint8_t>& out)
+{
+    out.clear();
+    put(out, session.ciphersuite, 2);
+    put(out, session.compression, 1);
+    put(out, session.id_len, 1);
+    put(out, session.id, session.id_len);
+    put(out, session.master, sizeof(session.master));
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (session.ticket_len > 0xFFFF) {
+        return false;
+    }
+    put(out, session.ticket_len, 2);
+    put(out, session.ticket, session.ticket_len);
+    put(out, session.ticket_lifetime, 4);
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    put(out, session.mfl_code, 1);
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+    put(out, session.encrypt_then_mac, 1);
+#endif
+    return true;
+}
+
+static bool decode(const std::vector<uint8_t>& data, mbedtls_ssl_session& session)
+{
+    SessionReader in(data);
+    if (!in.has(4)) {
+        return false;
+    }
+    session.ciphersuite = in.get(2);
+    session.compression = in.get(1);
+    session.id_len = in.get(1);
+    if (session.id_len > sizeof(session.id) || !in.has(session.id_len + sizeof(session.master))) {
+        return false;
+    }
+    in.get(session.id, session.id_len);
+    in.get(session.master, sizeof(session.master));
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (!in.has(2)) {
+        return false;
+    }
+    size_t ticket = in.get(2);
+    if (!in.has(ticket + 4)) {
+        return false;
+    }
+    if (ticket > 0) {
+        // released by mbedtls_ssl_session_free()
+        session.ticket = (unsigned char*)mbedtls_calloc(1, ticket);
+        if (session.ticket == nullptr) {
+            return false;
+        }
+        in.get(session.ticket, ticket);
+        session.ticket_len = ticket;
+    }
+    session.ticket_lifetime = in.get(4);
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    if (!in.has(1)) {
+        return false;
+    }
+    session.mfl_code = in.get(1);
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+    if (!in.has(1)) {
+        return false;
+    }
+    session.encrypt_then_mac = in.get(1);
+#endif
+    return in.done();
+}
+
+bool ClientSecureSessionAdapter::exportSession(WiFiClient& client, std::vector<uint8_t>& data)
+{
+    ResumableClientSecure* secure = this->secure(client);
+    if (secure == nullptr) {
+        return false;
+    }
+
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    bool result = mbedtls_ssl_get_session(secure->context(), &session) == 0 && encode(session, data);
+    mbedtls_ssl_session_free(&session);
+    return result;
+}
+
+void ClientSecureSessionAdapter::importSession(WiFiClient& client, const std::vector<uint8_t>& data)
+{
+    ResumableClientSecure* secure = this->secure(client);
+    if (secure == nullptr) {
+        return;
+    }
+
+    this->clearSession(client);
+    if (!decode(data, secure->_session)) {
+        log_w("Invalid TLS session");
+        this->clearSession(client);
+        return;
+    }
+    secure->_pending = true;
+}
+
+void ClientSecureSessionAdapter::clearSession(WiFiClient& client)
+{
+    ResumableClientSecure* secure = this->secure(client);
+    if (secure == nullptr) {
+        return;
+    }
+
+    mbedtls_ssl_session_free(&secure->_session);
+    mbedtls_ssl_session_init(&secure->_session);
+    secure->_pending = false;
+}
+
+bool ClientSecureSessionAdapter::resumed(WiFiClient& client)
+{
+    ResumableClientSecure* secure = this->secure(client);
+    if (secure == nullptr || !secure->_pending) {
+        return false;
+    }
+
+    // a resumed session keeps its master secret, a full handshake negotiates a new one
+    const mbedtls_ssl_session* session = secure->context()->session;
+    return session != nullptr && memcmp(session->master, secure->_session.master, sizeof(session->master)) == 0;
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#if defined(ESP32) && defined(HAWKBIT_TLS_RESUME)
+
+#include <WiFiClientSecure.h>
+#include <mbedtls/ssl.h>
+
+#include "hawkbit_tls.h"
+
+extern "C" int __wrap_mbedtls_ssl_handshake(mbedtls_ssl_context* ssl);
+
+/**
+ * A WiFiClientSecure, which can resume a TLS session, by session ID or session ticket.
+ *
+ * The Arduino core sets up the TLS context within connect(), right before running the handshake.
+ * So the session is handed to mbedtls when the handshake starts, by wrapping
+ * mbedtls_ssl_handshake(). This requires building with:
+ *
+ *     -DHAWKBIT_TLS_RESUME -Wl,--wrap=mbedtls_ssl_handshake
+ *
+ * Use it with a ClientSecureSessionAdapter and a TlsSessionCache:
+ *
+ *     ResumableClientSecure client;
+ *     ClientSecureSessionAdapter adapter(client);
+ *     TlsSessionCache sessions(adapter, &storage);
+ *     ...
+ *     update.tlsSessions(&sessions);
+ *
+ * The sessions are only persisted, if the storage is encrypted (see TlsSessionCache).
+ */
+class ResumableClientSecure : public WiFiClientSecure {
+    public:
+        ResumableClientSecure();
+        ~ResumableClientSecure();
+
+        ResumableClientSecure(const ResumableClientSecure&) = delete;
+        ResumableClientSecure& operator=(const ResumableClientSecure&) = delete;
+
+    private:
+        // the session to resume with the next handshake
+        mbedtls_ssl_session _session;
+        bool _pending;
+        // the next of all clients, see beforeHandshake()
+        ResumableClientSecure* _next;
+
+        mbedtls_ssl_context* context() { return &this->sslclient->ssl_ctx; }
+
+        /**
+         * Provide the pending session of the client, which owns the TLS context.
+         */
+        static void beforeHandshake(mbedtls_ssl_context* ssl);
+
+    friend class ClientSecureSessionAdapter;
+    friend int __wrap_mbedtls_ssl_handshake(mbedtls_ssl_context* ssl);
+};
+
+/**
+ * Access to the TLS session of a ResumableClientSecure.
+ *
+ * Sessions are stored as the parameters required for resuming them (cipher suite, session ID,
+ * master secret, and the ticket). The certificate of the server is not part of it, as a resumed
+ * handshake does not send it again.
+ */
+class ClientSecureSessionAdapter : public TlsSessionAdapter {
+    public:
+        /**
+         * @param client the client to manage, all others are ignored
+         */
+        explicit ClientSecureSessionAdapter(ResumableClientSecure& client) :
+            _client(client)
+        {
+        }
+
+        bool exportSession(WiFiClient& client, std::vector<uint8_t>& session) override;
+        void importSession(WiFiClient& client, const std::vector<uint8_t>& session) override;
+        void clearSession(WiFiClient& client) override;
+        bool resumed(WiFiClient& client) override;
+
+    private:
+        ResumableClientSecure& _client;
+
+        ResumableClientSecure* secure(WiFiClient& client)
+        {
+            // without RTTI, only the client given on construction can be recognized
+            return &client == &this->_client ? &this->_client : nullptr;
+        }
+};
+
+#endif
@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "hawkbit_verify.h"
+
+HashVerifier::HashVerifier() :
+    _count(0),
+    _enabled(true),
+    _finished(false),
+    _result(false)
+{
+}
+
+HashVerifier::~HashVerifier()
+{
+    for (size_t i = 0; i < this->_count; i++) {
+        mbedtls_md_free(&this->_entries[i].context);
+    }
+}
+
+static mbedtls_md_type_t algorithmOf(const String& algorithm)
+{
+    if (algorithm == "md5") {
+        return MBEDTLS_MD_MD5;
+    } else if (algorithm == "sha1") {
+        return MBEDTLS_MD_SHA1;
+    } else if (algorithm == "sha256") {
+        return MBEDTLS_MD_SHA256;
+    }
+    return MBEDTLS_MD_NONE;
+}
+
+bool HashVerifier::add(const String& algorithm, const String& expected)
+{
+    const mbedtls_md_info_t* info = mbedtls_md_info_from_type(algorithmOf(algorithm));
+    if (info == nullptr || this->_count >= MAX_HASHES) {
+        log_d("Unsupported hash: %s", algorithm.c_str());
+        return false;
+    }
+
+    Entry& entry = this->_entries[this->_count];
+    mbedtls_md_init(&entry.context);
+    if (mbedtls_md_setup(&entry.context, info, 0) != 0 || mbedtls_md_starts(&entry.context) != 0) {
+        mbedtls_md_free(&entry.context);
+        log_w("Failed to initialize hash: %s", algorithm.c_str());
+        return false;
+    }
+
+    entry.size = mbedtls_md_get_size(info);
+    entry.algorithm = algorithm;
+    entry.expected = expected;
+    entry.expected.toLowerCase();
+    this->_count++;
+
+    return true;
+}
+
+void HashVerifier::update(const uint8_t* data, size_t len)
+{
+    if (!this->_enabled || this->_finished || len == 0) {
+        return;
+    }
+    for (size_t i = 0; i < this->_count; i++) {
+        mbedtls_md_update(&this->_entries[i].context, data, len);
+    }
+}
+
+bool HashVerifier::verify()
+{
+    if (this->_finished) {
+        return this->_result;
+    }
+    this->_finished = true;
+
+    if (!this->_enabled) {
+        log_w("Unable to verify hashes, not all data was seen");
+        this->_result = false;
+        return this->_result;
+    }
+
+    this->_result = true;
+
+    for (size_t i = 0; i < this->_count; i++) {
+        Entry& entry = this->_entries[i];
+
+        uint8_t digest[MBEDTLS_MD_MAX_SIZE];
+        mbedtls_md_finish(&entry.context, digest);
+
+        char hex[MBEDTLS_MD_MAX_SIZE * 2 + 1];
+        uint8_t size = entry.size;
+        for (uint8_t j = 0; j < size; j++) {
+            sprintf(hex + j * 2, "%02x", digest[j]);
+        }
+        hex[size * 2] = 0;
+
+        if (entry.expected != hex) {
+            log_w("Hash mismatch - %s: expected %s, actual %s", entry.algorithm.c_str(), entry.expected.c_str(), hex);
+            this->_result = false;
+        } else {
+            log_d("Hash verified - %s: %s", entry.algorithm.c_str(), hex);
+        }
+    }
+
+    return this->_result;
+}
@@ -0,0 +1,122 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "hawkbit_log.h"
+#include <mbedtls/md.h>
+
+/**
+ * Computes hashes incrementally, and compares them to the expected values.
+ *
+ * Supports the algorithms hawkBit provides for artifacts: "md5", "sha1" and "sha256".
+ */
+class HashVerifier {
+    public:
+        static const size_t MAX_HASHES = 3;
+
+        HashVerifier();
+        ~HashVerifier();
+
+        HashVerifier(const HashVerifier&) = delete;
+        HashVerifier& operator=(const HashVerifier&) = delete;
+
+        /**
+         * Add an expected hash, returns false if the algorithm is not supported.
+         * @param algorithm the name of the algorithm, as used by hawkBit
+         * @param expected the expected value, hex encoded
+         */
+        bool add(const String& algorithm, const String& expected);
+
+        void update(const uint8_t* data, size_t len);
+
+        /**
+         * Disable verification, as not all data passes through the verifier (e.g. resuming a download
+         * without the state of the verifier which saw the beginning).
+         */
+        void disable() { this->_enabled = false; }
+
+        /**
+         * Check if more data can be verified, as the verifier is enabled and not finished yet.
+         */
+        bool active() const { return this->_enabled && !this->_finished; }
+
+        /**
+         * Get the number of hashes being computed.
+         */
+        size_t count() const { return this->_count; }
+
+        /**
+         * Finish computing the hashes, and compare them to the expected values.
+         *
+         * Returns false if any of the hashes does not match, or the verifier was disabled. Returns
+         * true if all hashes match, or no hash was expected.
+         */
+        bool verify();
+
+    private:
+        struct Entry {
+            mbedtls_md_context_t context;
+            uint8_t size;
+            String algorithm;
+            String expected;
+        };
+
+        Entry _entries[MAX_HASHES];
+        size_t _count;
+        bool _enabled;
+        bool _finished;
+        bool _result;
+};
+
+/**
+ * A stream, passing everything it reads through a hash verifier.
+ */
+class VerifyingStream : public Stream {
+    public:
+        VerifyingStream(Stream& source, HashVerifier& verifier) :
+            _source(source),
+            _verifier(verifier)
+        {
+        }
+
+        int available() override { return _source.available(); }
+        int peek() override { return _source.peek(); }
+        void flush() override { _source.flush(); }
+        size_t write(uint8_t c) override { return _source.write(c); }
+
+        int read() override
+        {
+            int c = _source.read();
+            if (c >= 0) {
+                uint8_t b = c;
+                _verifier.update(&b, 1);
+            }
+            return c;
+        }
+
+        using Stream::readBytes;
+
+        size_t readBytes(char* buffer, size_t length) override
+        {
+            size_t len = _source.readBytes(buffer, length);
+            _verifier.update((const uint8_t*)buffer, len);
+            return len;
+        }
+
+    private:
+        Stream& _source;
+        HashVerifier& _verifier;
+};
@@ -0,0 +1,243 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include "alloc.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <MockServer.h>
+
+/*
+ * Counts all heap allocations: operator new allocates with malloc(), and so does the C code
+ * (e.g. the arena of a deployment, or ArduinoJson).
+ *
+ * With AddressSanitizer, which replaces the allocator, its allocation hooks are used. Otherwise,
+ * the functions of the C library are wrapped.
+ *
+ * Blocks allocated off the device (see OffDevice) are remembered, so that they are not counted
+ * when they are released either, no matter by which thread.
+ */
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define HAWKBIT_ASAN 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define HAWKBIT_ASAN 1
+#endif
+
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> allocated(0);
+static std::atomic<size_t> held(0);
+static std::atomic<size_t> highest(0);
+
+// an open addressing hash set of the blocks allocated off the device, without allocating itself
+static const size_t OFF_DEVICE_CAPACITY = 1 << 16;
+static const uintptr_t EMPTY = 0;
+static const uintptr_t REMOVED = 1;
+
+static std::mutex offDeviceLock;
+static uintptr_t offDeviceBlocks[OFF_DEVICE_CAPACITY];
+static std::atomic<size_t> offDeviceCount(0);
+static size_t offDeviceRemoved = 0;
+
+static size_t slotOf(uintptr_t block)
+{
+    return (block >> 4) * 0x9e3779b97f4a7c15ull >> 48 & (OFF_DEVICE_CAPACITY - 1);
+}
+
+static void addOffDevice(const volatile void* ptr)
+{
+    uintptr_t block = (uintptr_t)ptr;
+    std::lock_guard<std::mutex> lock(offDeviceLock);
+    if (offDeviceCount + offDeviceRemoved >= OFF_DEVICE_CAPACITY * 3 / 4) {
+        if (offDeviceCount >= OFF_DEVICE_CAPACITY / 2) {
+            abort();
+        }
+        // rehash, dropping the removed entries
+        static uintptr_t blocks[OFF_DEVICE_CAPACITY];
+        memcpy(blocks, offDeviceBlocks, sizeof(blocks));
+        memset(offDeviceBlocks, 0, sizeof(offDeviceBlocks));
+        offDeviceRemoved = 0;
+        for (uintptr_t b : blocks) {
+            if (b != EMPTY && b != REMOVED) {
+                size_t i = slotOf(b);
+                while (offDeviceBlocks[i] != EMPTY) {
+                    i = (i + 1) & (OFF_DEVICE_CAPACITY - 1);
+                }
+                offDeviceBlocks[i] = b;
+            }
+        }
+    }
+    size_t i = slotOf(block);
+    while (offDeviceBlocks[i] != EMPTY && offDeviceBlocks[i] != REMOVED) {
+        i = (i + 1) & (OFF_DEVICE_CAPACITY - 1);
+    }
+    if (offDeviceBlocks[i] == REMOVED) {
+        offDeviceRemoved--;
+    }
+    offDeviceBlocks[i] = block;
+    offDeviceCount++;
+}
+
+static bool removeOffDevice(const volatile void* ptr)
+{
+    if (offDeviceCount == 0) {
+        return false;
+    }
+    uintptr_t block = (uintptr_t)ptr;
+    std::lock_guard<std::mutex> lock(offDeviceLock);
+    for (size_t i = slotOf(block); offDeviceBlocks[i] != EMPTY; i = (i + 1) & (OFF_DEVICE_CAPACITY - 1)) {
+        if (offDeviceBlocks[i] == block) {
+            offDeviceBlocks[i] = REMOVED;
+            offDeviceRemoved++;
+            offDeviceCount--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void allocate(const volatile void* ptr, size_t size)
+{
+    if (OffDevice::active()) {
+        addOffDevice(ptr);
+        return;
+    }
+    allocations++;
+    allocated += size;
+    size_t now = held += size;
+    size_t peak = highest;
+    while (now > peak && !highest.compare_exchange_weak(peak, now)) {
+    }
+}
+
+static void release(const volatile void* ptr, size_t size)
+{
+    if (!removeOffDevice(ptr)) {
+        held -= size;
+    }
+}
+
+#if defined(HAWKBIT_ASAN)
+
+extern "C" {
+int __sanitizer_install_malloc_and_free_hooks(void (*malloc_hook)(const volatile void*, size_t), void (*free_hook)(const volatile void*));
+size_t __sanitizer_get_allocated_size(const volatile void* ptr);
+}
+
+static void mallocHook(const volatile void* ptr, size_t size)
+{
+    allocate(ptr, size);
+}
+
+static void freeHook(const volatile void* ptr)
+{
+    // called before the block is released
+    release(ptr, __sanitizer_get_allocated_size(ptr));
+}
+
+static int installed = __sanitizer_install_malloc_and_free_hooks(mallocHook, freeHook);
+
+#else
+
+#include <malloc.h>
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+// the usable size is counted, as it is what the block really takes
+
+void* malloc(size_t size)
+{
+    void* ptr = __libc_malloc(size);
+    if (ptr != nullptr) {
+        allocate(ptr, malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size)
+{
+    void* ptr = __libc_calloc(count, size);
+    if (ptr != nullptr) {
+        allocate(ptr, malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (ptr == nullptr) {
+        return malloc(size);
+    }
+    size_t before = malloc_usable_size(ptr);
+    void* result = __libc_realloc(ptr, size);
+    if (result != nullptr || size == 0) {
+        release(ptr, before);
+    }
+    if (result != nullptr) {
+        allocate(result, malloc_usable_size(result));
+    }
+    return result;
+}
+
+void free(void* ptr)
+{
+    if (ptr != nullptr) {
+        release(ptr, malloc_usable_size(ptr));
+        __libc_free(ptr);
+    }
+}
+
+}
+
+#endif
+
+AllocationCounter::AllocationCounter() :
+    _count(allocations),
+    _bytes(allocated),
+    _current(held)
+{
+    highest = this->_current;
+}
+
+size_t AllocationCounter::count() const
+{
+    return allocations - this->_count;
+}
+
+size_t AllocationCounter::bytes() const
+{
+    return allocated - this->_bytes;
+}
+
+size_t AllocationCounter::peak() const
+{
+    return highest - this->_current;
+}
+
+long AllocationCounter::current() const
+{
+    return (long)held - (long)this->_current;
+}
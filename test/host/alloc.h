@@ -0,0 +1,53 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Counts the heap allocations (through operator new or malloc()) within its lifetime.
+ *
+ * Linking alloc.cpp wraps the allocator of a test executable. Only one counter should be active
+ * at a time, allocations of all threads are counted. Sizes are those of the blocks handed out,
+ * which may be slightly larger than requested.
+ */
+class AllocationCounter {
+    public:
+        AllocationCounter();
+
+        /**
+         * Get the number of allocations.
+         */
+        size_t count() const;
+
+        /**
+         * Get the number of bytes allocated, including what has been released again.
+         */
+        size_t bytes() const;
+
+        /**
+         * Get the highest number of bytes held at the same time, on top of what was held at the start.
+         */
+        size_t peak() const;
+
+        /**
+         * Get the number of bytes held now, on top of what was held at the start.
+         */
+        long current() const;
+
+    private:
+        size_t _count;
+        size_t _bytes;
+        size_t _current;
+};
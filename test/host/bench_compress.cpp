@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit_compress.h>
+
+#include <chrono>
+
+#include "codecs.h"
+#include "streams.h"
+
+/*
+ * The throughput of the decompressors, by window size.
+ *
+ * Usage: bench_compress [<size in KiB>] - the default is 1024
+ */
+
+static double decompress(const std::string& compressed, Decompressor* decompressor, size_t expected)
+{
+    auto start = std::chrono::steady_clock::now();
+    MemoryStream source(compressed);
+    DecompressingStream stream(source, compressed.size(), decompressor);
+    // the buffer size used by Update.writeStream()
+    size_t size = readAll(stream, 4096).size();
+    auto end = std::chrono::steady_clock::now();
+    if (size != expected || stream.failed()) {
+        fprintf(stderr, "decompression failed\n");
+        exit(1);
+    }
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static void report(const char* name, unsigned window, const std::string& data, const std::string& compressed, double seconds)
+{
+    printf("%-12s %9u %9.1f%% %12.1f\n", name, window, 100.0 * compressed.size() / data.size(), data.size() / seconds / (1024 * 1024));
+}
+
+int main(int argc, char** argv)
+{
+    size_t size = (argc > 1 ? atoi(argv[1]) : 1024) * 1024;
+    std::string data = firmware(size);
+    const int runs = 5;
+
+    printf("%-12s %9s %10s %12s\n", "codec", "window", "ratio", "MiB/s");
+
+    for (uint8_t window = 8; window <= 14; window++) {
+        uint8_t lookahead = window > 8 ? 5 : 4;
+        std::string compressed = heatshrinkEncode(data, window, lookahead);
+        double best = 1e9;
+        for (int i = 0; i < runs; i++) {
+            double seconds = decompress(compressed, new HeatshrinkDecompressor(window, lookahead), size);
+            best = seconds < best ? seconds : best;
+        }
+        report("heatshrink", 1u << window, data, compressed, best);
+    }
+
+#if defined(HAWKBIT_GZIP)
+    std::string compressed = gzipEncode(data);
+    double best = 1e9;
+    for (int i = 0; i < runs; i++) {
+        double seconds = decompress(compressed, new GzipDecompressor(), size);
+        best = seconds < best ? seconds : best;
+    }
+    report("gzip", TINFL_LZ_DICT_SIZE, data, compressed, best);
+#endif
+
+    return 0;
+}
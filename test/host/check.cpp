@@ -0,0 +1,70 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "check.h"
+
+#include <string.h>
+#include <vector>
+
+namespace check {
+
+struct Test {
+    const char* name;
+    TestFunction function;
+};
+
+static std::vector<Test>& tests()
+{
+    static std::vector<Test> tests;
+    return tests;
+}
+
+static int failures = 0;
+
+Registration::Registration(const char* name, TestFunction function)
+{
+    tests().push_back({ name, function });
+}
+
+void fail(const char* file, int line, const char* expression, const char* detail)
+{
+    failures++;
+    fprintf(stderr, "%s:%d: check failed: %s%s%s\n", file, line, expression, detail != nullptr ? " - " : "", detail != nullptr ? detail : "");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int run = 0;
+    int failed = 0;
+    for (const check::Test& test : check::tests()) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc && !selected; i++) {
+            selected = strcmp(argv[i], test.name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        int before = check::failures;
+        printf("[ RUN  ] %s\n", test.name);
+        fflush(stdout);
+        test.function();
+        bool ok = check::failures == before;
+        printf("[ %s ] %s\n", ok ? " OK " : "FAIL", test.name);
+        run++;
+        failed += ok ? 0 : 1;
+    }
+    printf("%d tests, %d failed\n", run, failed);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
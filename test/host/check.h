@@ -0,0 +1,70 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * A minimal test harness: a test executable defines its cases with TEST(), and is linked with
+ * check.cpp, which runs them all (or the ones named on the command line).
+ */
+
+namespace check {
+
+typedef void (*TestFunction)();
+
+struct Registration {
+    Registration(const char* name, TestFunction function);
+};
+
+/**
+ * Record a failed check, the current test continues.
+ */
+void fail(const char* file, int line, const char* expression, const char* detail = nullptr);
+
+}
+
+#define TEST(name) \
+    static void name(); \
+    static check::Registration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            check::fail(__FILE__, __LINE__, #expression); \
+        } \
+    } while (0)
+
+#define CHECK_EQ(expected, actual) \
+    do { \
+        long long e_ = (long long)(expected); \
+        long long a_ = (long long)(actual); \
+        if (e_ != a_) { \
+            char detail_[96]; \
+            snprintf(detail_, sizeof(detail_), "expected: %lld, actual: %lld", e_, a_); \
+            check::fail(__FILE__, __LINE__, #expected " == " #actual, detail_); \
+        } \
+    } while (0)
+
+#define CHECK_STR(expected, actual) \
+    do { \
+        String e_ = (expected); \
+        String a_ = (actual); \
+        if (e_ != a_) { \
+            String detail_ = String("expected: \"") + e_ + "\", actual: \"" + a_ + "\""; \
+            check::fail(__FILE__, __LINE__, #expected " == " #actual, detail_.c_str()); \
+        } \
+    } while (0)
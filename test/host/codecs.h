@@ -0,0 +1,153 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+/*
+ * Compressors for the test data, the counterparts of the decompressors of the library.
+ */
+
+/**
+ * Writes bits, the most significant first.
+ */
+class BitWriter {
+    public:
+        BitWriter() :
+            _current(0),
+            _bits(0)
+        {
+        }
+
+        void write(uint32_t value, uint8_t count)
+        {
+            for (int i = count - 1; i >= 0; i--) {
+                this->_current = (this->_current << 1) | ((value >> i) & 1);
+                if (++this->_bits == 8) {
+                    this->_out += (char)this->_current;
+                    this->_current = 0;
+                    this->_bits = 0;
+                }
+            }
+        }
+
+        std::string finish()
+        {
+            if (this->_bits > 0) {
+                // padded with zeros, like heatshrink does
+                this->_out += (char)(this->_current << (8 - this->_bits));
+                this->_current = 0;
+                this->_bits = 0;
+            }
+            return this->_out;
+        }
+
+    private:
+        std::string _out;
+        uint8_t _current;
+        uint8_t _bits;
+};
+
+/**
+ * Compress the data like <code>heatshrink -e -w &lt;window&gt; -l &lt;lookahead&gt;</code>: a
+ * tag bit, followed by a literal byte (1), or the offset and length of a back-reference (0).
+ *
+ * Matches are found with hash chains, which is not as thorough as heatshrink, but good enough
+ * for the tests and fast enough for the benchmark.
+ */
+inline std::string heatshrinkEncode(const std::string& data, uint8_t window, uint8_t lookahead)
+{
+    const size_t windowSize = (size_t)1 << window;
+    const size_t maxLength = (size_t)1 << lookahead;
+    // a back-reference must be shorter than the literals it replaces
+    const size_t minLength = (1 + window + lookahead) / 9 + 1;
+    const int maxChain = 64;
+
+    std::vector<int> head(1 << 16, -1);
+    std::vector<int> previous(data.size(), -1);
+    auto hash = [&data](size_t i) {
+        return ((uint8_t)data[i] << 8 | (uint8_t)data[i + 1]) & 0xffff;
+    };
+    auto insert = [&](size_t i) {
+        if (i + 1 < data.size()) {
+            previous[i] = head[hash(i)];
+            head[hash(i)] = i;
+        }
+    };
+
+    BitWriter out;
+    size_t i = 0;
+    while (i < data.size()) {
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        if (i + 1 < data.size()) {
+            int chain = 0;
+            for (int j = head[hash(i)]; j >= 0 && i - j <= windowSize && chain < maxChain; j = previous[j], chain++) {
+                size_t length = 0;
+                while (length < maxLength && i + length < data.size() && data[j + length] == data[i + length]) {
+                    length++;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestOffset = i - j;
+                }
+            }
+        }
+        if (bestLength >= minLength) {
+            out.write(0, 1);
+            out.write(bestOffset - 1, window);
+            out.write(bestLength - 1, lookahead);
+            for (size_t k = 0; k < bestLength; k++) {
+                insert(i++);
+            }
+        } else {
+            out.write(1, 1);
+            out.write((uint8_t)data[i], 8);
+            insert(i++);
+        }
+    }
+    return out.finish();
+}
+
+/**
+ * Compress the data with gzip.
+ * @param name the file name to put into the header, or null
+ */
+inline std::string gzipEncode(const std::string& data, const char* name = nullptr)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 + 15: a gzip header and trailer, with a window of 32 KiB
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY);
+
+    gz_header header;
+    memset(&header, 0, sizeof(header));
+    if (name != nullptr) {
+        header.name = (Bytef*)name;
+        deflateSetHeader(&stream, &header);
+    }
+
+    std::string result(deflateBound(&stream, data.size()), 0);
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)&result[0];
+    stream.avail_out = result.size();
+    deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
@@ -0,0 +1,429 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "ddi.h"
+
+#include <stdio.h>
+#include <thread>
+
+#include <ArduinoJson.h>
+#include <openssl/evp.h>
+
+static std::string hexDigest(const EVP_MD* md, const std::string& data)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_Digest(data.data(), data.size(), digest, &len, md, nullptr);
+    std::string result;
+    char hex[3];
+    for (unsigned int i = 0; i < len; i++) {
+        snprintf(hex, sizeof(hex), "%02x", digest[i]);
+        result += hex;
+    }
+    return result;
+}
+
+static std::string quote(const String& value)
+{
+    std::string result = "\"";
+    for (const char* c = value.c_str(); *c != 0; c++) {
+        if (*c == '"' || *c == '\\') {
+            result += '\\';
+        }
+        result += *c;
+    }
+    return result + "\"";
+}
+
+static std::string contentHash(const std::string& content)
+{
+    char hash[24];
+    snprintf(hash, sizeof(hash), "%zx", std::hash<std::string>()(content));
+    return hash;
+}
+
+/**
+ * Split a path into its segments, without the query.
+ */
+static std::vector<String> segments(const String& path)
+{
+    std::vector<String> result;
+    int query = path.indexOf('?');
+    String p = query < 0 ? path : path.substring(0, query);
+    int start = 1;
+    while (start < (int)p.length()) {
+        int end = p.indexOf('/', start);
+        if (end < 0) {
+            end = p.length();
+        }
+        result.push_back(p.substring(start, end));
+        start = end + 1;
+    }
+    return result;
+}
+
+DdiServer::DdiServer(const String& base, const String& tenant) :
+    _http(base),
+    _tenant(tenant),
+    _prefix("/" + tenant + "/controller/v1/"),
+    _sleep("00:05:00"),
+    _nextAction(1),
+    _closed(0),
+    _latency(0)
+{
+    this->_http.on("GET", this->_prefix, [this](const MockRequest& request) { return this->get(request); });
+    this->_http.on("POST", this->_prefix, [this](const MockRequest& request) { return this->post(request); });
+    this->_http.on("PUT", this->_prefix, [this](const MockRequest& request) { return this->put(request); });
+}
+
+void DdiServer::sleep(const String& interval)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_sleep = interval;
+}
+
+String DdiServer::controllerUrl(const String& controllerId) const
+{
+    return this->base() + this->_prefix + controllerId;
+}
+
+String DdiServer::deploy(const String& controllerId, const std::vector<DdiChunk>& chunks, const String& download, const String& update)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    Action action;
+    action.id = String(this->_nextAction++);
+    action.download = download;
+    action.update = update;
+    action.chunks = chunks;
+    action.canceled = false;
+    action.closed = false;
+    action.json = this->deploymentBase(controllerId, action);
+    this->_controllers[controllerId].actions.push_back(action);
+    return action.id;
+}
+
+void DdiServer::cancel(const String& controllerId)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    Action* action = this->current(this->_controllers[controllerId]);
+    if (action != nullptr) {
+        action->canceled = true;
+    }
+}
+
+void DdiServer::requestConfig(const String& controllerId)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_controllers[controllerId].config = true;
+}
+
+std::map<String, String> DdiServer::configData(const String& controllerId) const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    auto i = this->_controllers.find(controllerId);
+    return i != this->_controllers.end() ? i->second.data : std::map<String, String>();
+}
+
+std::vector<DdiFeedback> DdiServer::feedback() const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_feedback;
+}
+
+uint32_t DdiServer::closed() const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_closed;
+}
+
+void DdiServer::shapeDownloads(std::function<void(MockResponse&)> shape)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_shape = shape;
+}
+
+DdiServer::Action* DdiServer::action(Controller& controller, const String& id)
+{
+    for (Action& action : controller.actions) {
+        if (action.id == id) {
+            return &action;
+        }
+    }
+    return nullptr;
+}
+
+DdiServer::Action* DdiServer::current(Controller& controller)
+{
+    for (Action& action : controller.actions) {
+        if (!action.closed) {
+            return &action;
+        }
+    }
+    return nullptr;
+}
+
+std::string DdiServer::controllerBase(const String& controllerId, const Controller& controller) const
+{
+    String url = this->controllerUrl(controllerId);
+    std::string links;
+    for (const Action& action : controller.actions) {
+        if (action.closed) {
+            continue;
+        }
+        if (action.canceled) {
+            links = "\"cancelAction\":{\"href\":" + quote(url + "/cancelAction/" + action.id) + "}";
+        } else {
+            String href = url + "/deploymentBase/" + action.id + "?c=-" + contentHash(action.json).c_str();
+            links = "\"deploymentBase\":{\"href\":" + quote(href) + "}";
+        }
+        break;
+    }
+    if (controller.config) {
+        links += (links.empty() ? "" : ",");
+        links += "\"configData\":{\"href\":" + quote(url + "/configData") + "}";
+    }
+
+    return "{\"config\":{\"polling\":{\"sleep\":" + quote(this->_sleep) + "}},\"_links\":{" + links + "}}";
+}
+
+std::string DdiServer::deploymentBase(const String& controllerId, const Action& action) const
+{
+    std::string chunks;
+    int module = 0;
+    for (const DdiChunk& chunk : action.chunks) {
+        module++;
+        std::string artifacts;
+        for (const DdiArtifact& artifact : chunk.artifacts) {
+            String path = this->_prefix + controllerId + "/softwaremodules/" + String(module) + "/artifacts/" + artifact.filename;
+            artifacts += artifacts.empty() ? "{" : ",{";
+            artifacts += "\"filename\":" + quote(artifact.filename);
+            artifacts += ",\"hashes\":{\"sha1\":\"" + hexDigest(EVP_sha1(), artifact.content)
+                + "\",\"md5\":\"" + hexDigest(EVP_md5(), artifact.content)
+                + "\",\"sha256\":\"" + hexDigest(EVP_sha256(), artifact.content) + "\"}";
+            artifacts += ",\"size\":" + std::to_string(artifact.content.size());
+            artifacts += ",\"_links\":" + this->artifactLinks(path) + "}";
+        }
+        chunks += chunks.empty() ? "{" : ",{";
+        chunks += "\"part\":" + quote(chunk.part) + ",\"version\":" + quote(chunk.version) + ",\"name\":" + quote(chunk.name);
+        chunks += ",\"artifacts\":[" + artifacts + "]";
+        if (!chunk.metadata.empty()) {
+            std::string metadata;
+            for (const std::pair<String, String>& entry : chunk.metadata) {
+                metadata += metadata.empty() ? "{" : ",{";
+                metadata += "\"key\":" + quote(entry.first) + ",\"value\":" + quote(entry.second) + "}";
+            }
+            chunks += ",\"metadata\":[" + metadata + "]";
+        }
+        chunks += "}";
+    }
+
+    // the action history is not evaluated by the client, the server sends it anyway
+    return "{\"id\":" + quote(action.id)
+        + ",\"deployment\":{\"download\":" + quote(action.download) + ",\"update\":" + quote(action.update)
+        + ",\"maintenanceWindow\":\"available\",\"chunks\":[" + chunks + "]}"
+        + ",\"actionHistory\":{\"status\":\"RUNNING\",\"messages\":[\"Assignment initiated by user 'admin'\"]}}";
+}
+
+std::string DdiServer::artifactLinks(const String& path) const
+{
+    if (this->_downloadHosts.empty()) {
+        String href = this->base() + path;
+        return "{\"download\":{\"href\":" + quote(href) + "}"
+            + ",\"md5sum\":{\"href\":" + quote(href + ".MD5SUM") + "}"
+            + ",\"download-http\":{\"href\":" + quote(href) + "}"
+            + ",\"md5sum-http\":{\"href\":" + quote(href + ".MD5SUM") + "}}";
+    }
+
+    String checksums = this->_checksumHost->base() + path;
+    std::string links = "{\"md5sum\":{\"href\":" + quote(checksums + ".MD5SUM") + "}"
+        + ",\"sha1sum\":{\"href\":" + quote(checksums + ".SHA1SUM") + "}"
+        + ",\"sha256sum\":{\"href\":" + quote(checksums + ".SHA256SUM") + "}";
+    for (size_t i = 0; i < this->_downloadHosts.size(); i++) {
+        String name = i == 0 ? String("download") : i == 1 ? String("download-http") : "download-mirror-" + String((unsigned int)i);
+        links += ",\"" + std::string(name.c_str()) + "\":{\"href\":" + quote(this->_downloadHosts[i]->base() + path) + "}";
+    }
+    return links + "}";
+}
+
+std::vector<MockServer*> DdiServer::downloadHosts(const std::vector<String>& hosts, const String& checksums)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    std::vector<MockServer*> result;
+    auto serve = [this](MockServer& server) {
+        server.on("GET", this->_prefix, [this](const MockRequest& request) -> MockResponse {
+            std::vector<String> path = segments(request.path.substring(this->_prefix.length() - 1));
+            if (path.size() != 5 || path[1] != "softwaremodules" || path[3] != "artifacts") {
+                return MockResponse(404);
+            }
+            std::lock_guard<std::mutex> lock(this->_lock);
+            return this->artifact(request, path[4]);
+        });
+    };
+    this->_downloadHosts.clear();
+    for (const String& host : hosts) {
+        this->_downloadHosts.push_back(std::unique_ptr<MockServer>(new MockServer(host)));
+        serve(*this->_downloadHosts.back());
+        result.push_back(this->_downloadHosts.back().get());
+    }
+    this->_checksumHost.reset(new MockServer(checksums));
+    serve(*this->_checksumHost);
+    return result;
+}
+
+MockResponse DdiServer::get(const MockRequest& request)
+{
+    uint32_t latency = this->_latency;
+    if (latency > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(latency));
+    }
+
+    std::vector<String> path = segments(request.path.substring(this->_prefix.length() - 1));
+    if (path.empty()) {
+        return MockResponse(404);
+    }
+
+    std::lock_guard<std::mutex> lock(this->_lock);
+    Controller& controller = this->_controllers[path[0]];
+
+    if (path.size() == 1) {
+        std::string body = this->controllerBase(path[0], controller);
+        String etag = String("\"") + contentHash(body).c_str() + "\"";
+        if (request.header("If-None-Match") == etag) {
+            return MockResponse(304).header("ETag", etag);
+        }
+        return MockResponse(200, body).header("ETag", etag);
+    }
+
+    if (path.size() == 3 && path[1] == "deploymentBase") {
+        Action* action = this->action(controller, path[2]);
+        return action != nullptr ? MockResponse(200, action->json) : MockResponse(404);
+    }
+
+    if (path.size() == 3 && path[1] == "cancelAction") {
+        Action* action = this->action(controller, path[2]);
+        if (action == nullptr || !action->canceled) {
+            return MockResponse(404);
+        }
+        return MockResponse(200, "{\"id\":" + quote(action->id) + ",\"cancelAction\":{\"stopId\":" + quote(action->id) + "}}");
+    }
+
+    if (path.size() == 5 && path[1] == "softwaremodules" && path[3] == "artifacts") {
+        return this->artifact(request, path[4]);
+    }
+
+    return MockResponse(404);
+}
+
+MockResponse DdiServer::artifact(const MockRequest& request, const String& filename) const
+{
+    for (const auto& entry : this->_controllers) {
+        for (const Action& action : entry.second.actions) {
+            for (const DdiChunk& chunk : action.chunks) {
+                for (const DdiArtifact& artifact : chunk.artifacts) {
+                    if (artifact.filename != filename) {
+                        continue;
+                    }
+
+                    bool encoded = !artifact.encoding.isEmpty();
+                    const std::string& content = encoded ? artifact.encoded : artifact.content;
+
+                    MockResponse response(200);
+                    unsigned int start = 0;
+                    String range = request.header("Range");
+                    if (!encoded && sscanf(range.c_str(), "bytes=%u-", &start) == 1 && start < content.size()) {
+                        response.code = 206;
+                        response.header("Content-Range", String("bytes ") + String(start) + "-" + String((unsigned int)content.size() - 1) + "/" + String((unsigned int)content.size()));
+                    } else {
+                        start = 0;
+                    }
+                    response.body = content.substr(start);
+                    if (encoded) {
+                        response.header("Content-Encoding", artifact.encoding);
+                    }
+                    if (this->_shape) {
+                        this->_shape(response);
+                    }
+                    return response;
+                }
+            }
+        }
+    }
+    return MockResponse(404);
+}
+
+MockResponse DdiServer::post(const MockRequest& request)
+{
+    std::vector<String> path = segments(request.path.substring(this->_prefix.length() - 1));
+    if (path.size() != 4 || path[3] != "feedback" || (path[1] != "deploymentBase" && path[1] != "cancelAction")) {
+        return MockResponse(404);
+    }
+
+    DynamicJsonDocument doc(2048);
+    if (deserializeJson(doc, request.body.c_str())) {
+        return MockResponse(400);
+    }
+
+    DdiFeedback feedback;
+    feedback.controllerId = path[0];
+    feedback.actionId = path[2];
+    feedback.execution = doc["status"]["execution"] | "";
+    feedback.finished = doc["status"]["result"]["finished"] | "";
+    feedback.done = doc["status"]["result"]["progress"]["cnt"] | 0;
+    feedback.total = doc["status"]["result"]["progress"]["of"] | 0;
+    feedback.received = millis();
+
+    std::lock_guard<std::mutex> lock(this->_lock);
+    Action* action = this->action(this->_controllers[path[0]], path[2]);
+    if (action == nullptr) {
+        return MockResponse(404);
+    }
+    if (action->closed) {
+        return MockResponse(410);
+    }
+    if (feedback.execution == "closed") {
+        action->closed = true;
+        this->_closed++;
+    }
+    this->_feedback.push_back(feedback);
+    return MockResponse(200);
+}
+
+MockResponse DdiServer::put(const MockRequest& request)
+{
+    std::vector<String> path = segments(request.path.substring(this->_prefix.length() - 1));
+    if (path.size() != 2 || path[1] != "configData") {
+        return MockResponse(404);
+    }
+
+    DynamicJsonDocument doc(4096);
+    if (deserializeJson(doc, request.body.c_str())) {
+        return MockResponse(400);
+    }
+
+    std::lock_guard<std::mutex> lock(this->_lock);
+    Controller& controller = this->_controllers[path[0]];
+    String mode = doc["mode"] | "merge";
+    if (mode == "replace") {
+        controller.data.clear();
+    }
+    const JsonDocument& json = doc;
+    for (JsonPairConst entry : json["data"].as<JsonObjectConst>()) {
+        if (mode == "remove") {
+            controller.data.erase(entry.key().c_str());
+        } else {
+            controller.data[entry.key().c_str()] = entry.value().as<const char*>();
+        }
+    }
+    controller.config = false;
+    return MockResponse(200);
+}
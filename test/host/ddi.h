@@ -0,0 +1,203 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <MockServer.h>
+
+/**
+ * An artifact, offered by a DdiServer.
+ */
+struct DdiArtifact {
+    DdiArtifact(const String& filename, const std::string& content) :
+        filename(filename),
+        content(content)
+    {
+    }
+
+    String filename;
+    std::string content;
+    // if set, the artifact is sent encoded, e.g. with "gzip"
+    String encoding;
+    std::string encoded;
+};
+
+/**
+ * A software module of a deployment, offered by a DdiServer.
+ */
+struct DdiChunk {
+    DdiChunk(const String& name, const String& version, const std::vector<DdiArtifact>& artifacts, const String& part = "os") :
+        part(part),
+        name(name),
+        version(version),
+        artifacts(artifacts)
+    {
+    }
+
+    String part;
+    String name;
+    String version;
+    std::vector<DdiArtifact> artifacts;
+    // the metadata of the software module, which is visible to the target
+    std::vector<std::pair<String, String>> metadata;
+};
+
+/**
+ * A feedback, as received by a DdiServer.
+ */
+struct DdiFeedback {
+    String controllerId;
+    String actionId;
+    String execution;
+    String finished;
+    uint32_t done;
+    uint32_t total;
+    // when it was received (see millis())
+    unsigned long received;
+};
+
+/**
+ * A scriptable stand-in for the DDI API of a hawkBit server.
+ *
+ * It serves the controller base, deploymentBase, cancelAction and configData resources, and the
+ * artifacts, of any number of controllers. A test scripts what a controller gets offered, and
+ * inspects what the controllers reported. Like the server, it puts a hash of the deployment into
+ * its href, and answers conditional requests of the controller base.
+ */
+class DdiServer {
+    public:
+        explicit DdiServer(const String& base = "http://hawkbit:8080", const String& tenant = "DEFAULT");
+
+        DdiServer(const DdiServer&) = delete;
+        DdiServer& operator=(const DdiServer&) = delete;
+
+        MockServer& http() { return this->_http; }
+        const String& base() const { return this->_http.base(); }
+        const String& tenant() const { return this->_tenant; }
+
+        /**
+         * Set the polling interval, which is sent to the controllers (e.g. "00:05:00").
+         */
+        void sleep(const String& interval);
+
+        /**
+         * Offer a deployment to a controller.
+         * @return the ID of the action
+         */
+        String deploy(const String& controllerId, const std::vector<DdiChunk>& chunks, const String& download = "forced", const String& update = "forced");
+
+        /**
+         * Cancel the action of a controller.
+         */
+        void cancel(const String& controllerId);
+
+        /**
+         * Request the attributes of a controller.
+         */
+        void requestConfig(const String& controllerId);
+
+        /**
+         * Get the attributes, which a controller reported.
+         */
+        std::map<String, String> configData(const String& controllerId) const;
+
+        /**
+         * Get all feedback, which was received.
+         */
+        std::vector<DdiFeedback> feedback() const;
+
+        /**
+         * Get the number of actions, which were closed by the controllers.
+         */
+        uint32_t closed() const;
+
+        /**
+         * Change how artifacts are delivered (e.g. to slow them down, or to drop the connection).
+         */
+        void shapeDownloads(std::function<void(MockResponse&)> shape);
+
+        /**
+         * Serve the artifacts of later deployments from other hosts.
+         *
+         * The download links of each artifact point to the hosts, in this order: "download",
+         * "download-http", then "download-mirror-<n>". The links of the checksum files ("md5sum",
+         * "sha1sum" and "sha256sum") come first, and point to a host of their own.
+         * @return the servers of the download hosts, which a test can e.g. make refuse connections
+         */
+        std::vector<MockServer*> downloadHosts(const std::vector<String>& hosts, const String& checksums);
+
+        /**
+         * Delay the handling of each request, like a server under load.
+         */
+        void latency(uint32_t ms) { this->_latency = ms; }
+
+    private:
+        struct Action {
+            String id;
+            String download;
+            String update;
+            std::vector<DdiChunk> chunks;
+            bool canceled;
+            bool closed;
+            // the JSON of the deploymentBase resource
+            std::string json;
+        };
+
+        struct Controller {
+            Controller() :
+                config(false)
+            {
+            }
+
+            bool config;
+            std::map<String, String> data;
+            std::vector<Action> actions;
+        };
+
+        MockServer _http;
+        // the hosts serving the artifacts, see downloadHosts()
+        std::vector<std::unique_ptr<MockServer>> _downloadHosts;
+        std::unique_ptr<MockServer> _checksumHost;
+        String _tenant;
+        String _prefix;
+
+        mutable std::mutex _lock;
+        String _sleep;
+        uint32_t _nextAction;
+        std::map<String, Controller> _controllers;
+        std::vector<DdiFeedback> _feedback;
+        uint32_t _closed;
+        std::function<void(MockResponse&)> _shape;
+        std::atomic<uint32_t> _latency;
+
+        MockResponse get(const MockRequest& request);
+        MockResponse post(const MockRequest& request);
+        MockResponse put(const MockRequest& request);
+
+        std::string controllerBase(const String& controllerId, const Controller& controller) const;
+        std::string deploymentBase(const String& controllerId, const Action& action) const;
+        std::string artifactLinks(const String& path) const;
+        MockResponse artifact(const MockRequest& request, const String& filename) const;
+
+        String controllerUrl(const String& controllerId) const;
+        Action* action(Controller& controller, const String& id);
+        Action* current(Controller& controller);
+};
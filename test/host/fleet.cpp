@@ -0,0 +1,375 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <hawkbit.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "ddi.h"
+#include "streams.h"
+
+/*
+ * A fleet of virtual controllers, updated through the DDI stand-in.
+ *
+ * Each controller is a HawkbitClient of its own, with its own controllerId, token and connection.
+ * The controllers share a pool of threads: a thread takes the next controller from a queue, runs
+ * one step of it (a poll, the download of an artifact, a feedback), and queues it again. The
+ * client blocks during a request, so the number of threads bounds the requests in flight.
+ *
+ * First all controllers poll a number of times, without anything to do. Then a deployment gets
+ * rolled out to all of them: each polls (reading the deployment), downloads all artifacts while
+ * reporting progress, reports completion, and polls again. Printed are the request rates and
+ * latency percentiles of both phases, and when the controllers completed the rollout.
+ */
+
+struct Options {
+    int controllers = 100;
+    int threads = 8;
+    // the idle polls of each controller, before the rollout
+    int polls = 3;
+    int artifacts = 2;
+    size_t size = 64 * 1024;
+    // the time the server takes for each request
+    uint32_t latency = 2;
+    bool keepAlive = false;
+};
+
+/**
+ * A controller, and where it is in its update.
+ */
+struct Controller {
+    typedef enum { IDLE, POLL, DOWNLOAD, COMPLETE, CONFIRM, DONE } Step;
+
+    Controller(DdiServer& ddi, int index) :
+        id("device-" + String(index)),
+        token("token-" + String(index)),
+        doc(8192),
+        client(doc, wifi, ddi.base(), ddi.tenant(), id, token),
+        step(IDLE),
+        polls(0),
+        artifact(0),
+        completed(0),
+        failed(false)
+    {
+    }
+
+    String id;
+    String token;
+    WiFiClient wifi;
+    DynamicJsonDocument doc;
+    HawkbitClient client;
+
+    Step step;
+    State state;
+    int polls;
+    size_t artifact;
+    // when the rollout was completed (in milliseconds, after it started)
+    unsigned long completed;
+    bool failed;
+};
+
+/**
+ * The threads, which run the steps of the controllers.
+ */
+class Fleet {
+    public:
+        Fleet(const Options& options) :
+            _options(options),
+            _pending(0),
+            _stop(false)
+        {
+            for (int i = 0; i < options.threads; i++) {
+                this->_threads.push_back(std::thread(&Fleet::work, this));
+            }
+        }
+
+        ~Fleet()
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->_lock);
+                this->_stop = true;
+            }
+            this->_wake.notify_all();
+            for (std::thread& thread : this->_threads) {
+                thread.join();
+            }
+        }
+
+        /**
+         * Run the controllers, until all of them are done with the phase.
+         */
+        void run(std::vector<std::unique_ptr<Controller>>& controllers, unsigned long start)
+        {
+            std::unique_lock<std::mutex> lock(this->_lock);
+            this->_start = start;
+            for (std::unique_ptr<Controller>& controller : controllers) {
+                this->_queue.push_back(controller.get());
+            }
+            this->_pending = controllers.size();
+            this->_wake.notify_all();
+            this->_done.wait(lock, [this]() { return this->_pending == 0; });
+        }
+
+    private:
+        const Options& _options;
+        std::vector<std::thread> _threads;
+
+        std::mutex _lock;
+        std::condition_variable _wake;
+        std::condition_variable _done;
+        std::deque<Controller*> _queue;
+        size_t _pending;
+        bool _stop;
+        unsigned long _start;
+
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(this->_lock);
+            while (true) {
+                this->_wake.wait(lock, [this]() { return this->_stop || !this->_queue.empty(); });
+                if (this->_stop) {
+                    return;
+                }
+                Controller* controller = this->_queue.front();
+                this->_queue.pop_front();
+
+                lock.unlock();
+                bool more = this->step(*controller);
+                lock.lock();
+
+                if (more) {
+                    // behind all others, which are waiting for their turn
+                    this->_queue.push_back(controller);
+                    this->_wake.notify_one();
+                } else if (--this->_pending == 0) {
+                    this->_done.notify_all();
+                }
+            }
+        }
+
+        bool fail(Controller& controller, const char* what)
+        {
+            fprintf(stderr, "%s: %s failed\n", controller.id.c_str(), what);
+            controller.failed = true;
+            controller.step = Controller::DONE;
+            return false;
+        }
+
+        /**
+         * Run the next step of a controller.
+         * @return true if the controller has more to do in this phase
+         */
+        bool step(Controller& controller)
+        {
+            HawkbitClient& client = controller.client;
+
+            switch (controller.step) {
+                case Controller::IDLE:
+                    if (!client.readState(controller.state).ok()) {
+                        return this->fail(controller, "Idle poll");
+                    }
+                    if (++controller.polls < this->_options.polls) {
+                        return true;
+                    }
+                    controller.step = Controller::POLL;
+                    return false;
+
+                case Controller::POLL:
+                    if (!client.readState(controller.state).ok() || controller.state.type() != State::UPDATE) {
+                        return this->fail(controller, "Reading the deployment");
+                    }
+                    controller.artifact = 0;
+                    controller.step = Controller::DOWNLOAD;
+                    return true;
+
+                case Controller::DOWNLOAD: {
+                    const Deployment& deployment = controller.state.deployment();
+                    const ArrayView<Artifact>& artifacts = deployment.chunks()[0].artifacts();
+                    NullSink sink;
+                    if (!client.downloadTo(artifacts[controller.artifact], "download", sink).ok()) {
+                        return this->fail(controller, "Download");
+                    }
+                    controller.artifact++;
+                    if (!client.reportProgress(deployment, controller.artifact, artifacts.size()).ok()) {
+                        return this->fail(controller, "Progress feedback");
+                    }
+                    if (controller.artifact == artifacts.size()) {
+                        controller.step = Controller::COMPLETE;
+                    }
+                    return true;
+                }
+
+                case Controller::COMPLETE:
+                    if (!client.reportComplete(controller.state.deployment(), true).ok()) {
+                        return this->fail(controller, "Completion feedback");
+                    }
+                    controller.step = Controller::CONFIRM;
+                    return true;
+
+                case Controller::CONFIRM:
+                    if (!client.readState(controller.state).ok() || controller.state.type() != State::NONE) {
+                        return this->fail(controller, "Confirming the update");
+                    }
+                    controller.completed = millis() - this->_start;
+                    controller.step = Controller::DONE;
+                    return false;
+
+                case Controller::DONE:
+                    break;
+            }
+            return false;
+        }
+};
+
+/**
+ * Print the request rates and latencies of all controllers, over the period (in milliseconds).
+ */
+static void report(const char* phase, std::vector<std::unique_ptr<Controller>>& controllers, unsigned long period, DdiServer& ddi)
+{
+    RequestStats stats;
+    for (std::unique_ptr<Controller>& controller : controllers) {
+        stats.merge(controller->client.stats());
+        controller->client.resetStats();
+    }
+
+    MockServer& http = ddi.http();
+    unsigned long seconds = period > 0 ? period : 1;
+    printf("%s - %lu ms, %u requests (%lu/s), %u connections, %llu bytes received, %llu bytes sent\n",
+        phase, period, http.handled(), (unsigned long)(http.handled() * 1000ULL / seconds), http.connections(),
+        (unsigned long long)http.bytesReceived(), (unsigned long long)http.bytesSent());
+    for (size_t i = 0; i < RequestStats::KINDS; i++) {
+        RequestStats::Kind kind = (RequestStats::Kind)i;
+        if (stats.requests(kind) == 0) {
+            continue;
+        }
+        printf("  %-12s %6u requests (%5lu/s), %u failed - latency p50: %u ms, p90: %u ms, p99: %u ms, max: %u ms\n",
+            RequestStats::kindName(kind), stats.requests(kind), (unsigned long)(stats.requests(kind) * 1000ULL / seconds),
+            stats.failures(kind), stats.percentile(kind, 50), stats.percentile(kind, 90), stats.percentile(kind, 99),
+            stats.maxLatency(kind));
+    }
+    http.resetStats();
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --controllers <n>  virtual controllers (100)\n"
+        "  --threads <n>      threads running the controllers (8)\n"
+        "  --polls <n>        idle polls of each controller, before the rollout (3)\n"
+        "  --artifacts <n>    artifacts of the deployment (2)\n"
+        "  --size <bytes>     size of each artifact (65536)\n"
+        "  --latency <ms>     time the server takes for each request (2)\n"
+        "  --keep-alive       keep the connections open between requests\n",
+        name);
+}
+
+static bool parse(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--keep-alive") == 0) {
+            options.keepAlive = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        long value = atol(argv[++i]);
+        if (value < 0) {
+            return false;
+        }
+        if (strcmp(arg, "--controllers") == 0) {
+            options.controllers = value;
+        } else if (strcmp(arg, "--threads") == 0) {
+            options.threads = value;
+        } else if (strcmp(arg, "--polls") == 0) {
+            options.polls = value;
+        } else if (strcmp(arg, "--artifacts") == 0) {
+            options.artifacts = value;
+        } else if (strcmp(arg, "--size") == 0) {
+            options.size = value;
+        } else if (strcmp(arg, "--latency") == 0) {
+            options.latency = value;
+        } else {
+            return false;
+        }
+    }
+    return options.controllers > 0 && options.threads > 0 && options.polls > 0 && options.artifacts > 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("%d controllers, %d threads, %d idle polls, %d artifacts of %zu bytes, %u ms server latency, keep-alive: %d\n",
+        options.controllers, options.threads, options.polls, options.artifacts, options.size, options.latency, options.keepAlive);
+
+    DdiServer ddi;
+    ddi.latency(options.latency);
+
+    std::vector<std::unique_ptr<Controller>> controllers;
+    for (int i = 0; i < options.controllers; i++) {
+        controllers.push_back(std::unique_ptr<Controller>(new Controller(ddi, i)));
+        controllers.back()->client.keepAlive(options.keepAlive);
+    }
+
+    Fleet fleet(options);
+
+    unsigned long start = millis();
+    fleet.run(controllers, start);
+    report("Idle", controllers, millis() - start, ddi);
+
+    std::vector<DdiArtifact> artifacts;
+    for (int i = 0; i < options.artifacts; i++) {
+        artifacts.push_back(DdiArtifact("firmware-" + String(i) + ".bin", firmware(options.size, i)));
+    }
+    for (std::unique_ptr<Controller>& controller : controllers) {
+        ddi.deploy(controller->id, { DdiChunk("firmware", "2.0", artifacts) });
+    }
+
+    start = millis();
+    fleet.run(controllers, start);
+    unsigned long period = millis() - start;
+    report("Rollout", controllers, period, ddi);
+
+    std::vector<unsigned long> completed;
+    int failed = 0;
+    for (std::unique_ptr<Controller>& controller : controllers) {
+        if (controller->failed) {
+            failed++;
+        } else {
+            completed.push_back(controller->completed);
+        }
+    }
+    std::sort(completed.begin(), completed.end());
+    auto percentile = [&completed](int percent) -> unsigned long {
+        return completed.empty() ? 0 : completed[(completed.size() - 1) * percent / 100];
+    };
+    printf("Rollout completed by %zu of %d controllers (%u actions closed), %d failed - p50: %lu ms, p90: %lu ms, all: %lu ms\n",
+        completed.size(), options.controllers, ddi.closed(), failed, percentile(50), percentile(90), percentile(100));
+
+    return failed == 0 && ddi.closed() == (uint32_t)options.controllers ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "Arduino.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+// the time of the stopped clock (in microseconds), or -1 while it runs
+static std::atomic<long long> stopped(-1);
+
+static long long now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+unsigned long micros()
+{
+    long long time = stopped;
+    return time >= 0 ? time : now();
+}
+
+void stopClock()
+{
+    stopped = now();
+}
+
+void advanceClock(unsigned long ms)
+{
+    if (stopped >= 0) {
+        stopped += (long long)ms * 1000;
+    }
+}
+
+void startClock()
+{
+    stopped = -1;
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield()
+{
+    std::this_thread::yield();
+}
+
+static std::mutex randomLock;
+static std::mt19937 generator;
+
+long random(long max)
+{
+    return random(0, max);
+}
+
+long random(long min, long max)
+{
+    if (min >= max) {
+        return min;
+    }
+    std::lock_guard<std::mutex> lock(randomLock);
+    return std::uniform_int_distribution<long>(min, max - 1)(generator);
+}
+
+void randomSeed(unsigned long seed)
+{
+    std::lock_guard<std::mutex> lock(randomLock);
+    generator.seed(seed);
+}
+
+HardwareSerial Serial;
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stdout);
+}
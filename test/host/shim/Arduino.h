@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+/*
+ * A minimal emulation of the Arduino core for the ESP32, for building and testing the library on
+ * the host (see CMakeLists.txt). Only what the library uses is provided.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+
+using std::min;
+using std::max;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+/*
+ * Not part of the Arduino core, for testing code which depends on the time: a stopped clock only
+ * moves on with advanceClock(), for millis() and micros() of all threads. delay() still sleeps,
+ * and the clock is back at the real time once started again.
+ */
+void stopClock();
+void advanceClock(unsigned long ms);
+void startClock();
+
+/**
+ * Writes to stdout.
+ */
+class HardwareSerial : public Stream {
+    public:
+        void begin(unsigned long) {}
+
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        void flush() override;
+
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+};
+
+extern HardwareSerial Serial;
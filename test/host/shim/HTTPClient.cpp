@@ -0,0 +1,280 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "HTTPClient.h"
+
+#include <memory>
+#include <stdio.h>
+
+HTTPClient::HTTPClient() :
+    _client(nullptr),
+    _port(0),
+    _reuse(true),
+    _canReuse(false),
+    _http10(false),
+    _timeout(HTTPCLIENT_DEFAULT_TCP_TIMEOUT),
+    _connectTimeout(HTTPCLIENT_DEFAULT_TCP_TIMEOUT),
+    _size(-1),
+    _chunked(false)
+{
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& url)
+{
+    this->_client = &client;
+    this->_headers.clear();
+    for (std::pair<String, String>& header : this->_collected) {
+        header.second = String();
+    }
+    this->_size = -1;
+    this->_chunked = false;
+    return parseUrl(url, this->_host, this->_port, this->_path);
+}
+
+bool HTTPClient::connected()
+{
+    return this->_client != nullptr && this->_client->connected();
+}
+
+bool HTTPClient::connect()
+{
+    if (this->connected()) {
+        // like the original, an open connection is used, whatever it connects to
+        this->_client->flush();
+        return true;
+    }
+    if (!this->_client->connect(this->_host.c_str(), this->_port, this->_connectTimeout)) {
+        return false;
+    }
+    this->_client->setTimeout(this->_timeout);
+    return true;
+}
+
+void HTTPClient::end()
+{
+    this->disconnect();
+    this->_size = -1;
+    this->_chunked = false;
+}
+
+void HTTPClient::disconnect()
+{
+    if (this->connected()) {
+        this->_client->flush();
+        if (!this->_reuse || !this->_canReuse) {
+            this->_client->stop();
+        }
+    }
+}
+
+void HTTPClient::addHeader(const String& name, const String& value)
+{
+    // the original sets these by itself
+    if (name.equalsIgnoreCase("Connection") || name.equalsIgnoreCase("User-Agent") || name.equalsIgnoreCase("Host")) {
+        return;
+    }
+    this->_headers.push_back(std::make_pair(name, value));
+}
+
+void HTTPClient::collectHeaders(const char* keys[], size_t count)
+{
+    this->_collected.clear();
+    for (size_t i = 0; i < count; i++) {
+        this->_collected.push_back(std::make_pair(String(keys[i]), String()));
+    }
+}
+
+String HTTPClient::header(const char* name)
+{
+    for (const std::pair<String, String>& header : this->_collected) {
+        if (header.first.equalsIgnoreCase(name)) {
+            return header.second;
+        }
+    }
+    return String();
+}
+
+bool HTTPClient::hasHeader(const char* name)
+{
+    return !this->header(name).isEmpty();
+}
+
+int HTTPClient::GET()
+{
+    return this->sendRequest("GET");
+}
+
+int HTTPClient::POST(const String& payload)
+{
+    return this->sendRequest("POST", payload);
+}
+
+int HTTPClient::PUT(const String& payload)
+{
+    return this->sendRequest("PUT", payload);
+}
+
+int HTTPClient::sendRequest(const char* type, const String& payload)
+{
+    return this->sendRequest(type, (const uint8_t*)payload.c_str(), payload.length());
+}
+
+int HTTPClient::sendRequest(const char* type, const uint8_t* payload, size_t size)
+{
+    std::string body;
+    if (payload != nullptr) {
+        // the original writes the payload to the connection
+        OffDevice offDevice;
+        body.assign((const char*)payload, size);
+    }
+    return this->send(type, body);
+}
+
+int HTTPClient::sendRequest(const char* type, Stream* stream, size_t size)
+{
+    if (stream == nullptr) {
+        return HTTPC_ERROR_NO_STREAM;
+    }
+
+    // the original copies the stream through a buffer of up to a TCP segment
+    std::string body;
+    std::unique_ptr<char[]> buffer(new char[HTTP_TCP_BUFFER_SIZE]);
+    while (body.size() < size) {
+        size_t len = stream->readBytes(buffer.get(), std::min(size - body.size(), (size_t)HTTP_TCP_BUFFER_SIZE));
+        if (len == 0) {
+            return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+        }
+        OffDevice offDevice;
+        body.append(buffer.get(), len);
+    }
+
+    return this->send(type, body);
+}
+
+int HTTPClient::send(const char* type, const std::string& body)
+{
+    if (!this->connect()) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    MockRequest request;
+    request.method = type;
+    request.path = this->_path;
+    String host = this->_host;
+    if (this->_port != 80 && this->_port != 443) {
+        host += ':';
+        host += String((unsigned int)this->_port);
+    }
+    request.headers.push_back(std::make_pair(String("Host"), host));
+    request.headers.push_back(std::make_pair(String("User-Agent"), String("ESP32HTTPClient")));
+    request.headers.push_back(std::make_pair(String("Connection"), String(this->_reuse ? "keep-alive" : "close")));
+    if (!this->_http10) {
+        request.headers.push_back(std::make_pair(String("Accept-Encoding"), String("identity;q=1,chunked;q=0.1,*;q=0")));
+    }
+    request.headers.insert(request.headers.end(), this->_headers.begin(), this->_headers.end());
+    if (!body.empty()) {
+        request.headers.push_back(std::make_pair(String("Content-Length"), String((unsigned int)body.size())));
+    }
+    {
+        OffDevice offDevice;
+        request.body = body;
+    }
+
+    MockResponse response;
+    // the response body is framed by the server, according to the response and the protocol
+    bool chunked = false;
+    size_t length = 0;
+    if (!this->_client->exchange(request, response, [&chunked, &length, this](MockResponse& response) -> std::string {
+            chunked = response.chunked && !this->_http10;
+            length = response.body.size();
+            if (!chunked) {
+                // moved, only the client holds the body (like the receive buffers of a connection)
+                return std::move(response.body);
+            }
+            std::string framed;
+            size_t part = response.trickle > 0 ? response.trickle : 512;
+            for (size_t i = 0; i < response.body.size(); i += part) {
+                size_t len = std::min(part, response.body.size() - i);
+                char size[24];
+                snprintf(size, sizeof(size), "%zx\r\n", len);
+                framed += size;
+                framed.append(response.body, i, len);
+                framed += "\r\n";
+            }
+            return framed + "0\r\n\r\n";
+        })) {
+        return HTTPC_ERROR_CONNECTION_LOST;
+    }
+
+    this->_chunked = chunked;
+    // without chunks, an HTTP/1.0 server closes the connection to end the body
+    this->_size = response.chunked ? -1 : (int)length;
+    this->_canReuse = this->_reuse && !this->_http10 && !response.close && !(response.chunked && this->_http10);
+
+    for (std::pair<String, String>& collected : this->_collected) {
+        collected.second = String();
+        for (const std::pair<String, String>& header : response.headers) {
+            if (collected.first.equalsIgnoreCase(header.first)) {
+                collected.second = header.second;
+            }
+        }
+    }
+
+    return response.code;
+}
+
+String HTTPClient::getString()
+{
+    String result;
+    if (!this->connected()) {
+        return result;
+    }
+
+    char buffer[1460];
+    if (this->_size > 0) {
+        result.reserve(this->_size);
+        int remaining = this->_size;
+        while (remaining > 0) {
+            size_t len = this->_client->readBytes(buffer, std::min(remaining, (int)sizeof(buffer)));
+            if (len == 0) {
+                break;
+            }
+            result.concat(buffer, len);
+            remaining -= len;
+        }
+    } else if (this->_chunked) {
+        while (true) {
+            String line = this->_client->readStringUntil('\n');
+            size_t len = strtoul(line.c_str(), nullptr, 16);
+            if (len == 0) {
+                this->_client->readStringUntil('\n');
+                break;
+            }
+            while (len > 0) {
+                size_t read = this->_client->readBytes(buffer, std::min(len, sizeof(buffer)));
+                if (read == 0) {
+                    return result;
+                }
+                result.concat(buffer, read);
+                len -= read;
+            }
+            this->_client->readStringUntil('\n');
+        }
+    } else if (this->_size < 0) {
+        size_t len;
+        while ((len = this->_client->readBytes(buffer, sizeof(buffer))) > 0) {
+            result.concat(buffer, len);
+        }
+    }
+    return result;
+}
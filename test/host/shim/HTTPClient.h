@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WiFi.h"
+
+#define HTTPCLIENT_DEFAULT_TCP_TIMEOUT (5000)
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_STREAM           (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM        (-8)
+#define HTTPC_ERROR_ENCODING            (-9)
+#define HTTPC_ERROR_STREAM_WRITE        (-10)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+// the size of the buffer, a request body is sent through
+#define HTTP_TCP_BUFFER_SIZE (1460)
+
+typedef enum {
+    HTTP_CODE_OK = 200,
+    HTTP_CODE_CREATED = 201,
+    HTTP_CODE_ACCEPTED = 202,
+    HTTP_CODE_NO_CONTENT = 204,
+    HTTP_CODE_PARTIAL_CONTENT = 206,
+    HTTP_CODE_NOT_MODIFIED = 304,
+    HTTP_CODE_BAD_REQUEST = 400,
+    HTTP_CODE_UNAUTHORIZED = 401,
+    HTTP_CODE_NOT_FOUND = 404,
+    HTTP_CODE_CONFLICT = 409,
+    HTTP_CODE_GONE = 410,
+    HTTP_CODE_RANGE_NOT_SATISFIABLE = 416,
+    HTTP_CODE_TOO_MANY_REQUESTS = 429,
+    HTTP_CODE_INTERNAL_SERVER_ERROR = 500,
+    HTTP_CODE_SERVICE_UNAVAILABLE = 503
+} t_http_codes;
+
+/**
+ * The HTTPClient of the ESP32 Arduino core, as far as the library uses it.
+ *
+ * It follows the original in what is observable to the library: the request headers it sends,
+ * when a connection is kept open, copying a request body through a buffer of its own, and
+ * providing the raw body (including any chunk framing) through getStream().
+ */
+class HTTPClient {
+    public:
+        HTTPClient();
+
+        bool begin(WiFiClient& client, const String& url);
+        void end();
+        bool connected();
+
+        void setReuse(bool reuse) { this->_reuse = reuse; }
+        void useHTTP10(bool http10) { this->_http10 = http10; }
+        void setTimeout(uint16_t timeout) { this->_timeout = timeout; }
+        void setConnectTimeout(int32_t timeout) { this->_connectTimeout = timeout; }
+
+        void addHeader(const String& name, const String& value);
+        void collectHeaders(const char* keys[], size_t count);
+        String header(const char* name);
+        bool hasHeader(const char* name);
+
+        int GET();
+        int POST(const String& payload);
+        int PUT(const String& payload);
+        int sendRequest(const char* type, const String& payload);
+        int sendRequest(const char* type, const uint8_t* payload = nullptr, size_t size = 0);
+        int sendRequest(const char* type, Stream* stream, size_t size = 0);
+
+        int getSize() { return this->_size; }
+        WiFiClient& getStream() { return *this->_client; }
+        WiFiClient* getStreamPtr() { return this->_client; }
+        String getString();
+
+    private:
+        WiFiClient* _client;
+        String _host;
+        uint16_t _port;
+        String _path;
+
+        bool _reuse;
+        bool _canReuse;
+        bool _http10;
+        uint16_t _timeout;
+        int32_t _connectTimeout;
+
+        std::vector<std::pair<String, String>> _headers;
+        std::vector<std::pair<String, String>> _collected;
+
+        int _size;
+        bool _chunked;
+
+        bool connect();
+        int send(const char* type, const std::string& body);
+        void disconnect();
+};
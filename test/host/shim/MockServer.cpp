@@ -0,0 +1,206 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "MockServer.h"
+
+#include <stdio.h>
+
+static std::mutex serversLock;
+static std::vector<MockServer*> servers;
+
+int& OffDevice::depth()
+{
+    // constant initialized, so it may be used within the allocator
+    static thread_local int depth = 0;
+    return depth;
+}
+
+bool parseUrl(const String& url, String& host, uint16_t& port, String& path)
+{
+    int start = url.indexOf("://");
+    if (start < 0) {
+        return false;
+    }
+    bool secure = url.startsWith("https:");
+    start += 3;
+
+    int slash = url.indexOf('/', start);
+    String authority = slash < 0 ? url.substring(start) : url.substring(start, slash);
+    path = slash < 0 ? String("/") : url.substring(slash);
+
+    // an IPv6 address is in brackets, e.g. "[::1]:8080"
+    int close = authority.startsWith("[") ? authority.indexOf(']') : -1;
+    int colon = authority.indexOf(':', close < 0 ? 0 : close);
+    if (close > 0) {
+        host = authority.substring(1, close);
+    } else {
+        host = colon < 0 ? authority : authority.substring(0, colon);
+    }
+    port = colon < 0 ? (secure ? 443 : 80) : authority.substring(colon + 1).toInt();
+    return !host.isEmpty();
+}
+
+String MockRequest::header(const String& name) const
+{
+    for (const std::pair<String, String>& header : this->headers) {
+        if (header.first.equalsIgnoreCase(name)) {
+            return header.second;
+        }
+    }
+    return String();
+}
+
+size_t MockRequest::wireSize() const
+{
+    // "<method> <path> HTTP/1.1\r\n", "<name>: <value>\r\n", "\r\n"
+    size_t size = this->method.length() + 1 + this->path.length() + 11;
+    for (const std::pair<String, String>& header : this->headers) {
+        size += header.first.length() + 2 + header.second.length() + 2;
+    }
+    return size + 2 + this->body.size();
+}
+
+MockServer::MockServer(const String& base) :
+    _base(base),
+    _port(0),
+    _record(false),
+    _refuse(false),
+    _epoch(0),
+    _connections(0),
+    _handled(0),
+    _bytesReceived(0),
+    _bytesSent(0)
+{
+    String path;
+    parseUrl(base, this->_host, this->_port, path);
+
+    std::lock_guard<std::mutex> lock(serversLock);
+    servers.push_back(this);
+}
+
+MockServer::~MockServer()
+{
+    std::lock_guard<std::mutex> lock(serversLock);
+    for (auto i = servers.begin(); i != servers.end(); ++i) {
+        if (*i == this) {
+            servers.erase(i);
+            break;
+        }
+    }
+}
+
+MockServer* MockServer::find(const String& host, uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(serversLock);
+    for (MockServer* server : servers) {
+        if (server->_host == host && server->_port == port) {
+            return server;
+        }
+    }
+    return nullptr;
+}
+
+void MockServer::on(const String& method, const String& prefix, Handler handler)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_routes.push_back({ method, prefix, handler });
+}
+
+std::vector<MockRequest> MockServer::requests() const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_requests;
+}
+
+uint32_t MockServer::connections() const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_connections;
+}
+
+void MockServer::shape(std::function<void(MockResponse&)> shape)
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_shape = shape;
+}
+
+uint32_t MockServer::handled() const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_handled;
+}
+
+uint64_t MockServer::bytesReceived() const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_bytesReceived;
+}
+
+uint64_t MockServer::bytesSent() const
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    return this->_bytesSent;
+}
+
+void MockServer::resetStats()
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_connections = 0;
+    this->_handled = 0;
+    this->_bytesReceived = 0;
+    this->_bytesSent = 0;
+    this->_requests.clear();
+}
+
+bool MockServer::accept()
+{
+    std::lock_guard<std::mutex> lock(this->_lock);
+    if (this->_refuse) {
+        return false;
+    }
+    this->_connections++;
+    return true;
+}
+
+MockResponse MockServer::handle(const MockRequest& request)
+{
+    OffDevice offDevice;
+    Handler handler;
+    std::function<void(MockResponse&)> shape;
+    {
+        std::lock_guard<std::mutex> lock(this->_lock);
+        shape = this->_shape;
+        size_t longest = 0;
+        for (const Route& route : this->_routes) {
+            if (route.method == request.method && request.path.startsWith(route.prefix) && (!handler || route.prefix.length() > longest)) {
+                handler = route.handler;
+                longest = route.prefix.length();
+            }
+        }
+        this->_handled++;
+        this->_bytesReceived += request.wireSize();
+        if (this->_record) {
+            this->_requests.push_back(request);
+        }
+    }
+
+    // handlers run unlocked, so that they may take their time
+    MockResponse response = handler ? handler(request) : MockResponse(404);
+    if (shape) {
+        shape(response);
+    }
+
+    std::lock_guard<std::mutex> lock(this->_lock);
+    this->_bytesSent += response.body.size();
+    return response;
+}
@@ -0,0 +1,194 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "WString.h"
+
+/**
+ * Marks the allocations of the current thread as being off the device, within its lifetime.
+ *
+ * Used for the servers and the data in flight on the network, so that the allocation counters
+ * of the tests (alloc.h) only see what the library holds.
+ */
+class OffDevice {
+    public:
+        OffDevice() { depth()++; }
+        ~OffDevice() { depth()--; }
+
+        OffDevice(const OffDevice&) = delete;
+        OffDevice& operator=(const OffDevice&) = delete;
+
+        static bool active() { return depth() > 0; }
+
+    private:
+        static int& depth();
+};
+
+/**
+ * A request, as received by a MockServer.
+ */
+struct MockRequest {
+    String method;
+    // the path, including the query
+    String path;
+    std::vector<std::pair<String, String>> headers;
+    std::string body;
+
+    /**
+     * Get the value of a header, or an empty string.
+     */
+    String header(const String& name) const;
+
+    /**
+     * Get the number of bytes of the request on the wire (HTTP/1.1, without TLS).
+     */
+    size_t wireSize() const;
+};
+
+/**
+ * A response of a MockServer, and how it gets delivered.
+ */
+struct MockResponse {
+    MockResponse(int code = 200, const std::string& body = std::string()) :
+        code(code),
+        body(body),
+        chunked(false),
+        close(false),
+        breakAfter((size_t)-1),
+        trickle(0),
+        interval(0)
+    {
+    }
+
+    int code;
+    std::vector<std::pair<String, String>> headers;
+    std::string body;
+
+    // send the body without a content length
+    bool chunked;
+    // close the connection after the response
+    bool close;
+    // drop the connection after this number of bytes of the body
+    size_t breakAfter;
+    // deliver the body in parts of this size, zero delivers all of it right away
+    size_t trickle;
+    // the time (in milliseconds) between two parts
+    uint32_t interval;
+
+    MockResponse& header(const String& name, const String& value)
+    {
+        this->headers.push_back(std::make_pair(name, value));
+        return *this;
+    }
+};
+
+/**
+ * An HTTP server, reached through the WiFiClient and HTTPClient of the host build.
+ *
+ * The server is registered with its host and port, and handles requests in-process. Requests are
+ * dispatched to the handler of the longest matching path prefix, and may be called from several
+ * threads at the same time.
+ */
+class MockServer {
+    public:
+        typedef std::function<MockResponse(const MockRequest&)> Handler;
+
+        /**
+         * @param base the scheme and authority of the server (e.g. "http://hawkbit:8080")
+         */
+        explicit MockServer(const String& base);
+        ~MockServer();
+
+        MockServer(const MockServer&) = delete;
+        MockServer& operator=(const MockServer&) = delete;
+
+        /**
+         * Handle the requests of the method, with a path starting with the prefix.
+         */
+        void on(const String& method, const String& prefix, Handler handler);
+
+        /**
+         * Change all responses, after their handler created them (e.g. to send them chunked).
+         */
+        void shape(std::function<void(MockResponse&)> shape);
+
+        /**
+         * Keep all requests, to be inspected by a test.
+         */
+        void record(bool record) { this->_record = record; }
+        std::vector<MockRequest> requests() const;
+
+        const String& base() const { return this->_base; }
+
+        uint32_t connections() const;
+        uint32_t handled() const;
+        uint64_t bytesReceived() const;
+        uint64_t bytesSent() const;
+        void resetStats();
+
+        /**
+         * Refuse new connections, e.g. to simulate a server which is down.
+         */
+        void refuse(bool refuse) { this->_refuse = refuse; }
+
+        /**
+         * Close all open connections, the clients notice on their next request.
+         */
+        void dropConnections() { this->_epoch++; }
+        uint32_t epoch() const { return this->_epoch; }
+
+        /**
+         * Find the server for a host and port, returns null if there is none.
+         */
+        static MockServer* find(const String& host, uint16_t port);
+
+        bool accept();
+        MockResponse handle(const MockRequest& request);
+
+    private:
+        struct Route {
+            String method;
+            String prefix;
+            Handler handler;
+        };
+
+        String _base;
+        String _host;
+        uint16_t _port;
+
+        mutable std::mutex _lock;
+        std::vector<Route> _routes;
+        std::function<void(MockResponse&)> _shape;
+        std::atomic<bool> _record;
+        std::atomic<bool> _refuse;
+        std::atomic<uint32_t> _epoch;
+        std::vector<MockRequest> _requests;
+
+        uint32_t _connections;
+        uint32_t _handled;
+        uint64_t _bytesReceived;
+        uint64_t _bytesSent;
+};
+
+/**
+ * Split a URL into host, port and path, returns false if it is not an HTTP(S) URL.
+ */
+bool parseUrl(const String& url, String& host, uint16_t& port, String& path);
@@ -0,0 +1,48 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "Print.h"
+
+#include <stdio.h>
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    while (n < size && this->write(buffer[n]) == 1) {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...)
+{
+    char buffer[128];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    if ((size_t)len < sizeof(buffer)) {
+        return this->write((const uint8_t*)buffer, len);
+    }
+
+    char* large = new char[len + 1];
+    va_start(args, format);
+    vsnprintf(large, len + 1, format, args);
+    va_end(args);
+    size_t n = this->write((const uint8_t*)large, len);
+    delete[] large;
+    return n;
+}
@@ -0,0 +1,54 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "WString.h"
+
+/**
+ * The Print of the Arduino core, as far as the library uses it.
+ */
+class Print {
+    public:
+        virtual ~Print() {}
+
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size);
+        size_t write(const char* str) { return str != nullptr ? this->write((const uint8_t*)str, strlen(str)) : 0; }
+        size_t write(const char* buffer, size_t size) { return this->write((const uint8_t*)buffer, size); }
+
+        virtual void flush() {}
+
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+        size_t print(const char* str) { return this->write(str); }
+        size_t print(const String& str) { return this->write(str.c_str(), str.length()); }
+        size_t print(char c) { return this->write((uint8_t)c); }
+        size_t print(int value, int base = DEC) { return this->print(String(value, base)); }
+        size_t print(unsigned int value, int base = DEC) { return this->print(String(value, base)); }
+        size_t print(long value, int base = DEC) { return this->print(String(value, base)); }
+        size_t print(unsigned long value, int base = DEC) { return this->print(String(value, base)); }
+
+        size_t println() { return this->write("\r\n"); }
+
+        template<typename T>
+        size_t println(const T& value)
+        {
+            size_t n = this->print(value);
+            return n + this->println();
+        }
+};
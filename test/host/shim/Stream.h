@@ -0,0 +1,48 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include "Print.h"
+
+/**
+ * The Stream of the Arduino core, as far as the library uses it.
+ *
+ * Reading multiple bytes waits for each of them, up to the timeout, like the original.
+ */
+class Stream : public Print {
+    public:
+        Stream() :
+            _timeout(1000)
+        {
+        }
+
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        virtual void flush() = 0;
+
+        void setTimeout(unsigned long timeout) { this->_timeout = timeout; }
+        unsigned long getTimeout() const { return this->_timeout; }
+
+        virtual size_t readBytes(char* buffer, size_t length);
+        size_t readBytes(uint8_t* buffer, size_t length) { return this->readBytes((char*)buffer, length); }
+
+        String readString();
+        String readStringUntil(char terminator);
+
+    protected:
+        unsigned long _timeout;
+
+        int timedRead();
+};
@@ -0,0 +1,400 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utility>
+
+static String formatUnsigned(unsigned long long value, unsigned char base, bool negative)
+{
+    char buffer[72];
+    char* p = buffer + sizeof(buffer) - 1;
+    *p = 0;
+    do {
+        unsigned digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= base;
+    } while (value > 0);
+    if (negative) {
+        *--p = '-';
+    }
+    return String(p);
+}
+
+static String formatSigned(long long value, unsigned char base)
+{
+    if (value < 0 && base == DEC) {
+        return formatUnsigned(-(unsigned long long)value, base, true);
+    }
+    return formatUnsigned((unsigned long long)value, base, false);
+}
+
+String::String(const char* str) :
+    _buffer(nullptr),
+    _capacity(0),
+    _length(0)
+{
+    if (str != nullptr) {
+        this->assign(str, strlen(str));
+    }
+}
+
+String::String(const char* str, size_t len) :
+    _buffer(nullptr),
+    _capacity(0),
+    _length(0)
+{
+    this->assign(str, len);
+}
+
+String::String(const String& other) :
+    _buffer(nullptr),
+    _capacity(0),
+    _length(0)
+{
+    this->assign(other.c_str(), other._length);
+}
+
+String::String(String&& other) :
+    _buffer(other._buffer),
+    _capacity(other._capacity),
+    _length(other._length)
+{
+    other._buffer = nullptr;
+    other._capacity = 0;
+    other._length = 0;
+}
+
+String::String(char c) :
+    String(&c, 1)
+{
+}
+
+String::String(int value, unsigned char base) :
+    String(formatSigned(value, base))
+{
+}
+
+String::String(unsigned int value, unsigned char base) :
+    String(formatUnsigned(value, base, false))
+{
+}
+
+String::String(long value, unsigned char base) :
+    String(formatSigned(value, base))
+{
+}
+
+String::String(unsigned long value, unsigned char base) :
+    String(formatUnsigned(value, base, false))
+{
+}
+
+String::String(long long value, unsigned char base) :
+    String(formatSigned(value, base))
+{
+}
+
+String::String(unsigned long long value, unsigned char base) :
+    String(formatUnsigned(value, base, false))
+{
+}
+
+String::String(double value, unsigned int decimals) :
+    _buffer(nullptr),
+    _capacity(0),
+    _length(0)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+    this->assign(buffer, strlen(buffer));
+}
+
+String::~String()
+{
+    delete[] this->_buffer;
+}
+
+String& String::operator=(const String& other)
+{
+    if (this != &other) {
+        this->assign(other.c_str(), other._length);
+    }
+    return *this;
+}
+
+String& String::operator=(String&& other)
+{
+    if (this != &other) {
+        delete[] this->_buffer;
+        this->_buffer = other._buffer;
+        this->_capacity = other._capacity;
+        this->_length = other._length;
+        other._buffer = nullptr;
+        other._capacity = 0;
+        other._length = 0;
+    }
+    return *this;
+}
+
+String& String::operator=(const char* str)
+{
+    this->assign(str != nullptr ? str : "", str != nullptr ? strlen(str) : 0);
+    return *this;
+}
+
+bool String::reserve(size_t size)
+{
+    if (this->_buffer != nullptr && this->_capacity >= size) {
+        return true;
+    }
+    char* buffer = new char[size + 1];
+    memcpy(buffer, this->c_str(), this->_length + 1);
+    delete[] this->_buffer;
+    this->_buffer = buffer;
+    this->_capacity = size;
+    return true;
+}
+
+void String::assign(const char* str, size_t len)
+{
+    if (len == 0 && this->_buffer == nullptr) {
+        // like the original, an empty string does not allocate
+        this->_length = 0;
+        return;
+    }
+    if (this->_capacity < len || this->_buffer == nullptr) {
+        delete[] this->_buffer;
+        this->_buffer = new char[len + 1];
+        this->_capacity = len;
+    }
+    memmove(this->_buffer, str, len);
+    this->_buffer[len] = 0;
+    this->_length = len;
+}
+
+bool String::concat(const char* str, size_t len)
+{
+    if (len == 0) {
+        return true;
+    }
+    size_t length = this->_length + len;
+    if (this->_capacity < length || this->_buffer == nullptr) {
+        // the same growth as the original: exactly what is required
+        char* buffer = new char[length + 1];
+        memcpy(buffer, this->c_str(), this->_length);
+        memcpy(buffer + this->_length, str, len);
+        delete[] this->_buffer;
+        this->_buffer = buffer;
+        this->_capacity = length;
+    } else {
+        memmove(this->_buffer + this->_length, str, len);
+    }
+    this->_buffer[length] = 0;
+    this->_length = length;
+    return true;
+}
+
+bool String::equalsIgnoreCase(const String& other) const
+{
+    if (this->_length != other._length) {
+        return false;
+    }
+    for (size_t i = 0; i < this->_length; i++) {
+        if (tolower((unsigned char)this->_buffer[i]) != tolower((unsigned char)other._buffer[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::startsWith(const String& prefix, unsigned int offset) const
+{
+    if (offset > this->_length || prefix._length > this->_length - offset) {
+        return false;
+    }
+    return strncmp(this->c_str() + offset, prefix.c_str(), prefix._length) == 0;
+}
+
+bool String::endsWith(const String& suffix) const
+{
+    if (suffix._length > this->_length) {
+        return false;
+    }
+    return strcmp(this->c_str() + this->_length - suffix._length, suffix.c_str()) == 0;
+}
+
+char& String::operator[](unsigned int index)
+{
+    static char dummy;
+    if (index >= this->_length) {
+        dummy = 0;
+        return dummy;
+    }
+    return this->_buffer[index];
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    if (from >= this->_length) {
+        return -1;
+    }
+    const char* found = strchr(this->_buffer + from, c);
+    return found != nullptr ? found - this->_buffer : -1;
+}
+
+int String::indexOf(const String& str, unsigned int from) const
+{
+    if (from > this->_length) {
+        return -1;
+    }
+    const char* found = strstr(this->c_str() + from, str.c_str());
+    return found != nullptr ? found - this->c_str() : -1;
+}
+
+int String::lastIndexOf(char c) const
+{
+    const char* found = strrchr(this->c_str(), c);
+    return found != nullptr && c != 0 ? found - this->c_str() : -1;
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (from > to) {
+        unsigned int swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from >= this->_length) {
+        return String();
+    }
+    if (to > this->_length) {
+        to = this->_length;
+    }
+    return String(this->_buffer + from, to - from);
+}
+
+void String::replace(const String& find, const String& replace)
+{
+    if (find._length == 0 || this->_length == 0) {
+        return;
+    }
+    String result;
+    const char* start = this->_buffer;
+    const char* found;
+    while ((found = strstr(start, find.c_str())) != nullptr) {
+        result.concat(start, found - start);
+        result.concat(replace);
+        start = found + find._length;
+    }
+    result.concat(start);
+    *this = std::move(result);
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index >= this->_length) {
+        return;
+    }
+    if (count > this->_length - index) {
+        count = this->_length - index;
+    }
+    memmove(this->_buffer + index, this->_buffer + index + count, this->_length - index - count + 1);
+    this->_length -= count;
+}
+
+void String::toLowerCase()
+{
+    for (size_t i = 0; i < this->_length; i++) {
+        this->_buffer[i] = tolower((unsigned char)this->_buffer[i]);
+    }
+}
+
+void String::toUpperCase()
+{
+    for (size_t i = 0; i < this->_length; i++) {
+        this->_buffer[i] = toupper((unsigned char)this->_buffer[i]);
+    }
+}
+
+void String::trim()
+{
+    size_t start = 0;
+    while (start < this->_length && isspace((unsigned char)this->_buffer[start])) {
+        start++;
+    }
+    size_t end = this->_length;
+    while (end > start && isspace((unsigned char)this->_buffer[end - 1])) {
+        end--;
+    }
+    if (start > 0 || end < this->_length) {
+        *this = this->substring(start, end);
+    }
+}
+
+long String::toInt() const
+{
+    return atol(this->c_str());
+}
+
+float String::toFloat() const
+{
+    return atof(this->c_str());
+}
+
+String operator+(const String& lhs, const String& rhs)
+{
+    String result;
+    result.reserve(lhs.length() + rhs.length());
+    result += lhs;
+    result += rhs;
+    return result;
+}
+
+String operator+(const String& lhs, const char* rhs)
+{
+    return lhs + String(rhs);
+}
+
+String operator+(const char* lhs, const String& rhs)
+{
+    return String(lhs) + rhs;
+}
+
+String operator+(const String& lhs, char rhs)
+{
+    return lhs + String(rhs);
+}
+
+String operator+(const String& lhs, int rhs)
+{
+    return lhs + String(rhs);
+}
+
+String operator+(const String& lhs, unsigned int rhs)
+{
+    return lhs + String(rhs);
+}
+
+String operator+(const String& lhs, long rhs)
+{
+    return lhs + String(rhs);
+}
+
+String operator+(const String& lhs, unsigned long rhs)
+{
+    return lhs + String(rhs);
+}
@@ -0,0 +1,130 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+/**
+ * The String of the Arduino core, as far as the library uses it.
+ *
+ * Like the original, the data is held in a single heap buffer (allocated with new[], so that the
+ * allocation tests see it), which grows on demand.
+ */
+class String {
+    public:
+        String(const char* str = "");
+        String(const char* str, size_t len);
+        String(const String& other);
+        String(String&& other);
+        explicit String(char c);
+        explicit String(int value, unsigned char base = DEC);
+        explicit String(unsigned int value, unsigned char base = DEC);
+        explicit String(long value, unsigned char base = DEC);
+        explicit String(unsigned long value, unsigned char base = DEC);
+        explicit String(long long value, unsigned char base = DEC);
+        explicit String(unsigned long long value, unsigned char base = DEC);
+        explicit String(double value, unsigned int decimals = 2);
+        ~String();
+
+        String& operator=(const String& other);
+        String& operator=(String&& other);
+        String& operator=(const char* str);
+
+        bool reserve(size_t size);
+        size_t length() const { return this->_length; }
+        bool isEmpty() const { return this->_length == 0; }
+        const char* c_str() const { return this->_buffer != nullptr ? this->_buffer : ""; }
+
+        bool concat(const String& str) { return this->concat(str.c_str(), str._length); }
+        bool concat(const char* str) { return str != nullptr && this->concat(str, strlen(str)); }
+        bool concat(const char* str, size_t len);
+        bool concat(char c) { return this->concat(&c, 1); }
+        bool concat(unsigned char c) { return this->concat(String((unsigned int)c)); }
+        bool concat(int value) { return this->concat(String(value)); }
+        bool concat(unsigned int value) { return this->concat(String(value)); }
+        bool concat(long value) { return this->concat(String(value)); }
+        bool concat(unsigned long value) { return this->concat(String(value)); }
+        bool concat(long long value) { return this->concat(String(value)); }
+        bool concat(unsigned long long value) { return this->concat(String(value)); }
+        bool concat(double value) { return this->concat(String(value)); }
+
+        template<typename T>
+        String& operator+=(const T& value)
+        {
+            this->concat(value);
+            return *this;
+        }
+
+        int compareTo(const String& other) const { return strcmp(this->c_str(), other.c_str()); }
+        bool equals(const String& other) const { return this->_length == other._length && this->compareTo(other) == 0; }
+        bool equals(const char* str) const { return strcmp(this->c_str(), str != nullptr ? str : "") == 0; }
+        bool equalsIgnoreCase(const String& other) const;
+        bool operator==(const String& other) const { return this->equals(other); }
+        bool operator==(const char* str) const { return this->equals(str); }
+        bool operator!=(const String& other) const { return !this->equals(other); }
+        bool operator!=(const char* str) const { return !this->equals(str); }
+        bool operator<(const String& other) const { return this->compareTo(other) < 0; }
+        bool operator>(const String& other) const { return this->compareTo(other) > 0; }
+
+        bool startsWith(const String& prefix) const { return this->startsWith(prefix, 0); }
+        bool startsWith(const String& prefix, unsigned int offset) const;
+        bool endsWith(const String& suffix) const;
+
+        char charAt(unsigned int index) const { return index < this->_length ? this->_buffer[index] : 0; }
+        char operator[](unsigned int index) const { return this->charAt(index); }
+        char& operator[](unsigned int index);
+
+        int indexOf(char c, unsigned int from = 0) const;
+        int indexOf(const String& str, unsigned int from = 0) const;
+        int lastIndexOf(char c) const;
+
+        String substring(unsigned int from) const { return this->substring(from, this->_length); }
+        String substring(unsigned int from, unsigned int to) const;
+
+        void replace(const String& find, const String& replace);
+        void remove(unsigned int index) { this->remove(index, (unsigned int)-1); }
+        void remove(unsigned int index, unsigned int count);
+        void toLowerCase();
+        void toUpperCase();
+        void trim();
+
+        long toInt() const;
+        float toFloat() const;
+
+    private:
+        char* _buffer;
+        size_t _capacity;
+        size_t _length;
+
+        void assign(const char* str, size_t len);
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const String& lhs, const char* rhs);
+String operator+(const char* lhs, const String& rhs);
+String operator+(const String& lhs, char rhs);
+String operator+(const String& lhs, int rhs);
+String operator+(const String& lhs, unsigned int rhs);
+String operator+(const String& lhs, long rhs);
+String operator+(const String& lhs, unsigned long rhs);
+
+inline bool operator==(const char* lhs, const String& rhs) { return rhs == lhs; }
+inline bool operator!=(const char* lhs, const String& rhs) { return rhs != lhs; }
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include "WiFi.h"
+
+WiFiClient::WiFiClient() :
+    _server(nullptr),
+    _epoch(0),
+    _open(false),
+    _connects(0),
+    _position(0),
+    _limit(0),
+    _close(false),
+    _trickle(0),
+    _interval(0),
+    _started(0)
+{
+}
+
+int WiFiClient::connect(const char* host, uint16_t port)
+{
+    return this->connect(host, port, 0);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t)
+{
+    this->stop();
+
+    MockServer* server = MockServer::find(host, port);
+    if (server == nullptr || !server->accept()) {
+        return 0;
+    }
+
+    this->_server = server;
+    this->_epoch = server->epoch();
+    this->_open = true;
+    this->_connects++;
+    return 1;
+}
+
+uint8_t WiFiClient::connected()
+{
+    this->checkClosed();
+    return this->_open || this->available() > 0;
+}
+
+void WiFiClient::stop()
+{
+    this->_open = false;
+    this->_server = nullptr;
+    this->_body.clear();
+    this->_position = 0;
+    this->_limit = 0;
+}
+
+size_t WiFiClient::arrived() const
+{
+    if (this->_trickle == 0 || this->_interval == 0) {
+        return this->_limit;
+    }
+    size_t parts = 1 + (millis() - this->_started) / this->_interval;
+    return std::min(this->_limit, parts * this->_trickle);
+}
+
+void WiFiClient::checkClosed()
+{
+    if (this->_open && this->_position >= this->_limit && (this->_close || this->_limit < this->_body.size())) {
+        this->_open = false;
+    }
+}
+
+int WiFiClient::available()
+{
+    return this->arrived() - std::min(this->_position, this->arrived());
+}
+
+int WiFiClient::read()
+{
+    char c;
+    return this->readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+}
+
+int WiFiClient::peek()
+{
+    return this->available() > 0 ? (uint8_t)this->_body[this->_position] : -1;
+}
+
+void WiFiClient::flush()
+{
+    this->_position = std::max(this->_position, this->arrived());
+    this->checkClosed();
+}
+
+size_t WiFiClient::readBytes(char* buffer, size_t length)
+{
+    size_t read = 0;
+    unsigned long start = millis();
+    while (read < length) {
+        size_t available = this->available();
+        if (available == 0) {
+            if (this->_position >= this->_limit || millis() - start >= this->_timeout) {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+        size_t len = std::min(available, length - read);
+        memcpy(buffer + read, this->_body.data() + this->_position, len);
+        this->_position += len;
+        read += len;
+        start = millis();
+    }
+    this->checkClosed();
+    return read;
+}
+
+bool WiFiClient::exchange(const MockRequest& request, MockResponse& response, std::function<std::string(MockResponse&)> frame)
+{
+    if (!this->_open || this->_server == nullptr || this->_server->epoch() != this->_epoch) {
+        // a persistent connection, which the server has closed meanwhile
+        this->stop();
+        return false;
+    }
+
+    response = this->_server->handle(request);
+
+    {
+        OffDevice offDevice;
+        this->_body = frame(response);
+    }
+    this->_position = 0;
+    this->_limit = std::min(this->_body.size(), response.breakAfter);
+    this->_close = response.close;
+    this->_trickle = response.trickle;
+    this->_interval = response.interval;
+    this->_started = millis();
+    return true;
+}
@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "Arduino.h"
+#include "MockServer.h"
+
+/**
+ * The WiFiClient of the Arduino core, connecting to a MockServer instead of a socket.
+ *
+ * The HTTPClient hands a request to exchange(), which lets the server handle it right away. The
+ * body of the response is then delivered through the stream, at the pace the response asks for.
+ */
+class WiFiClient : public Stream {
+    public:
+        WiFiClient();
+        virtual ~WiFiClient() {}
+
+        virtual int connect(const char* host, uint16_t port);
+        virtual int connect(const char* host, uint16_t port, int32_t timeout);
+        virtual uint8_t connected();
+        virtual void stop();
+        operator bool() { return this->connected(); }
+
+        int available() override;
+        int read() override;
+        int peek() override;
+        // like the original, this discards what has been received
+        void flush() override;
+        size_t readBytes(char* buffer, size_t length) override;
+        using Stream::readBytes;
+
+        size_t write(uint8_t) override { return this->_open ? 1 : 0; }
+        size_t write(const uint8_t*, size_t size) override { return this->_open ? size : 0; }
+        using Print::write;
+
+        /**
+         * Let the server handle a request, and start receiving the response body.
+         *
+         * @param frame provides the body, as it is sent over the connection (e.g. with chunks), it may
+         * move the body out of the response
+         * @return false if the connection was closed by the server
+         */
+        bool exchange(const MockRequest& request, MockResponse& response, std::function<std::string(MockResponse&)> frame);
+
+        /**
+         * Get the number of connections this client opened.
+         */
+        uint32_t connects() const { return this->_connects; }
+
+    private:
+        MockServer* _server;
+        uint32_t _epoch;
+        bool _open;
+        uint32_t _connects;
+
+        std::string _body;
+        size_t _position;
+        // the end of the body, or where the connection drops
+        size_t _limit;
+        bool _close;
+        size_t _trickle;
+        uint32_t _interval;
+        unsigned long _started;
+
+        // the number of bytes of the body, which have arrived by now
+        size_t arrived() const;
+        // close the connection, once the body has been read
+        void checkClosed();
+};
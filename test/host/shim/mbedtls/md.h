@@ -0,0 +1,102 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+/*
+ * The message digest API of mbedtls, as far as the library uses it, implemented with OpenSSL.
+ */
+
+#include <stddef.h>
+#include <openssl/evp.h>
+
+#define MBEDTLS_MD_MAX_SIZE 64
+
+typedef enum {
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_MD5,
+    MBEDTLS_MD_SHA1,
+    MBEDTLS_MD_SHA224,
+    MBEDTLS_MD_SHA256,
+    MBEDTLS_MD_SHA384,
+    MBEDTLS_MD_SHA512,
+} mbedtls_md_type_t;
+
+typedef struct {
+    mbedtls_md_type_t type;
+    const EVP_MD* (*md)(void);
+} mbedtls_md_info_t;
+
+typedef struct {
+    const mbedtls_md_info_t* info;
+    EVP_MD_CTX* ctx;
+} mbedtls_md_context_t;
+
+inline const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t type)
+{
+    static const mbedtls_md_info_t infos[] = {
+        { MBEDTLS_MD_MD5, &EVP_md5 },
+        { MBEDTLS_MD_SHA1, &EVP_sha1 },
+        { MBEDTLS_MD_SHA224, &EVP_sha224 },
+        { MBEDTLS_MD_SHA256, &EVP_sha256 },
+        { MBEDTLS_MD_SHA384, &EVP_sha384 },
+        { MBEDTLS_MD_SHA512, &EVP_sha512 },
+    };
+    for (const mbedtls_md_info_t& info : infos) {
+        if (info.type == type) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+inline unsigned char mbedtls_md_get_size(const mbedtls_md_info_t* info)
+{
+    return info != nullptr ? EVP_MD_size(info->md()) : 0;
+}
+
+inline void mbedtls_md_init(mbedtls_md_context_t* ctx)
+{
+    ctx->info = nullptr;
+    ctx->ctx = nullptr;
+}
+
+inline void mbedtls_md_free(mbedtls_md_context_t* ctx)
+{
+    if (ctx->ctx != nullptr) {
+        EVP_MD_CTX_free(ctx->ctx);
+    }
+    mbedtls_md_init(ctx);
+}
+
+inline int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* info, int)
+{
+    ctx->info = info;
+    ctx->ctx = EVP_MD_CTX_new();
+    return ctx->ctx != nullptr ? 0 : -1;
+}
+
+inline int mbedtls_md_starts(mbedtls_md_context_t* ctx)
+{
+    return EVP_DigestInit_ex(ctx->ctx, ctx->info->md(), nullptr) == 1 ? 0 : -1;
+}
+
+inline int mbedtls_md_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t len)
+{
+    return EVP_DigestUpdate(ctx->ctx, input, len) == 1 ? 0 : -1;
+}
+
+inline int mbedtls_md_finish(mbedtls_md_context_t* ctx, unsigned char* output)
+{
+    return EVP_DigestFinal_ex(ctx->ctx, output, nullptr) == 1 ? 0 : -1;
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+/*
+ * The tinfl API of the miniz inflater in the ESP32 ROM, as far as the library uses it,
+ * implemented with zlib.
+ *
+ * Like tinfl, the output goes into a circular dictionary of TINFL_LZ_DICT_SIZE bytes. zlib keeps
+ * a window of its own, so the dictionary is only written to.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+};
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+struct tinfl_decompressor {
+    tinfl_decompressor() :
+        initialized(false)
+    {
+    }
+
+    ~tinfl_decompressor()
+    {
+        if (this->initialized) {
+            inflateEnd(&this->stream);
+        }
+    }
+
+    z_stream stream;
+    bool initialized;
+};
+
+inline void tinfl_init(tinfl_decompressor* r)
+{
+    if (r->initialized) {
+        inflateEnd(&r->stream);
+    }
+    memset(&r->stream, 0, sizeof(r->stream));
+    // raw deflate, the gzip header and trailer are handled by the caller
+    r->initialized = inflateInit2(&r->stream, -15) == Z_OK;
+}
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* in, size_t* inSize,
+    mz_uint8* outStart, mz_uint8* outNext, size_t* outSize, const mz_uint32 flags)
+{
+    (void)outStart;
+    (void)flags;
+
+    if (!r->initialized) {
+        return TINFL_STATUS_BAD_PARAM;
+    }
+
+    r->stream.next_in = const_cast<mz_uint8*>(in);
+    r->stream.avail_in = *inSize;
+    r->stream.next_out = outNext;
+    r->stream.avail_out = *outSize;
+
+    int ret = inflate(&r->stream, Z_NO_FLUSH);
+
+    *inSize -= r->stream.avail_in;
+    *outSize -= r->stream.avail_out;
+
+    if (ret == Z_STREAM_END) {
+        return TINFL_STATUS_DONE;
+    }
+    if (ret == Z_OK || ret == Z_BUF_ERROR) {
+        return r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+    }
+    return TINFL_STATUS_FAILED;
+}
@@ -0,0 +1,71 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#pragma once
+
+#include <map>
+
+#include <hawkbit_storage.h>
+
+/**
+ * A storage in memory, which counts the writes (like the wear of the flash), and may be limited
+ * in the size of a value (like an NVS entry). It claims to be encrypted, if asked to.
+ */
+class MemoryStorage : public HawkbitStorage {
+    public:
+        MemoryStorage(size_t limit = 0) :
+            stores(0),
+            removes(0),
+            encryption(false),
+            _limit(limit)
+        {
+        }
+
+        bool store(const char* key, const String& value) override
+        {
+            if (this->_limit > 0 && value.length() > this->_limit) {
+                return false;
+            }
+            this->stores++;
+            this->values[key] = value;
+            return true;
+        }
+
+        bool load(const char* key, String& value) override
+        {
+            auto i = this->values.find(key);
+            if (i == this->values.end()) {
+                return false;
+            }
+            value = i->second;
+            return true;
+        }
+
+        void remove(const char* key) override
+        {
+            this->removes++;
+            this->values.erase(key);
+        }
+
+        bool encrypted() const override { return this->encryption; }
+
+        bool has(const char* key) const { return this->values.find(key) != this->values.end(); }
+
+        std::map<String, String> values;
+        int stores;
+        int removes;
+        bool encryption;
+
+    private:
+        size_t _limit;
+};
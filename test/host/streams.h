@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <string>
+
+/**
+ * A stream reading from memory.
+ *
+ * Optionally, it only reports a limited number of bytes as available, like a network stream
+ * receiving the data in packets.
+ */
+class MemoryStream : public Stream {
+    public:
+        explicit MemoryStream(const std::string& data, size_t packet = 0) :
+            _data(data),
+            _position(0),
+            _packet(packet)
+        {
+        }
+
+        size_t position() const { return this->_position; }
+
+        int available() override
+        {
+            size_t remaining = this->_data.size() - this->_position;
+            return this->_packet > 0 && this->_packet < remaining ? this->_packet : remaining;
+        }
+
+        int read() override
+        {
+            return this->_position < this->_data.size() ? (uint8_t)this->_data[this->_position++] : -1;
+        }
+
+        int peek() override
+        {
+            return this->_position < this->_data.size() ? (uint8_t)this->_data[this->_position] : -1;
+        }
+
+        void flush() override {}
+        size_t write(uint8_t) override { return 0; }
+
+        using Stream::readBytes;
+
+        size_t readBytes(char* buffer, size_t length) override
+        {
+            size_t n = this->_data.size() - this->_position;
+            n = n < length ? n : length;
+            memcpy(buffer, this->_data.data() + this->_position, n);
+            this->_position += n;
+            return n;
+        }
+
+    private:
+        std::string _data;
+        size_t _position;
+        size_t _packet;
+};
+
+/**
+ * Prints into a string, e.g. for comparing dump() output.
+ */
+class StringPrint : public Print {
+    public:
+        size_t write(uint8_t c) override
+        {
+            this->_data += (char)c;
+            return 1;
+        }
+
+        const std::string& data() const { return this->_data; }
+
+    private:
+        std::string _data;
+};
+
+/**
+ * Read a stream up to its end.
+ */
+inline std::string readAll(Stream& stream, size_t chunk = 1024)
+{
+    std::string result;
+    std::string buffer(chunk, 0);
+    size_t len;
+    while ((len = stream.readBytes(&buffer[0], chunk)) > 0) {
+        result.append(buffer.data(), len);
+    }
+    return result;
+}
+
+/**
+ * Create pseudo random data, which compresses like firmware: a mix of repeated sequences and noise.
+ */
+inline std::string firmware(size_t size, uint32_t seed = 1)
+{
+    std::string result;
+    result.reserve(size);
+    uint32_t state = seed;
+    auto next = [&state]() {
+        state = state * 1103515245 + 12345;
+        return state >> 16;
+    };
+    while (result.size() < size) {
+        uint32_t r = next();
+        if (r % 4 == 0 || result.size() <= 64) {
+            // noise
+            for (int i = 0; i < 16; i++) {
+                result += (char)next();
+            }
+        } else {
+            // a copy of a previous sequence
+            size_t length = 8 + next() % 56;
+            size_t from = result.size() - 64 + next() % 64 - (next() % 4 == 0 ? next() % (result.size() - 64) : 0);
+            for (size_t i = 0; i < length; i++) {
+                result += result[from + i];
+            }
+        }
+    }
+    result.resize(size);
+    return result;
+}
@@ -0,0 +1,557 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <hawkbit.h>
+
+#include <functional>
+
+#include "check.h"
+#include "codecs.h"
+#include "ddi.h"
+
+/*
+ * The flow of an update (readState, readDeployment, download, sendFeedback), against the DDI
+ * stand-in.
+ */
+
+static std::string content(size_t size)
+{
+    std::string result(size, 0);
+    for (size_t i = 0; i < size; i++) {
+        result[i] = (char)(i * 7 + i / 251);
+    }
+    return result;
+}
+
+TEST(update)
+{
+    DdiServer ddi;
+    std::string firmware = content(100000);
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware) }) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    CHECK_EQ(300000, state.pollingInterval());
+
+    const Deployment& deployment = state.deployment();
+    CHECK_EQ(1, deployment.chunks().size());
+    const Artifact& artifact = deployment.chunks()[0].artifacts()[0];
+    CHECK_STR("firmware.bin", artifact.filename());
+    CHECK_EQ(firmware.size(), artifact.size());
+    CHECK_EQ(3, artifact.hashes().size());
+
+    std::vector<uint8_t> buffer(firmware.size());
+    RamSink sink(buffer.data(), buffer.size());
+    CHECK(client.downloadTo(artifact, "download", sink).ok());
+    CHECK(sink.committed());
+    CHECK(std::string((const char*)sink.data(), sink.size()) == firmware);
+
+    CHECK(client.reportComplete(deployment).ok());
+    CHECK_EQ(1, ddi.closed());
+
+    std::vector<DdiFeedback> feedback = ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("closed", feedback[0].execution);
+    CHECK_STR("success", feedback[0].finished);
+
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::NONE, state.type());
+}
+
+TEST(corrupted_artifact)
+{
+    DdiServer ddi;
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", content(5000)) }) });
+    ddi.shapeDownloads([](MockResponse& response) { response.body[100] ^= 1; });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    std::vector<uint8_t> buffer(5000);
+    RamSink sink(buffer.data(), buffer.size());
+    HawkbitError error = client.downloadTo(state.deployment().chunks()[0].artifacts()[0], "download", sink);
+    CHECK_EQ(HawkbitError::INTEGRITY, error.category());
+    CHECK(!sink.committed());
+}
+
+TEST(gzip_encoded_artifact)
+{
+    DdiServer ddi;
+    DdiArtifact artifact("firmware.bin", content(20000));
+    artifact.encoding = "gzip";
+    artifact.encoded = gzipEncode(artifact.content);
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { artifact }) });
+    // without a length, over HTTP/1.0 the response ends with the gzip data (or the connection)
+    ddi.shapeDownloads([](MockResponse& response) { response.chunked = true; });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.streaming(true);
+
+    State state;
+    CHECK(client.readState(state).ok());
+    std::vector<uint8_t> buffer(20000);
+    RamSink sink(buffer.data(), buffer.size());
+    unsigned long start = millis();
+    CHECK(client.downloadTo(state.deployment().chunks()[0].artifacts()[0], "download", sink).ok());
+    // not waiting for the stream to time out
+    CHECK(millis() - start < wifi.getTimeout());
+    CHECK(sink.committed());
+    CHECK(std::string((const char*)sink.data(), sink.size()) == artifact.content);
+}
+
+/**
+ * A sink in RAM with a block size, which records the length of each write.
+ */
+class BlockSink : public RamSink {
+    public:
+        BlockSink(uint8_t* buffer, size_t capacity, size_t size) :
+            RamSink(buffer, capacity),
+            _size(size)
+        {
+        }
+
+        bool write(const uint8_t* data, size_t len) override
+        {
+            this->writes.push_back(len);
+            return RamSink::write(data, len);
+        }
+
+        size_t blockSize() const override { return this->_size; }
+
+        std::vector<size_t> writes;
+
+    private:
+        size_t _size;
+};
+
+TEST(pipeline_writes_whole_blocks)
+{
+    DdiServer ddi;
+    DdiArtifact plain("plain.bin", content(20000));
+    // the decompressor returns short reads
+    DdiArtifact encoded("encoded.bin", content(20000));
+    encoded.encoding = "gzip";
+    encoded.encoded = gzipEncode(encoded.content);
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { plain, encoded }) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    State state;
+    CHECK(client.readState(state).ok());
+    if (state.type() != State::UPDATE) {
+        return;
+    }
+
+    // the blocks of the pipeline are no multiple of the block size of the sink
+    DownloadPipeline pipeline(4096);
+    for (const Artifact& artifact : state.deployment().chunks()[0].artifacts()) {
+        std::vector<uint8_t> buffer(20000);
+        BlockSink sink(buffer.data(), buffer.size(), 1000);
+        CHECK(client.downloadTo(artifact, "download", sink, pipeline).ok());
+        CHECK(sink.committed());
+        CHECK(std::string((const char*)sink.data(), sink.size()) == plain.content);
+        CHECK(!sink.writes.empty());
+        for (size_t len : sink.writes) {
+            CHECK(len > 0 && len % 1000 == 0);
+        }
+    }
+}
+
+/**
+ * Get the requests for an artifact.
+ */
+static std::vector<MockRequest> downloads(DdiServer& ddi, const String& filename)
+{
+    std::vector<MockRequest> result;
+    for (const MockRequest& request : ddi.http().requests()) {
+        if (request.path.endsWith("/artifacts/" + filename)) {
+            result.push_back(request);
+        }
+    }
+    return result;
+}
+
+/**
+ * Download an artifact, which breaks off after 4000 of 10000 bytes the first time, and resume it.
+ * @param shape changes the responses to the range requests
+ */
+static void resumeDownload(std::function<void(MockResponse&)> shape, std::vector<MockRequest>& requests)
+{
+    DdiServer ddi;
+    std::string firmware = content(10000);
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware) }) });
+    ddi.http().record(true);
+    int count = 0;
+    ddi.shapeDownloads([&count, shape](MockResponse& response) {
+        if (count++ == 0) {
+            response.breakAfter = 4000;
+        } else if (response.code == 206) {
+            shape(response);
+        }
+    });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    const Artifact& artifact = state.deployment().chunks()[0].artifacts()[0];
+    std::vector<uint8_t> buffer(firmware.size());
+    RamSink sink(buffer.data(), buffer.size());
+
+    HawkbitError error = client.downloadTo(artifact, "download", sink);
+    CHECK_EQ(HawkbitError::TRANSPORT, error.category());
+    CHECK(!sink.committed());
+    // the data received so far is kept
+    CHECK_EQ(4000, sink.size());
+    CHECK(client.canResume(artifact, 4000));
+
+    CHECK(client.downloadTo(artifact, "download", sink).ok());
+    CHECK(sink.committed());
+    CHECK(std::string((const char*)sink.data(), sink.size()) == firmware);
+
+    requests = downloads(ddi, "firmware.bin");
+}
+
+TEST(resumes_broken_download)
+{
+    std::vector<MockRequest> requests;
+    resumeDownload([](MockResponse&) {}, requests);
+    CHECK_EQ(2, requests.size());
+    if (requests.size() == 2) {
+        CHECK_STR("", requests[0].header("Range"));
+        CHECK_STR("bytes=4000-", requests[1].header("Range"));
+    }
+}
+
+TEST(restarts_when_range_ignored)
+{
+    // the server sends the complete artifact, the sink starts over
+    std::vector<MockRequest> requests;
+    resumeDownload([](MockResponse& response) {
+        response.code = 200;
+        response.headers.clear();
+        response.body = content(10000);
+    }, requests);
+    CHECK_EQ(2, requests.size());
+}
+
+TEST(restarts_on_unexpected_range)
+{
+    // the server sends another range than requested, the complete artifact is requested instead
+    std::vector<MockRequest> requests;
+    resumeDownload([](MockResponse& response) {
+        for (std::pair<String, String>& header : response.headers) {
+            if (header.first == "Content-Range") {
+                header.second = "bytes 3000-9999/10000";
+            }
+        }
+        response.body = content(10000).substr(3000);
+    }, requests);
+    CHECK_EQ(3, requests.size());
+    if (requests.size() == 3) {
+        CHECK_STR("bytes=4000-", requests[1].header("Range"));
+        CHECK_STR("", requests[2].header("Range"));
+    }
+}
+
+TEST(state_not_modified)
+{
+    DdiServer ddi;
+    ddi.http().record(true);
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::NONE, state.type());
+
+    std::vector<MockRequest> requests = ddi.http().requests();
+    CHECK_EQ(2, requests.size());
+    CHECK(requests[0].header("If-None-Match").isEmpty());
+    CHECK(!requests[1].header("If-None-Match").isEmpty());
+}
+
+TEST(registration)
+{
+    DdiServer ddi;
+    ddi.requestConfig("device");
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::REGISTER, state.type());
+
+    std::map<String, String> data = { { "board", "esp32" }, { "version", "1.0" } };
+    CHECK(client.syncRegistration(state.registration(), data).ok());
+    CHECK(ddi.configData("device") == data);
+
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::NONE, state.type());
+}
+
+/**
+ * Answer a registration request of the server, returning the request which was sent.
+ */
+static MockRequest answerRegistration(DdiServer& ddi, HawkbitClient& client, const std::map<String, String>& data, bool sync)
+{
+    ddi.requestConfig("device");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::REGISTER, state.type());
+    if (state.type() != State::REGISTER) {
+        return MockRequest();
+    }
+    if (sync) {
+        CHECK(client.syncRegistration(state.registration(), data).ok());
+    } else {
+        CHECK(client.updateRegistration(state.registration(), data).ok());
+    }
+    CHECK(ddi.configData("device") == data);
+
+    std::vector<MockRequest> requests = ddi.http().requests();
+    CHECK(!requests.empty());
+    return requests.empty() ? MockRequest() : requests.back();
+}
+
+/**
+ * Get the attributes, which a registration request sent.
+ */
+static std::vector<String> sentKeys(const MockRequest& request)
+{
+    DynamicJsonDocument doc(4096);
+    CHECK(!deserializeJson(doc, request.body.c_str()));
+    std::vector<String> keys;
+    const JsonDocument& json = doc;
+    for (JsonPairConst entry : json["data"].as<JsonObjectConst>()) {
+        keys.push_back(entry.key().c_str());
+    }
+    return keys;
+}
+
+TEST(registration_bytes)
+{
+    std::map<String, String> data = {
+        { "board", "esp32-devkitc-v4" },
+        { "chip", "ESP32-D0WDQ6 rev 1" },
+        { "mac", "24:0a:c4:12:34:56" },
+        { "sdk", "v3.3.5-1-g85c43024c" },
+        { "partition", "ota_0" },
+        { "firmware", "1.0.0" },
+        { "uptime", "12" },
+    };
+
+    DdiServer ddi;
+    ddi.http().record(true);
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    // the same answers, each replacing all attributes
+    DdiServer fullDdi("http://hawkbit-full:8080");
+    fullDdi.http().record(true);
+    WiFiClient fullWifi;
+    DynamicJsonDocument fullDoc(8192);
+    HawkbitClient full(fullDoc, fullWifi, fullDdi.base(), fullDdi.tenant(), "device", "token");
+
+    struct Round {
+        const char* name;
+        MockRequest sync;
+        MockRequest full;
+    };
+    std::vector<Round> rounds;
+    auto answer = [&](const char* name) {
+        rounds.push_back(Round { name, answerRegistration(ddi, client, data, true), answerRegistration(fullDdi, full, data, false) });
+        return sentKeys(rounds.back().sync);
+    };
+
+    // the first answer sends everything
+    std::vector<String> keys = answer("first");
+    CHECK_EQ(data.size(), keys.size());
+    CHECK(rounds.back().sync.body.find("\"replace\"") != std::string::npos);
+
+    // nothing changed, a single attribute answers the request
+    keys = answer("unchanged");
+    CHECK_EQ(1, keys.size());
+    CHECK(rounds.back().sync.body.find("\"merge\"") != std::string::npos);
+
+    // only what changed
+    data["uptime"] = "3600";
+    data["firmware"] = "1.1.0";
+    keys = answer("two changed");
+    CHECK_EQ(2, keys.size());
+    CHECK(keys == std::vector<String>({ "firmware", "uptime" }));
+    CHECK(rounds.back().sync.body.find("\"merge\"") != std::string::npos);
+
+    // a dropped attribute can only be removed by replacing all of them
+    data.erase("partition");
+    keys = answer("one dropped");
+    CHECK_EQ(data.size(), keys.size());
+    CHECK(rounds.back().sync.body.find("\"replace\"") != std::string::npos);
+
+    size_t syncTotal = 0;
+    size_t fullTotal = 0;
+    for (const Round& round : rounds) {
+        printf("registration %-12s - body: %4zu bytes (all attributes: %4zu), on the wire: %4zu bytes (all attributes: %4zu)\n",
+            round.name, round.sync.body.size(), round.full.body.size(), round.sync.wireSize(), round.full.wireSize());
+        syncTotal += round.sync.wireSize();
+        fullTotal += round.full.wireSize();
+    }
+    printf("registration total on the wire: %zu bytes (all attributes: %zu)\n", syncTotal, fullTotal);
+
+    // the changed answers are smaller than the full ones
+    CHECK(rounds[1].sync.wireSize() < rounds[1].full.wireSize());
+    CHECK(rounds[2].sync.wireSize() < rounds[2].full.wireSize());
+    CHECK(rounds[2].sync.wireSize() > rounds[1].sync.wireSize());
+    CHECK(syncTotal < fullTotal);
+}
+
+TEST(cancel)
+{
+    DdiServer ddi;
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", content(100)) }) });
+    ddi.cancel("device");
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::CANCEL, state.type());
+    CHECK(client.reportCancelAccepted(state.stop()).ok());
+    CHECK_EQ(1, ddi.closed());
+}
+
+TEST(keep_alive)
+{
+    DdiServer ddi;
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", content(20000)) }) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.keepAlive(true);
+
+    State state;
+    CHECK(client.readState(state).ok());
+    std::vector<uint8_t> buffer(20000);
+    RamSink sink(buffer.data(), buffer.size());
+    CHECK(client.downloadTo(state.deployment().chunks()[0].artifacts()[0], "download", sink).ok());
+    CHECK(client.reportComplete(state.deployment()).ok());
+
+    // controller base, deploymentBase, artifact, feedback
+    CHECK_EQ(4, ddi.http().handled());
+    CHECK_EQ(1, ddi.http().connections());
+}
+
+/**
+ * A TLS stack without sessions, for a client with a cache of them.
+ */
+class NoSessions : public TlsSessionAdapter {
+    public:
+        bool exportSession(WiFiClient&, std::vector<uint8_t>&) override { return false; }
+        void importSession(WiFiClient&, const std::vector<uint8_t>&) override {}
+        void clearSession(WiFiClient&) override {}
+        bool resumed(WiFiClient&) override { return false; }
+};
+
+TEST(connects_ahead_only_if_useful)
+{
+    DdiServer ddi;
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    State state;
+
+    // the HTTPClient connects itself
+    CHECK(client.readState(state).ok());
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(2, ddi.http().connections());
+    CHECK_EQ(0, client.handshakes());
+
+    // for resuming a TLS session
+    NoSessions adapter;
+    TlsSessionCache sessions(adapter);
+    client.tlsSessions(&sessions);
+    CHECK(client.readState(state).ok());
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(4, ddi.http().connections());
+    CHECK_EQ(2, client.handshakes());
+
+    // for keeping the connection
+    client.tlsSessions(nullptr);
+    client.keepAlive(true);
+    CHECK(client.readState(state).ok());
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(5, ddi.http().connections());
+    CHECK_EQ(3, client.handshakes());
+    CHECK_EQ(1, client.handshakesSaved());
+}
+
+TEST(ipv6_host)
+{
+    DdiServer ddi("http://[::1]:8443");
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", content(1000)) }) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.keepAlive(true);
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    if (state.type() != State::UPDATE) {
+        return;
+    }
+    std::vector<uint8_t> buffer(1000);
+    RamSink sink(buffer.data(), buffer.size());
+    CHECK(client.downloadTo(state.deployment().chunks()[0].artifacts()[0], "download", sink).ok());
+    CHECK_EQ(1, ddi.http().connections());
+    CHECK_EQ(1, client.handshakes());
+}
+
+TEST(server_down)
+{
+    DdiServer ddi;
+    ddi.http().refuse(true);
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    HawkbitError error = client.readState(state);
+    CHECK_EQ(HawkbitError::TRANSPORT, error.category());
+    CHECK(error.transient());
+}
@@ -0,0 +1,189 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit_compress.h>
+
+#include "check.h"
+#include "codecs.h"
+#include "streams.h"
+
+/*
+ * The decompressors, with data compressed on the host.
+ */
+
+static std::string decompress(const std::string& compressed, Decompressor* decompressor, bool& failed,
+    size_t chunk = 1024, size_t packet = 0)
+{
+    MemoryStream source(compressed, packet);
+    DecompressingStream stream(source, compressed.size(), decompressor);
+    std::string result = readAll(stream, chunk);
+    failed = stream.failed();
+    return result;
+}
+
+TEST(compression_of_filename)
+{
+    CHECK(compressionOf("firmware.bin.gz") == Compression::GZIP);
+    CHECK(compressionOf("firmware.bin.hs") == Compression::HEATSHRINK);
+    CHECK(compressionOf("firmware.bin") == Compression::NONE);
+    CHECK(compressionOf("gz") == Compression::NONE);
+}
+
+TEST(crc32)
+{
+    const char* check = "123456789";
+    CHECK_EQ(0xcbf43926, crc32Update(0, (const uint8_t*)check, 9));
+    // incrementally
+    uint32_t crc = crc32Update(0, (const uint8_t*)check, 4);
+    CHECK_EQ(0xcbf43926, crc32Update(crc, (const uint8_t*)check + 4, 5));
+}
+
+TEST(heatshrink_round_trip)
+{
+    std::string data = firmware(100000);
+    const uint8_t parameters[][2] = { { 4, 3 }, { 8, 4 }, { 10, 5 }, { 13, 4 }, { 15, 14 } };
+    for (const auto& p : parameters) {
+        std::string compressed = heatshrinkEncode(data, p[0], p[1]);
+        bool failed;
+        std::string result = decompress(compressed, new HeatshrinkDecompressor(p[0], p[1]), failed);
+        CHECK(!failed);
+        CHECK_EQ(data.size(), result.size());
+        CHECK(data == result);
+    }
+}
+
+TEST(heatshrink_small_reads)
+{
+    std::string data = firmware(5000);
+    std::string compressed = heatshrinkEncode(data, 8, 4);
+    bool failed;
+    // one byte at a time, from input arriving in small packets
+    CHECK(data == decompress(compressed, new HeatshrinkDecompressor(), failed, 1, 3));
+    CHECK(!failed);
+}
+
+TEST(heatshrink_mismatching_parameters)
+{
+    std::string data = firmware(5000);
+    std::string compressed = heatshrinkEncode(data, 10, 4);
+    bool failed;
+    CHECK(data != decompress(compressed, new HeatshrinkDecompressor(8, 4), failed));
+}
+
+TEST(heatshrink_invalid_parameters)
+{
+    const uint8_t parameters[][2] = { { 3, 2 }, { 16, 4 }, { 8, 2 }, { 8, 8 } };
+    for (const auto& p : parameters) {
+        HeatshrinkDecompressor decompressor(p[0], p[1]);
+        CHECK(decompressor.failed());
+    }
+
+    bool failed;
+    std::string result = decompress(heatshrinkEncode("data", 8, 4), createDecompressor(Compression::HEATSHRINK, 8, 8), failed);
+    CHECK(failed);
+    CHECK(result.empty());
+}
+
+TEST(gzip_round_trip)
+{
+    std::string data = firmware(200000);
+    bool failed;
+    std::string result = decompress(gzipEncode(data), createDecompressor(Compression::GZIP), failed);
+    CHECK(!failed);
+    CHECK_EQ(data.size(), result.size());
+    CHECK(data == result);
+}
+
+TEST(gzip_with_file_name)
+{
+    std::string data = firmware(10000);
+    bool failed;
+    CHECK(data == decompress(gzipEncode(data, "firmware.bin"), new GzipDecompressor(), failed, 1, 7));
+    CHECK(!failed);
+}
+
+TEST(gzip_empty)
+{
+    bool failed;
+    CHECK(decompress(gzipEncode(""), new GzipDecompressor(), failed).empty());
+    CHECK(!failed);
+}
+
+TEST(gzip_invalid_header)
+{
+    std::string compressed = gzipEncode(firmware(1000));
+    compressed[2] = 7;
+    bool failed;
+    CHECK(decompress(compressed, new GzipDecompressor(), failed).empty());
+    CHECK(failed);
+}
+
+TEST(gzip_corrupted_data)
+{
+    std::string compressed = gzipEncode(std::string(10000, 'a'));
+    compressed[12] ^= 0x55;
+    bool failed;
+    decompress(compressed, new GzipDecompressor(), failed);
+    CHECK(failed);
+}
+
+TEST(gzip_invalid_crc)
+{
+    std::string data = firmware(10000);
+    std::string compressed = gzipEncode(data);
+    compressed[compressed.size() - 8] ^= 1;
+    bool failed;
+    // the data is all there, the stream fails at its end
+    CHECK(data == decompress(compressed, new GzipDecompressor(), failed));
+    CHECK(failed);
+}
+
+TEST(gzip_invalid_size)
+{
+    std::string compressed = gzipEncode(firmware(10000));
+    compressed[compressed.size() - 1] ^= 1;
+    bool failed;
+    decompress(compressed, new GzipDecompressor(), failed);
+    CHECK(failed);
+}
+
+TEST(gzip_missing_trailer)
+{
+    std::string compressed = gzipEncode(firmware(10000));
+    compressed.resize(compressed.size() - 3);
+    bool failed;
+    decompress(compressed, new GzipDecompressor(), failed);
+    CHECK(failed);
+}
+
+TEST(gzip_reads_input_to_end)
+{
+    // e.g. the hashes of the artifact are computed on the compressed input
+    std::string compressed = gzipEncode(firmware(10000)) + "trailing";
+    MemoryStream source(compressed);
+    DecompressingStream stream(source, compressed.size(), new GzipDecompressor());
+    readAll(stream);
+    CHECK(!stream.failed());
+    CHECK_EQ(compressed.size(), source.position());
+}
+
+TEST(unsupported_compression)
+{
+    CHECK(createDecompressor(Compression::NONE) == nullptr);
+
+    MemoryStream source("data");
+    DecompressingStream stream(source, 4, nullptr);
+    CHECK(stream.failed());
+    CHECK_EQ(-1, stream.read());
+}
@@ -0,0 +1,147 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit.h>
+
+#include <type_traits>
+
+#include "alloc.h"
+#include "check.h"
+#include "ddi.h"
+#include "streams.h"
+
+/*
+ * The allocations of an update cycle, which must not copy the deployment data.
+ */
+
+static_assert(!std::is_copy_constructible<State>::value, "State must be move-only");
+static_assert(!std::is_copy_assignable<State>::value, "State must be move-only");
+
+/**
+ * A print, which discards its output.
+ */
+class NullPrint : public Print {
+    public:
+        size_t write(uint8_t) override { return 1; }
+        size_t write(const uint8_t*, size_t size) override { return size; }
+};
+
+struct Cycle {
+    size_t read;
+    size_t download;
+    size_t feedback;
+    size_t bytes;
+    // the most memory held while dumping the deployment
+    size_t dump;
+};
+
+/**
+ * Run an update of a deployment with a number of artifacts: read the state, download the first
+ * artifact, and report progress and completion.
+ */
+static Cycle updateCycle(int artifacts)
+{
+    DdiServer ddi;
+    std::vector<DdiArtifact> files;
+    for (int i = 0; i < artifacts; i++) {
+        files.push_back(DdiArtifact("partition-" + String(i) + ".bin", firmware(4096, i)));
+    }
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", files) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(32 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    std::vector<uint8_t> buffer(4096);
+    RamSink sink(buffer.data(), buffer.size());
+    std::vector<String> details = { "Downloaded partition-0.bin" };
+    NullPrint out;
+
+    Cycle result = {};
+    AllocationCounter allocations;
+    size_t mark = 0;
+    auto step = [&allocations, &mark]() {
+        size_t count = allocations.count() - mark;
+        mark = allocations.count();
+        return count;
+    };
+
+    State state;
+    CHECK(client.readState(state).ok());
+    // moved out of the state, like an application keeps it
+    State current(std::move(state));
+    result.read = step();
+    CHECK_EQ(State::UPDATE, current.type());
+    if (current.type() != State::UPDATE) {
+        return result;
+    }
+    const Deployment& deployment = current.deployment();
+
+    {
+        // the counts go on, only the peak restarts
+        AllocationCounter dump;
+        current.dump(out);
+        result.dump = dump.peak();
+        step();
+    }
+
+    CHECK(client.downloadTo(deployment.chunks()[0].artifacts()[0], "download", sink).ok());
+    result.download = step();
+
+    CHECK(client.reportProgress(deployment, 1, artifacts, details).ok());
+    CHECK(client.reportComplete(deployment, true, details).ok());
+    result.feedback = step();
+
+    result.bytes = allocations.bytes();
+    return result;
+}
+
+TEST(moving_state_does_not_allocate)
+{
+    DdiServer ddi;
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware(100)) }) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+
+    AllocationCounter allocations;
+    State moved(std::move(state));
+    State assigned;
+    assigned = std::move(moved);
+    CHECK_EQ(0, allocations.count());
+    CHECK_EQ(State::UPDATE, assigned.type());
+}
+
+TEST(update_cycle)
+{
+    Cycle one = updateCycle(1);
+    Cycle many = updateCycle(20);
+
+    printf("1 artifact - allocations: read: %zu, download: %zu, feedback: %zu (%zu bytes); dump holds: %zu bytes\n",
+        one.read, one.download, one.feedback, one.bytes, one.dump);
+    printf("20 artifacts - allocations: read: %zu, download: %zu, feedback: %zu (%zu bytes); dump holds: %zu bytes\n",
+        many.read, many.download, many.feedback, many.bytes, many.dump);
+
+    // a single allocation holds the deployment, no matter how many artifacts it has
+    CHECK_EQ(one.read, many.read);
+    // nothing of the deployment gets copied
+    CHECK_EQ(one.download, many.download);
+    CHECK_EQ(one.feedback, many.feedback);
+    // only a prefix and a line at a time
+    CHECK(many.dump < 512);
+}
@@ -0,0 +1,300 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit_delta.h>
+
+#include <openssl/sha.h>
+
+#include "alloc.h"
+#include "check.h"
+#include "streams.h"
+
+/*
+ * Applying deltas, with file backed "partitions".
+ */
+
+/**
+ * A delta source, reading from a file.
+ */
+class FileSource : public DeltaSource {
+    public:
+        explicit FileSource(const std::string& content) :
+            _file(tmpfile()),
+            _size(content.size())
+        {
+            fwrite(content.data(), 1, content.size(), this->_file);
+        }
+
+        ~FileSource()
+        {
+            fclose(this->_file);
+        }
+
+        uint32_t size() const override { return this->_size; }
+
+        bool read(uint32_t offset, uint8_t* buffer, size_t len) override
+        {
+            return fseek(this->_file, offset, SEEK_SET) == 0 && fread(buffer, 1, len, this->_file) == len;
+        }
+
+    private:
+        FILE* _file;
+        uint32_t _size;
+};
+
+/**
+ * The target partition, a file.
+ */
+class FileTarget {
+    public:
+        FileTarget() :
+            _file(tmpfile())
+        {
+        }
+
+        ~FileTarget()
+        {
+            fclose(this->_file);
+        }
+
+        bool write(const uint8_t* data, size_t len) { return fwrite(data, 1, len, this->_file) == len; }
+
+        std::string content()
+        {
+            std::string result;
+            rewind(this->_file);
+            char buffer[4096];
+            size_t len;
+            while ((len = fread(buffer, 1, sizeof(buffer), this->_file)) > 0) {
+                result.append(buffer, len);
+            }
+            return result;
+        }
+
+    private:
+        FILE* _file;
+};
+
+/**
+ * Builds patches, in the format of tools/hawkbit_delta.py.
+ */
+class PatchBuilder {
+    public:
+        PatchBuilder(const std::string& source, const std::string& target)
+        {
+            this->_patch = "HBD2";
+            put(source.size());
+            put(target.size());
+            uint8_t hash[SHA256_DIGEST_LENGTH];
+            SHA256((const uint8_t*)source.data(), source.size(), hash);
+            this->_patch.append((const char*)hash, sizeof(hash));
+            SHA256((const uint8_t*)target.data(), target.size(), hash);
+            this->_patch.append((const char*)hash, sizeof(hash));
+        }
+
+        PatchBuilder& copy(uint32_t offset, uint32_t length)
+        {
+            this->_patch += (char)0x01;
+            put(offset);
+            put(length);
+            return *this;
+        }
+
+        PatchBuilder& insert(const std::string& data)
+        {
+            this->_patch += (char)0x02;
+            put(data.size());
+            this->_patch += data;
+            return *this;
+        }
+
+        std::string end() const { return this->_patch + (char)0x00; }
+        std::string partial() const { return this->_patch; }
+
+    private:
+        std::string _patch;
+
+        void put(uint32_t value)
+        {
+            for (int i = 0; i < 4; i++) {
+                this->_patch += (char)(value >> (i * 8));
+            }
+        }
+};
+
+static bool apply(const std::string& patch, DeltaSource& source, FileTarget& target, DeltaPatcher& patcher)
+{
+    MemoryStream stream(patch);
+    stream.setTimeout(0);
+    return patcher.apply(stream, source, [&target](const uint8_t* data, size_t len) {
+        return target.write(data, len);
+    });
+}
+
+static bool apply(const std::string& patch, DeltaSource& source)
+{
+    DeltaPatcher patcher;
+    FileTarget target;
+    return apply(patch, source, target, patcher);
+}
+
+TEST(is_delta)
+{
+    CHECK(DeltaPatcher::isDelta("firmware.bin.delta"));
+    CHECK(!DeltaPatcher::isDelta("firmware.bin"));
+}
+
+TEST(applies_patch)
+{
+    std::string sourceImage = firmware(300000, 1);
+    // a release, which changes a few percent of the image
+    std::string targetImage = sourceImage.substr(0, 100000) + firmware(5000, 2) + sourceImage.substr(100000, 150000)
+        + firmware(3000, 3) + sourceImage.substr(260000);
+
+    std::string patch = PatchBuilder(sourceImage, targetImage)
+        .copy(0, 100000)
+        .insert(targetImage.substr(100000, 5000))
+        .copy(100000, 150000)
+        .insert(targetImage.substr(255000, 3000))
+        .copy(260000, 40000)
+        .end();
+
+    FileSource source(sourceImage);
+    FileTarget target;
+    DeltaPatcher patcher;
+    CHECK(apply(patch, source, target, patcher));
+    CHECK(target.content() == targetImage);
+    CHECK_EQ(targetImage.size(), patcher.targetSize());
+    CHECK_EQ(290000, patcher.copied());
+    CHECK_EQ(8000, patcher.inserted());
+}
+
+TEST(bounded_memory)
+{
+    std::string sourceImage = firmware(1200000);
+    std::string patch = PatchBuilder(sourceImage, sourceImage).copy(0, sourceImage.size()).end();
+    FileSource source(sourceImage);
+
+    AllocationCounter allocations;
+    CHECK(apply(patch, source));
+    // neither the source nor the target is buffered
+    CHECK(allocations.peak() < 8 * 1024);
+}
+
+TEST(invalid_header)
+{
+    FileSource source("source");
+    std::string patch = PatchBuilder("source", "target").insert("target").end();
+    patch[3] = '3';
+    CHECK(!apply(patch, source));
+    CHECK(!apply("HBD2", source));
+    // the previous format, without the hash of the source
+    patch[3] = '1';
+    CHECK(!apply(patch, source));
+}
+
+TEST(source_too_small)
+{
+    FileSource source("source");
+    CHECK(!apply(PatchBuilder("sources", "target").insert("target").end(), source));
+}
+
+TEST(hash_mismatch)
+{
+    FileSource source("source");
+    std::string patch = PatchBuilder("source", "target").insert("tarGet").end();
+    CHECK(!apply(patch, source));
+}
+
+TEST(source_mismatch)
+{
+    std::string sourceImage = firmware(10000, 1);
+    std::string targetImage = sourceImage.substr(0, 5000) + "x" + sourceImage.substr(5001);
+    std::string patch = PatchBuilder(sourceImage, targetImage).copy(0, 5000).insert("x").copy(5001, 4999).end();
+
+    // another build of the running firmware
+    std::string otherImage = sourceImage;
+    otherImage[9000] ^= 1;
+    FileSource other(otherImage);
+    FileTarget target;
+    DeltaPatcher patcher;
+    CHECK(!apply(patch, other, target, patcher));
+    // nothing of the source was used
+    CHECK(target.content().empty());
+    CHECK_EQ(0, patcher.copied());
+
+    // the source may be larger, e.g. the partition of the image
+    FileSource partition(sourceImage + std::string(2000, (char)0xff));
+    CHECK(apply(patch, partition));
+}
+
+TEST(source_not_used)
+{
+    // a patch without copies does not depend on the source
+    FileSource source("another source");
+    CHECK(apply(PatchBuilder("source", "target").insert("target").end(), source));
+}
+
+TEST(copy_outside_of_source)
+{
+    FileSource source("source");
+    CHECK(!apply(PatchBuilder("source", "rce").copy(3, 4).end(), source));
+    CHECK(!apply(PatchBuilder("source", "rce").copy(7, 0).end(), source));
+}
+
+TEST(copy_overflow)
+{
+    // offset + length wraps around to within the source
+    FileSource source("source");
+    CHECK(!apply(PatchBuilder("source", "rce").copy(0xfffffffe, 5).end(), source));
+    CHECK(!apply(PatchBuilder("source", "rce").copy(3, 0xffffffff).end(), source));
+}
+
+TEST(exceeds_target_size)
+{
+    FileSource source("source");
+    CHECK(!apply(PatchBuilder("source", "target").insert("target").insert("x").end(), source));
+    // a huge length is rejected before reading it
+    CHECK(!apply(PatchBuilder("source", "target").insert("tar").copy(0, 0xfffffff0).end(), source));
+}
+
+TEST(too_short_target)
+{
+    FileSource source("source");
+    CHECK(!apply(PatchBuilder("source", "target").insert("targ").end(), source));
+}
+
+TEST(truncated_patch)
+{
+    FileSource source("source");
+    std::string patch = PatchBuilder("source", "target").insert("target").end();
+    // without the end record, and within the data
+    CHECK(!apply(patch.substr(0, patch.size() - 1), source));
+    CHECK(!apply(patch.substr(0, patch.size() - 3), source));
+}
+
+TEST(invalid_operation)
+{
+    FileSource source("source");
+    std::string patch = PatchBuilder("source", "target").partial() + (char)0x03;
+    CHECK(!apply(patch, source));
+}
+
+TEST(sink_aborts)
+{
+    FileSource source("source");
+    MemoryStream stream(PatchBuilder("source", "target").insert("target").end());
+    DeltaPatcher patcher;
+    CHECK(!patcher.apply(stream, source, [](const uint8_t*, size_t) { return false; }));
+}
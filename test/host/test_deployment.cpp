@@ -0,0 +1,312 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit.h>
+
+#include <list>
+
+#include "alloc.h"
+#include "check.h"
+#include "ddi.h"
+#include "storage.h"
+#include "streams.h"
+
+/*
+ * The arena backed layout of a deployment, and re-using a deployment in memory or from a storage.
+ */
+
+/**
+ * Offer a deployment of a single module, with 20 artifacts.
+ */
+static void deploy20(DdiServer& ddi)
+{
+    std::vector<DdiArtifact> artifacts;
+    for (int i = 0; i < 20; i++) {
+        artifacts.push_back(DdiArtifact("partition-" + String(i) + ".bin", firmware(64, i)));
+    }
+    ddi.deploy("device", { DdiChunk("firmware", "2.1.0", artifacts) });
+}
+
+/*
+ * The layout used before the arena: lists of chunks and artifacts, with maps of hashes and links.
+ */
+
+struct ListArtifact {
+    String filename;
+    uint32_t size;
+    std::map<String, String> hashes;
+    std::map<String, String> links;
+};
+
+struct ListChunk {
+    String part;
+    String version;
+    String name;
+    std::list<ListArtifact> artifacts;
+};
+
+static std::list<ListChunk> toLists(const Deployment& deployment)
+{
+    std::list<ListChunk> result;
+    for (const Chunk& chunk : deployment.chunks()) {
+        result.push_back(ListChunk());
+        ListChunk& c = result.back();
+        c.part = chunk.part();
+        c.version = chunk.version();
+        c.name = chunk.name();
+        for (const Artifact& artifact : chunk.artifacts()) {
+            c.artifacts.push_back(ListArtifact());
+            ListArtifact& a = c.artifacts.back();
+            a.filename = artifact.filename();
+            a.size = artifact.size();
+            for (const KeyValue& hash : artifact.hashes()) {
+                a.hashes[hash.first] = hash.second;
+            }
+            for (const KeyValue& link : artifact.links()) {
+                a.links[link.first] = link.second;
+            }
+        }
+    }
+    return result;
+}
+
+TEST(reads_deployment)
+{
+    DdiServer ddi;
+    deploy20(ddi);
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(32 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    if (state.type() != State::UPDATE) {
+        return;
+    }
+
+    const Deployment& deployment = state.deployment();
+    CHECK_EQ(1, deployment.chunks().size());
+    const Chunk& chunk = deployment.chunks()[0];
+    CHECK_STR("firmware", chunk.name());
+    CHECK_STR("2.1.0", chunk.version());
+    CHECK_STR("os", chunk.part());
+    CHECK_EQ(20, chunk.artifacts().size());
+
+    for (size_t i = 0; i < chunk.artifacts().size(); i++) {
+        const Artifact& artifact = chunk.artifacts()[i];
+        CHECK_STR("partition-" + String((unsigned int)i) + ".bin", artifact.filename());
+        CHECK_EQ(64, artifact.size());
+        // sorted by key
+        CHECK_EQ(3, artifact.hashes().size());
+        CHECK_STR("md5", artifact.hashes()[0].first);
+        CHECK_STR("sha1", artifact.hashes()[1].first);
+        CHECK_STR("sha256", artifact.hashes()[2].first);
+        CHECK(artifact.hashes().find("sha256") != artifact.hashes().end());
+        CHECK(artifact.hashes().find("crc32") == artifact.hashes().end());
+        CHECK_EQ(4, artifact.links().size());
+        CHECK(artifact.links().find("download-http")->second.c_str() != nullptr);
+        CHECK(String(artifact.links().find("download")->second).endsWith("/artifacts/" + String(artifact.filename())));
+    }
+}
+
+TEST(single_allocation)
+{
+    DdiServer ddi;
+    deploy20(ddi);
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(32 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    size_t arenaCount, arenaBytes;
+    State state;
+    {
+        AllocationCounter allocations;
+        CHECK(client.readState(state).ok());
+        CHECK_EQ(State::UPDATE, state.type());
+        if (state.type() != State::UPDATE) {
+            return;
+        }
+        arenaCount = allocations.count();
+        arenaBytes = state.deployment().memory();
+        // nothing but the deployment is left, besides what the client keeps of the requests
+        CHECK(allocations.current() < (long)arenaBytes + 1024);
+    }
+
+    {
+        // copies share the arena
+        AllocationCounter allocations;
+        Deployment copy = state.deployment();
+        State other(copy);
+        CHECK_EQ(0, allocations.count());
+    }
+
+    size_t listCount, listBytes;
+    {
+        AllocationCounter allocations;
+        std::list<ListChunk> lists = toLists(state.deployment());
+        listCount = allocations.count();
+        listBytes = allocations.current();
+    }
+
+    printf("20 artifacts - lists: %zu allocations, %zu bytes; arena: 1 allocation, %zu bytes "
+        "(%zu allocations while reading the state)\n", listCount, listBytes, arenaBytes, arenaCount);
+    CHECK(arenaBytes < listBytes);
+}
+
+/**
+ * Count the requests of a deployment.
+ */
+static int deploymentRequests(DdiServer& ddi)
+{
+    int count = 0;
+    for (const MockRequest& request : ddi.http().requests()) {
+        if (request.method == "GET" && request.path.indexOf("/deploymentBase/") >= 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Offer a deployment, which fits into a value of NVS.
+ */
+static void deploy3(DdiServer& ddi)
+{
+    ddi.deploy("device", { DdiChunk("firmware", "2.1.0", {
+        DdiArtifact("bootloader.bin", firmware(64, 1)),
+        DdiArtifact("partitions.bin", firmware(64, 2)),
+        DdiArtifact("firmware.bin", firmware(64, 3)),
+    }) });
+}
+
+static std::string dump(const Deployment& deployment)
+{
+    StringPrint out;
+    deployment.dump(out);
+    return out.data();
+}
+
+TEST(reuses_unchanged_deployment)
+{
+    DdiServer ddi;
+    deploy20(ddi);
+    ddi.http().record(true);
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(32 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State first;
+    CHECK(client.readState(first).ok());
+    State second;
+    CHECK(client.readState(second).ok());
+    CHECK_EQ(State::UPDATE, second.type());
+    if (second.type() != State::UPDATE) {
+        return;
+    }
+    // the href holds the same content hash, so the deployment is not fetched again
+    CHECK_EQ(1, deploymentRequests(ddi));
+    CHECK(dump(first.deployment()) == dump(second.deployment()));
+}
+
+TEST(restores_persisted_deployment)
+{
+    DdiServer ddi;
+    deploy3(ddi);
+    ddi.http().record(true);
+    MemoryStorage storage;
+    std::string expected;
+
+    {
+        WiFiClient wifi;
+        DynamicJsonDocument doc(32 * 1024);
+        HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+        client.persistDeployments(&storage);
+        State state;
+        CHECK(client.readState(state).ok());
+        CHECK_EQ(State::UPDATE, state.type());
+        expected = dump(state.deployment());
+        CHECK(storage.has("deployment"));
+        CHECK_EQ(1, storage.stores);
+    }
+
+    // after a reboot
+    WiFiClient wifi;
+    DynamicJsonDocument doc(32 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.persistDeployments(&storage);
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    if (state.type() != State::UPDATE) {
+        return;
+    }
+    CHECK_EQ(1, deploymentRequests(ddi));
+    CHECK(dump(state.deployment()) == expected);
+    CHECK_EQ(1, storage.stores);
+
+    // progress keeps it, the final feedback removes it
+    CHECK(client.reportProgress(state.deployment(), 1, 2).ok());
+    CHECK(storage.has("deployment"));
+    CHECK(client.reportComplete(state.deployment()).ok());
+    CHECK(!storage.has("deployment"));
+}
+
+TEST(skips_persisting_large_deployment)
+{
+    DdiServer ddi;
+    deploy20(ddi);
+    ddi.http().record(true);
+
+    // with an outdated deployment
+    MemoryStorage storage;
+    storage.values["deployment"] = "http://hawkbit:8080/outdated?c=1\n{}";
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(32 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.persistDeployments(&storage);
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    // more than a value of NVS holds
+    CHECK_EQ(0, storage.stores);
+    CHECK(!storage.has("deployment"));
+
+    // still kept in memory
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(1, deploymentRequests(ddi));
+}
+
+TEST(removes_deployment_failed_to_persist)
+{
+    DdiServer ddi;
+    deploy3(ddi);
+
+    // a storage, which is too small for the deployment
+    MemoryStorage storage(1000);
+    storage.values["deployment"] = "http://hawkbit:8080/outdated?c=1\n{}";
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(32 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.persistDeployments(&storage);
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    CHECK(!storage.has("deployment"));
+}
@@ -0,0 +1,284 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <hawkbit.h>
+#include <hawkbit_executor.h>
+
+#include "check.h"
+#include "ddi.h"
+#include "streams.h"
+
+/*
+ * Executing a deployment of several artifacts, which are committed all together, or not at all.
+ */
+
+/**
+ * The buffer of a TestSink, set up before the RamSink using it.
+ */
+struct SinkBuffer {
+    SinkBuffer() :
+        buffer(64 * 1024)
+    {
+    }
+
+    std::vector<uint8_t> buffer;
+};
+
+/**
+ * A sink in RAM, which records its commits and roll backs, and may fail to commit.
+ */
+class TestSink : private SinkBuffer, public RamSink {
+    public:
+        TestSink(const String& name, std::vector<String>& log) :
+            RamSink(buffer.data(), buffer.size()),
+            name(name),
+            failCommit(false),
+            canRollback(true),
+            begins(0),
+            _log(log)
+        {
+        }
+
+        bool begin(const Artifact& artifact) override
+        {
+            this->begins++;
+            return RamSink::begin(artifact);
+        }
+
+        bool commit() override
+        {
+            this->_log.push_back("commit " + this->name);
+            return !this->failCommit && RamSink::commit();
+        }
+
+        bool revertible() const override { return this->canRollback; }
+
+        bool rollback() override
+        {
+            this->_log.push_back("rollback " + this->name);
+            return this->canRollback && RamSink::rollback();
+        }
+
+        String name;
+        bool failCommit;
+        bool canRollback;
+        int begins;
+
+    private:
+        std::vector<String>& _log;
+};
+
+/**
+ * A deployment of an application (part "bApp"), a configuration and a firmware image (part "os").
+ */
+static void deployThree(DdiServer& ddi)
+{
+    ddi.deploy("device", {
+        DdiChunk("app", "1.0", { DdiArtifact("app.bin", firmware(1000, 1)), DdiArtifact("settings.json", firmware(500, 2)) }, "bApp"),
+        DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware(3000, 3)) }, "os"),
+    });
+}
+
+/**
+ * Count the requests for an artifact.
+ */
+static int downloads(DdiServer& ddi, const String& filename)
+{
+    int count = 0;
+    for (const MockRequest& request : ddi.http().requests()) {
+        if (request.path.endsWith("/artifacts/" + filename)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+struct Fixture {
+    Fixture() :
+        doc(8192),
+        client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token"),
+        app("app", log),
+        settings("settings", log),
+        os("os", log),
+        executor(client)
+    {
+        ddi.http().record(true);
+        executor.routeFilename(".json", settings, 128);
+        executor.routePart("bApp", app, 10);
+        executor.routePart("os", os, 255);
+    }
+
+    /**
+     * Read the deployment.
+     */
+    bool read()
+    {
+        CHECK(client.readState(state).ok());
+        CHECK_EQ(State::UPDATE, state.type());
+        return state.type() == State::UPDATE;
+    }
+
+    DdiServer ddi;
+    WiFiClient wifi;
+    DynamicJsonDocument doc;
+    HawkbitClient client;
+
+    std::vector<String> log;
+    TestSink app;
+    TestSink settings;
+    TestSink os;
+
+    // aborts what is still staged when destroyed, before the sinks
+    DeploymentExecutor executor;
+    State state;
+};
+
+TEST(commits_in_priority_order)
+{
+    Fixture f;
+    deployThree(f.ddi);
+    if (!f.read()) {
+        return;
+    }
+
+    CHECK(f.executor.execute(f.state.deployment()).ok());
+    CHECK(f.log == std::vector<String>({ "commit app", "commit settings", "commit os" }));
+    CHECK(f.app.committed() && f.settings.committed() && f.os.committed());
+    CHECK(memcmp(firmware(3000, 3).data(), f.os.data(), 3000) == 0);
+    CHECK_EQ(0, f.executor.staged());
+
+    std::vector<DdiFeedback> feedback = f.ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("success", feedback.back().finished);
+}
+
+TEST(corrupted_artifact_commits_nothing)
+{
+    Fixture f;
+    deployThree(f.ddi);
+    // the second one, after app.bin was verified
+    f.ddi.shapeDownloads([](MockResponse& response) {
+        if (response.body.size() == 500) {
+            response.body[10] ^= 1;
+        }
+    });
+    if (!f.read()) {
+        return;
+    }
+
+    HawkbitError error = f.executor.execute(f.state.deployment());
+    CHECK_EQ(HawkbitError::INTEGRITY, error.category());
+    CHECK(f.log.empty());
+    CHECK(!f.app.committed() && !f.settings.committed() && !f.os.committed());
+    // what was verified already got discarded
+    CHECK_EQ(0, f.app.size());
+    CHECK_EQ(0, f.executor.staged());
+    // the deployment failed before the firmware was downloaded
+    CHECK_EQ(0, downloads(f.ddi, "firmware.bin"));
+
+    std::vector<DdiFeedback> feedback = f.ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("failure", feedback.back().finished);
+}
+
+TEST(rejects_shared_sink)
+{
+    Fixture f;
+    f.ddi.deploy("device", { DdiChunk("app", "1.0", { DdiArtifact("app.bin", firmware(100, 1)), DdiArtifact("app2.bin", firmware(100, 2)) }, "bApp") });
+    if (!f.read()) {
+        return;
+    }
+
+    HawkbitError error = f.executor.execute(f.state.deployment());
+    CHECK_EQ(HawkbitError::PROTOCOL, error.category());
+    CHECK_EQ(0, f.app.begins);
+    CHECK_EQ(0, downloads(f.ddi, "app.bin") + downloads(f.ddi, "app2.bin"));
+
+    std::vector<DdiFeedback> feedback = f.ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("failure", feedback.back().finished);
+}
+
+TEST(retry_skips_staged_artifacts)
+{
+    Fixture f;
+    deployThree(f.ddi);
+    // the connection breaks during the first download of the firmware, the last one
+    int firmwareDownloads = 0;
+    f.ddi.shapeDownloads([&firmwareDownloads](MockResponse& response) {
+        if (response.body.size() == 3000 && firmwareDownloads++ == 0) {
+            response.breakAfter = 1000;
+        }
+    });
+    if (!f.read()) {
+        return;
+    }
+
+    HawkbitError error = f.executor.execute(f.state.deployment());
+    CHECK(error.transient());
+    CHECK_EQ(2, f.executor.staged());
+    CHECK(f.log.empty());
+    // not reported, the deployment goes on
+    CHECK_EQ(0, f.ddi.feedback().size());
+
+    CHECK(f.executor.execute(f.state.deployment()).ok());
+    CHECK_EQ(0, f.executor.staged());
+    CHECK_EQ(1, downloads(f.ddi, "app.bin"));
+    CHECK_EQ(1, downloads(f.ddi, "settings.json"));
+    CHECK_EQ(2, downloads(f.ddi, "firmware.bin"));
+    CHECK_EQ(1, f.app.begins);
+    CHECK_EQ(1, f.settings.begins);
+    CHECK(f.log == std::vector<String>({ "commit app", "commit settings", "commit os" }));
+    CHECK(memcmp(firmware(3000, 3).data(), f.os.data(), 3000) == 0);
+
+    std::vector<DdiFeedback> feedback = f.ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("success", feedback.back().finished);
+}
+
+TEST(failed_commit_rolls_back)
+{
+    Fixture f;
+    deployThree(f.ddi);
+    f.os.failCommit = true;
+    if (!f.read()) {
+        return;
+    }
+
+    HawkbitError error = f.executor.execute(f.state.deployment());
+    CHECK_EQ(HawkbitError::APPLICATION, error.category());
+    CHECK(f.log == std::vector<String>({ "commit app", "commit settings", "commit os", "rollback settings", "rollback app" }));
+    CHECK(!f.app.committed() && !f.settings.committed() && !f.os.committed());
+
+    std::vector<DdiFeedback> feedback = f.ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("failure", feedback.back().finished);
+}
+
+TEST(irreversible_sink_commits_last)
+{
+    Fixture f;
+    deployThree(f.ddi);
+    // committed first by priority, but it cannot be undone
+    f.app.canRollback = false;
+    f.settings.failCommit = true;
+    if (!f.read()) {
+        return;
+    }
+
+    HawkbitError error = f.executor.execute(f.state.deployment());
+    CHECK_EQ(HawkbitError::APPLICATION, error.category());
+    // the application was never committed
+    CHECK(f.log == std::vector<String>({ "commit settings" }));
+    CHECK(!f.app.committed() && !f.os.committed());
+}
@@ -0,0 +1,362 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit.h>
+
+#include "alloc.h"
+#include "check.h"
+#include "ddi.h"
+#include "storage.h"
+#include "streams.h"
+
+/*
+ * Sending feedback: the queue of pending feedback, and the allocations of a feedback call, with
+ * the body streamed from the document.
+ */
+
+static const String URL_1 = "http://hawkbit:8080/DEFAULT/controller/v1/device/deploymentBase/1/feedback";
+static const String URL_2 = "http://hawkbit:8080/DEFAULT/controller/v1/device/deploymentBase/2/feedback";
+
+static Feedback progress(const String& url, const String& id, uint32_t done)
+{
+    return Feedback(url, id, "proceeding", "none", { "Downloading" }, done, 10);
+}
+
+static Feedback closed(const String& url, const String& id)
+{
+    return Feedback(url, id, "closed", "success", { "Done" });
+}
+
+TEST(queue_coalesces_by_url)
+{
+    FeedbackQueue queue(8);
+    CHECK(queue.push(progress(URL_1, "1", 1)));
+    CHECK(queue.push(progress(URL_2, "2", 1)));
+    CHECK(queue.push(progress(URL_1, "1", 2)));
+    CHECK_EQ(2, queue.size());
+    CHECK_STR(URL_2, queue.front().url());
+    queue.pop();
+    CHECK_EQ(2, queue.front().done());
+
+    // the final feedback supersedes the progress, but is never superseded itself
+    CHECK(queue.push(closed(URL_1, "1")));
+    CHECK_EQ(1, queue.size());
+    CHECK(queue.front().isFinal());
+    CHECK(queue.push(progress(URL_1, "1", 3)));
+    CHECK_EQ(2, queue.size());
+    CHECK(queue.front().isFinal());
+}
+
+TEST(queue_drops_oldest_progress_when_full)
+{
+    FeedbackQueue queue(2);
+    CHECK(queue.push(closed(URL_1, "1")));
+    CHECK(queue.push(progress(URL_2, "2", 1)));
+    CHECK(queue.push(progress("http://hawkbit:8080/DEFAULT/controller/v1/device/deploymentBase/3/feedback", "3", 1)));
+    CHECK_EQ(2, queue.size());
+    CHECK_STR("1", queue.front().id());
+    queue.pop();
+    CHECK_STR("3", queue.front().id());
+
+    // only final feedback left, new progress is dropped, new final feedback drops the oldest
+    FeedbackQueue finals(2);
+    CHECK(finals.push(closed(URL_1, "1")));
+    CHECK(finals.push(closed(URL_2, "2")));
+    CHECK(!finals.push(progress("http://hawkbit:8080/DEFAULT/controller/v1/device/deploymentBase/3/feedback", "3", 1)));
+    CHECK(finals.push(closed("http://hawkbit:8080/DEFAULT/controller/v1/device/deploymentBase/3/feedback", "3")));
+    CHECK_EQ(2, finals.size());
+    CHECK_STR("2", finals.front().id());
+}
+
+TEST(queue_persists_final_feedback)
+{
+    MemoryStorage storage;
+    DynamicJsonDocument doc(4096);
+
+    {
+        FeedbackQueue queue(8, &storage);
+        queue.push(progress(URL_1, "1", 1));
+        queue.persist(doc);
+        // progress is not worth wearing the flash
+        CHECK_EQ(0, storage.stores);
+        CHECK(!storage.has(FeedbackQueue::STORAGE_KEY));
+
+        queue.push(progress(URL_2, "2", 5));
+        queue.push(closed(URL_1, "1"));
+        queue.persist(doc);
+        CHECK_EQ(1, storage.stores);
+        CHECK(storage.has(FeedbackQueue::STORAGE_KEY));
+
+        // unchanged final feedback is not written again
+        queue.push(progress(URL_2, "2", 6));
+        queue.persist(doc);
+        CHECK_EQ(1, storage.stores);
+    }
+
+    // after a reboot, only the final feedback is back
+    FeedbackQueue restored(8, &storage);
+    restored.restore(doc);
+    CHECK_EQ(1, restored.size());
+    CHECK_STR(URL_1, restored.front().url());
+    CHECK_STR("1", restored.front().id());
+    CHECK_STR("closed", restored.front().execution());
+    CHECK_STR("success", restored.front().finished());
+    CHECK_EQ(1, restored.front().details().size());
+
+    // once it is sent, the storage is cleared
+    restored.pop();
+    restored.persist(doc);
+    CHECK_EQ(1, storage.removes);
+    CHECK(!storage.has(FeedbackQueue::STORAGE_KEY));
+    restored.persist(doc);
+    CHECK_EQ(1, storage.removes);
+}
+
+TEST(report_returns_own_result)
+{
+    DdiServer ddi;
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware(100)) }) });
+    ddi.deploy("device", { DdiChunk("firmware", "2.0", { DdiArtifact("firmware.bin", firmware(100)) }) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.queueFeedback();
+
+    State first;
+    CHECK(client.readState(first).ok());
+    CHECK_EQ(State::UPDATE, first.type());
+    if (first.type() != State::UPDATE) {
+        return;
+    }
+
+    // the progress is kept, while the server is down
+    ddi.http().refuse(true);
+    CHECK(!client.reportProgress(first.deployment(), 1, 2).ok());
+    CHECK_EQ(1, client.pendingFeedback());
+    ddi.http().refuse(false);
+
+    // meanwhile, the action gets closed (e.g. by an earlier instance) and the next one is offered
+    WiFiClient otherWifi;
+    DynamicJsonDocument otherDoc(8192);
+    HawkbitClient other(otherDoc, otherWifi, ddi.base(), ddi.tenant(), "device", "token");
+    State state;
+    CHECK(other.readState(state).ok());
+    CHECK(other.reportComplete(state.deployment()).ok());
+    State second;
+    CHECK(other.readState(second).ok());
+    CHECK_EQ(State::UPDATE, second.type());
+    if (second.type() != State::UPDATE) {
+        return;
+    }
+
+    // the pending progress is rejected (the action is gone), but this feedback was accepted
+    UpdateResult result = client.reportComplete(second.deployment());
+    CHECK(result.ok());
+    CHECK_EQ(200, result.code());
+    CHECK_EQ(0, client.pendingFeedback());
+    CHECK_EQ(1, client.rejectedFeedback());
+    CHECK_EQ(2, ddi.closed());
+}
+
+/**
+ * Download an artifact of 10000 bytes, arriving over about 200 ms, while reporting the progress
+ * through a secondary connection.
+ * @return the progress feedback the server received during the download
+ */
+static std::vector<DdiFeedback> downloadWithProgress(uint32_t interval, uint8_t step, uint32_t& reports)
+{
+    DdiServer ddi;
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware(10000)) }) });
+    ddi.shapeDownloads([](MockResponse& response) {
+        response.trickle = 500;
+        response.interval = 10;
+    });
+
+    WiFiClient wifi;
+    WiFiClient progressWifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.progressClient(progressWifi);
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    if (state.type() != State::UPDATE) {
+        return {};
+    }
+
+    NullSink sink;
+    unsigned long finished;
+    {
+        ProgressReporter reporter(client, state.deployment(), interval, step);
+        CHECK(client.downloadTo(state.deployment().chunks()[0].artifacts()[0], "download", sink).ok());
+        finished = millis();
+        reports = reporter.reports();
+    }
+
+    std::vector<DdiFeedback> progress;
+    for (const DdiFeedback& feedback : ddi.feedback()) {
+        CHECK_STR("proceeding", feedback.execution);
+        CHECK_EQ(10000, feedback.total);
+        // sent while the download was still running
+        CHECK(feedback.received <= finished);
+        progress.push_back(feedback);
+    }
+    return progress;
+}
+
+TEST(progress_limited_by_interval)
+{
+    uint32_t reports = 0;
+    std::vector<DdiFeedback> progress = downloadWithProgress(50, 0, reports);
+    // each report is sent right away, but the last one may be dropped when the download ends
+    CHECK(progress.size() >= 2);
+    CHECK(progress.size() <= reports);
+    CHECK(reports <= 5);
+    for (size_t i = 1; i < progress.size(); i++) {
+        CHECK(progress[i].done > progress[i - 1].done);
+        // a little slack, for sending the reports
+        CHECK(progress[i].received - progress[i - 1].received >= 40);
+    }
+}
+
+TEST(progress_limited_by_step)
+{
+    uint32_t reports = 0;
+    std::vector<DdiFeedback> progress = downloadWithProgress(0, 25, reports);
+    CHECK(progress.size() >= 3);
+    CHECK(progress.size() <= reports);
+    CHECK(reports <= 4);
+    uint32_t last = 0;
+    for (const DdiFeedback& feedback : progress) {
+        CHECK(feedback.done - last >= 2500);
+        last = feedback.done;
+    }
+}
+
+// the calls measured, after a first one has opened the connection
+static const int CALLS = 20;
+
+struct PerCall {
+    double count;
+    double bytes;
+};
+
+/**
+ * Get the average allocations of a number of calls.
+ */
+template<typename Call>
+static PerCall measure(Call call)
+{
+    // opens the connection, later calls re-use it
+    call(0);
+
+    AllocationCounter allocations;
+    for (int i = 1; i <= CALLS; i++) {
+        call(i);
+    }
+    return PerCall { (double)allocations.count() / CALLS, (double)allocations.bytes() / CALLS };
+}
+
+/**
+ * The feedback URL, as it was assembled before the controller URL got cached.
+ */
+static String chainedUrl(const DdiServer& ddi, const String& controllerId, const Deployment& deployment)
+{
+    return ddi.base() + "/" + ddi.tenant() + "/controller/v1/" + controllerId + "/deploymentBase/" + deployment.id().c_str() + "/feedback";
+}
+
+/**
+ * Fill the document like the client does for a progress report.
+ */
+static void progressJson(JsonDocument& doc, const Feedback& feedback)
+{
+    doc.clear();
+    doc["id"] = feedback.id();
+    JsonArray d = doc["status"].createNestedArray("details");
+    for (const String& detail : feedback.details()) {
+        d.add(detail);
+    }
+    doc["status"]["execution"] = feedback.execution();
+    doc["status"]["result"]["finished"] = feedback.finished();
+    doc["status"]["result"]["progress"]["cnt"] = feedback.done();
+    doc["status"]["result"]["progress"]["of"] = feedback.total();
+}
+
+TEST(feedback_allocations)
+{
+    DdiServer ddi;
+    ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware(1024)) }) });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    if (state.type() != State::UPDATE) {
+        return;
+    }
+    const Deployment& deployment = state.deployment();
+    std::vector<String> details = { "Downloading firmware.bin", "Writing to partition ota_1" };
+
+    PerCall streamed = measure([&](int i) {
+        CHECK(client.reportProgress(deployment, i, CALLS, details).ok());
+    });
+
+    // the same request, sent the way it was before: the body serialized into a String, the URL
+    // concatenated, and the response read into a String
+    WiFiClient bufferedWifi;
+    DynamicJsonDocument bufferedDoc(8192);
+    HTTPClient http;
+    http.setReuse(true);
+    PerCall buffered = measure([&](int i) {
+        Feedback feedback(chainedUrl(ddi, "device", deployment), deployment.id(), "proceeding", "none", details, i, CALLS);
+        progressJson(bufferedDoc, feedback);
+        String body;
+        serializeJson(bufferedDoc, body);
+        http.begin(bufferedWifi, feedback.url());
+        http.addHeader("Accept", "application/hal+json");
+        http.addHeader("Content-Type", "application/json");
+        http.addHeader("Authorization", "TargetToken token");
+        CHECK_EQ(200, http.POST(body));
+        String payload = http.getString();
+        http.end();
+    });
+
+    // what the emulated HTTPClient takes for a request by itself, the floor of both
+    WiFiClient bareWifi;
+    HTTPClient bare;
+    bare.setReuse(true);
+    String url = chainedUrl(ddi, "device", deployment);
+    String body = "{}";
+    PerCall transport = measure([&](int) {
+        bare.begin(bareWifi, url);
+        bare.addHeader("Accept", "application/hal+json");
+        bare.addHeader("Content-Type", "application/json");
+        bare.addHeader("Authorization", "TargetToken token");
+        bare.POST(body);
+        bare.end();
+    });
+
+    printf("per feedback call - streamed: %.1f allocations (%.0f bytes), buffered: %.1f allocations (%.0f bytes), HTTPClient alone: %.1f allocations (%.0f bytes)\n",
+        streamed.count, streamed.bytes, buffered.count, buffered.bytes, transport.count, transport.bytes);
+
+    CHECK(streamed.count < buffered.count);
+    CHECK(streamed.bytes < buffered.bytes);
+    // all three went to the server
+    CHECK_EQ((size_t)(3 * (CALLS + 1)), ddi.feedback().size());
+}
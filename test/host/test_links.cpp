@@ -0,0 +1,137 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <hawkbit.h>
+
+#include "check.h"
+#include "ddi.h"
+#include "streams.h"
+
+/*
+ * Selecting the download link automatically, among several hosts serving the artifacts.
+ */
+
+struct Fixture {
+    Fixture() :
+        doc(8192),
+        client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token"),
+        content(firmware(5000)),
+        buffer(content.size()),
+        sink(buffer.data(), buffer.size())
+    {
+        hosts = ddi.downloadHosts({ "http://cdn-a:8080", "http://cdn-b:8080" }, "http://checksums:8080");
+        ddi.deploy("device", { DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", content) }) });
+    }
+
+    /**
+     * Read the deployment, returns its artifact.
+     */
+    const Artifact* read()
+    {
+        CHECK(client.readState(state).ok());
+        CHECK_EQ(State::UPDATE, state.type());
+        if (state.type() != State::UPDATE) {
+            return nullptr;
+        }
+        const Artifact& artifact = state.deployment().chunks()[0].artifacts()[0];
+        // the checksum links are there, to be ignored
+        CHECK_EQ(5, artifact.links().size());
+        CHECK_EQ(2, LinkSelector::count(artifact.links()));
+        return &artifact;
+    }
+
+    /**
+     * Get the link type, which the client selects next.
+     */
+    String selected(const Artifact& artifact) const
+    {
+        FlatMap::const_iterator link = client.linkSelector().select(artifact.links());
+        CHECK(link != artifact.links().end());
+        return link != artifact.links().end() ? String(link->first.c_str()) : String();
+    }
+
+    const LinkSelector::Host* host(const String& host) const
+    {
+        for (const LinkSelector::Host& entry : client.linkSelector().hosts()) {
+            if (entry.host == host) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    DdiServer ddi;
+    std::vector<MockServer*> hosts;
+    WiFiClient wifi;
+    DynamicJsonDocument doc;
+    HawkbitClient client;
+    State state;
+
+    std::string content;
+    std::vector<uint8_t> buffer;
+    RamSink sink;
+};
+
+TEST(fails_over_to_second_link)
+{
+    Fixture f;
+    f.hosts[0]->refuse(true);
+    const Artifact* artifact = f.read();
+    if (artifact == nullptr) {
+        return;
+    }
+
+    // nothing measured yet, the first download link
+    CHECK_STR("download", f.selected(*artifact));
+
+    CHECK(f.client.downloadTo(*artifact, HawkbitClient::AUTO_LINK, f.sink).ok());
+    CHECK(f.sink.committed());
+    CHECK_EQ(f.content.size(), f.sink.size());
+    CHECK(memcmp(f.content.data(), f.sink.data(), f.content.size()) == 0);
+    CHECK_EQ(0, f.hosts[0]->handled());
+    CHECK_EQ(1, f.hosts[1]->handled());
+
+    const LinkSelector::Host* a = f.host("http://cdn-a:8080");
+    const LinkSelector::Host* b = f.host("http://cdn-b:8080");
+    CHECK(a != nullptr && a->failures == 1 && a->recentFailures == 1);
+    CHECK(b != nullptr && b->successes == 1 && b->failures == 0);
+
+    // the failed host is avoided, even once it is back
+    f.hosts[0]->refuse(false);
+    CHECK_STR("download-http", f.selected(*artifact));
+
+    CHECK(f.client.downloadTo(*artifact, HawkbitClient::AUTO_LINK, f.sink).ok());
+    CHECK_EQ(0, f.hosts[0]->handled());
+    CHECK_EQ(2, f.hosts[1]->handled());
+}
+
+TEST(never_selects_checksum_links)
+{
+    Fixture f;
+    f.hosts[0]->refuse(true);
+    f.hosts[1]->refuse(true);
+    const Artifact* artifact = f.read();
+    if (artifact == nullptr) {
+        return;
+    }
+
+    // each download link is tried once, the checksum links never
+    HawkbitError error = f.client.downloadTo(*artifact, HawkbitClient::AUTO_LINK, f.sink);
+    CHECK(error.transient());
+    CHECK(!f.sink.committed());
+    CHECK(f.host("http://checksums:8080") == nullptr);
+    CHECK_EQ(2, f.client.linkSelector().hosts().size());
+
+    // all download hosts failed, the one which failed first is re-tried, not a checksum link
+    CHECK_STR("download", f.selected(*artifact));
+}
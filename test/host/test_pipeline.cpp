@@ -0,0 +1,196 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit_pipeline.h>
+
+#include "check.h"
+#include "streams.h"
+
+/*
+ * The download pipeline, with a simulated network and a simulated slow sink (the flash).
+ */
+
+static const size_t BLOCK_SIZE = 4096;
+
+/**
+ * A network stream, taking some time for each packet.
+ */
+class SlowStream : public MemoryStream {
+    public:
+        SlowStream(const std::string& data, unsigned long packetMicros) :
+            MemoryStream(data, 1460),
+            _packetMicros(packetMicros)
+        {
+        }
+
+        size_t readBytes(char* buffer, size_t length) override
+        {
+            size_t total = 0;
+            while (total < length) {
+                size_t len = length - total < 1460 ? length - total : 1460;
+                delayMicroseconds(this->_packetMicros);
+                len = MemoryStream::readBytes(buffer + total, len);
+                if (len == 0) {
+                    break;
+                }
+                total += len;
+            }
+            return total;
+        }
+
+    private:
+        unsigned long _packetMicros;
+};
+
+/**
+ * A sink, taking some time for each block, like erasing and writing flash.
+ */
+class SlowSink {
+    public:
+        explicit SlowSink(unsigned long blockMicros = 0) :
+            _blockMicros(blockMicros)
+        {
+        }
+
+        bool operator()(const uint8_t* data, size_t len)
+        {
+            delayMicroseconds(this->_blockMicros);
+            this->_data.append((const char*)data, len);
+            return true;
+        }
+
+        const std::string& data() const { return this->_data; }
+
+    private:
+        unsigned long _blockMicros;
+        std::string _data;
+};
+
+/**
+ * Copy the stream into the sink, alternating between both, like Update.writeStream() does.
+ */
+static void serial(Stream& stream, uint32_t length, SlowSink& sink)
+{
+    uint8_t buffer[BLOCK_SIZE];
+    while (length > 0) {
+        size_t len = stream.readBytes(buffer, length < BLOCK_SIZE ? length : BLOCK_SIZE);
+        if (len == 0) {
+            break;
+        }
+        sink(buffer, len);
+        length -= len;
+    }
+}
+
+TEST(ring)
+{
+    SpscRing<int, 4> ring;
+    int value = -1;
+    CHECK(!ring.pop(value));
+    for (int i = 0; i < 4; i++) {
+        CHECK(ring.push(i));
+    }
+    CHECK(!ring.push(4));
+    CHECK(ring.pop(value));
+    CHECK_EQ(0, value);
+    CHECK(ring.push(4));
+    for (int i = 1; i <= 4; i++) {
+        CHECK(ring.pop(value));
+        CHECK_EQ(i, value);
+    }
+    CHECK(!ring.pop(value));
+}
+
+TEST(copies_stream)
+{
+    std::string data = firmware(100000);
+    MemoryStream stream(data);
+    SlowSink sink;
+    DownloadPipeline pipeline(BLOCK_SIZE);
+    CHECK(pipeline.run(stream, data.size(), [&sink](const uint8_t* data, size_t len) { return sink(data, len); }));
+    CHECK(sink.data() == data);
+    CHECK_EQ(data.size(), pipeline.bytes());
+}
+
+TEST(unknown_length)
+{
+    std::string data = firmware(10000);
+    MemoryStream stream(data);
+    SlowSink sink;
+    DownloadPipeline pipeline(BLOCK_SIZE);
+    CHECK(pipeline.run(stream, 0, [&sink](const uint8_t* data, size_t len) { return sink(data, len); }));
+    CHECK(sink.data() == data);
+}
+
+TEST(stream_ends_early)
+{
+    std::string data = firmware(10000);
+    MemoryStream stream(data);
+    DownloadPipeline pipeline(BLOCK_SIZE);
+    CHECK(!pipeline.run(stream, data.size() + 1, [](const uint8_t*, size_t) { return true; }));
+    CHECK_EQ(data.size(), pipeline.bytes());
+}
+
+TEST(sink_aborts)
+{
+    std::string data = firmware(100000);
+    MemoryStream stream(data);
+    DownloadPipeline pipeline(BLOCK_SIZE);
+    int blocks = 0;
+    CHECK(!pipeline.run(stream, data.size(), [&blocks](const uint8_t*, size_t) { return ++blocks < 3; }));
+    CHECK_EQ(3, blocks);
+    // the producer stopped early, it can't be ahead by more than all blocks
+    CHECK(stream.position() <= (2 + DownloadPipeline::BLOCKS) * BLOCK_SIZE);
+}
+
+TEST(runs_repeatedly)
+{
+    DownloadPipeline pipeline(BLOCK_SIZE);
+    for (int i = 0; i < 3; i++) {
+        std::string data = firmware(20000 + i * 1000, i);
+        MemoryStream stream(data);
+        SlowSink sink;
+        CHECK(pipeline.run(stream, data.size(), [&sink](const uint8_t* data, size_t len) { return sink(data, len); }));
+        CHECK(sink.data() == data);
+    }
+}
+
+TEST(overlaps_slow_sink)
+{
+    // 256 KiB, the network and the sink take about the same time for each block
+    std::string data = firmware(256 * 1024);
+    const unsigned long packetMicros = 500;
+    const unsigned long blockMicros = 1500;
+
+    uint32_t started = millis();
+    SlowStream serialStream(data, packetMicros);
+    SlowSink serialSink(blockMicros);
+    serial(serialStream, data.size(), serialSink);
+    uint32_t serialElapsed = millis() - started;
+    CHECK(serialSink.data() == data);
+
+    SlowStream stream(data, packetMicros);
+    SlowSink sink(blockMicros);
+    DownloadPipeline pipeline(BLOCK_SIZE);
+    CHECK(pipeline.run(stream, data.size(), [&sink](const uint8_t* data, size_t len) { return sink(data, len); }));
+    CHECK(sink.data() == data);
+
+    uint32_t serialThroughput = (uint64_t)data.size() * 1000 / (serialElapsed > 0 ? serialElapsed : 1);
+    printf("serial: %u bytes/s, pipelined: %u bytes/s (%.2fx)\n", serialThroughput, pipeline.throughput(),
+        (double)pipeline.throughput() / serialThroughput);
+    pipeline.dump(Serial, "    ");
+
+    // ideally, it takes half the time
+    CHECK(pipeline.elapsed() * 4 < serialElapsed * 3);
+}
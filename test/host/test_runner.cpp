@@ -0,0 +1,194 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <hawkbit.h>
+#include <hawkbit_runner.h>
+
+#include <map>
+
+#include "check.h"
+#include "codecs.h"
+#include "ddi.h"
+#include "streams.h"
+
+/*
+ * The state machine of the UpdateRunner, from the poll to the reported deployment.
+ */
+
+/**
+ * A runner, with an application which keeps the artifacts in memory.
+ */
+struct Fixture {
+    Fixture(uint32_t stall = 30000) :
+        doc(8192),
+        client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token"),
+        // polls right away, there is no interval from the server
+        scheduler(10, 1000, 0),
+        runner(client, scheduler, 256, stall),
+        completed(0),
+        success(false)
+    {
+        ddi.sleep("00:00:00");
+        ddi.http().record(true);
+
+        runner.onArtifact([this](const Artifact& artifact) {
+            this->data[artifact.filename().c_str()].clear();
+            return true;
+        });
+        runner.onData([this](const Artifact& artifact, const uint8_t* data, size_t len) {
+            this->data[artifact.filename().c_str()].append((const char*)data, len);
+            return true;
+        });
+        runner.onArtifactDone([this](const Artifact& artifact, bool success) {
+            if (success) {
+                this->committed.push_back(artifact.filename().c_str());
+            } else {
+                this->data.erase(artifact.filename().c_str());
+            }
+            return true;
+        });
+        runner.onResume([this](const Artifact& artifact, uint32_t offset) {
+            this->resumed.push_back(offset);
+            return this->data[artifact.filename().c_str()].size() == offset;
+        });
+        runner.onComplete([this](const Deployment&, bool success) {
+            this->completed++;
+            this->success = success;
+        });
+    }
+
+    /**
+     * Run the state machine, until the deployment was reported.
+     * @return false if that did not happen in time
+     */
+    bool run(unsigned long timeout = 5000)
+    {
+        unsigned long start = millis();
+        while (this->completed == 0) {
+            if (millis() - start > timeout) {
+                return false;
+            }
+            if (!this->runner.tick()) {
+                delay(1);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Get the requests for an artifact.
+     */
+    std::vector<MockRequest> downloads(const String& filename)
+    {
+        std::vector<MockRequest> result;
+        for (const MockRequest& request : this->ddi.http().requests()) {
+            if (request.path.endsWith("/artifacts/" + filename)) {
+                result.push_back(request);
+            }
+        }
+        return result;
+    }
+
+    DdiServer ddi;
+    WiFiClient wifi;
+    DynamicJsonDocument doc;
+    HawkbitClient client;
+    PollScheduler scheduler;
+    UpdateRunner runner;
+
+    std::map<String, std::string> data;
+    std::vector<String> committed;
+    std::vector<uint32_t> resumed;
+    int completed;
+    bool success;
+};
+
+TEST(runs_deployment)
+{
+    Fixture f;
+    f.ddi.deploy("device", {
+        DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware(3000, 1)) }),
+        DdiChunk("app", "1.0", { DdiArtifact("app.bin", firmware(1000, 2)), DdiArtifact("settings.json", firmware(100, 3)) }, "bApp"),
+    });
+
+    CHECK_EQ(UpdateRunner::IDLE, f.runner.phase());
+    CHECK(f.run());
+    CHECK(f.success);
+    CHECK_EQ(UpdateRunner::IDLE, f.runner.phase());
+    CHECK(f.committed == std::vector<String>({ "firmware.bin", "app.bin", "settings.json" }));
+    CHECK(f.data["firmware.bin"] == firmware(3000, 1));
+    CHECK(f.data["app.bin"] == firmware(1000, 2));
+    CHECK(f.data["settings.json"] == firmware(100, 3));
+    CHECK(f.resumed.empty());
+
+    CHECK_EQ(1, f.ddi.closed());
+    std::vector<DdiFeedback> feedback = f.ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("closed", feedback.back().execution);
+    CHECK_STR("success", feedback.back().finished);
+}
+
+TEST(resumes_stalled_download)
+{
+    Fixture f(100);
+    f.ddi.deploy("device", {
+        DdiChunk("app", "1.0", { DdiArtifact("app.bin", firmware(1000, 2)) }, "bApp"),
+        DdiChunk("firmware", "1.0", { DdiArtifact("firmware.bin", firmware(3000, 1)) }),
+    });
+    // the first download of the firmware stalls after a part, with the connection open
+    int firmwareDownloads = 0;
+    f.ddi.shapeDownloads([&firmwareDownloads](MockResponse& response) {
+        if (response.body.size() == 3000 && firmwareDownloads++ == 0) {
+            response.trickle = 1200;
+            response.interval = 60000;
+        }
+    });
+
+    CHECK(f.run());
+    CHECK(f.success);
+    CHECK(f.committed == std::vector<String>({ "app.bin", "firmware.bin" }));
+    CHECK(f.data["firmware.bin"] == firmware(3000, 1));
+    // the download was suspended, and continued with the next poll
+    CHECK(f.resumed == std::vector<uint32_t>({ 1200 }));
+    CHECK_EQ(0, f.scheduler.failures());
+
+    CHECK_EQ(1, f.downloads("app.bin").size());
+    std::vector<MockRequest> downloads = f.downloads("firmware.bin");
+    CHECK_EQ(2, downloads.size());
+    if (downloads.size() == 2) {
+        CHECK_STR("bytes=1200-", downloads[1].header("Range"));
+    }
+
+    CHECK_EQ(1, f.ddi.closed());
+    std::vector<DdiFeedback> feedback = f.ddi.feedback();
+    CHECK_EQ(1, feedback.size());
+    CHECK_STR("success", feedback.back().finished);
+}
+
+TEST(gzip_encoded_download_ends_with_data)
+{
+    Fixture f;
+    DdiArtifact artifact("firmware.bin", firmware(20000, 1));
+    artifact.encoding = "gzip";
+    artifact.encoded = gzipEncode(artifact.content);
+    f.ddi.deploy("device", { DdiChunk("firmware", "1.0", { artifact }) });
+    // without a length, over HTTP/1.0 the response ends with the gzip data (or the connection)
+    f.ddi.shapeDownloads([](MockResponse& response) { response.chunked = true; });
+    f.client.streaming(true);
+
+    // well before the download would stall
+    CHECK(f.run(2000));
+    CHECK(f.success);
+    CHECK(f.data["firmware.bin"] == artifact.content);
+    CHECK_EQ(1, f.downloads("firmware.bin").size());
+}
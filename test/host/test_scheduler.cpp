@@ -0,0 +1,166 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <hawkbit.h>
+
+#include "check.h"
+#include "ddi.h"
+
+/*
+ * Scheduling the polls: the interval of the server, the jitter, and backing off after failures,
+ * with a stopped clock.
+ */
+
+/**
+ * Stops the clock while it exists.
+ */
+struct StoppedClock {
+    StoppedClock() { stopClock(); }
+    ~StoppedClock() { startClock(); }
+};
+
+/**
+ * Poll the stand-in once, for a state with its polling interval.
+ */
+static State poll(DdiServer& ddi)
+{
+    WiFiClient wifi;
+    DynamicJsonDocument doc(8192);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    State state;
+    CHECK(client.readState(state).ok());
+    return state;
+}
+
+TEST(due_after_interval)
+{
+    StoppedClock clock;
+    PollScheduler scheduler(10000, 3600000, 0);
+    scheduler.success(State());
+    CHECK(!scheduler.due());
+    CHECK_EQ(10000, scheduler.remaining());
+
+    advanceClock(9999);
+    CHECK(!scheduler.due());
+    CHECK_EQ(1, scheduler.remaining());
+    advanceClock(1);
+    CHECK(scheduler.due());
+    CHECK_EQ(0, scheduler.remaining());
+    advanceClock(5000);
+    CHECK(scheduler.due());
+    CHECK_EQ(0, scheduler.remaining());
+}
+
+TEST(spreads_first_poll)
+{
+    StoppedClock clock;
+    PollScheduler scheduler(10000, 3600000, 0);
+    scheduler.begin(0);
+    CHECK(scheduler.due());
+
+    randomSeed(1);
+    uint32_t least = UINT32_MAX;
+    uint32_t most = 0;
+    for (int i = 0; i < 100; i++) {
+        scheduler.begin(60000);
+        least = std::min(least, scheduler.remaining());
+        most = std::max(most, scheduler.remaining());
+    }
+    CHECK(most < 60000);
+    // spread over the whole range, not just delayed
+    CHECK(least < 10000);
+    CHECK(most > 50000);
+}
+
+TEST(jitters_interval)
+{
+    StoppedClock clock;
+    PollScheduler scheduler(10000, 3600000, 20);
+
+    randomSeed(1);
+    uint32_t least = UINT32_MAX;
+    uint32_t most = 0;
+    for (int i = 0; i < 200; i++) {
+        scheduler.success(State());
+        least = std::min(least, scheduler.remaining());
+        most = std::max(most, scheduler.remaining());
+    }
+    // up to 20% either way
+    CHECK(least >= 8000);
+    CHECK(most <= 12000);
+    CHECK(least < 9000);
+    CHECK(most > 11000);
+}
+
+TEST(server_interval_overrides_default)
+{
+    StoppedClock clock;
+    DdiServer ddi;
+    ddi.sleep("00:05:00");
+    State state = poll(ddi);
+    CHECK_EQ(300000, state.pollingInterval());
+
+    PollScheduler scheduler(10000, 3600000, 0);
+    scheduler.success(state);
+    CHECK_EQ(300000, scheduler.remaining());
+    advanceClock(10000);
+    CHECK(!scheduler.due());
+
+    // back to the default, when the server does not request an interval
+    scheduler.success(State());
+    CHECK_EQ(10000, scheduler.remaining());
+}
+
+TEST(backs_off_exponentially)
+{
+    StoppedClock clock;
+    PollScheduler scheduler(1000, 60000, 0);
+    scheduler.success(State());
+
+    const uint32_t expected[] = { 2000, 4000, 8000, 16000, 32000, 60000, 60000 };
+    for (uint32_t delay : expected) {
+        scheduler.failure();
+        CHECK_EQ(delay, scheduler.remaining());
+    }
+    CHECK_EQ(7, scheduler.failures());
+
+    // the count is limited, the back-off does not overflow
+    for (int i = 0; i < 100; i++) {
+        scheduler.failure();
+    }
+    CHECK_EQ(16, scheduler.failures());
+    CHECK_EQ(60000, scheduler.remaining());
+
+    // a successful poll resets it
+    scheduler.success(State());
+    CHECK_EQ(0, scheduler.failures());
+    CHECK_EQ(1000, scheduler.remaining());
+}
+
+TEST(backs_off_from_server_interval)
+{
+    StoppedClock clock;
+    DdiServer ddi;
+    ddi.sleep("00:05:00");
+    State state = poll(ddi);
+
+    PollScheduler scheduler(10000, 3600000, 20);
+    scheduler.success(state);
+    randomSeed(1);
+    for (int i = 0; i < 20; i++) {
+        scheduler.failure();
+        uint32_t backoff = std::min<uint64_t>(300000ULL << std::min(i + 1, 16), 3600000);
+        CHECK(scheduler.remaining() >= backoff - backoff / 5);
+        CHECK(scheduler.remaining() <= backoff + backoff / 5);
+    }
+}
@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+
+#include <hawkbit.h>
+
+#include "alloc.h"
+#include "check.h"
+#include "ddi.h"
+#include "streams.h"
+
+/*
+ * Parsing the responses of the server directly from the HTTP stream, against buffering them.
+ */
+
+/**
+ * Offer a large deployment, with several chunks of multiple artifacts, and release notes.
+ */
+static void deployLarge(DdiServer& ddi)
+{
+    std::vector<DdiChunk> chunks;
+    for (int i = 0; i < 8; i++) {
+        std::vector<DdiArtifact> artifacts;
+        for (int j = 0; j < 4; j++) {
+            artifacts.push_back(DdiArtifact("module-" + String(i) + "-part-" + String(j) + ".bin", firmware(100 + j, i)));
+        }
+        chunks.push_back(DdiChunk("module-" + String(i), "1.0." + String(i), artifacts, i == 0 ? "os" : "bApp"));
+        String notes;
+        for (int j = 0; j < 20; j++) {
+            notes += "Fixed issue #" + String(1000 + i * 20 + j) + " in the handling of the sensor data. ";
+        }
+        chunks.back().metadata.push_back(std::make_pair(String("releaseNotes"), notes));
+    }
+    ddi.deploy("device", chunks);
+}
+
+struct ReadResult {
+    // the highest heap usage while reading the state
+    size_t peak;
+    // the bytes of all response bodies
+    size_t payload;
+    // the size of the parsed deployment
+    size_t memory;
+    std::string dump;
+};
+
+static ReadResult readLarge(bool streaming)
+{
+    DdiServer ddi;
+    deployLarge(ddi);
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(64 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.streaming(streaming);
+
+    ReadResult result;
+    State state;
+    {
+        AllocationCounter allocations;
+        CHECK(client.readState(state).ok());
+        result.peak = allocations.peak();
+    }
+    result.payload = ddi.http().bytesSent();
+    CHECK_EQ(State::UPDATE, state.type());
+    if (state.type() != State::UPDATE) {
+        return result;
+    }
+    CHECK_EQ(8, state.deployment().chunks().size());
+    result.memory = state.deployment().memory();
+
+    StringPrint out;
+    state.deployment().dump(out);
+    result.dump = out.data();
+    return result;
+}
+
+TEST(streaming_reads_same_deployment)
+{
+    CHECK(readLarge(true).dump == readLarge(false).dump);
+}
+
+TEST(streaming_lowers_peak_heap)
+{
+    ReadResult buffered = readLarge(false);
+    ReadResult streaming = readLarge(true);
+    printf("responses: %zu bytes, deployment: %zu bytes, peak heap - buffered: %zu bytes, streaming: %zu bytes\n",
+        buffered.payload, buffered.memory, buffered.peak, streaming.peak);
+    // the document is allocated up front, so the buffered path holds the full payload on top of it
+    // (the deploymentBase response is all but about 200 bytes of the payload)
+    CHECK(buffered.peak + 512 >= buffered.payload);
+    // while streaming, nothing but the parsed deployment, without the parts dropped by the filter
+    CHECK(streaming.peak < streaming.memory + 4096);
+    CHECK(streaming.peak < buffered.peak);
+}
+
+TEST(streaming_chunked_response)
+{
+    // with keep-alive, the server may send chunked responses, which are buffered instead
+    DdiServer ddi;
+    deployLarge(ddi);
+    ddi.http().shape([](MockResponse& response) { response.chunked = true; });
+
+    WiFiClient wifi;
+    DynamicJsonDocument doc(64 * 1024);
+    HawkbitClient client(doc, wifi, ddi.base(), ddi.tenant(), "device", "token");
+    client.keepAlive(true);
+
+    State state;
+    CHECK(client.readState(state).ok());
+    CHECK_EQ(State::UPDATE, state.type());
+    CHECK(state.type() == State::UPDATE && state.deployment().chunks().size() == 8);
+}
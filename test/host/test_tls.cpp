@@ -0,0 +1,288 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <hawkbit_tls.h>
+
+#include <set>
+
+#include "check.h"
+#include "storage.h"
+#include "streams.h"
+
+/*
+ * The cache of TLS sessions, with a fake TLS implementation.
+ */
+
+/**
+ * Hands out a new session with each full handshake, and resumes the sessions it handed out.
+ */
+class FakeAdapter : public TlsSessionAdapter {
+    public:
+        FakeAdapter(size_t size = 200) :
+            size(size),
+            issued(0),
+            _imported(false),
+            _resumed(false)
+        {
+        }
+
+        /**
+         * Run the handshake of the client, with the session imported before.
+         */
+        void handshake()
+        {
+            this->_resumed = this->_imported && this->_accepted.count(this->_session) > 0;
+            if (!this->_resumed) {
+                this->_session = std::vector<uint8_t>(this->size, (uint8_t)++this->issued);
+                this->_accepted.insert(this->_session);
+            }
+        }
+
+        /**
+         * Forget all sessions, like a server which rotated its ticket keys.
+         */
+        void forget() { this->_accepted.clear(); }
+
+        bool exportSession(WiFiClient&, std::vector<uint8_t>& session) override
+        {
+            session = this->_session;
+            return true;
+        }
+
+        void importSession(WiFiClient&, const std::vector<uint8_t>& session) override
+        {
+            this->_session = session;
+            this->_imported = true;
+        }
+
+        void clearSession(WiFiClient&) override { this->_imported = false; }
+
+        bool resumed(WiFiClient&) override { return this->_resumed; }
+
+        size_t size;
+        int issued;
+
+    private:
+        std::set<std::vector<uint8_t>> _accepted;
+        std::vector<uint8_t> _session;
+        bool _imported;
+        bool _resumed;
+};
+
+/**
+ * Connect the client to the host, returns true if the handshake resumed a session.
+ */
+static bool connect(TlsSessionCache& cache, FakeAdapter& adapter, WiFiClient& client, const String& host)
+{
+    cache.beforeConnect(client, host);
+    adapter.handshake();
+    return cache.afterConnect(client, host);
+}
+
+TEST(resumes_cached_session)
+{
+    FakeAdapter adapter;
+    TlsSessionCache cache(adapter);
+    WiFiClient client;
+
+    CHECK(!connect(cache, adapter, client, "https://a"));
+    CHECK(connect(cache, adapter, client, "https://a"));
+    CHECK(connect(cache, adapter, client, "https://a"));
+    CHECK_EQ(1, adapter.issued);
+
+    // a session of another host is not used
+    CHECK(!connect(cache, adapter, client, "https://b"));
+    CHECK_EQ(2, cache.size());
+
+    // the server does not resume the session any more, the new one is cached
+    adapter.forget();
+    CHECK(!connect(cache, adapter, client, "https://a"));
+    CHECK(connect(cache, adapter, client, "https://a"));
+    CHECK_EQ(2, cache.size());
+}
+
+TEST(evicts_least_recently_used)
+{
+    FakeAdapter adapter;
+    TlsSessionCache cache(adapter, nullptr, 2);
+    WiFiClient client;
+
+    connect(cache, adapter, client, "https://a");
+    delay(2);
+    connect(cache, adapter, client, "https://b");
+    delay(2);
+    CHECK(connect(cache, adapter, client, "https://a"));
+    delay(2);
+    // replaces b, which was used longest ago
+    connect(cache, adapter, client, "https://c");
+    CHECK_EQ(2, cache.size());
+    CHECK(connect(cache, adapter, client, "https://a"));
+    CHECK(connect(cache, adapter, client, "https://c"));
+    CHECK(!connect(cache, adapter, client, "https://b"));
+}
+
+TEST(skips_oversized_session)
+{
+    // the fields of a session, and a ticket of 1 KiB
+    FakeAdapter adapter(92 + 1024);
+    TlsSessionCache cache(adapter);
+    WiFiClient client;
+    connect(cache, adapter, client, "https://a");
+    CHECK(connect(cache, adapter, client, "https://a"));
+
+    FakeAdapter large(92 + 1025);
+    TlsSessionCache limited(large);
+    CHECK(!connect(limited, large, client, "https://a"));
+    CHECK(!connect(limited, large, client, "https://a"));
+    CHECK_EQ(0, limited.size());
+}
+
+TEST(invalidates_session)
+{
+    FakeAdapter adapter;
+    TlsSessionCache cache(adapter);
+    WiFiClient client;
+    connect(cache, adapter, client, "https://a");
+    cache.invalidate("https://a");
+    CHECK_EQ(0, cache.size());
+    CHECK(!connect(cache, adapter, client, "https://a"));
+}
+
+TEST(persists_only_encrypted)
+{
+    FakeAdapter adapter;
+    WiFiClient client;
+    MemoryStorage storage;
+    storage.values[TlsSessionCache::STORAGE_KEY] = "https://a 0102\n";
+
+    {
+        TlsSessionCache cache(adapter, &storage);
+        connect(cache, adapter, client, "https://a");
+        cache.flush();
+        CHECK_EQ(0, storage.stores);
+        // a session persisted before is removed
+        CHECK(!storage.has(TlsSessionCache::STORAGE_KEY));
+    }
+
+    storage.encryption = true;
+    {
+        TlsSessionCache cache(adapter, &storage);
+        CHECK(!connect(cache, adapter, client, "https://a"));
+        CHECK_EQ(1, storage.stores);
+    }
+
+    // after a reboot, the first connection resumes the session
+    TlsSessionCache restored(adapter, &storage);
+    CHECK(connect(restored, adapter, client, "https://a"));
+    CHECK_EQ(1, restored.size());
+    CHECK_EQ(1, storage.stores);
+}
+
+TEST(persists_unencrypted_if_allowed)
+{
+    FakeAdapter adapter;
+    WiFiClient client;
+    MemoryStorage storage;
+
+    {
+        TlsSessionCache cache(adapter, &storage);
+        cache.allowUnencrypted(true);
+        connect(cache, adapter, client, "https://a");
+        CHECK_EQ(1, storage.stores);
+    }
+
+    TlsSessionCache restored(adapter, &storage);
+    restored.allowUnencrypted(true);
+    CHECK(connect(restored, adapter, client, "https://a"));
+}
+
+TEST(limits_writes)
+{
+    FakeAdapter adapter;
+    WiFiClient client;
+    MemoryStorage storage;
+    storage.encryption = true;
+
+    TlsSessionCache cache(adapter, &storage);
+    for (int i = 0; i < 10; i++) {
+        adapter.forget();
+        CHECK(!connect(cache, adapter, client, "https://a"));
+    }
+    cache.invalidate("https://b");
+    // the first session right away, all others wait for the interval
+    CHECK_EQ(1, storage.stores);
+
+    cache.flush();
+    CHECK_EQ(2, storage.stores);
+    cache.flush();
+    CHECK_EQ(2, storage.stores);
+
+    TlsSessionCache restored(adapter, &storage);
+    CHECK(connect(restored, adapter, client, "https://a"));
+
+    cache.persistInterval(10);
+    delay(20);
+    adapter.forget();
+    connect(cache, adapter, client, "https://a");
+    CHECK_EQ(3, storage.stores);
+}
+
+TEST(persists_what_fits)
+{
+    // in hex, only three of these sessions fit into a value
+    FakeAdapter adapter(TlsSessionCache::DEFAULT_MAX_SESSION / 2);
+    WiFiClient client;
+    MemoryStorage storage(TlsSessionCache::MAX_PERSISTED);
+    storage.encryption = true;
+
+    TlsSessionCache cache(adapter, &storage);
+    cache.persistInterval(0);
+    const char* hosts[] = { "https://a", "https://b", "https://c", "https://d" };
+    for (const char* host : hosts) {
+        delay(2);
+        connect(cache, adapter, client, host);
+    }
+    CHECK_EQ(4, cache.size());
+    CHECK_EQ(4, storage.stores);
+
+    // the most recently used ones
+    TlsSessionCache restored(adapter, &storage);
+    CHECK(!connect(restored, adapter, client, "https://a"));
+    CHECK(connect(restored, adapter, client, "https://b"));
+    CHECK(connect(restored, adapter, client, "https://c"));
+    CHECK(connect(restored, adapter, client, "https://d"));
+}
+
+TEST(handshake_stats)
+{
+    HandshakeStats stats;
+    CHECK_EQ(0, stats.fullLatency());
+    CHECK_EQ(0, stats.resumedLatency());
+
+    stats.record(false, 900);
+    stats.record(false, 1100);
+    stats.record(true, 150);
+    stats.reuse();
+    stats.reuse();
+    stats.reuse();
+
+    CHECK_EQ(2, stats.full());
+    CHECK_EQ(1, stats.resumed());
+    CHECK_EQ(3, stats.reused());
+    CHECK_EQ(1000, stats.fullLatency());
+    CHECK_EQ(150, stats.resumedLatency());
+
+    StringPrint out;
+    stats.dump(out, "  ");
+    CHECK(out.data() == "  Handshakes - full: 2 (avg 1000 ms), resumed: 1 (avg 150 ms), saved: 3\n");
+}
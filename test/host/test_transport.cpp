@@ -0,0 +1,171 @@
+/*******************************************************************************
+ * Copyright (c) 2020 Red Hat Inc
+ *
+ * See the NOTICE file(s) distributed with this work for additional
+ * information regarding copyright ownership.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License 2.0 which is available at
+ * http://www.eclipse.org/legal/epl-2.0
+ *
+ * SPDX-License-Identifier: EPL-2.0
+ *******************************************************************************/
+
+#include <HTTPClient.h>
+
+#include "check.h"
+
+/*
+ * The emulation of the HTTPClient, which the other tests rely on.
+ */
+
+TEST(keeps_connection_open)
+{
+    MockServer server("http://hawkbit:8080");
+    server.on("GET", "/", [](const MockRequest&) { return MockResponse(200, "hello"); });
+
+    WiFiClient client;
+    HTTPClient http;
+    http.setReuse(true);
+
+    for (int i = 0; i < 3; i++) {
+        http.begin(client, "http://hawkbit:8080/path");
+        CHECK_EQ(200, http.GET());
+        CHECK_EQ(5, http.getSize());
+        CHECK_STR("hello", http.getString());
+        http.end();
+    }
+
+    CHECK_EQ(1, server.connections());
+    CHECK_EQ(3, server.handled());
+}
+
+TEST(closes_connection_for_http10)
+{
+    MockServer server("http://hawkbit:8080");
+    server.on("GET", "/", [](const MockRequest&) { return MockResponse(200, "hello"); });
+
+    WiFiClient client;
+    HTTPClient http;
+    http.useHTTP10(true);
+
+    for (int i = 0; i < 2; i++) {
+        http.begin(client, "http://hawkbit:8080/");
+        CHECK_EQ(200, http.GET());
+        http.end();
+        CHECK(!client.connected());
+    }
+
+    CHECK_EQ(2, server.connections());
+}
+
+TEST(refused_connection)
+{
+    WiFiClient client;
+    HTTPClient http;
+    http.begin(client, "http://nowhere:8080/");
+    CHECK_EQ(HTTPC_ERROR_CONNECTION_REFUSED, http.GET());
+}
+
+TEST(dropped_connection)
+{
+    MockServer server("http://hawkbit:8080");
+    server.on("GET", "/", [](const MockRequest&) { return MockResponse(200, "hello"); });
+
+    WiFiClient client;
+    HTTPClient http;
+    http.begin(client, "http://hawkbit:8080/");
+    CHECK_EQ(200, http.GET());
+    http.end();
+
+    server.dropConnections();
+
+    http.begin(client, "http://hawkbit:8080/");
+    CHECK_EQ(HTTPC_ERROR_CONNECTION_LOST, http.GET());
+    http.end();
+}
+
+TEST(chunked_response)
+{
+    MockServer server("http://hawkbit:8080");
+    server.on("GET", "/", [](const MockRequest&) {
+        MockResponse response(200, std::string(2000, 'x'));
+        response.chunked = true;
+        return response;
+    });
+
+    WiFiClient client;
+    HTTPClient http;
+    http.begin(client, "http://hawkbit:8080/");
+    CHECK_EQ(200, http.GET());
+    CHECK_EQ(-1, http.getSize());
+    // the stream has the chunks (of 0x200 bytes), getString() decodes them
+    CHECK_EQ('2', http.getStream().peek());
+    CHECK_EQ(2000, http.getString().length());
+    http.end();
+}
+
+TEST(request_headers_and_body)
+{
+    MockServer server("http://hawkbit:8080");
+    server.record(true);
+    server.on("PUT", "/", [](const MockRequest&) { return MockResponse(204); });
+
+    static const char* headers[] = { "ETag" };
+    WiFiClient client;
+    HTTPClient http;
+    http.collectHeaders(headers, 1);
+    http.begin(client, "http://hawkbit:8080/a?b=c");
+    http.addHeader("Authorization", "TargetToken x");
+    CHECK_EQ(204, http.sendRequest("PUT", String("{}")));
+    http.end();
+
+    std::vector<MockRequest> requests = server.requests();
+    CHECK_EQ(1, requests.size());
+    CHECK_STR("/a?b=c", requests[0].path);
+    CHECK_STR("hawkbit:8080", requests[0].header("Host"));
+    CHECK_STR("TargetToken x", requests[0].header("Authorization"));
+    CHECK_STR("2", requests[0].header("Content-Length"));
+    CHECK(requests[0].body == "{}");
+}
+
+TEST(collects_response_headers)
+{
+    MockServer server("http://hawkbit:8080");
+    server.on("GET", "/", [](const MockRequest&) { return MockResponse(200).header("etag", "\"1\""); });
+
+    static const char* headers[] = { "ETag", "Last-Modified" };
+    WiFiClient client;
+    HTTPClient http;
+    http.collectHeaders(headers, 2);
+    http.begin(client, "http://hawkbit:8080/");
+    CHECK_EQ(200, http.GET());
+    CHECK_STR("\"1\"", http.header("ETag"));
+    CHECK_STR("", http.header("Last-Modified"));
+    http.end();
+}
+
+TEST(broken_and_slow_body)
+{
+    MockServer server("http://hawkbit:8080");
+    server.on("GET", "/", [](const MockRequest&) {
+        MockResponse response(200, std::string(1000, 'x'));
+        response.breakAfter = 600;
+        response.trickle = 200;
+        response.interval = 5;
+        return response;
+    });
+
+    WiFiClient client;
+    HTTPClient http;
+    http.begin(client, "http://hawkbit:8080/");
+    CHECK_EQ(200, http.GET());
+    CHECK_EQ(1000, http.getSize());
+
+    unsigned long start = millis();
+    char buffer[1000];
+    CHECK_EQ(600, client.readBytes(buffer, sizeof(buffer)));
+    CHECK(millis() - start >= 10);
+    CHECK(!client.connected());
+    http.end();
+}
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+# *******************************************************************************
+#  Copyright (c) 2020 Red Hat Inc
+#
+#  See the NOTICE file(s) distributed with this work for additional
+#  information regarding copyright ownership.
+#
+#  This program and the accompanying materials are made available under the
+#  terms of the Eclipse Public License 2.0 which is available at
+#  http://www.eclipse.org/legal/epl-2.0
+#
+#  SPDX-License-Identifier: EPL-2.0
+# *******************************************************************************
+
+"""
+Create and apply delta artifacts in the "HBD2" format, as applied by DeltaPatcher (hawkbit_delta.h).
+
+Create a delta from the firmware running on the devices to a new one, and upload it to hawkBit with
+a file name ending in ".delta":
+
+    hawkbit_delta.py diff firmware-1.0.bin firmware-1.1.bin firmware-1.0-1.1.delta
+
+Check a delta, by applying it on the host:
+
+    hawkbit_delta.py apply firmware-1.0.bin firmware-1.0-1.1.delta firmware-1.1.bin
+
+The source is the complete partition on the device, so the delta must be created from exactly the
+image which was flashed. The delta holds the hash of the source image, which the device checks
+before using the source, so a delta for another image fails right away.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"HBD2"
+
+END = 0x00
+COPY = 0x01
+INSERT = 0x02
+
+# the length of the blocks the source gets indexed by, and the minimum length of a copy
+BLOCK = 32
+# the distance of the indexed blocks in the source
+STEP = 16
+# the maximum length of a single record
+MAX_RECORD = 0xFFFFFFFF
+
+
+def index(source):
+    blocks = {}
+    for offset in range(0, len(source) - BLOCK + 1, STEP):
+        blocks.setdefault(source[offset:offset + BLOCK], offset)
+    return blocks
+
+
+def match(source, target, source_offset, target_offset):
+    length = 0
+    limit = min(len(source) - source_offset, len(target) - target_offset)
+    while length < limit and source[source_offset + length] == target[target_offset + length]:
+        length += 1
+    return length
+
+
+def diff(source, target):
+    """
+    Create the records, turning the source into the target: a list of (COPY, offset, length) and
+    (INSERT, data) tuples.
+    """
+    blocks = index(source)
+    records = []
+    literal = bytearray()
+    position = 0
+
+    while position < len(target):
+        offset = blocks.get(target[position:position + BLOCK])
+        if offset is None:
+            literal.append(target[position])
+            position += 1
+            continue
+
+        length = match(source, target, offset, position)
+
+        # extend the copy backwards, into the literal data before it
+        while literal and offset > 0 and source[offset - 1] == literal[-1]:
+            literal.pop()
+            offset -= 1
+            position -= 1
+            length += 1
+
+        if literal:
+            records.append((INSERT, bytes(literal)))
+            literal = bytearray()
+        records.append((COPY, offset, length))
+        position += length
+
+    if literal:
+        records.append((INSERT, bytes(literal)))
+
+    return records
+
+
+def encode(source, target, records):
+    out = bytearray()
+    out += MAGIC
+    out += struct.pack("<II", len(source), len(target))
+    out += hashlib.sha256(source).digest()
+    out += hashlib.sha256(target).digest()
+    for record in records:
+        if record[0] == COPY:
+            _, offset, length = record
+            while length > 0:
+                n = min(length, MAX_RECORD)
+                out += struct.pack("<BII", COPY, offset, n)
+                offset += n
+                length -= n
+        else:
+            data = record[1]
+            for start in range(0, len(data), MAX_RECORD):
+                chunk = data[start:start + MAX_RECORD]
+                out += struct.pack("<BI", INSERT, len(chunk))
+                out += chunk
+    out += struct.pack("<B", END)
+    return bytes(out)
+
+
+def apply(source, patch):
+    if patch[0:4] != MAGIC:
+        raise ValueError("Invalid delta header")
+    source_size, target_size = struct.unpack_from("<II", patch, 4)
+    source_hash = patch[12:44]
+    expected = patch[44:76]
+    if source_size > len(source):
+        raise ValueError("Delta requires a source of %d bytes, only %d are available" % (source_size, len(source)))
+
+    target = bytearray()
+    position = 76
+    source_verified = False
+    while True:
+        op = patch[position]
+        position += 1
+        if op == END:
+            break
+        if op == COPY:
+            offset, length = struct.unpack_from("<II", patch, position)
+            position += 8
+            if offset + length > source_size:
+                raise ValueError("Delta copies outside of source: %d+%d" % (offset, length))
+            # like the device, before the first copy
+            if not source_verified:
+                if hashlib.sha256(source[:source_size]).digest() != source_hash:
+                    raise ValueError("Delta was created for another source image")
+                source_verified = True
+            target += source[offset:offset + length]
+        elif op == INSERT:
+            (length,) = struct.unpack_from("<I", patch, position)
+            position += 4
+            target += patch[position:position + length]
+            position += length
+        else:
+            raise ValueError("Invalid delta operation: %d" % op)
+        if len(target) > target_size:
+            raise ValueError("Delta exceeds target size")
+
+    if len(target) != target_size:
+        raise ValueError("Delta produced %d bytes, expected %d" % (len(target), target_size))
+    if hashlib.sha256(target).digest() != expected:
+        raise ValueError("Hash mismatch")
+    return bytes(target)
+
+
+def read(filename):
+    with open(filename, "rb") as f:
+        return f.read()
+
+
+def write(filename, data):
+    with open(filename, "wb") as f:
+        f.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Create and apply hawkBit delta artifacts")
+    commands = parser.add_subparsers(dest="command")
+    commands.required = True
+
+    create = commands.add_parser("diff", help="create a delta from the source to the target image")
+    create.add_argument("source")
+    create.add_argument("target")
+    create.add_argument("delta")
+
+    check = commands.add_parser("apply", help="apply a delta to the source image")
+    check.add_argument("source")
+    check.add_argument("delta")
+    check.add_argument("target")
+
+    args = parser.parse_args()
+
+    if args.command == "diff":
+        source = read(args.source)
+        target = read(args.target)
+        records = diff(source, target)
+        patch = encode(source, target, records)
+        # make sure the patch reproduces the target
+        apply(source, patch)
+        write(args.delta, patch)
+        copied = sum(r[2] for r in records if r[0] == COPY)
+        print("Delta: %d bytes, target: %d bytes (copied: %d, inserted: %d)"
+              % (len(patch), len(target), copied, len(target) - copied))
+    else:
+        try:
+            write(args.target, apply(read(args.source), read(args.delta)))
+        except ValueError as e:
+            print(e, file=sys.stderr)
+            return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())